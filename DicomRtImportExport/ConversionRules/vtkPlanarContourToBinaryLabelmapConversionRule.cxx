@@ -0,0 +1,583 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include <vtkSMPTools.h>
+#include <vtkVariant.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Contours closer than this along the contour normal are considered to be on the same plane (mm)
+  const double PLANE_POSITION_TOLERANCE = 0.01;
+  /// Maximum cosine of the angle between the contour normal and the in-plane axes of the labelmap
+  const double PARALLEL_PLANE_TOLERANCE = 0.001;
+
+  /// Contour edge crossing a range of labelmap rows
+  struct ScanlineEdge
+  {
+    double StartX;
+    double StartY;
+    /// Change of X per row
+    double Slope;
+    /// Last row the edge crosses
+    int LastRow;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Get the typical distance between adjacent contour planes, computed the same way as the spacing of the contours
+  /// in the closed surface conversion: the mean distance, without the distances differing from it by 10% or more.
+  /// If all distances differ that much from the mean, then the mean is returned
+  double GetTypicalPlaneSpacing(const std::vector<vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane>& planes)
+  {
+    if (planes.size() < 2)
+    {
+      return 0.0;
+    }
+    double distanceMean = (planes.back().Position - planes.front().Position) / (planes.size() - 1);
+
+    double distanceSum = 0.0;
+    int numberOfDistances = 0;
+    for (size_t planeIndex = 1; planeIndex < planes.size(); ++planeIndex)
+    {
+      double distance = planes[planeIndex].Position - planes[planeIndex-1].Position;
+      if (fabs(distance - distanceMean) >= distanceMean / 10.0)
+      {
+        continue;
+      }
+      distanceSum += distance;
+      ++numberOfDistances;
+    }
+    return (numberOfDistances > 0 ? distanceSum / numberOfDistances : distanceMean);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToBinaryLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+/// Rasterize the contour planes in parallel.
+/// Each plane fills the first labelmap slice assigned to it using a scanline fill with the even-odd rule, then
+/// copies it to the other slices assigned to it. The slices of different planes do not overlap, so the voxels
+/// are never written concurrently.
+class vtkPlanarContourToBinaryLabelmapConversionRule::PlaneRasterizationFunctor
+{
+public:
+  PlaneRasterizationFunctor(const std::vector<ContourPlane>& planes, const std::vector<int>& firstSlices,
+    const std::vector<int>& lastSlices, vtkMatrix4x4* worldToImageMatrix, unsigned char* voxels, int extent[6])
+    : Planes(planes)
+    , FirstSlices(firstSlices)
+    , LastSlices(lastSlices)
+    , Voxels(voxels)
+  {
+    vtkMatrix4x4::DeepCopy(this->WorldToImage, worldToImageMatrix);
+    for (int i=0; i<6; ++i)
+    {
+      this->Extent[i] = extent[i];
+    }
+  }
+
+  void operator()(vtkIdType beginPlane, vtkIdType endPlane)
+  {
+    for (vtkIdType planeIndex = beginPlane; planeIndex < endPlane; ++planeIndex)
+    {
+      this->RasterizePlane(planeIndex);
+    }
+  }
+
+  /// Fill the slices assigned to a plane
+  void RasterizePlane(vtkIdType planeIndex)
+  {
+    int firstSlice = this->FirstSlices[planeIndex];
+    int lastSlice = this->LastSlices[planeIndex];
+    if (firstSlice > lastSlice)
+    {
+      // No slice is nearest to this plane
+      return;
+    }
+
+    const ContourPlane& plane = this->Planes[planeIndex];
+    int numberOfColumns = this->Extent[1] - this->Extent[0] + 1;
+    int numberOfRows = this->Extent[3] - this->Extent[2] + 1;
+    vtkIdType sliceSize = (vtkIdType)numberOfColumns * numberOfRows;
+    unsigned char* firstSliceVoxels = this->Voxels + (firstSlice - this->Extent[4]) * sliceSize;
+
+    // Collect the edges of all contours, by the first row they cross
+    std::vector< std::vector<ScanlineEdge> > edgesStartingAtRow(numberOfRows);
+    int numberOfContours = (int)plane.Offsets.size() - 1;
+    std::vector<double> contourImageCoordinates;
+    for (int contourIndex = 0; contourIndex < numberOfContours; ++contourIndex)
+    {
+      vtkIdType firstPointIndex = plane.Offsets[contourIndex];
+      int numberOfPoints = (int)(plane.Offsets[contourIndex+1] - firstPointIndex);
+      if (numberOfPoints < 3)
+      {
+        continue;
+      }
+
+      // Column and row coordinates of the points. The slice coordinate is not needed as the plane is parallel with the slices
+      contourImageCoordinates.resize(2*numberOfPoints);
+      for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+      {
+        const double* point = &plane.Coordinates[3*(firstPointIndex+pointIndex)];
+        for (int axis=0; axis<2; ++axis)
+        {
+          const double* matrixRow = this->WorldToImage + 4*axis;
+          contourImageCoordinates[2*pointIndex+axis] = matrixRow[0]*point[0] + matrixRow[1]*point[1] + matrixRow[2]*point[2] + matrixRow[3];
+        }
+      }
+
+      // The contour is closed by the edge between the last and the first point
+      for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+      {
+        const double* startPoint = &contourImageCoordinates[2*pointIndex];
+        const double* endPoint = &contourImageCoordinates[2*((pointIndex+1) % numberOfPoints)];
+        if (startPoint[1] == endPoint[1])
+        {
+          // Horizontal edges do not cross any rows
+          continue;
+        }
+        if (startPoint[1] > endPoint[1])
+        {
+          std::swap(startPoint, endPoint);
+        }
+        // The edge crosses the rows in the half-open range [startY, endY), so that a vertex shared by two edges is
+        // only counted once, unless it is a local extremum
+        int firstRow = std::max((int)std::ceil(startPoint[1]), this->Extent[2]);
+        int lastRow = std::min((int)std::ceil(endPoint[1]) - 1, this->Extent[3]);
+        if (firstRow > lastRow)
+        {
+          continue;
+        }
+        ScanlineEdge edge;
+        edge.StartX = startPoint[0];
+        edge.StartY = startPoint[1];
+        edge.Slope = (endPoint[0] - startPoint[0]) / (endPoint[1] - startPoint[1]);
+        edge.LastRow = lastRow;
+        edgesStartingAtRow[firstRow - this->Extent[2]].push_back(edge);
+      }
+    }
+
+    // Fill the voxels between pairs of crossings in each row (even-odd rule)
+    std::vector<ScanlineEdge> activeEdges;
+    std::vector<double> crossings;
+    for (int row = this->Extent[2]; row <= this->Extent[3]; ++row)
+    {
+      // Remove edges that ended in the previous row, and add the edges starting in this row
+      size_t numberOfActiveEdges = 0;
+      for (size_t edgeIndex = 0; edgeIndex < activeEdges.size(); ++edgeIndex)
+      {
+        if (activeEdges[edgeIndex].LastRow >= row)
+        {
+          activeEdges[numberOfActiveEdges++] = activeEdges[edgeIndex];
+        }
+      }
+      activeEdges.resize(numberOfActiveEdges);
+      const std::vector<ScanlineEdge>& startingEdges = edgesStartingAtRow[row - this->Extent[2]];
+      activeEdges.insert(activeEdges.end(), startingEdges.begin(), startingEdges.end());
+      if (activeEdges.empty())
+      {
+        continue;
+      }
+
+      crossings.resize(activeEdges.size());
+      for (size_t edgeIndex = 0; edgeIndex < activeEdges.size(); ++edgeIndex)
+      {
+        const ScanlineEdge& edge = activeEdges[edgeIndex];
+        crossings[edgeIndex] = edge.StartX + (row - edge.StartY) * edge.Slope;
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      unsigned char* rowVoxels = firstSliceVoxels + (vtkIdType)(row - this->Extent[2]) * numberOfColumns;
+      for (size_t crossingIndex = 0; crossingIndex + 1 < crossings.size(); crossingIndex += 2)
+      {
+        // Voxel centers in the half-open range [enter, exit) are inside
+        int firstColumn = std::max((int)std::ceil(crossings[crossingIndex]), this->Extent[0]);
+        int lastColumn = std::min((int)std::ceil(crossings[crossingIndex+1]) - 1, this->Extent[1]);
+        if (firstColumn <= lastColumn)
+        {
+          memset(rowVoxels + (firstColumn - this->Extent[0]), 1, lastColumn - firstColumn + 1);
+        }
+      }
+    }
+
+    // Nearest-plane interpolation: the other slices of the slab are the same as the first one
+    for (int slice = firstSlice + 1; slice <= lastSlice; ++slice)
+    {
+      memcpy(this->Voxels + (slice - this->Extent[4]) * sliceSize, firstSliceVoxels, sliceSize);
+    }
+  }
+
+private:
+  const std::vector<ContourPlane>& Planes;
+  const std::vector<int>& FirstSlices;
+  const std::vector<int>& LastSlices;
+  double WorldToImage[16];
+  unsigned char* Voxels;
+  int Extent[6];
+};
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+  this->ConversionParameters[vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()] = std::make_pair("0.0",
+    "Default thickness for contours if slice spacing cannot be calculated. If zero, then a single contour plane fills one labelmap slice.");
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::~vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlanarContourToBinaryLabelmapConversionRule::GetConversionCost(vtkDataObject* vtkNotUsed(sourceRepresentation)/*=NULL*/, vtkDataObject* vtkNotUsed(targetRepresentation)/*=NULL*/)
+{
+  // Rough input-independent guess (ms)
+  // Lower than the path through closed surface, so that this rule is chosen if only the labelmap is needed
+  return 300;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!binaryLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+  if (planarContourPolyData->GetNumberOfPoints() < 3 || planarContourPolyData->GetNumberOfLines() < 1)
+  {
+    vtkErrorMacro("Convert: Cannot create binary labelmap from planar contour with number of points: " << planarContourPolyData->GetNumberOfPoints() << " and number of lines: " << planarContourPolyData->GetNumberOfLines());
+    return false;
+  }
+
+  // Collect the contours into planes
+  double defaultSliceThickness = vtkVariant(this->ConversionParameters[
+    vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()].first).ToDouble();
+  double contourNormal[3] = {0.0, 0.0, 1.0};
+  std::vector<ContourPlane> planes;
+  if (!vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes(planarContourPolyData, contourNormal, planes, defaultSliceThickness))
+  {
+    vtkErrorMacro("Convert: Failed to determine contour planes!");
+    return false;
+  }
+
+  // Calculate output geometry so that the slices filled from the first and last planes are included
+  vtkSmartPointer<vtkPolyData> slabPolyData = vtkSmartPointer<vtkPolyData>::New();
+  vtkPlanarContourToBinaryLabelmapConversionRule::CreateSlabBoundaryPolyData(planarContourPolyData, contourNormal, planes, slabPolyData);
+  if (!this->CalculateOutputGeometry(slabPolyData, binaryLabelmap))
+  {
+    vtkErrorMacro("Convert: Failed to calculate output image geometry!");
+    return false;
+  }
+
+  // The contours can only be rasterized into the slices if they are parallel
+  double originPosition = 0.0;
+  double sliceStep = 0.0;
+  if (!vtkPlanarContourToBinaryLabelmapConversionRule::GetSlicePositionsAlongNormal(binaryLabelmap, contourNormal, originPosition, sliceStep))
+  {
+    vtkDebugMacro("Convert: Contour planes are not parallel with the labelmap slices, converting through closed surface");
+    return this->ConvertThroughClosedSurface(planarContourPolyData, targetRepresentation);
+  }
+
+  // A single plane without default slice thickness fills the slice it is in
+  if (planes.size() == 1 && planes[0].SlabMinimum == planes[0].SlabMaximum)
+  {
+    planes[0].SlabMinimum = planes[0].Position - fabs(sliceStep) / 2.0;
+    planes[0].SlabMaximum = planes[0].Position + fabs(sliceStep) / 2.0;
+  }
+
+  return vtkPlanarContourToBinaryLabelmapConversionRule::RasterizeContourPlanes(planes, originPosition, sliceStep, binaryLabelmap);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes(vtkPolyData* planarContourPolyData, double contourNormal[3],
+  std::vector<ContourPlane>& planes, double defaultSliceThickness/*=0.0*/)
+{
+  planes.clear();
+  vtkPoints* points = planarContourPolyData->GetPoints();
+  vtkCellArray* lines = planarContourPolyData->GetLines();
+  if (!points || !lines)
+  {
+    return false;
+  }
+
+  // Collect the contours, and use the normal of the contour with the largest area (most accurate)
+  std::vector<vtkIdType> contourPointIds;
+  std::vector<vtkIdType> contourOffsets(1, 0);
+  double largestNormalLength = 0.0;
+  vtkIdType numberOfLinePoints = 0;
+  vtkIdType* linePointIds = NULL;
+  for (lines->InitTraversal(); lines->GetNextCell(numberOfLinePoints, linePointIds); )
+  {
+    if (numberOfLinePoints < 3)
+    {
+      continue;
+    }
+    contourPointIds.insert(contourPointIds.end(), linePointIds, linePointIds + numberOfLinePoints);
+    contourOffsets.push_back((vtkIdType)contourPointIds.size());
+
+    // Newell's method, the length of the normal is twice the area of the contour
+    double normal[3] = {0.0, 0.0, 0.0};
+    double currentPoint[3] = {0.0, 0.0, 0.0};
+    double nextPoint[3] = {0.0, 0.0, 0.0};
+    points->GetPoint(linePointIds[numberOfLinePoints-1], currentPoint);
+    for (vtkIdType pointIndex = 0; pointIndex < numberOfLinePoints; ++pointIndex)
+    {
+      points->GetPoint(linePointIds[pointIndex], nextPoint);
+      normal[0] += (currentPoint[1] - nextPoint[1]) * (currentPoint[2] + nextPoint[2]);
+      normal[1] += (currentPoint[2] - nextPoint[2]) * (currentPoint[0] + nextPoint[0]);
+      normal[2] += (currentPoint[0] - nextPoint[0]) * (currentPoint[1] + nextPoint[1]);
+      currentPoint[0] = nextPoint[0];
+      currentPoint[1] = nextPoint[1];
+      currentPoint[2] = nextPoint[2];
+    }
+    double normalLength = vtkMath::Norm(normal);
+    if (normalLength > largestNormalLength)
+    {
+      largestNormalLength = normalLength;
+      contourNormal[0] = normal[0] / normalLength;
+      contourNormal[1] = normal[1] / normalLength;
+      contourNormal[2] = normal[2] / normalLength;
+    }
+  }
+  if (largestNormalLength == 0.0)
+  {
+    vtkGenericWarningMacro("vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes: None of the contours has a valid plane");
+    return false;
+  }
+
+  // Sort the contours by their position along the normal
+  int numberOfContours = (int)contourOffsets.size() - 1;
+  std::vector< std::pair<double, int> > contourPositions(numberOfContours);
+  for (int contourIndex = 0; contourIndex < numberOfContours; ++contourIndex)
+  {
+    double positionSum = 0.0;
+    for (vtkIdType index = contourOffsets[contourIndex]; index < contourOffsets[contourIndex+1]; ++index)
+    {
+      double point[3] = {0.0, 0.0, 0.0};
+      points->GetPoint(contourPointIds[index], point);
+      positionSum += vtkMath::Dot(point, contourNormal);
+    }
+    contourPositions[contourIndex] = std::make_pair(positionSum / (contourOffsets[contourIndex+1] - contourOffsets[contourIndex]), contourIndex);
+  }
+  std::sort(contourPositions.begin(), contourPositions.end());
+
+  // Group contours on the same plane
+  for (int sortedIndex = 0; sortedIndex < numberOfContours; ++sortedIndex)
+  {
+    double position = contourPositions[sortedIndex].first;
+    int contourIndex = contourPositions[sortedIndex].second;
+    if (planes.empty() || position - planes.back().Position > PLANE_POSITION_TOLERANCE)
+    {
+      planes.push_back(ContourPlane());
+      planes.back().Position = position;
+    }
+    ContourPlane& plane = planes.back();
+    for (vtkIdType index = contourOffsets[contourIndex]; index < contourOffsets[contourIndex+1]; ++index)
+    {
+      double point[3] = {0.0, 0.0, 0.0};
+      points->GetPoint(contourPointIds[index], point);
+      plane.Coordinates.insert(plane.Coordinates.end(), point, point+3);
+    }
+    plane.Offsets.push_back((vtkIdType)plane.Coordinates.size() / 3);
+  }
+
+  // A single plane extends by half of the default slice thickness on both sides
+  int numberOfPlanes = (int)planes.size();
+  if (numberOfPlanes == 1)
+  {
+    double halfThickness = std::max(defaultSliceThickness, 0.0) / 2.0;
+    planes[0].SlabMinimum = planes[0].Position - halfThickness;
+    planes[0].SlabMaximum = planes[0].Position + halfThickness;
+    return true;
+  }
+
+  // Each plane fills the positions closer to it than to its neighbors, so gaps between planes (for example missing
+  // contours) are filled from the nearest plane instead of losing volume compared to the closed surface. The first
+  // and last planes extend outwards by half of the typical plane spacing
+  double outerHalfDistance = GetTypicalPlaneSpacing(planes) / 2.0;
+  for (int planeIndex = 0; planeIndex < numberOfPlanes; ++planeIndex)
+  {
+    ContourPlane& plane = planes[planeIndex];
+    // Adjacent slabs share their boundary, so that no position is filled from two planes
+    plane.SlabMinimum = (planeIndex > 0 ? planes[planeIndex-1].SlabMaximum : plane.Position - outerHalfDistance);
+    plane.SlabMaximum = (planeIndex < numberOfPlanes-1 ? (plane.Position + planes[planeIndex+1].Position) / 2.0
+      : plane.Position + outerHalfDistance);
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToBinaryLabelmapConversionRule::CreateSlabBoundaryPolyData(vtkPolyData* planarContourPolyData,
+  const double contourNormal[3], const std::vector<ContourPlane>& planes, vtkPolyData* slabPolyData)
+{
+  if (!planarContourPolyData || !slabPolyData || planes.empty())
+  {
+    vtkGenericWarningMacro("vtkPlanarContourToBinaryLabelmapConversionRule::CreateSlabBoundaryPolyData: Invalid arguments!");
+    return;
+  }
+
+  vtkSmartPointer<vtkPoints> slabPoints = vtkSmartPointer<vtkPoints>::New();
+  slabPoints->DeepCopy(planarContourPolyData->GetPoints());
+
+  // Points of the first plane moved to the lower boundary of its slab, and points of the last plane moved to the upper one
+  const ContourPlane* boundaryPlanes[2] = { &planes.front(), &planes.back() };
+  for (int boundaryIndex = 0; boundaryIndex < 2; ++boundaryIndex)
+  {
+    const ContourPlane* plane = boundaryPlanes[boundaryIndex];
+    double shift = (boundaryIndex == 0 ? plane->SlabMinimum : plane->SlabMaximum) - plane->Position;
+    for (size_t coordinateIndex = 0; coordinateIndex < plane->Coordinates.size(); coordinateIndex += 3)
+    {
+      const double* point = &plane->Coordinates[coordinateIndex];
+      slabPoints->InsertNextPoint(point[0] + shift*contourNormal[0], point[1] + shift*contourNormal[1], point[2] + shift*contourNormal[2]);
+    }
+  }
+
+  slabPolyData->Initialize();
+  slabPolyData->SetPoints(slabPoints);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::GetSlicePositionsAlongNormal(vtkOrientedImageData* image,
+  const double contourNormal[3], double& originPosition, double& sliceStep)
+{
+  if (!image)
+  {
+    vtkGenericWarningMacro("vtkPlanarContourToBinaryLabelmapConversionRule::GetSlicePositionsAlongNormal: Invalid image!");
+    return false;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  image->GetImageToWorldMatrix(imageToWorldMatrix);
+  double axisDirections[3][3] = {{0.0,0.0,0.0}, {0.0,0.0,0.0}, {0.0,0.0,0.0}};
+  double origin[3] = {0.0, 0.0, 0.0};
+  for (int row=0; row<3; ++row)
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      axisDirections[axis][row] = imageToWorldMatrix->GetElement(row, axis);
+    }
+    origin[row] = imageToWorldMatrix->GetElement(row, 3);
+  }
+  originPosition = vtkMath::Dot(origin, contourNormal);
+  sliceStep = vtkMath::Dot(axisDirections[2], contourNormal);
+
+  vtkMath::Normalize(axisDirections[0]);
+  vtkMath::Normalize(axisDirections[1]);
+  return ( fabs(vtkMath::Dot(axisDirections[0], contourNormal)) <= PARALLEL_PLANE_TOLERANCE
+    && fabs(vtkMath::Dot(axisDirections[1], contourNormal)) <= PARALLEL_PLANE_TOLERANCE
+    && sliceStep != 0.0 );
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::RasterizeContourPlanes(const std::vector<ContourPlane>& planes,
+  double originPosition, double sliceStep, vtkOrientedImageData* binaryLabelmap)
+{
+  if (!binaryLabelmap)
+  {
+    vtkGenericWarningMacro("vtkPlanarContourToBinaryLabelmapConversionRule::RasterizeContourPlanes: Invalid labelmap!");
+    return false;
+  }
+  int numberOfPlanes = (int)planes.size();
+
+  // Allocate output image data
+  binaryLabelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  int extent[6] = {0,-1,0,-1,0,-1};
+  binaryLabelmap->GetExtent(extent);
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    // Empty output
+    return true;
+  }
+  unsigned char* voxels = static_cast<unsigned char*>(binaryLabelmap->GetScalarPointerForExtent(extent));
+  memset(voxels, 0, (size_t)(extent[1]-extent[0]+1) * (extent[3]-extent[2]+1) * (extent[5]-extent[4]+1));
+
+  // Assign each slice to the plane whose slab contains the slice position
+  std::vector<double> slabMaximums(numberOfPlanes, 0.0);
+  for (int planeIndex = 0; planeIndex < numberOfPlanes; ++planeIndex)
+  {
+    slabMaximums[planeIndex] = planes[planeIndex].SlabMaximum;
+  }
+  std::vector<int> firstSlices(numberOfPlanes, extent[5]+1);
+  std::vector<int> lastSlices(numberOfPlanes, extent[4]-1);
+  for (int slice = extent[4]; slice <= extent[5]; ++slice)
+  {
+    double slicePosition = originPosition + slice * sliceStep;
+    int planeIndex = (int)(std::upper_bound(slabMaximums.begin(), slabMaximums.end(), slicePosition) - slabMaximums.begin());
+    if (planeIndex >= numberOfPlanes || slicePosition < planes[planeIndex].SlabMinimum)
+    {
+      continue;
+    }
+    firstSlices[planeIndex] = std::min(firstSlices[planeIndex], slice);
+    lastSlices[planeIndex] = std::max(lastSlices[planeIndex], slice);
+  }
+
+  // Rasterize the planes
+  vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  binaryLabelmap->GetWorldToImageMatrix(worldToImageMatrix);
+  PlaneRasterizationFunctor functor(planes, firstSlices, lastSlices, worldToImageMatrix, voxels, extent);
+  vtkSMPTools::For(0, numberOfPlanes, 1, functor);
+
+  binaryLabelmap->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::ConvertThroughClosedSurface(vtkPolyData* planarContourPolyData, vtkDataObject* targetRepresentation)
+{
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  vtkSmartPointer<vtkPolyData> closedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+  if (!closedSurfaceRule->Convert(planarContourPolyData, closedSurfacePolyData))
+  {
+    vtkErrorMacro("ConvertThroughClosedSurface: Failed to convert planar contour to closed surface!");
+    return false;
+  }
+  return this->Superclass::Convert(closedSurfacePolyData, targetRepresentation);
+}
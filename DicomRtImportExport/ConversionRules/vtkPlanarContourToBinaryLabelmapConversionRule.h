@@ -0,0 +1,135 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToBinaryLabelmapConversionRule_h
+#define __vtkPlanarContourToBinaryLabelmapConversionRule_h
+
+// SegmentationCore includes
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+#include "vtkSegmentationConverter.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+// STD includes
+#include <vector>
+
+class vtkPolyData;
+class vtkOrientedImageData;
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) directly to
+///   binary labelmap representation (vtkOrientedImageData type), without creating
+///   a closed surface first.
+///
+/// The contours of each plane are rasterized into the labelmap slice with a scanline polygon fill.
+/// The even-odd rule is used, so contours inside other contours of the same plane are holes.
+/// Each labelmap slice is filled from the nearest contour plane (nearest-plane interpolation), so slices in gaps between
+/// planes (for example missing contours) are filled as well, like in the closed surface. The first and last planes
+/// extend by half of the typical plane spacing, like the end caps of the closed surface. A single plane extends by half
+/// of the "Default slice thickness" conversion parameter, or fills only the slice it is in if that is not set.
+/// Planes are rasterized in parallel. The output geometry is determined the same way as in the base class
+/// \sa vtkClosedSurfaceToBinaryLabelmapConversionRule, so the oversampling and reference geometry parameters apply.
+/// If the contour planes are not parallel with the slices of the output geometry, then the contours are converted
+/// through a closed surface instead.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToBinaryLabelmapConversionRule
+  : public vtkClosedSurfaceToBinaryLabelmapConversionRule
+{
+public:
+  static vtkPlanarContourToBinaryLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToBinaryLabelmapConversionRule, vtkClosedSurfaceToBinaryLabelmapConversionRule);
+  virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
+
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
+  /// Get the cost of the conversion.
+  virtual unsigned int GetConversionCost(vtkDataObject* sourceRepresentation=NULL, vtkDataObject* targetRepresentation=NULL) VTK_OVERRIDE;
+
+  /// Human-readable name of the converter rule
+  virtual const char* GetName() VTK_OVERRIDE { return "Planar contour to binary labelmap"; };
+
+  /// Human-readable name of the source representation
+  virtual const char* GetSourceRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(); };
+
+  /// Human-readable name of the target representation
+  virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(); };
+
+public:
+  /// Contours of one plane. The coordinates of the contour points are stored one after the other
+  struct ContourPlane
+  {
+    ContourPlane() : Position(0.0), SlabMinimum(0.0), SlabMaximum(0.0) { this->Offsets.push_back(0); };
+
+    /// Position of the plane along the contour normal
+    double Position;
+    /// Range of positions along the contour normal that are filled from this plane
+    double SlabMinimum;
+    double SlabMaximum;
+    /// World coordinates of the contour points (x,y,z triplets)
+    std::vector<double> Coordinates;
+    /// Index of the first point of each contour. Contains one more element than the number of contours
+    std::vector<vtkIdType> Offsets;
+  };
+
+  /// Collect the contours of the input into planes, sorted by their position along the contour normal.
+  /// The slab of each plane is the range of positions closer to it than to its neighbors. The first and last
+  /// planes extend outwards by half of the typical plane spacing.
+  /// \param planarContourPolyData Input planar contours
+  /// \param contourNormal Output normal of the contours
+  /// \param planes Output contour planes
+  /// \param defaultSliceThickness Thickness of the slab if there is only one plane. If zero, then the slab is empty
+  /// \return Success flag. Fails if there are no contours with a valid normal
+  static bool ComputeContourPlanes(vtkPolyData* planarContourPolyData, double contourNormal[3], std::vector<ContourPlane>& planes,
+    double defaultSliceThickness=0.0);
+
+  /// Create poly data from the contour points, and the points of the first and last planes moved to the outer
+  /// boundaries of their slabs. The output geometry calculated from it contains all slices filled from the planes
+  static void CreateSlabBoundaryPolyData(vtkPolyData* planarContourPolyData, const double contourNormal[3],
+    const std::vector<ContourPlane>& planes, vtkPolyData* slabPolyData);
+
+  /// Get the position of the slices of an image along the contour normal: slice k is at originPosition + k * sliceStep
+  /// \return False if the contour planes are not parallel with the image slices
+  static bool GetSlicePositionsAlongNormal(vtkOrientedImageData* image, const double contourNormal[3],
+    double& originPosition, double& sliceStep);
+
+  /// Allocate the labelmap and fill each slice from the plane whose slab contains the slice position.
+  /// The slabs need to be sorted and must not overlap, but there may be gaps between them.
+  /// \param originPosition Position of the slice at index 0 along the contour normal \sa GetSlicePositionsAlongNormal
+  /// \param sliceStep Signed distance between adjacent slices along the contour normal
+  /// \param binaryLabelmap Labelmap with its geometry already set
+  static bool RasterizeContourPlanes(const std::vector<ContourPlane>& planes, double originPosition, double sliceStep,
+    vtkOrientedImageData* binaryLabelmap);
+
+protected:
+  /// Convert through closed surface, used if the contours cannot be rasterized directly into the labelmap slices
+  bool ConvertThroughClosedSurface(vtkPolyData* planarContourPolyData, vtkDataObject* targetRepresentation);
+
+  class PlaneRasterizationFunctor;
+
+protected:
+  vtkPlanarContourToBinaryLabelmapConversionRule();
+  ~vtkPlanarContourToBinaryLabelmapConversionRule();
+
+private:
+  vtkPlanarContourToBinaryLabelmapConversionRule(const vtkPlanarContourToBinaryLabelmapConversionRule&); // Not implemented
+  void operator=(const vtkPlanarContourToBinaryLabelmapConversionRule&); // Not implemented
+};
+
+#endif // __vtkPlanarContourToBinaryLabelmapConversionRule_h
@@ -46,13 +46,280 @@
 #include <vtkTransform.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkSMPTools.h>
 
 // STD includes
 #include <algorithm>
+#include <map>
 
 //----------------------------------------------------------------------------
 vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToClosedSurfaceConversionRule);
 
+//----------------------------------------------------------------------------
+/// Triangulate consecutive pairs of contour planes in parallel.
+/// The contours, the lines and the input points are shared between the pairs. They are not modified, and the input
+/// points are only accessed using GetPoint(id, x), which does not use the internal buffer of the points.
+/// The point locators used for branching are not thread-safe (FindClosestPoint reads the points of the locator data set
+/// using the internal buffer), so each pair of planes builds its own locators, even though the lines of a plane are
+/// part of two pairs.
+/// Each pair of planes adds its triangles to its own cell array. A line is only flagged as triangulated to above by
+/// the pair where it is on the lower plane, and as triangulated to below by the pair where it is on the upper plane,
+/// so the flags are never written concurrently.
+/// Overlapping lines are found using a grid index over the lines of the upper plane, and no cells are allocated
+/// for each pair of lines. Point locators are only built for the lines that need branching.
+class vtkPlanarContourToClosedSurfaceConversionRule::PlanePairTriangulationFunctor
+{
+public:
+  PlanePairTriangulationFunctor(vtkPlanarContourToClosedSurfaceConversionRule* rule, vtkPolyData* inputROIPoints,
+    const ContourSet& contours, std::vector<vtkSmartPointer<vtkLine> >& lines,
+    std::vector<vtkIdType>& firstLineOnPlaneIndices, std::vector<int>& numberOfLinesOnPlanes,
+    std::vector<vtkSmartPointer<vtkCellArray> >& planePairPolygons,
+    std::vector<char>& lineTriangulatedToAbove, std::vector<char>& lineTriangulatedToBelow)
+    : Rule(rule)
+    , InputROIPoints(inputROIPoints)
+    , Contours(contours)
+    , Lines(lines)
+    , FirstLineOnPlaneIndices(firstLineOnPlaneIndices)
+    , NumberOfLinesOnPlanes(numberOfLinesOnPlanes)
+    , PlanePairPolygons(planePairPolygons)
+    , LineTriangulatedToAbove(lineTriangulatedToAbove)
+    , LineTriangulatedToBelow(lineTriangulatedToBelow)
+  {
+  }
+
+  void operator()(vtkIdType beginPlanePair, vtkIdType endPlanePair)
+  {
+    for (vtkIdType planePairIndex = beginPlanePair; planePairIndex < endPlanePair; ++planePairIndex)
+      {
+      this->TriangulatePlanePair(planePairIndex);
+      }
+  }
+
+  /// Triangulate the overlapping lines of a plane and the plane above it
+  void TriangulatePlanePair(vtkIdType plane1Index)
+  {
+    vtkIdType firstLineOnPlane1Index = this->FirstLineOnPlaneIndices[plane1Index]; // pointer to first line on plane 1
+    int numberOfLinesInPlane1 = this->NumberOfLinesOnPlanes[plane1Index];
+    vtkIdType firstLineOnPlane2Index = this->FirstLineOnPlaneIndices[plane1Index+1]; // pointer to first line on plane 2
+    int numberOfLinesInPlane2 = this->NumberOfLinesOnPlanes[plane1Index+1];
+
+    vtkCellArray* outputPolygons = this->PlanePairPolygons[plane1Index];
+    // initialize overlaps lists. - list of list
+    // Each internal list represents a line from the plane and will store the pointers to the overlap lines
+    std::vector< std::vector< vtkIdType > > plane1Overlaps(numberOfLinesInPlane1);
+    std::vector< std::vector< vtkIdType > > plane2Overlaps(numberOfLinesInPlane2);
+    this->FindOverlappingLines(firstLineOnPlane1Index, numberOfLinesInPlane1, firstLineOnPlane2Index, numberOfLinesInPlane2,
+      plane1Overlaps, plane2Overlaps);
+
+    // Collect the point locators and point ids of the overlapping lines once for each line.
+    // The locators are only needed for branching, and are built once for each line in this pair of planes.
+    // They must not be shared with the other pairs, as locator queries are not thread-safe.
+    std::map<vtkIdType, vtkSmartPointer<vtkPointLocator> > pointLocators;
+    std::vector< std::vector<vtkSmartPointer<vtkPointLocator> > > plane1OverlapPointLocators(numberOfLinesInPlane1);
+    std::vector< std::vector<vtkSmartPointer<vtkIdList> > > plane1OverlapPointIds(numberOfLinesInPlane1);
+    for (int line1Index = 0; line1Index < numberOfLinesInPlane1; ++line1Index)
+      {
+      this->GetOverlappingLineLocators(plane1Overlaps[line1Index], pointLocators, plane1OverlapPointLocators[line1Index], plane1OverlapPointIds[line1Index]);
+      }
+    std::vector< std::vector<vtkSmartPointer<vtkPointLocator> > > plane2OverlapPointLocators(numberOfLinesInPlane2);
+    std::vector< std::vector<vtkSmartPointer<vtkIdList> > > plane2OverlapPointIds(numberOfLinesInPlane2);
+    for (int line2Index = 0; line2Index < numberOfLinesInPlane2; ++line2Index)
+      {
+      this->GetOverlappingLineLocators(plane2Overlaps[line2Index], pointLocators, plane2OverlapPointLocators[line2Index], plane2OverlapPointIds[line2Index]);
+      }
+
+    // The divided lines are reset by each branching, so they can be reused for all overlapping line pairs
+    vtkSmartPointer<vtkLine> dividedLine1 = vtkSmartPointer<vtkLine>::New();
+    vtkSmartPointer<vtkLine> dividedLine2 = vtkSmartPointer<vtkLine>::New();
+
+    // Loop through all of the lines in the first plane
+    for (vtkIdType line1Index = firstLineOnPlane1Index; line1Index < firstLineOnPlane1Index+numberOfLinesInPlane1; ++line1Index)
+      {
+      vtkLine* line1 = this->Lines[line1Index];
+      int line1PlaneIndex = line1Index - firstLineOnPlane1Index;
+      const std::vector< vtkIdType >& line1Overlaps = plane1Overlaps[line1PlaneIndex];
+
+      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
+      for (size_t overlapIndex = 0; overlapIndex < line1Overlaps.size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
+        {
+        vtkIdType line2Index = line1Overlaps[overlapIndex];
+        vtkLine* line2 = this->Lines[line2Index];
+        int line2PlaneIndex = line2Index - firstLineOnPlane2Index;
+
+        // Get the portion of line 1 that is close to line 2,
+        this->Rule->Branch(this->InputROIPoints, line1, line2Index, line1Overlaps,
+          plane1OverlapPointLocators[line1PlaneIndex], plane1OverlapPointIds[line1PlaneIndex], dividedLine1);
+        vtkIdList* dividedPointsInLine1 = dividedLine1->GetPointIds();
+        int numberOfdividedPointsInLine1 = dividedLine1->GetNumberOfPoints();
+
+        // Get the portion of line 2 that is close to line 1.
+        this->Rule->Branch(this->InputROIPoints, line2, line1Index, plane2Overlaps[line2PlaneIndex],
+          plane2OverlapPointLocators[line2PlaneIndex], plane2OverlapPointIds[line2PlaneIndex], dividedLine2);
+        vtkIdList* dividedPointsInLine2 = dividedLine2->GetPointIds();
+        int numberOfdividedPointsInLine2 = dividedLine2->GetNumberOfPoints();
+
+        if (numberOfdividedPointsInLine1 > 1 && numberOfdividedPointsInLine2 > 1)
+          {
+          this->LineTriangulatedToAbove[line1Index] = 1;
+          this->LineTriangulatedToBelow[line2Index] = 1;
+          this->Rule->TriangulateContours(this->InputROIPoints, dividedPointsInLine1, dividedPointsInLine2, outputPolygons);
+          }
+        }
+      }
+  }
+
+  /// Find the overlapping lines of two planes. The lines of plane 2 are binned into a uniform grid over their XY bounds,
+  /// and each line of plane 1 is only tested against the lines in the grid cells its bounds cover.
+  /// The overlap lists are in increasing line index order, the same as if all pairs of lines were tested.
+  void FindOverlappingLines(vtkIdType firstLineOnPlane1Index, int numberOfLinesInPlane1,
+    vtkIdType firstLineOnPlane2Index, int numberOfLinesInPlane2,
+    std::vector< std::vector< vtkIdType > >& plane1Overlaps, std::vector< std::vector< vtkIdType > >& plane2Overlaps)
+  {
+    // XY bounds of the lines in plane 2
+    double gridBounds[4] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+    for (int line2Index = 0; line2Index < numberOfLinesInPlane2; ++line2Index)
+      {
+      const double* line2Bounds = &this->Contours.Bounds[6*(firstLineOnPlane2Index+line2Index)];
+      for (int i=0; i<2; ++i)
+        {
+        gridBounds[2*i] = std::min(gridBounds[2*i], line2Bounds[2*i]);
+        gridBounds[2*i+1] = std::max(gridBounds[2*i+1], line2Bounds[2*i+1]);
+        }
+      }
+
+    // Roughly one line per grid cell
+    int gridSize = std::max(1, (int)std::ceil(std::sqrt((double)numberOfLinesInPlane2)));
+    double gridCellSize[2] = {1.0, 1.0};
+    for (int i=0; i<2; ++i)
+      {
+      double size = (gridBounds[2*i+1] - gridBounds[2*i]) / gridSize;
+      if (size > 0.0)
+        {
+        gridCellSize[i] = size;
+        }
+      }
+
+    std::vector< std::vector<int> > gridCells(gridSize*gridSize);
+    for (int line2Index = 0; line2Index < numberOfLinesInPlane2; ++line2Index)
+      {
+      int cellRange[4] = {0,0,0,0};
+      this->GetGridCellRange(&this->Contours.Bounds[6*(firstLineOnPlane2Index+line2Index)], gridBounds, gridCellSize, gridSize, cellRange);
+      for (int y=cellRange[2]; y<=cellRange[3]; ++y)
+        {
+        for (int x=cellRange[0]; x<=cellRange[1]; ++x)
+          {
+          gridCells[y*gridSize+x].push_back(line2Index);
+          }
+        }
+      }
+
+    // Lines spanning multiple cells are only tested once for each line in plane 1
+    std::vector<int> lastTestedLine1Indices(numberOfLinesInPlane2, -1);
+    std::vector<int> overlappingLine2Indices;
+    for (int line1Index=0; line1Index < numberOfLinesInPlane1; ++line1Index)
+      {
+      const double* line1Bounds = &this->Contours.Bounds[6*(firstLineOnPlane1Index+line1Index)];
+      int cellRange[4] = {0,0,0,0};
+      this->GetGridCellRange(line1Bounds, gridBounds, gridCellSize, gridSize, cellRange);
+
+      overlappingLine2Indices.clear();
+      for (int y=cellRange[2]; y<=cellRange[3]; ++y)
+        {
+        for (int x=cellRange[0]; x<=cellRange[1]; ++x)
+          {
+          const std::vector<int>& cellLines = gridCells[y*gridSize+x];
+          for (size_t cellLineIndex = 0; cellLineIndex < cellLines.size(); ++cellLineIndex)
+            {
+            int line2Index = cellLines[cellLineIndex];
+            if (lastTestedLine1Indices[line2Index] == line1Index)
+              {
+              continue;
+              }
+            lastTestedLine1Indices[line2Index] = line1Index;
+
+            // If the two lines overlap, then add them to the lists
+            if (this->Rule->DoBoundsOverlap(line1Bounds, &this->Contours.Bounds[6*(firstLineOnPlane2Index+line2Index)]))
+              {
+              overlappingLine2Indices.push_back(line2Index);
+              }
+            }
+          }
+        }
+
+      std::sort(overlappingLine2Indices.begin(), overlappingLine2Indices.end());
+      for (size_t i=0; i<overlappingLine2Indices.size(); ++i)
+        {
+        // line from plane 1 overlaps with line from plane 2
+        plane1Overlaps[line1Index].push_back(firstLineOnPlane2Index+overlappingLine2Indices[i]);
+        plane2Overlaps[overlappingLine2Indices[i]].push_back(firstLineOnPlane1Index+line1Index);
+        }
+      }
+  }
+
+  /// Get the range of grid cells covered by the XY bounds of a line (clamped to the grid)
+  void GetGridCellRange(const double* lineBounds, double gridBounds[4], double gridCellSize[2], int gridSize, int cellRange[4])
+  {
+    for (int i=0; i<2; ++i)
+      {
+      for (int j=0; j<2; ++j)
+        {
+        int cellIndex = (int)std::floor((lineBounds[2*i+j] - gridBounds[2*i]) / gridCellSize[i]);
+        cellRange[2*i+j] = std::max(0, std::min(gridSize-1, cellIndex));
+        }
+      }
+  }
+
+  /// Collect the point locators and point ids of the given lines.
+  /// Branching only uses the locators if there are multiple overlapping lines, so they are not built otherwise.
+  void GetOverlappingLineLocators(const std::vector< vtkIdType >& overlappingLineIds, std::map<vtkIdType, vtkSmartPointer<vtkPointLocator> >& pointLocators,
+    std::vector<vtkSmartPointer<vtkPointLocator> >& overlapPointLocators, std::vector<vtkSmartPointer<vtkIdList> >& overlapPointIds)
+  {
+    overlapPointLocators.resize(overlappingLineIds.size());
+    overlapPointIds.resize(overlappingLineIds.size());
+    for (size_t overlapIndex = 0; overlapIndex < overlappingLineIds.size(); ++overlapIndex)
+      {
+      vtkIdType j = overlappingLineIds[overlapIndex];
+      overlapPointIds[overlapIndex] = this->Lines[j]->GetPointIds();
+      if (overlappingLineIds.size() < 2)
+        {
+        continue;
+        }
+
+      vtkSmartPointer<vtkPointLocator>& pointLocator = pointLocators[j];
+      if (!pointLocator)
+        {
+        // The locator contains the points of the line in order, so the closest point index is the index in the line
+        int numberOfPoints = this->Contours.GetNumberOfPoints(j);
+        const vtkIdType* pointIds = this->Contours.GetPointIds(j);
+        vtkSmartPointer<vtkPoints> linePoints = vtkSmartPointer<vtkPoints>::New();
+        linePoints->SetDataTypeToDouble();
+        linePoints->SetNumberOfPoints(numberOfPoints);
+        for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+          {
+          linePoints->SetPoint(pointIndex, this->Contours.GetPoint(pointIds[pointIndex]));
+          }
+        vtkSmartPointer<vtkPolyData> linePolyData = vtkSmartPointer<vtkPolyData>::New();
+        linePolyData->SetPoints(linePoints);
+        pointLocator = vtkSmartPointer<vtkPointLocator>::New();
+        pointLocator->SetDataSet(linePolyData);
+        pointLocator->BuildLocator();
+        }
+      overlapPointLocators[overlapIndex] = pointLocator;
+      }
+  }
+
+protected:
+  vtkPlanarContourToClosedSurfaceConversionRule* Rule;
+  vtkPolyData* InputROIPoints;
+  const ContourSet& Contours;
+  std::vector<vtkSmartPointer<vtkLine> >& Lines;
+  std::vector<vtkIdType>& FirstLineOnPlaneIndices;
+  std::vector<int>& NumberOfLinesOnPlanes;
+  std::vector<vtkSmartPointer<vtkCellArray> >& PlanePairPolygons;
+  std::vector<char>& LineTriangulatedToAbove;
+  std::vector<char>& LineTriangulatedToBelow;
+};
+
 //----------------------------------------------------------------------------
 vtkPlanarContourToClosedSurfaceConversionRule::vtkPlanarContourToClosedSurfaceConversionRule()
 {
@@ -143,162 +410,100 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
   transformRASToContoursFilter->Update();
   inputContoursCopy->DeepCopy(transformRASToContoursFilter->GetOutput());
 
+  // Create the flat representation of the contours. The pre-processing steps and the triangulation of the planes
+  // work on it, and the lines of the polydata are only updated for end-capping.
+  ContourSet contours;
+  this->BuildContourSet(inputContoursCopy, contours);
+
   // Make sure the contours are in the right order.
-  this->SortContours(inputContoursCopy);
+  this->SortContours(contours);
 
   // remove keyholes from the lines
-  this->FixKeyholes(inputContoursCopy, 0.001, 3);
+  this->FixKeyholes(contours, 0.001, 3);
 
   // set all lines to be counter-clockwise
-  this->SetLinesCounterClockwise(inputContoursCopy);
+  this->SetLinesCounterClockwise(contours);
 
   vtkSmartPointer<vtkPoints> outputPoints = inputContoursCopy->GetPoints();
-  vtkSmartPointer<vtkCellArray> outputLines = inputContoursCopy->GetLines();
   vtkSmartPointer<vtkCellArray> outputPolygons = vtkSmartPointer<vtkCellArray>::New(); // Triangles should be added to this
 
   // Total number of lines in the contours
-  int numberOfLines = inputContoursCopy->GetNumberOfLines();
+  int numberOfLines = contours.GetNumberOfContours();
 
-  double spacing = this->GetSpacingBetweenLines(inputContoursCopy);
+  double spacing = this->GetSpacingBetweenLines(contours);
 
-  std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators(numberOfLines);
-  std::vector<vtkSmartPointer<vtkIdList> > linePointIdLists(numberOfLines);
+  // Lines used for branching. Only the point ids are set, the points are read from the input polydata.
+  std::vector<vtkSmartPointer<vtkLine> > lines(numberOfLines);
   for(int lineIndex = 0; lineIndex < numberOfLines; ++lineIndex)
     {
-    vtkSmartPointer<vtkLine> currentLine = vtkSmartPointer<vtkLine>::New();
-    currentLine->DeepCopy(inputContoursCopy->GetCell(lineIndex));
-    linePointIdLists[lineIndex] = currentLine->GetPointIds();
-    vtkSmartPointer<vtkPolyData> linePolyData = vtkSmartPointer<vtkPolyData>::New();
-    linePolyData->SetPoints(currentLine->GetPoints());
-    pointLocators[lineIndex] = vtkSmartPointer<vtkPointLocator>::New();
-    pointLocators[lineIndex]->SetDataSet(linePolyData);
-    pointLocators[lineIndex]->BuildLocator();
+    int numberOfPointsInLine = contours.GetNumberOfPoints(lineIndex);
+    const vtkIdType* linePointIds = contours.GetPointIds(lineIndex);
+    lines[lineIndex] = vtkSmartPointer<vtkLine>::New();
+    vtkIdList* lineIdList = lines[lineIndex]->GetPointIds();
+    lineIdList->SetNumberOfIds(numberOfPointsInLine);
+    for (int pointIndex = 0; pointIndex < numberOfPointsInLine; ++pointIndex)
+      {
+      lineIdList->SetId(pointIndex, linePointIds[pointIndex]);
+      }
     }
 
-  // Vector of booleans to determine which lines are triangulated from above and from below.
-  std::vector< bool > lineTriganulatedToAbove(numberOfLines);
-  std::vector< bool > lineTriganulatedToBelow(numberOfLines);
-  for (int i=0; i<numberOfLines; ++i)
+  // Flags to determine which lines are triangulated from above and from below.
+  // Stored as char instead of bool so that lines can be flagged from multiple threads.
+  std::vector<char> lineTriangulatedToAboveFlags(numberOfLines, 0);
+  std::vector<char> lineTriangulatedToBelowFlags(numberOfLines, 0);
+
+  // Find the planes. The lines are sorted, so the lines of a plane are consecutive.
+  std::vector<vtkIdType> firstLineOnPlaneIndices;
+  std::vector<int> numberOfLinesOnPlanes;
+  vtkIdType firstLineOnPlaneIndex = 0;
+  while (firstLineOnPlaneIndex < numberOfLines)
     {
-    lineTriganulatedToAbove[i] = false;
-    lineTriganulatedToBelow[i] = false;
+    int numberOfLinesOnPlane = this->GetNumberOfLinesOnPlane(contours, firstLineOnPlaneIndex, spacing);
+    firstLineOnPlaneIndices.push_back(firstLineOnPlaneIndex);
+    numberOfLinesOnPlanes.push_back(numberOfLinesOnPlane);
+    firstLineOnPlaneIndex += numberOfLinesOnPlane;
     }
 
-  // Get two consecutive planes.
-  vtkIdType firstLineOnPlane1Index = 0; // pointer to first line on plane 1.
-  int numberOfLinesInPlane1 = this->GetNumberOfLinesOnPlane(inputContoursCopy, 0, spacing);
-
-  // Loop through all of the contours in the polydata
-  while (firstLineOnPlane1Index + numberOfLinesInPlane1 < numberOfLines)
+  // Triangulate the consecutive pairs of planes in parallel, each into its own cell array
+  vtkIdType numberOfPlanePairs = (firstLineOnPlaneIndices.size() > 1 ? (vtkIdType)firstLineOnPlaneIndices.size() - 1 : 0);
+  std::vector<vtkSmartPointer<vtkCellArray> > planePairPolygons(numberOfPlanePairs);
+  for (vtkIdType planePairIndex = 0; planePairIndex < numberOfPlanePairs; ++planePairIndex)
     {
-    vtkIdType firstLineOnPlane2Index = firstLineOnPlane1Index + numberOfLinesInPlane1; // pointer to first line on plane 2
-    int numberOfLinesInPlane2 = this->GetNumberOfLinesOnPlane(inputContoursCopy, firstLineOnPlane2Index, spacing); // number of lines on plane 2
-
-    // initialize overlaps lists. - list of list
-    // Each internal list represents a line from the plane and will store the pointers to the overlap lines
-
-    // List of Overlaps for lines from plane 1
-    std::vector< std::vector< vtkIdType > > plane1Overlaps;
-    for (int line1Index = 0; line1Index < numberOfLinesInPlane1; ++line1Index)
-      {
-      std::vector< vtkIdType > temp;
-      plane1Overlaps.push_back(temp);
-      }
-
-    // overlaps for lines from plane 2
-    std::vector< std::vector< vtkIdType > > plane2Overlaps;
-    for (int line2Index=0; line2Index < numberOfLinesInPlane2; ++line2Index)
-      {
-      std::vector< vtkIdType > temp;
-      plane2Overlaps.push_back(temp);
-      }
-
-    // Loop through the lines in the first plane
-    for (int line1Index=0; line1Index < numberOfLinesInPlane1; ++line1Index)
-      {
-      vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-      line1->DeepCopy(inputContoursCopy->GetCell(firstLineOnPlane1Index+line1Index));
-
-      // Loop through the lines in the second plane
-      for (int line2Index=0; line2Index < numberOfLinesInPlane2; ++line2Index)
-        {
-        vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-        line2->DeepCopy(inputContoursCopy->GetCell(firstLineOnPlane2Index+line2Index));
-
-        // If the two lines overlap, then add them to the lists
-        if (this->DoLinesOverlap(line1, line2))
-          {
-          // line from plane 1 overlaps with line from plane 2
-          plane1Overlaps[line1Index].push_back(firstLineOnPlane2Index+line2Index);
-          plane2Overlaps[line2Index].push_back(firstLineOnPlane1Index+line1Index);
-          }
-        }
-      }
+    planePairPolygons[planePairIndex] = vtkSmartPointer<vtkCellArray>::New();
+    }
+  PlanePairTriangulationFunctor functor(this, inputContoursCopy, contours, lines,
+    firstLineOnPlaneIndices, numberOfLinesOnPlanes, planePairPolygons, lineTriangulatedToAboveFlags, lineTriangulatedToBelowFlags);
+  vtkSMPTools::For(0, numberOfPlanePairs, functor);
 
-    // Loop through all of the lines in the first plane
-    for (int line1Index = firstLineOnPlane1Index; line1Index < firstLineOnPlane1Index+numberOfLinesInPlane1; ++line1Index)
+  // Merge the triangles in the order of the planes, so that the mesh is the same as if the pairs were triangulated one by one
+  for (vtkIdType planePairIndex = 0; planePairIndex < numberOfPlanePairs; ++planePairIndex)
+    {
+    vtkCellArray* currentPolygons = planePairPolygons[planePairIndex];
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    for (currentPolygons->InitTraversal(); currentPolygons->GetNextCell(numberOfCellPoints, cellPointIds); )
       {
-      vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-      line1->DeepCopy(inputContoursCopy->GetCell(line1Index));
-
-      std::vector<vtkSmartPointer<vtkPointLocator> > overlap1PointLocators(plane1Overlaps[line1Index-firstLineOnPlane1Index].size());
-      std::vector<vtkSmartPointer<vtkIdList> > overlap1PointIds(plane1Overlaps[line1Index-firstLineOnPlane1Index].size());
-
-      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
-      for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index-firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
-        {
-        vtkIdType j = plane1Overlaps[line1Index-firstLineOnPlane1Index][overlapIndex];
-        overlap1PointLocators[overlapIndex] = (pointLocators[j]);
-        overlap1PointIds[overlapIndex] = (linePointIdLists[j]);
-        }
-
-      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
-      for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index-firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
-        {
-        vtkIdType line2Index = plane1Overlaps[line1Index-firstLineOnPlane1Index][overlapIndex];
-
-        vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-        line2->DeepCopy(inputContoursCopy->GetCell(line2Index));
-
-        std::vector<vtkSmartPointer<vtkPointLocator> > overlap2PointLocators(plane2Overlaps[line2Index-firstLineOnPlane2Index].size());
-        std::vector<vtkSmartPointer<vtkIdList> > overlap2PointIds(plane2Overlaps[line2Index-firstLineOnPlane2Index].size());
-
-        for (size_t i=0; i<plane2Overlaps[line2Index-firstLineOnPlane2Index].size(); ++i)
-          {
-          int j = plane2Overlaps[line2Index-firstLineOnPlane2Index][i];
-          overlap2PointLocators[i] = (pointLocators[j]);
-          overlap2PointIds[i] = (linePointIdLists[j]);
-          }
-
-        // Get the portion of line 1 that is close to line 2,
-        vtkSmartPointer<vtkLine> dividedLine1 = vtkSmartPointer<vtkLine>::New();
-        this->Branch(inputContoursCopy, line1, line2Index, plane1Overlaps[line1Index-firstLineOnPlane1Index], overlap1PointLocators, overlap1PointIds, dividedLine1);
-        vtkSmartPointer<vtkIdList> dividedPointsInLine1 = dividedLine1->GetPointIds();
-        int numberOfdividedPointsInLine1 = dividedLine1->GetNumberOfPoints();
-
-        // Get the portion of line 2 that is close to line 1.
-        vtkSmartPointer<vtkLine> dividedLine2 = vtkSmartPointer<vtkLine>::New();
-        this->Branch(inputContoursCopy, line2, line1Index, plane2Overlaps[line2Index-firstLineOnPlane2Index], overlap2PointLocators, overlap2PointIds, dividedLine2);
-        vtkSmartPointer<vtkIdList> dividedPointsInLine2 = dividedLine2->GetPointIds();
-        int numberOfdividedPointsInLine2 = dividedLine2->GetNumberOfPoints();
-
-        if (numberOfdividedPointsInLine1 > 1 && numberOfdividedPointsInLine2 > 1)
-          {
-          lineTriganulatedToAbove[line1Index] = true;
-          lineTriganulatedToBelow[line2Index] = true;
-          this->TriangulateContours(inputContoursCopy, dividedPointsInLine1, dividedPointsInLine2, outputPolygons);
-          }
-
-        }
+      outputPolygons->InsertNextCell(numberOfCellPoints, cellPointIds);
       }
+    }
 
-    // Advance the points
-    firstLineOnPlane1Index = firstLineOnPlane2Index;
-    numberOfLinesInPlane1 = numberOfLinesInPlane2;
+  std::vector< bool > lineTriganulatedToAbove(numberOfLines);
+  std::vector< bool > lineTriganulatedToBelow(numberOfLines);
+  for (int i=0; i<numberOfLines; ++i)
+    {
+    lineTriganulatedToAbove[i] = (lineTriangulatedToAboveFlags[i] != 0);
+    lineTriganulatedToBelow[i] = (lineTriangulatedToBelowFlags[i] != 0);
     }
 
+  // Replace the lines of the polydata with the processed contours
+  vtkSmartPointer<vtkCellArray> outputLines = vtkSmartPointer<vtkCellArray>::New();
+  this->CreateContourLines(contours, outputLines);
+  inputContoursCopy->DeleteCells();
+  inputContoursCopy->SetLines(outputLines);
+  inputContoursCopy->BuildCells();
+
   // Triangulate all contours which are exposed.
-  this->EndCapping( inputContoursCopy, outputPolygons, lineTriganulatedToAbove, lineTriganulatedToBelow);
+  this->EndCapping( inputContoursCopy, outputPolygons, lineTriganulatedToAbove, lineTriganulatedToBelow, spacing);
 
   // Initialize the output data.
   closedSurfacePolyData->SetPoints(outputPoints);
@@ -318,6 +523,94 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
   return true;
 }
 
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::ContourSet::AddContour(const vtkIdType* pointIds, int numberOfPoints)
+{
+  double bounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  if (numberOfPoints > 0)
+    {
+    bounds[0] = bounds[2] = bounds[4] = VTK_DOUBLE_MAX;
+    bounds[1] = bounds[3] = bounds[5] = VTK_DOUBLE_MIN;
+    for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+      {
+      this->PointIds.push_back(pointIds[pointIndex]);
+      const double* point = this->GetPoint(pointIds[pointIndex]);
+      for (int i=0; i<3; ++i)
+        {
+        bounds[2*i] = std::min(bounds[2*i], point[i]);
+        bounds[2*i+1] = std::max(bounds[2*i+1], point[i]);
+        }
+      }
+    }
+  else
+    {
+    vtkMath::UninitializeBounds(bounds);
+    }
+
+  this->Offsets.push_back((vtkIdType)this->PointIds.size());
+  this->Bounds.insert(this->Bounds.end(), bounds, bounds+6);
+  this->PlaneZ.push_back((bounds[4] + bounds[5])/2.0);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::ContourSet::Swap(ContourSet& other)
+{
+  this->Coordinates.swap(other.Coordinates);
+  this->PointIds.swap(other.PointIds);
+  this->Offsets.swap(other.Offsets);
+  this->Bounds.swap(other.Bounds);
+  this->PlaneZ.swap(other.PlaneZ);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::BuildContourSet(vtkPolyData* inputROIPoints, ContourSet& contours)
+{
+  ContourSet newContours;
+  if (!inputROIPoints)
+    {
+    vtkErrorMacro("BuildContourSet: Invalid vtkPolyData!");
+    contours.Swap(newContours);
+    return;
+    }
+
+  vtkPoints* points = inputROIPoints->GetPoints();
+  vtkIdType numberOfPoints = (points ? points->GetNumberOfPoints() : 0);
+  newContours.Coordinates.resize(3*numberOfPoints);
+  for (vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    points->GetPoint(pointId, &newContours.Coordinates[3*pointId]);
+    }
+
+  vtkCellArray* lines = inputROIPoints->GetLines();
+  if (lines)
+    {
+    vtkIdType numberOfLinePoints = 0;
+    vtkIdType* linePointIds = NULL;
+    for (lines->InitTraversal(); lines->GetNextCell(numberOfLinePoints, linePointIds); )
+      {
+      newContours.AddContour(linePointIds, numberOfLinePoints);
+      }
+    }
+
+  contours.Swap(newContours);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::CreateContourLines(const ContourSet& contours, vtkCellArray* outputLines)
+{
+  if (!outputLines)
+    {
+    vtkErrorMacro("CreateContourLines: Invalid vtkCellArray!");
+    return;
+    }
+
+  outputLines->Initialize();
+  for (int contourIndex = 0; contourIndex < contours.GetNumberOfContours(); ++contourIndex)
+    {
+    outputLines->InsertNextCell(contours.GetNumberOfPoints(contourIndex), contours.GetPointIds(contourIndex));
+    }
+}
+
 //----------------------------------------------------------------------------
 void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyData* inputROIPoints, vtkIdList* pointsInLine1, vtkIdList* pointsInLine2, vtkCellArray* outputPolygons)
 {
@@ -601,67 +894,55 @@ vtkIdType vtkPlanarContourToClosedSurfaceConversionRule::GetClosestPoint(vtkPoly
 }
 
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::SortContours(vtkPolyData* inputROIPoints)
+void vtkPlanarContourToClosedSurfaceConversionRule::SortContours(ContourSet& contours)
 {
-  if (!inputROIPoints)
-    {
-    vtkErrorMacro("inputROIPoints: Invalid vtkPolyData!");
-    return;
-    }
-  int numberOfLines = inputROIPoints->GetNumberOfLines();
+  int numberOfLines = contours.GetNumberOfContours();
 
-  vtkSmartPointer<vtkLine> originalLine;
   std::vector<std::pair<double, vtkIdType> > lineZIdPairs;
 
   // Loop through all of the lines
   for (vtkIdType currentLineID = 0; currentLineID < numberOfLines; ++currentLineID)
     {
-    vtkSmartPointer<vtkCell> currentLine = inputROIPoints->GetCell(currentLineID);
-
-    // Calculate the average Z value of the line based on the bounds
-    double averageZ = (currentLine->GetBounds()[4] + currentLine->GetBounds()[5])/2.0;
-
     // Add the pair as: (average Z :: line id)
-    lineZIdPairs.push_back(std::make_pair(averageZ, currentLineID));
+    lineZIdPairs.push_back(std::make_pair(contours.PlaneZ[currentLineID], currentLineID));
     }
   std::sort(lineZIdPairs.begin(), lineZIdPairs.end());
 
-  vtkSmartPointer<vtkCellArray> outputLines = vtkSmartPointer<vtkCellArray>::New();
-  outputLines->Initialize();
-  inputROIPoints->DeleteCells();
-
-  // Loop through all of the lines
+  // The points are not changed, only the contours are reordered
+  ContourSet sortedContours;
+  sortedContours.Coordinates.swap(contours.Coordinates);
   for (vtkIdType currentLineID = 0; currentLineID < numberOfLines; ++currentLineID)
     {
-    outputLines->InsertNextCell(inputROIPoints->GetCell(lineZIdPairs[currentLineID].second));
+    vtkIdType lineId = lineZIdPairs[currentLineID].second;
+    sortedContours.AddContour(contours.GetPointIds(lineId), contours.GetNumberOfPoints(lineId));
     }
-  inputROIPoints->SetLines(outputLines);
-  inputROIPoints->BuildCells();
+  contours.Swap(sortedContours);
 }
 
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(vtkPolyData* inputROIPoints, double epsilon, int minimumSeperation)
+void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(ContourSet& contours, double epsilon, int minimumSeperation)
 {
-  if (!inputROIPoints)
-    {
-    vtkErrorMacro("inputROIPoints: Invalid vtkPolyData!");
-    return;
-    }
-
-  vtkSmartPointer<vtkLine> originalLine;
-  std::vector<vtkSmartPointer<vtkLine> > newLines;
+  std::vector< std::vector<vtkIdType> > newLines;
   int pointsOfSeperation;
 
-  int numberOfLines = inputROIPoints->GetNumberOfLines();
+  int numberOfLines = contours.GetNumberOfContours();
+
+  vtkSmartPointer<vtkIdList> pointsWithinRadius = vtkSmartPointer<vtkIdList>::New();
 
   // Loop through all of the lines
   for (vtkIdType currentLineId = 0; currentLineId < numberOfLines; ++currentLineId)
     {
-    originalLine = vtkSmartPointer<vtkLine>::New();
-    originalLine->DeepCopy(inputROIPoints->GetCell(currentLineId));
+    const vtkIdType* originalLinePointIds = contours.GetPointIds(currentLineId);
+    int numberOfPointsInLine = contours.GetNumberOfPoints(currentLineId);
 
-    vtkSmartPointer<vtkPoints> originalLinePoints = originalLine->GetPoints();
-    int numberOfPointsInLine = originalLine->GetNumberOfPoints();
+    // The locator contains the points of the line in order, so the point ids it finds are indices in the line
+    vtkSmartPointer<vtkPoints> originalLinePoints = vtkSmartPointer<vtkPoints>::New();
+    originalLinePoints->SetDataTypeToDouble();
+    originalLinePoints->SetNumberOfPoints(numberOfPointsInLine);
+    for (int pointIndex = 0; pointIndex < numberOfPointsInLine; ++pointIndex)
+      {
+      originalLinePoints->SetPoint(pointIndex, contours.GetPoint(originalLinePointIds[pointIndex]));
+      }
 
     vtkSmartPointer<vtkPolyData> linePolyData = vtkSmartPointer<vtkPolyData>::New();
     linePolyData->SetPoints(originalLinePoints);
@@ -675,20 +956,13 @@ void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(vtkPolyData* inp
     // If the value of flags[i] is -1, the point is not part of a keyhole
     // If the value of flags[i] is >= 0, it represents a point that is
     // close enough that it could be considered part of a keyhole.
-    std::vector< int > flags(numberOfPointsInLine);
-
-    // Loop through and initialize the list of flags to -1.
-    for (int i=0; i<numberOfPointsInLine; ++i)
-      {
-      flags[i] = -1;
-      }
+    std::vector< int > flags(numberOfPointsInLine, -1);
 
     for (int point1Id = 0; point1Id < numberOfPointsInLine; ++point1Id)
       {
       double point1[3] = {0,0,0};
       originalLinePoints->GetPoint(point1Id, point1);
 
-      vtkSmartPointer<vtkIdList> pointsWithinRadius = vtkSmartPointer<vtkIdList>::New();
       pointsWithinRadius->Initialize();
       pointLocator->FindPointsWithinRadius(epsilon, point1, pointsWithinRadius);
 
@@ -710,39 +984,34 @@ void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(vtkPolyData* inp
 
     if (!keyHoleExists)
       {
-      newLines.push_back(originalLine);
+      newLines.push_back(std::vector<vtkIdType>(originalLinePointIds, originalLinePointIds + numberOfPointsInLine));
       }
     else
       {
       size_t currentLayer = 0;
       bool pointInChannel = false;
 
-      std::vector<vtkSmartPointer<vtkIdList> > rawLinePointIds;
-      std::vector<vtkSmartPointer<vtkIdList> > finishedLinePointIds;
+      // Indices of the lines in newLines
+      std::vector<size_t> rawLineIndices;
+      std::vector<size_t> finishedLineIndices;
 
       // Loop through all of the points in the line
       for (int currentPointIndex = 0; currentPointIndex < numberOfPointsInLine; ++currentPointIndex)
         {
 
         // Add a new line if necessary
-        if (currentLayer == rawLinePointIds.size())
+        if (currentLayer == rawLineIndices.size())
           {
-          vtkSmartPointer<vtkLine> newLine = vtkSmartPointer<vtkLine>::New();
-          newLine->GetPoints()->SetData(originalLinePoints->GetData());
-
-          vtkSmartPointer<vtkIdList> newLineIds = newLine->GetPointIds();
-          newLineIds->Initialize();
-
-          newLines.push_back(newLine);
-          rawLinePointIds.push_back(newLineIds);
+          rawLineIndices.push_back(newLines.size());
+          newLines.push_back(std::vector<vtkIdType>());
           }
 
-        int currentPointId = originalLine->GetPointId(currentPointIndex);
+        vtkIdType currentPointId = originalLinePointIds[currentPointIndex];
 
         // If the current point is not part of a keyhole, add it to the current line
         if (flags[currentPointIndex] == -1)
           {
-          rawLinePointIds[currentLayer]->InsertNextId(currentPointId);
+          newLines[rawLineIndices[currentLayer]].push_back(currentPointId);
           pointInChannel = false;
           }
         else
@@ -751,7 +1020,7 @@ void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(vtkPolyData* inp
           // increment the layer, and start the channel.
           if (flags[currentPointIndex] > currentPointIndex && !pointInChannel)
             {
-            rawLinePointIds[currentLayer]->InsertNextId(currentPointId);
+            newLines[rawLineIndices[currentLayer]].push_back(currentPointId);
             ++currentLayer;
             pointInChannel = true;
 
@@ -762,9 +1031,9 @@ void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(vtkPolyData* inp
           // channel.
           else if (flags[currentPointIndex] < currentPointIndex && !pointInChannel)
             {
-            rawLinePointIds[currentLayer]->InsertNextId(currentPointId);
-            finishedLinePointIds.push_back(rawLinePointIds[currentLayer]);
-            rawLinePointIds.pop_back();
+            newLines[rawLineIndices[currentLayer]].push_back(currentPointId);
+            finishedLineIndices.push_back(rawLineIndices[currentLayer]);
+            rawLineIndices.pop_back();
             if (currentLayer > 0)
               {
               --currentLayer;
@@ -775,86 +1044,72 @@ void vtkPlanarContourToClosedSurfaceConversionRule::FixKeyholes(vtkPolyData* inp
         }
 
       // Add the remaining line to the finished list.
-      for (size_t remainingLineId=0; remainingLineId < rawLinePointIds.size(); ++remainingLineId)
+      for (size_t remainingLineId=0; remainingLineId < rawLineIndices.size(); ++remainingLineId)
         {
-        finishedLinePointIds.push_back(rawLinePointIds[remainingLineId]);
+        finishedLineIndices.push_back(rawLineIndices[remainingLineId]);
         }
 
       // Loop through the completed lines and make sure that they are closed
-      for (size_t finishedLineId = 0; finishedLineId < finishedLinePointIds.size(); ++finishedLineId)
+      for (size_t finishedLineId = 0; finishedLineId < finishedLineIndices.size(); ++finishedLineId)
         {
-        if ( finishedLinePointIds[finishedLineId]->GetNumberOfIds() > 0
-          && finishedLinePointIds[finishedLineId]->GetId(0) != finishedLinePointIds[finishedLineId]->GetId(finishedLinePointIds[finishedLineId]->GetNumberOfIds()-1) )
+        std::vector<vtkIdType>& finishedLine = newLines[finishedLineIndices[finishedLineId]];
+        if (finishedLine.size() > 0 && finishedLine.front() != finishedLine.back())
           {
-          finishedLinePointIds[finishedLineId]->InsertNextId(finishedLinePointIds[finishedLineId]->GetId(0));
+          finishedLine.push_back(finishedLine.front());
           }
         }
 
       }
     }
 
-  vtkSmartPointer<vtkCellArray> outputLines = vtkSmartPointer<vtkCellArray>::New();
-  outputLines->Initialize();
-  inputROIPoints->DeleteCells();
+  ContourSet fixedContours;
+  fixedContours.Coordinates.swap(contours.Coordinates);
   for (size_t currentLineIndex = 0; currentLineIndex < newLines.size(); ++currentLineIndex)
     {
     // Only add the lines if they have more than 2 points
-    if (newLines[currentLineIndex]->GetNumberOfPoints() > 1)
+    if (newLines[currentLineIndex].size() > 1)
       {
-      outputLines->InsertNextCell(newLines[currentLineIndex]);
+      fixedContours.AddContour(&newLines[currentLineIndex][0], (int)newLines[currentLineIndex].size());
       }
     }
-  inputROIPoints->SetLines(outputLines);
-  inputROIPoints->BuildCells();
+  contours.Swap(fixedContours);
 }
 
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::SetLinesCounterClockwise(vtkPolyData* inputROIPoints)
+void vtkPlanarContourToClosedSurfaceConversionRule::SetLinesCounterClockwise(ContourSet& contours)
 {
-  if (!inputROIPoints)
-    {
-    vtkErrorMacro("inputROIPoints: Invalid vtkPolyData!");
-    return;
-    }
-
-  int numberOfLines = inputROIPoints->GetNumberOfLines();
-
-  std::vector<vtkSmartPointer<vtkLine> > newLines;
+  int numberOfLines = contours.GetNumberOfContours();
 
+  // Reverse the point ids of clockwise lines in place. The bounds of the lines do not change.
   for(int currentLineId=0 ; currentLineId < numberOfLines; ++currentLineId)
     {
-    vtkSmartPointer<vtkLine> currentLine = vtkSmartPointer<vtkLine>::New();
-    currentLine->DeepCopy(inputROIPoints->GetCell(currentLineId));
-
-    vtkSmartPointer<vtkPoints> currentPoints = currentLine->GetPoints();
-
-    if (IsLineClockwise(inputROIPoints, currentLine))
+    if (this->IsContourClockwise(contours, currentLineId))
       {
-      vtkSmartPointer<vtkLine> newLine = vtkSmartPointer<vtkLine>::New();
-      vtkSmartPointer<vtkIdList> newLineIds = newLine->GetPointIds();
-      newLineIds->Initialize();
-
-      this->ReverseLine(currentLine, newLine);
-      newLines.push_back(newLine);
-
-      }
-    else
-      {
-      newLines.push_back(currentLine);
+      std::reverse(contours.PointIds.begin() + contours.Offsets[currentLineId], contours.PointIds.begin() + contours.Offsets[currentLineId+1]);
       }
     }
+}
 
-  // Replace the lines in the input data with the modified lines.
-  vtkSmartPointer<vtkCellArray> outputLines = vtkSmartPointer<vtkCellArray>::New();
-  outputLines->Initialize();
-  inputROIPoints->DeleteCells();
-  for (size_t currentLineIndex = 0; currentLineIndex < newLines.size(); ++currentLineIndex)
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToClosedSurfaceConversionRule::IsContourClockwise(const ContourSet& contours, int contourIndex)
+{
+  int numberOfPoints = contours.GetNumberOfPoints(contourIndex);
+  const vtkIdType* pointIds = contours.GetPointIds(contourIndex);
+
+  // Calculate twice the area of the line.
+  double areaSum = 0;
+
+  for (int currentPointId=0; currentPointId < numberOfPoints-1; ++currentPointId)
     {
-    outputLines->InsertNextCell(newLines[currentLineIndex]);
+    const double* point1 = contours.GetPoint(pointIds[currentPointId]);
+    const double* point2 = contours.GetPoint(pointIds[currentPointId + 1]);
+
+    areaSum += (point2[0] - point1[0]) * (point2[1] + point1[1]);
     }
-  inputROIPoints->SetLines(outputLines);
-  inputROIPoints->BuildCells();
 
+  // If the area is positive, the contour is clockwise,
+  // If it is negative, the contour is counter-clockwise.
+  return areaSum > 0;
 }
 
 //----------------------------------------------------------------------------
@@ -921,23 +1176,17 @@ void vtkPlanarContourToClosedSurfaceConversionRule::ReverseLine(vtkLine* origina
 }
 
 //----------------------------------------------------------------------------
-int vtkPlanarContourToClosedSurfaceConversionRule::GetNumberOfLinesOnPlane(vtkPolyData* inputROIPoints, vtkIdType originalLineIndex, double spacing)
+int vtkPlanarContourToClosedSurfaceConversionRule::GetNumberOfLinesOnPlane(const ContourSet& contours, vtkIdType originalLineIndex, double spacing)
 {
-  if (!inputROIPoints)
-    {
-    vtkErrorMacro("GetNumberOfLinesOnPlane: Invalid vtkPolyData!");
-    return 0;
-    }
-
-  int numberOfLines = inputROIPoints->GetNumberOfLines();
+  int numberOfLines = contours.GetNumberOfContours();
 
   double contourPlaneThreshold = 0.1*spacing;
-  double lineZ = (inputROIPoints->GetCell(originalLineIndex)->GetBounds()[4] + inputROIPoints->GetCell(originalLineIndex)->GetBounds()[5])/2.0; // z-value
+  double lineZ = contours.PlaneZ[originalLineIndex]; // z-value
   vtkIdType currentLineId = originalLineIndex+1;
 
   while (currentLineId < numberOfLines)
     {
-    double currentLineZDifference = std::abs(0.5*(inputROIPoints->GetCell(currentLineId)->GetBounds()[4] + inputROIPoints->GetCell(currentLineId)->GetBounds()[5]) - lineZ);
+    double currentLineZDifference = std::abs(contours.PlaneZ[currentLineId] - lineZ);
     if (currentLineZDifference < contourPlaneThreshold)
       {
       currentLineId++;
@@ -951,26 +1200,8 @@ int vtkPlanarContourToClosedSurfaceConversionRule::GetNumberOfLinesOnPlane(vtkPo
 }
 
 //----------------------------------------------------------------------------
-bool vtkPlanarContourToClosedSurfaceConversionRule::DoLinesOverlap(vtkLine* line1, vtkLine* line2)
+bool vtkPlanarContourToClosedSurfaceConversionRule::DoBoundsOverlap(const double bounds1[6], const double bounds2[6])
 {
-  if (!line1)
-    {
-    vtkErrorMacro("DoLinesOverlap: Invalid vtkLine!");
-    return false;
-    }
-
-  if (!line2)
-    {
-    vtkErrorMacro("DoLinesOverlap: Invalid vtkLine!");
-    return false;
-    }
-
-  double bounds1[6];
-  line1->GetBounds(bounds1);
-
-  double bounds2[6];
-  line2->GetBounds(bounds2);
-
   return bounds1[0] < bounds2[1] &&
          bounds1[1] > bounds2[0] &&
          bounds1[2] < bounds2[3] &&
@@ -978,7 +1209,7 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::DoLinesOverlap(vtkLine* line
 }
 // TODO: It may be possible to speed up this function by only calling the branch function once. -- need to look into this
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists, vtkLine* outputLine)
+void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists, vtkLine* outputLine)
 {
   if (!inputROIPoints)
     {
@@ -1043,7 +1274,7 @@ void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROI
 }
 
 //----------------------------------------------------------------------------
-int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, std::vector< vtkIdType > overlappingLineIds,  std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists)
+int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists)
 {
   if (!inputROIPoints)
     {
@@ -1082,7 +1313,7 @@ int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData*
 }
 
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::EndCapping(vtkPolyData* inputROIPoints, vtkCellArray* outputPolygons, std::vector< bool > lineTriganulatedToAbove, std::vector< bool > lineTriganulatedToBelow)
+void vtkPlanarContourToClosedSurfaceConversionRule::EndCapping(vtkPolyData* inputROIPoints, vtkCellArray* outputPolygons, std::vector< bool > lineTriganulatedToAbove, std::vector< bool > lineTriganulatedToBelow, double lineSpacing)
 {
   if (!inputROIPoints)
     {
@@ -1097,8 +1328,6 @@ void vtkPlanarContourToClosedSurfaceConversionRule::EndCapping(vtkPolyData* inpu
     }
   int numberOfLines = inputROIPoints->GetNumberOfLines();
 
-  double lineSpacing = this->GetSpacingBetweenLines(inputROIPoints);
-
   // Loop through all of the lines in the polydata
   for (int currentLineIndex = 0; currentLineIndex < numberOfLines; ++currentLineIndex)
     {
@@ -1203,18 +1432,13 @@ void vtkPlanarContourToClosedSurfaceConversionRule::EndCapping(vtkPolyData* inpu
 }
 
 //----------------------------------------------------------------------------
-double vtkPlanarContourToClosedSurfaceConversionRule::GetSpacingBetweenLines(vtkPolyData* inputROIPoints)
+double vtkPlanarContourToClosedSurfaceConversionRule::GetSpacingBetweenLines(const ContourSet& contours)
 {
   double defaultSliceThickness = vtkVariant(this->ConversionParameters[this->GetDefaultSliceThicknessParameterName()].first).ToDouble();
 
-  if (!inputROIPoints)
-    {
-    vtkErrorMacro("GetSpacingBetweenLines: Invalid vtkPolyData!");
-    return defaultSliceThickness;
-    }
-  if (inputROIPoints->GetNumberOfCells() < 2)
+  if (contours.GetNumberOfContours() < 2)
     {
-    vtkErrorMacro("GetSpacingBetweenLines: Input polydata has less than two cells! Unable to calculate spacing.");
+    vtkErrorMacro("GetSpacingBetweenLines: Input has less than two contours! Unable to calculate spacing.");
     return defaultSliceThickness;
     }
 
@@ -1224,25 +1448,10 @@ double vtkPlanarContourToClosedSurfaceConversionRule::GetSpacingBetweenLines(vtk
 
   // Loop through all of the lines
   vtkIdType lineId = 0;
-  while (lineId < inputROIPoints->GetNumberOfLines() - 1)
+  while (lineId < contours.GetNumberOfContours() - 1)
     {
-
-    // First line
-    vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-    line1->DeepCopy(inputROIPoints->GetCell(lineId));
-
-    double line1Bounds[6] = { 0, 0, 0, 0, 0, 0 };
-    line1->GetBounds( line1Bounds );
-
-    // Second line
-    vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-    line2->DeepCopy(inputROIPoints->GetCell(lineId + 1));
-
-    double line2Bounds[6] = { 0, 0, 0, 0, 0, 0 };
-    line2->GetBounds( line2Bounds );
-
     // Calculate the distance as the difference between the z value in the middle of the bounding boxes of the two lines.
-    double distance = std::abs( (line1Bounds[4]+line1Bounds[5])/2 - (line2Bounds[4]+line2Bounds[5])/2 );
+    double distance = std::abs( contours.PlaneZ[lineId] - contours.PlaneZ[lineId + 1] );
 
     // If the distance between the lines is not zero, add it to the list
     if (distance > 0.01)
@@ -1716,59 +1925,103 @@ void vtkPlanarContourToClosedSurfaceConversionRule::DecimateLines(vtkPolyData* i
 
   vtkSmartPointer<vtkCellArray> outputLines = vtkSmartPointer<vtkCellArray>::New();
 
+  // Indexed heap of the points that can be removed. The ids in the queue are the indices of the points in the line,
+  // so the priority of a point can be updated when its neighbours change.
   vtkSmartPointer<vtkPriorityQueue> priorityQueue = vtkSmartPointer<vtkPriorityQueue>::New();
 
+  // Doubly linked list of the remaining points of the current line
+  std::vector<vtkIdType> nextIndices;
+  std::vector<vtkIdType> previousIndices;
+  std::vector<bool> removed;
+  std::vector<vtkIdType> outputLineIds;
+
   // Loop through all of the lines
-  for (vtkIdType inputLineId = 0; inputLineId < inputPolyData->GetNumberOfLines(); ++inputLineId)
+  vtkIdType numberOfInputPoints = 0;
+  vtkIdType* inputLinePointIds = NULL;
+  for (inputLines->InitTraversal(); inputLines->GetNextCell(numberOfInputPoints, inputLinePointIds); )
     {
-
-    vtkSmartPointer<vtkLine> outputLine = vtkSmartPointer<vtkLine>::New();
-    outputLine->DeepCopy(inputPolyData->GetCell(inputLineId));
-
-    vtkSmartPointer<vtkLine> inputLine =  vtkSmartPointer<vtkLine>::New();
-    inputLine->ShallowCopy(inputPolyData->GetCell(inputLineId));
-
-    vtkSmartPointer<vtkIdList> outputLineIds = outputLine->GetPointIds();
+    outputLineIds.assign(inputLinePointIds, inputLinePointIds + numberOfInputPoints);
 
     // If there are less than 2 points, then just copy the line
-    if (outputLineIds->GetNumberOfIds() > 2)
+    if (numberOfInputPoints > 2)
       {
-
-      //// Loop through the points in the current line
-      for (int pointIndex = 0; pointIndex < outputLineIds->GetNumberOfIds(); ++pointIndex)
+      // The last point of a closed line is the same as the first one, so the points form a ring without it.
+      // Open lines are also treated as a ring, the neighbour of the last point is the first point.
+      bool isClosed = (inputLinePointIds[0] == inputLinePointIds[numberOfInputPoints-1]);
+      vtkIdType numberOfPoints = (isClosed ? numberOfInputPoints-1 : numberOfInputPoints);
+
+      nextIndices.resize(numberOfPoints);
+      previousIndices.resize(numberOfPoints);
+      removed.assign(numberOfPoints, false);
+      for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
         {
-        // Add the current point to the output line
-        vtkIdType pointId = outputLineIds->GetId(pointIndex);
+        nextIndices[pointIndex] = (pointIndex+1 < numberOfPoints ? pointIndex+1 : 0);
+        previousIndices[pointIndex] = (pointIndex > 0 ? pointIndex-1 : numberOfPoints-1);
+        }
 
-        // Calculate the error and add it to the priority queue
-        priorityQueue->Insert(this->ComputeError(inputPoints, outputLineIds, pointIndex), pointId);
+      // Calculate the error of each point and add it to the priority queue
+      priorityQueue->Reset();
+      for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+        {
+        priorityQueue->Insert(this->ComputeError(inputPoints, inputLinePointIds[previousIndices[pointIndex]],
+          inputLinePointIds[pointIndex], inputLinePointIds[nextIndices[pointIndex]]), pointIndex);
         }
 
-      // While the priority queue is not empty, doesn't contain any errors that are less than the machine epsilon,
-      // and while the ratio of the # output points / # input points is greater than the decimation factor
-      while (priorityQueue->GetNumberOfItems() > 3 &&
-            ((priorityQueue->GetPriority(priorityQueue->Peek()) < VTK_DBL_EPSILON) ||
-            (1.0 * outputLineIds->GetNumberOfIds() / inputLine->GetNumberOfPoints() > decimationFactor)))
+      // While there are more than three points, and the queue contains errors that are less than the machine epsilon
+      // or the ratio of the # output points / # input points is greater than the decimation factor
+      vtkIdType numberOfRemainingPoints = numberOfPoints;
+      while (numberOfRemainingPoints > 3)
         {
-        // Remove the point from the outputLineIds
-        this->RemovePointDecimation(outputLineIds, priorityQueue->Pop());
+        double error = 0.0;
+        priorityQueue->Peek(0, error);
+        vtkIdType numberOfOutputPoints = (isClosed ? numberOfRemainingPoints+1 : numberOfRemainingPoints);
+        if (error >= VTK_DBL_EPSILON && 1.0 * numberOfOutputPoints / numberOfInputPoints <= decimationFactor)
+          {
+          break;
+          }
+
+        // Remove the point from the line
+        vtkIdType pointIndex = priorityQueue->Pop();
+        vtkIdType previousIndex = previousIndices[pointIndex];
+        vtkIdType nextIndex = nextIndices[pointIndex];
+        nextIndices[previousIndex] = nextIndex;
+        previousIndices[nextIndex] = previousIndex;
+        removed[pointIndex] = true;
+        --numberOfRemainingPoints;
+
+        // Only the errors of the two neighbours change
+        priorityQueue->DeleteId(previousIndex);
+        priorityQueue->Insert(this->ComputeError(inputPoints, inputLinePointIds[previousIndices[previousIndex]],
+          inputLinePointIds[previousIndex], inputLinePointIds[nextIndex]), previousIndex);
+        priorityQueue->DeleteId(nextIndex);
+        priorityQueue->Insert(this->ComputeError(inputPoints, inputLinePointIds[previousIndex],
+          inputLinePointIds[nextIndex], inputLinePointIds[nextIndices[nextIndex]]), nextIndex);
         }
 
+      // Collect the remaining points in their original order
+      outputLineIds.clear();
+      for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+        {
+        if (!removed[pointIndex])
+          {
+          outputLineIds.push_back(inputLinePointIds[pointIndex]);
+          }
+        }
       }
 
     // Make sure the contour is closed
-    if (outputLineIds->GetNumberOfIds() > 1)
+    if (outputLineIds.size() > 1)
       {
-      if (outputLineIds->GetId(0) != outputLineIds->GetId(outputLineIds->GetNumberOfIds() - 1))
+      if (outputLineIds.front() != outputLineIds.back())
         {
-        outputLineIds->InsertNextId(outputLineIds->GetId(0));
+        outputLineIds.push_back(outputLineIds.front());
         }
       }
 
     // If there are no points, then the line doesn't need to be added
-    if (outputLineIds->GetNumberOfIds() > 0)
+    if (outputLineIds.size() > 0)
       {
-      outputLines->InsertNextCell(outputLineIds);
+      outputLines->InsertNextCell((vtkIdType)outputLineIds.size(), &outputLineIds[0]);
       }
 
     }
@@ -1782,32 +2035,7 @@ void vtkPlanarContourToClosedSurfaceConversionRule::DecimateLines(vtkPolyData* i
 }
 
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::RemovePointDecimation(vtkIdList* originalIdList, vtkIdType pointId)
-{
-
-  if (!originalIdList)
-    {
-   vtkErrorMacro("RemovePointDecimation: Invalid vtkIdList!");
-   return;
-    }
-
-  vtkSmartPointer<vtkIdList> idList = vtkSmartPointer<vtkIdList>::New();
-  idList->Initialize();
-  for (int i=0; i < originalIdList->GetNumberOfIds(); ++i)
-    {
-    vtkIdType id = originalIdList->GetId(i);
-
-    if (pointId != id)
-      {
-      idList->InsertNextId(id);
-      }
-    }
-  originalIdList->DeepCopy(idList);
-
-}
-
-//----------------------------------------------------------------------------
-double vtkPlanarContourToClosedSurfaceConversionRule::ComputeError(vtkPoints* points, vtkIdList* lineIds, vtkIdType pointIndex)
+double vtkPlanarContourToClosedSurfaceConversionRule::ComputeError(vtkPoints* points, vtkIdType previousId, vtkIdType currentId, vtkIdType nextId)
 {
   if (!points)
     {
@@ -1815,18 +2043,6 @@ double vtkPlanarContourToClosedSurfaceConversionRule::ComputeError(vtkPoints* po
    return 0.0;
     }
 
-  if (!lineIds)
-    {
-   vtkErrorMacro("ComputeError: Invalid vtkIdList!");
-   return 0.0;
-    }
-
-  bool isClosed = (lineIds->GetId(0) == lineIds->GetId(lineIds->GetNumberOfIds()-1));
-
-  vtkIdType currentId = lineIds->GetId(pointIndex);
-  vtkIdType nextId = lineIds->GetId(this->GetNextLocation(pointIndex, lineIds->GetNumberOfIds(), isClosed));
-  vtkIdType previousId = lineIds->GetId(this->GetPreviousLocation(pointIndex, lineIds->GetNumberOfIds(), isClosed));
-
   double currentPoint[3] = {0,0,0};
   points->GetPoint(currentId, currentPoint);
 
@@ -30,6 +30,9 @@
 // VTK includes
 #include "vtkPointLocator.h"
 
+// STD includes
+#include <vector>
+
 class vtkPolyData;
 class vtkIdList;
 class vtkCellArray;
@@ -80,10 +83,52 @@ public:
   /// Human-readable name of the target representation
   virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName(); };
 
+protected:
+  /// Flat representation of the planar contours used during the conversion.
+  /// The point ids of all contours are stored one after the other, and the coordinates of the points are copied
+  /// once from the input. The bounds and the plane Z of each contour are computed when the contour is added.
+  struct ContourSet
+  {
+    /// Coordinates of the points (x, y, z of each point), indexed by point id
+    std::vector<double> Coordinates;
+    /// Point ids of all contours
+    std::vector<vtkIdType> PointIds;
+    /// Index of the first point id of each contour in PointIds, followed by the number of point ids
+    std::vector<vtkIdType> Offsets;
+    /// Bounds of the contours (6 values for each contour)
+    std::vector<double> Bounds;
+    /// Z value of the contours (middle of the bounds along Z)
+    std::vector<double> PlaneZ;
+
+    ContourSet() { this->Offsets.push_back(0); };
+    int GetNumberOfContours() const { return (int)this->Offsets.size() - 1; };
+    int GetNumberOfPoints(vtkIdType contourIndex) const { return (int)(this->Offsets[contourIndex+1] - this->Offsets[contourIndex]); };
+    const vtkIdType* GetPointIds(vtkIdType contourIndex) const { return (this->PointIds.empty() ? NULL : &this->PointIds[0] + this->Offsets[contourIndex]); };
+    const double* GetPoint(vtkIdType pointId) const { return &this->Coordinates[3*pointId]; };
+
+    /// Add a contour with the given point ids, and compute its bounds and plane Z
+    void AddContour(const vtkIdType* pointIds, int numberOfPoints);
+    /// Swap contents with another contour set
+    void Swap(ContourSet& other);
+  };
+
+  /// Functor triangulating the consecutive pairs of contour planes in parallel
+  class PlanePairTriangulationFunctor;
+
 protected:
   vtkPlanarContourToClosedSurfaceConversionRule();
   virtual ~vtkPlanarContourToClosedSurfaceConversionRule();
 
+  /// Create the flat contour representation from the points and lines of a polydata
+  /// \param inputROIPoints Polydata containing all of the points and contours
+  /// \param contours Output contour set
+  void BuildContourSet(vtkPolyData* inputROIPoints, ContourSet& contours);
+
+  /// Create the lines of the contours in a contour set
+  /// \param contours Contour set
+  /// \param outputLines Cell array the lines are added to
+  void CreateContourLines(const ContourSet& contours, vtkCellArray* outputLines);
+
   /// Construct a surface triangulation between two lines using a dynamic programming algorithm.
   /// \param inputROIPoints Polydata containing all of the points and contours
   /// \param pointsInLine1 List of points that are contained in the line to be triangulated
@@ -106,18 +151,23 @@ protected:
   vtkIdType GetClosestPoint(vtkPolyData* inputROIPoints, double* originalPoint, vtkIdList* linePointIds);
 
   /// Sort the contours based on Z value.
-  /// \param inputROIPoints Polydata containing all of the points and contours
-  void SortContours(vtkPolyData* inputROIPoints);
+  /// \param contours Contour set containing all of the points and contours
+  void SortContours(ContourSet& contours);
 
   /// Remove the keyholes from the contours.
-  /// \param inputROIPoints Polydata containing all of the points and contours
+  /// \param contours Contour set containing all of the points and contours
   /// \param The minimum distance between two points in mm before points are considered to be part of a keyhole
   /// \param The minimum number of seperation of indices between points before they can be part of a keyhole
-  void FixKeyholes(vtkPolyData* inputROIPoints, double epsilon, int minimumSeperation);
+  void FixKeyholes(ContourSet& contours, double epsilon, int minimumSeperation);
 
   /// Set all of the lines to be oriented in the clockwise direction.
-  /// \param inputROIPoints Polydata containing all of the points and contours
-  void SetLinesCounterClockwise(vtkPolyData* inputROIPoints);
+  /// \param contours Contour set containing all of the points and contours
+  void SetLinesCounterClockwise(ContourSet& contours);
+
+  /// Determine if a contour runs in a clockwise orientation.
+  /// \param contours Contour set containing all of the points and contours
+  /// \param contourIndex Index of the contour that is being checked
+  bool IsContourClockwise(const ContourSet& contours, int contourIndex);
 
   /// Determine if a line runs in a clockwise orientation.
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -131,15 +181,15 @@ protected:
 
   /// Determine the number of contours that share the same Z-coordinates.
   /// WARNING: This function requires that the normal vector of all contours is aligned with the Z-axis.
-  /// \param inputROIPoints Polydata containing all of the points and contours
+  /// \param contours Contour set containing all of the points and contours
   /// \param originalLineIndex The index of the line that is part of the plane being checked
   /// \param spacing The spacing between lines
-  int GetNumberOfLinesOnPlane(vtkPolyData* inputROIPoints, vtkIdType originalLineIndex, double spacing);
+  int GetNumberOfLinesOnPlane(const ContourSet& contours, vtkIdType originalLineIndex, double spacing);
 
-  /// Determine if two contours overlap in the XY axis.
-  /// \param The first line
-  /// \param The second line
-  bool DoLinesOverlap(vtkLine* line1, vtkLine* line2);
+  /// Determine if the bounds of two contours overlap in the XY axis.
+  /// \param The bounds of the first line
+  /// \param The bounds of the second line
+  bool DoBoundsOverlap(const double bounds1[6], const double bounds2[6]);
 
   /// Create a branching pattern for overlapping contours.
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -149,7 +199,7 @@ protected:
   /// \param pointLocators List of point locators for lines in the overlap list
   /// \param lineIdLists List of vtkIdLists for all of the lines in the overlap list
   /// \param outputLine The output branched line
-  void Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists, vtkLine* outputLine);
+  void Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists, vtkLine* outputLine);
 
   /// Find the branch closest from the point on the trunk
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -157,7 +207,7 @@ protected:
   /// \param overlappingLineIds List of line IDs for lines that overlap with the current line
   /// \param pointLocators List of point locators for lines in the overlap list
   /// \param lineIdLists List of vtkIdLists for all of the lines in the overlap list
-  int GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists);
+  int GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists);
 
   /// Seal the exterior contours of the mesh.
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -165,13 +215,14 @@ protected:
   /// \param outputPolygons
   /// \param lineTriganulatedToAbove
   /// \param lineTriganulatedToBelow
-  void EndCapping(vtkPolyData* inputROIPoints, vtkCellArray* outputPolygons, std::vector< bool > lineTriganulatedToAbove, std::vector< bool > lineTriganulatedToBelow);
+  /// \param lineSpacing The size of the spacing between the contours
+  void EndCapping(vtkPolyData* inputROIPoints, vtkCellArray* outputPolygons, std::vector< bool > lineTriganulatedToAbove, std::vector< bool > lineTriganulatedToBelow, double lineSpacing);
 
   /// Calculate the spacing between the lines in the polydata
   /// WARNING: This function requires that the normal vector of all contours is aligned with the Z-axis.
-  /// \param inputROIPoints Polydata containing all of the points and contours
+  /// \param contours Contour set containing all of the points and contours
   /// \return The size of the spacing between the contours
-  double GetSpacingBetweenLines(vtkPolyData* inputROIPoints);
+  double GetSpacingBetweenLines(const ContourSet& contours);
 
   /// Create an additional contour on the exterior of the surface to compensate for slice thickness.
   /// This step is generally called end-capping.
@@ -203,21 +254,19 @@ protected:
 
   /// Remove points from the input lines, until there are no points with error less than VTK_DBL_EPSILON and
   /// the following is acheived (number of points in new line) / (number of points in old line) < decimation factor
+  /// The point with the smallest error is removed first. The remaining points of a line are kept in a linked list,
+  /// so removing a point only updates the errors of its two neighbours.
   /// \param inputLines Lines to be decimated
   /// \param decimationFactor Represents the goal decimation
   void DecimateLines(vtkPolyData* inputPolyData, double decimationFactor);
 
-  /// Remove a point from the line, and make sure the points in the line are still in order
-  /// \param idList The idList that the point is to be removed from
-  /// \param pointId The id of the point that is being removed
-  void RemovePointDecimation(vtkIdList* idList, vtkIdType pointId);
-
   /// Calculate the distance of the specified point from the line defined by the two points on either side
   /// \param points Contains the point data
-  /// \param lineIds Contains the current line
-  /// \param pointId The id of the point
+  /// \param previousId The id of the point before the specified point
+  /// \param currentId The id of the point
+  /// \param nextId The id of the point after the specified point
   /// \return Distance of the specified point from the line defined by the two points on either side
-  double ComputeError(vtkPoints* points, vtkIdList* lineIds, vtkIdType pointId);
+  double ComputeError(vtkPoints* points, vtkIdType previousId, vtkIdType currentId, vtkIdType nextId);
 
   /// Remove some points from the start and end of the line
   /// TODO: This step is based on trial and error, to fix an issue from the contour generated by
@@ -0,0 +1,507 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkPointData.h>
+#include <vtkFieldData.h>
+#include <vtkDoubleArray.h>
+#include <vtkIntArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include <vtkSMPTools.h>
+#include <vtkVariant.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Value range of fractional labelmaps, the same as in vtkClosedSurfaceToFractionalLabelmapConversionRule
+  const double FRACTIONAL_LABELMAP_MINIMUM_VALUE = -108.0;
+  const double FRACTIONAL_LABELMAP_MAXIMUM_VALUE = 108.0;
+
+  typedef vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane ContourPlane;
+
+  //----------------------------------------------------------------------------
+  /// Add the area right of a part of a contour edge within a row to the accumulator of the row.
+  /// Column c of the row covers [c, c+1], and the covered area of a voxel is the sum of the accumulator up to and
+  /// including its column. The accumulator has two more elements than the number of columns.
+  /// \param height Height of the edge part, negative if the edge goes downwards
+  void AccumulateRowSegment(double* rowAccumulator, int numberOfColumns, double x0, double x1, double height)
+  {
+    if (x0 > x1)
+    {
+      std::swap(x0, x1);
+    }
+    if (x1 - x0 < 1e-9)
+    {
+      // Vertical part: the voxel containing it is covered right of it, and the voxels further right are fully covered
+      double x = std::min(std::max((x0 + x1) / 2.0, 0.0), (double)numberOfColumns);
+      int column = (int)x;
+      rowAccumulator[column] += height * (column + 1 - x);
+      rowAccumulator[column+1] += height * (x - column);
+      return;
+    }
+
+    double heightPerWidth = height / (x1 - x0);
+    if (x0 < 0.0)
+    {
+      // The part left of the first column covers all voxels of the row
+      rowAccumulator[0] += heightPerWidth * (std::min(x1, 0.0) - x0);
+      if (x1 <= 0.0)
+      {
+        return;
+      }
+      x0 = 0.0;
+    }
+    if (x1 > numberOfColumns)
+    {
+      // The part right of the last column does not cover any voxel
+      if (x0 >= numberOfColumns)
+      {
+        return;
+      }
+      x1 = numberOfColumns;
+    }
+
+    // Clip the part against the columns. Each clipped piece covers the trapezoid right of it in its own voxel
+    for (int column = (int)x0; column < x1; ++column)
+    {
+      double left = std::max(x0, (double)column);
+      double right = std::min(x1, (double)(column + 1));
+      double pieceHeight = heightPerWidth * (right - left);
+      double middle = (left + right) / 2.0;
+      rowAccumulator[column] += pieceHeight * (column + 1 - middle);
+      rowAccumulator[column+1] += pieceHeight * (middle - column);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Clip a contour edge against the rows and add the area right of it to the accumulator.
+  /// Upward edges add and downward edges subtract area, multiplied by the weight of the contour
+  void AccumulateEdge(std::vector<double>& accumulator, int numberOfColumns, int numberOfRows,
+    const double* startPoint, const double* endPoint, double weight)
+  {
+    if (startPoint[1] == endPoint[1])
+    {
+      // Horizontal edges do not bound any area
+      return;
+    }
+    double direction = weight;
+    if (startPoint[1] > endPoint[1])
+    {
+      std::swap(startPoint, endPoint);
+      direction = -weight;
+    }
+
+    double slope = (endPoint[0] - startPoint[0]) / (endPoint[1] - startPoint[1]);
+    int firstRow = std::max((int)std::floor(startPoint[1]), 0);
+    int lastRow = std::min((int)std::ceil(endPoint[1]) - 1, numberOfRows - 1);
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+      double bottom = std::max(startPoint[1], (double)row);
+      double top = std::min(endPoint[1], (double)(row + 1));
+      if (top <= bottom)
+      {
+        continue;
+      }
+      double x0 = startPoint[0] + (bottom - startPoint[1]) * slope;
+      double x1 = startPoint[0] + (top - startPoint[1]) * slope;
+      AccumulateRowSegment(&accumulator[(size_t)row * (numberOfColumns + 2)], numberOfColumns, x0, x1, direction * (top - bottom));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Signed area of a contour given by 2D coordinates, positive if counter-clockwise
+  double GetSignedArea(const double* coordinates, int numberOfPoints)
+  {
+    double area = 0.0;
+    for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+    {
+      const double* point = coordinates + 2*pointIndex;
+      const double* nextPoint = coordinates + 2*((pointIndex+1) % numberOfPoints);
+      area += point[0] * nextPoint[1] - nextPoint[0] * point[1];
+    }
+    return area / 2.0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Determine if a point is inside a contour given by 2D coordinates (even-odd rule)
+  bool IsPointInContour(const double point[2], const double* coordinates, int numberOfPoints)
+  {
+    bool inside = false;
+    for (int pointIndex = 0, previousIndex = numberOfPoints - 1; pointIndex < numberOfPoints; previousIndex = pointIndex++)
+    {
+      const double* currentPoint = coordinates + 2*pointIndex;
+      const double* previousPoint = coordinates + 2*previousIndex;
+      if ( (currentPoint[1] > point[1]) != (previousPoint[1] > point[1])
+        && point[0] < currentPoint[0] + (point[1] - currentPoint[1]) * (previousPoint[0] - currentPoint[0]) / (previousPoint[1] - currentPoint[1]) )
+      {
+        inside = !inside;
+      }
+    }
+    return inside;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute the covered area of each voxel of the labelmap slices in the contour planes, in parallel.
+  /// Contours inside an odd number of other contours of the plane are holes, so their area is subtracted.
+  class PlaneCoverageFunctor
+  {
+  public:
+    PlaneCoverageFunctor(const std::vector<ContourPlane>& planes, const std::vector<char>& planeNeeded,
+      vtkMatrix4x4* worldToImageMatrix, int extent[6], std::vector< std::vector<float> >& planeCoverages)
+      : Planes(planes)
+      , PlaneNeeded(planeNeeded)
+      , PlaneCoverages(planeCoverages)
+    {
+      vtkMatrix4x4::DeepCopy(this->WorldToImage, worldToImageMatrix);
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = extent[i];
+      }
+    }
+
+    void operator()(vtkIdType beginPlane, vtkIdType endPlane)
+    {
+      for (vtkIdType planeIndex = beginPlane; planeIndex < endPlane; ++planeIndex)
+      {
+        this->ComputePlaneCoverage(planeIndex);
+      }
+    }
+
+    void ComputePlaneCoverage(vtkIdType planeIndex)
+    {
+      if (!this->PlaneNeeded[planeIndex])
+      {
+        return;
+      }
+
+      const ContourPlane& plane = this->Planes[planeIndex];
+      int numberOfColumns = this->Extent[1] - this->Extent[0] + 1;
+      int numberOfRows = this->Extent[3] - this->Extent[2] + 1;
+
+      // In-plane coordinates of the contour points, shifted so that voxel (column, row) covers [column, column+1] x [row, row+1]
+      vtkIdType numberOfPoints = plane.Offsets.back();
+      std::vector<double> coordinates(2*numberOfPoints);
+      for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+      {
+        const double* point = &plane.Coordinates[3*pointIndex];
+        for (int axis=0; axis<2; ++axis)
+        {
+          const double* matrixRow = this->WorldToImage + 4*axis;
+          coordinates[2*pointIndex+axis] = matrixRow[0]*point[0] + matrixRow[1]*point[1] + matrixRow[2]*point[2] + matrixRow[3]
+            - this->Extent[2*axis] + 0.5;
+        }
+      }
+
+      std::vector<double> accumulator((size_t)(numberOfColumns + 2) * numberOfRows, 0.0);
+      int numberOfContours = (int)plane.Offsets.size() - 1;
+      for (int contourIndex = 0; contourIndex < numberOfContours; ++contourIndex)
+      {
+        int numberOfContourPoints = (int)(plane.Offsets[contourIndex+1] - plane.Offsets[contourIndex]);
+        const double* contourCoordinates = &coordinates[2*plane.Offsets[contourIndex]];
+        double signedArea = (numberOfContourPoints < 3 ? 0.0 : GetSignedArea(contourCoordinates, numberOfContourPoints));
+        if (signedArea == 0.0)
+        {
+          continue;
+        }
+
+        // Nesting depth of the contour
+        int depth = 0;
+        for (int otherContourIndex = 0; otherContourIndex < numberOfContours; ++otherContourIndex)
+        {
+          int numberOfOtherContourPoints = (int)(plane.Offsets[otherContourIndex+1] - plane.Offsets[otherContourIndex]);
+          if ( otherContourIndex != contourIndex && numberOfOtherContourPoints >= 3
+            && IsPointInContour(contourCoordinates, &coordinates[2*plane.Offsets[otherContourIndex]], numberOfOtherContourPoints) )
+          {
+            ++depth;
+          }
+        }
+
+        // Counter-clockwise contours accumulate negative area, so the weight also normalizes the orientation
+        double weight = (depth % 2 == 0 ? 1.0 : -1.0) * (signedArea > 0.0 ? -1.0 : 1.0);
+        for (int pointIndex = 0; pointIndex < numberOfContourPoints; ++pointIndex)
+        {
+          AccumulateEdge(accumulator, numberOfColumns, numberOfRows, contourCoordinates + 2*pointIndex,
+            contourCoordinates + 2*((pointIndex+1) % numberOfContourPoints), weight);
+        }
+      }
+
+      std::vector<float>& coverage = this->PlaneCoverages[planeIndex];
+      coverage.resize((size_t)numberOfColumns * numberOfRows);
+      for (int row = 0; row < numberOfRows; ++row)
+      {
+        const double* rowAccumulator = &accumulator[(size_t)row * (numberOfColumns + 2)];
+        float* rowCoverage = &coverage[(size_t)row * numberOfColumns];
+        double coveredArea = 0.0;
+        for (int column = 0; column < numberOfColumns; ++column)
+        {
+          coveredArea += rowAccumulator[column];
+          rowCoverage[column] = (float)std::min(std::max(coveredArea, 0.0), 1.0);
+        }
+      }
+    }
+
+  private:
+    const std::vector<ContourPlane>& Planes;
+    const std::vector<char>& PlaneNeeded;
+    std::vector< std::vector<float> >& PlaneCoverages;
+    double WorldToImage[16];
+    int Extent[6];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute the fractional labelmap slices in parallel, from the covered areas of the planes weighted by the
+  /// overlap of their slabs with the slice
+  class SliceFractionFunctor
+  {
+  public:
+    SliceFractionFunctor(const std::vector<ContourPlane>& planes, const std::vector< std::vector<float> >& planeCoverages,
+      double originPosition, double sliceStep, int extent[6], char* voxels)
+      : Planes(planes)
+      , PlaneCoverages(planeCoverages)
+      , OriginPosition(originPosition)
+      , SliceStep(sliceStep)
+      , Voxels(voxels)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = extent[i];
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      for (vtkIdType sliceIndex = beginSlice; sliceIndex < endSlice; ++sliceIndex)
+      {
+        this->ComputeSlice(sliceIndex);
+      }
+    }
+
+    void ComputeSlice(vtkIdType sliceIndex)
+    {
+      vtkIdType sliceSize = (vtkIdType)(this->Extent[1] - this->Extent[0] + 1) * (this->Extent[3] - this->Extent[2] + 1);
+      double sliceThickness = fabs(this->SliceStep);
+      double slicePosition = this->OriginPosition + (this->Extent[4] + sliceIndex) * this->SliceStep;
+      double sliceMinimum = slicePosition - sliceThickness / 2.0;
+      double sliceMaximum = slicePosition + sliceThickness / 2.0;
+
+      std::vector<double> fractions(sliceSize, 0.0);
+      for (size_t planeIndex = 0; planeIndex < this->Planes.size(); ++planeIndex)
+      {
+        const ContourPlane& plane = this->Planes[planeIndex];
+        double overlap = std::min(sliceMaximum, plane.SlabMaximum) - std::max(sliceMinimum, plane.SlabMinimum);
+        if (overlap <= 0.0)
+        {
+          continue;
+        }
+        double weight = overlap / sliceThickness;
+        const std::vector<float>& coverage = this->PlaneCoverages[planeIndex];
+        for (vtkIdType voxelIndex = 0; voxelIndex < sliceSize; ++voxelIndex)
+        {
+          fractions[voxelIndex] += weight * coverage[voxelIndex];
+        }
+      }
+
+      char* sliceVoxels = this->Voxels + sliceIndex * sliceSize;
+      for (vtkIdType voxelIndex = 0; voxelIndex < sliceSize; ++voxelIndex)
+      {
+        double fraction = std::min(fractions[voxelIndex], 1.0);
+        sliceVoxels[voxelIndex] = (char)vtkMath::Round( FRACTIONAL_LABELMAP_MINIMUM_VALUE
+          + fraction * (FRACTIONAL_LABELMAP_MAXIMUM_VALUE - FRACTIONAL_LABELMAP_MINIMUM_VALUE) );
+      }
+    }
+
+  private:
+    const std::vector<ContourPlane>& Planes;
+    const std::vector< std::vector<float> >& PlaneCoverages;
+    double OriginPosition;
+    double SliceStep;
+    char* Voxels;
+    int Extent[6];
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToFractionalLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToFractionalLabelmapConversionRule::vtkPlanarContourToFractionalLabelmapConversionRule()
+{
+  this->ConversionParameters[vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()] = std::make_pair("0.0",
+    "Default thickness for contours if slice spacing cannot be calculated. If zero, then a single contour plane extends over one labelmap slice.");
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToFractionalLabelmapConversionRule::~vtkPlanarContourToFractionalLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlanarContourToFractionalLabelmapConversionRule::GetConversionCost(vtkDataObject* vtkNotUsed(sourceRepresentation)/*=NULL*/, vtkDataObject* vtkNotUsed(targetRepresentation)/*=NULL*/)
+{
+  // Rough input-independent guess (ms)
+  // Lower than the path through closed surface, so that this rule is chosen if only the fractional labelmap is needed
+  return 400;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToFractionalLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* fractionalLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!fractionalLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+  if (planarContourPolyData->GetNumberOfPoints() < 3 || planarContourPolyData->GetNumberOfLines() < 1)
+  {
+    vtkErrorMacro("Convert: Cannot create fractional labelmap from planar contour with number of points: " << planarContourPolyData->GetNumberOfPoints() << " and number of lines: " << planarContourPolyData->GetNumberOfLines());
+    return false;
+  }
+
+  // Collect the contours into planes
+  double defaultSliceThickness = vtkVariant(this->ConversionParameters[
+    vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()].first).ToDouble();
+  double contourNormal[3] = {0.0, 0.0, 1.0};
+  std::vector<ContourPlane> planes;
+  if (!vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes(planarContourPolyData, contourNormal, planes, defaultSliceThickness))
+  {
+    vtkErrorMacro("Convert: Failed to determine contour planes!");
+    return false;
+  }
+  int numberOfPlanes = (int)planes.size();
+
+  // Calculate output geometry so that the slabs of the first and last planes are included
+  vtkSmartPointer<vtkPolyData> slabPolyData = vtkSmartPointer<vtkPolyData>::New();
+  vtkPlanarContourToBinaryLabelmapConversionRule::CreateSlabBoundaryPolyData(planarContourPolyData, contourNormal, planes, slabPolyData);
+  if (!this->CalculateOutputGeometry(slabPolyData, fractionalLabelmap))
+  {
+    vtkErrorMacro("Convert: Failed to calculate output image geometry!");
+    return false;
+  }
+
+  // The covered areas can only be computed in the slices if the contours are parallel with them
+  double originPosition = 0.0;
+  double sliceStep = 0.0;
+  if (!vtkPlanarContourToBinaryLabelmapConversionRule::GetSlicePositionsAlongNormal(fractionalLabelmap, contourNormal, originPosition, sliceStep))
+  {
+    vtkDebugMacro("Convert: Contour planes are not parallel with the labelmap slices, converting through closed surface");
+    return this->ConvertThroughClosedSurface(planarContourPolyData, targetRepresentation);
+  }
+
+  // A single plane without default slice thickness extends over the thickness of one slice
+  if (numberOfPlanes == 1 && planes[0].SlabMinimum == planes[0].SlabMaximum)
+  {
+    planes[0].SlabMinimum = planes[0].Position - fabs(sliceStep) / 2.0;
+    planes[0].SlabMaximum = planes[0].Position + fabs(sliceStep) / 2.0;
+  }
+
+  // Allocate output image data
+  fractionalLabelmap->AllocateScalars(VTK_CHAR, 1);
+
+  // Specify the scalar range of values in the labelmap
+  vtkSmartPointer<vtkDoubleArray> scalarRange = vtkSmartPointer<vtkDoubleArray>::New();
+  scalarRange->SetName(vtkSegmentationConverter::GetScalarRangeFieldName());
+  scalarRange->InsertNextValue(FRACTIONAL_LABELMAP_MINIMUM_VALUE);
+  scalarRange->InsertNextValue(FRACTIONAL_LABELMAP_MAXIMUM_VALUE);
+  fractionalLabelmap->GetFieldData()->AddArray(scalarRange);
+
+  // Specify the surface threshold value for visualization
+  vtkSmartPointer<vtkDoubleArray> thresholdValue = vtkSmartPointer<vtkDoubleArray>::New();
+  thresholdValue->SetName(vtkSegmentationConverter::GetThresholdValueFieldName());
+  thresholdValue->InsertNextValue((FRACTIONAL_LABELMAP_MINIMUM_VALUE + FRACTIONAL_LABELMAP_MAXIMUM_VALUE) / 2.0);
+  fractionalLabelmap->GetFieldData()->AddArray(thresholdValue);
+
+  // Specify the interpolation type for visualization
+  vtkSmartPointer<vtkIntArray> interpolationType = vtkSmartPointer<vtkIntArray>::New();
+  interpolationType->SetName(vtkSegmentationConverter::GetInterpolationTypeFieldName());
+  interpolationType->InsertNextValue(VTK_LINEAR_INTERPOLATION);
+  fractionalLabelmap->GetFieldData()->AddArray(interpolationType);
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  fractionalLabelmap->GetExtent(extent);
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    // Empty output
+    return true;
+  }
+  char* voxels = static_cast<char*>(fractionalLabelmap->GetScalarPointerForExtent(extent));
+
+  // Only the planes whose slab overlaps with the slices are needed
+  double firstSlicePosition = originPosition + extent[4] * sliceStep;
+  double lastSlicePosition = originPosition + extent[5] * sliceStep;
+  double slicesMinimum = std::min(firstSlicePosition, lastSlicePosition) - fabs(sliceStep) / 2.0;
+  double slicesMaximum = std::max(firstSlicePosition, lastSlicePosition) + fabs(sliceStep) / 2.0;
+  std::vector<char> planeNeeded(numberOfPlanes, 0);
+  for (int planeIndex = 0; planeIndex < numberOfPlanes; ++planeIndex)
+  {
+    planeNeeded[planeIndex] = ( planes[planeIndex].SlabMaximum > slicesMinimum && planes[planeIndex].SlabMinimum < slicesMaximum );
+  }
+
+  // Compute covered areas in the planes
+  vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  fractionalLabelmap->GetWorldToImageMatrix(worldToImageMatrix);
+  std::vector< std::vector<float> > planeCoverages(numberOfPlanes);
+  PlaneCoverageFunctor coverageFunctor(planes, planeNeeded, worldToImageMatrix, extent, planeCoverages);
+  vtkSMPTools::For(0, numberOfPlanes, 1, coverageFunctor);
+
+  // Combine the planes overlapping each slice
+  SliceFractionFunctor fractionFunctor(planes, planeCoverages, originPosition, sliceStep, extent, voxels);
+  vtkSMPTools::For(0, extent[5] - extent[4] + 1, fractionFunctor);
+
+  fractionalLabelmap->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToFractionalLabelmapConversionRule::ConvertThroughClosedSurface(vtkPolyData* planarContourPolyData, vtkDataObject* targetRepresentation)
+{
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  vtkSmartPointer<vtkPolyData> closedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+  if (!closedSurfaceRule->Convert(planarContourPolyData, closedSurfacePolyData))
+  {
+    vtkErrorMacro("ConvertThroughClosedSurface: Failed to convert planar contour to closed surface!");
+    return false;
+  }
+  return this->Superclass::Convert(closedSurfacePolyData, targetRepresentation);
+}
@@ -0,0 +1,82 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToFractionalLabelmapConversionRule_h
+#define __vtkPlanarContourToFractionalLabelmapConversionRule_h
+
+// SegmentationCore includes
+#include "vtkClosedSurfaceToFractionalLabelmapConversionRule.h"
+#include "vtkSegmentationConverter.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+class vtkPolyData;
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) directly to
+///   fractional labelmap representation (vtkOrientedImageData type), without oversampling.
+///
+/// The fraction of each voxel covered by the structure is computed exactly, assuming that each contour plane
+/// extends over its slab (the positions closer to it than to the neighboring planes, see
+/// \sa vtkPlanarContourToBinaryLabelmapConversionRule). In each plane the area of the voxels covered by the contours
+/// is computed by clipping the contour edges against the rows and columns of the voxel grid. Contours inside
+/// other contours of the same plane are holes. The covered areas of the planes are then weighted by the overlap of
+/// their slabs with the voxel along the contour normal.
+/// Planes are processed in parallel. The scalar type, value range and field data of the output are the same as
+/// those of \sa vtkClosedSurfaceToFractionalLabelmapConversionRule.
+/// If the contour planes are not parallel with the slices of the output geometry, then the contours are converted
+/// through a closed surface instead.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToFractionalLabelmapConversionRule
+  : public vtkClosedSurfaceToFractionalLabelmapConversionRule
+{
+public:
+  static vtkPlanarContourToFractionalLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToFractionalLabelmapConversionRule, vtkClosedSurfaceToFractionalLabelmapConversionRule);
+  virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
+
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
+  /// Get the cost of the conversion.
+  virtual unsigned int GetConversionCost(vtkDataObject* sourceRepresentation=NULL, vtkDataObject* targetRepresentation=NULL) VTK_OVERRIDE;
+
+  /// Human-readable name of the converter rule
+  virtual const char* GetName() VTK_OVERRIDE { return "Planar contour to fractional labelmap"; };
+
+  /// Human-readable name of the source representation
+  virtual const char* GetSourceRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(); };
+
+  /// Human-readable name of the target representation
+  virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationFractionalLabelmapRepresentationName(); };
+
+protected:
+  /// Convert through closed surface, used if the contours cannot be rasterized directly into the labelmap slices
+  bool ConvertThroughClosedSurface(vtkPolyData* planarContourPolyData, vtkDataObject* targetRepresentation);
+
+protected:
+  vtkPlanarContourToFractionalLabelmapConversionRule();
+  ~vtkPlanarContourToFractionalLabelmapConversionRule();
+
+private:
+  vtkPlanarContourToFractionalLabelmapConversionRule(const vtkPlanarContourToFractionalLabelmapConversionRule&); // Not implemented
+  void operator=(const vtkPlanarContourToFractionalLabelmapConversionRule&); // Not implemented
+};
+
+#endif // __vtkPlanarContourToFractionalLabelmapConversionRule_h
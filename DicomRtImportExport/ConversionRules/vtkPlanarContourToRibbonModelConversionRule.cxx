@@ -20,31 +20,28 @@
 
 // Segmentations includes
 #include "vtkPlanarContourToRibbonModelConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
 
 // VTK includes
 #include <vtkObjectFactory.h>
-#include <vtkVector.h>
+#include <vtkSmartPointer.h>
 #include <vtkPolyData.h>
-#include <vtkCell.h>
-#include <vtkIdList.h>
-#include <vtkPlane.h>
-#include <vtkCleanPolyData.h>
-#include <vtkPolyDataNormals.h>
-#include <vtkRibbonFilter.h>
+#include <vtkPointData.h>
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkFloatArray.h>
+#include <vtkVariant.h>
 #include <vtkMath.h>
 
+// STD includes
+#include <map>
+#include <sstream>
+
 //----------------------------------------------------------------------------
 // Utility functions
 namespace
 {
-  vtkVector3d operator -(const vtkVector3d& a, const vtkVector3d& b)
-  {
-    vtkVector3d result;
-    result.SetX(a.GetX() - b.GetX());
-    result.SetY(a.GetY() - b.GetY());
-    result.SetZ(a.GetZ() - b.GetZ());
-    return result;
-  }
+  typedef vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane ContourPlane;
 
   bool AreEqualWithTolerance(double a, double b)
   {
@@ -86,7 +83,8 @@ vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToRibbonModelConversionRule
 //----------------------------------------------------------------------------
 vtkPlanarContourToRibbonModelConversionRule::vtkPlanarContourToRibbonModelConversionRule()
 {
-  //this->ConversionParameters[GetXYParameterName()] = std::make_pair("value", "description");
+  this->ConversionParameters[vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()] = std::make_pair("0.0",
+    "Default thickness for contours if slice spacing cannot be calculated.");
 }
 
 //----------------------------------------------------------------------------
@@ -152,232 +150,146 @@ bool vtkPlanarContourToRibbonModelConversionRule::Convert(vtkDataObject* sourceR
     return false;
   }
 
-  // Compute plane spacing of contours
-  vtkSmartPointer<vtkPlane> contoursPlane = vtkSmartPointer<vtkPlane>::New();
-  double sliceThickness = this->ComputeContourPlaneSpacing(planarContourPolyData, contoursPlane);
-
-  // Remove coincident points (if there are multiple contour points at the same position then the ribbon filter fails)
-  vtkSmartPointer<vtkCleanPolyData> cleaner = vtkSmartPointer<vtkCleanPolyData>::New();
-  cleaner->SetInputData(planarContourPolyData);
-
-  // Convert to ribbon using vtkRibbonFilter
-  vtkSmartPointer<vtkRibbonFilter> ribbonFilter = vtkSmartPointer<vtkRibbonFilter>::New();
-  ribbonFilter->SetInputConnection(cleaner->GetOutputPort());
-  ribbonFilter->SetDefaultNormal(contoursPlane->GetNormal());
-  ribbonFilter->UseDefaultNormalOn();
-  ribbonFilter->SetWidth(sliceThickness / 2.0);
-  ribbonFilter->SetAngle(90.0);
-  ribbonFilter->Update();
-
-  vtkSmartPointer<vtkPolyDataNormals> normalFilter = vtkSmartPointer<vtkPolyDataNormals>::New();
-  normalFilter->SetInputConnection(ribbonFilter->GetOutputPort());
-  normalFilter->ConsistencyOn();
-  normalFilter->Update();
-
-  ribbonModelPolyData->DeepCopy(normalFilter->GetOutput());
-
-  return true;
-}
-
-//----------------------------------------------------------------------------
-bool vtkPlanarContourToRibbonModelConversionRule::ComputePlaneForContour(vtkPoints* contourPoints, vtkCell* contourCell, vtkPlane* contourPlane)
-{
-  if (!contourPoints || !contourCell || !contourPlane)
+  // Compute the normal and the plane positions of the contours
+  double contourNormal[3] = {0.0, 0.0, 1.0};
+  std::vector<ContourPlane> planes;
+  if (!vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes(planarContourPolyData, contourNormal, planes))
   {
-    vtkErrorMacro("ComputePlaneForContour: Invalid arguments!");
+    vtkErrorMacro("Convert: Failed to determine contour planes!");
     return false;
   }
 
-  // Get point indices
-  vtkIdList* currentContourPointIds = contourCell->GetPointIds();
-  int numberOfPoints = currentContourPointIds->GetNumberOfIds();
-  if (numberOfPoints < 3)
-  {
-    vtkWarningMacro("ComputePlaneForContour: Contour does not contain enough points to extract a planar equation.");
-    return false;
-  }
-
-  // Compute equation of the current plane from the first point, and two other points about equal number of points away from the first one.
-  // This heuristic method attempts to get an as accurate plane normal vector as possible by maximizing expected distance between plane points.
-  int firstPointIndex = currentContourPointIds->GetId(0);
-  int secondPointIndex = currentContourPointIds->GetId(numberOfPoints / 3);
-  int thirdPointIndex = currentContourPointIds->GetId(2 * numberOfPoints / 3);
-  // Sanity check of indices
-  if (secondPointIndex == firstPointIndex || secondPointIndex == thirdPointIndex)
-  {
-    vtkErrorMacro("ComputePlaneForContour: Invalid contour point indices for computing plane equation. This is probably a bug, please report!");
-    return false;
-  }
-
-  // Get plane points
-  double firstPointArray[3] = {0.0,0.0,0.0};
-  contourPoints->GetPoint(firstPointIndex, firstPointArray);
-  double secondPointArray[3] = {0.0,0.0,0.0};
-  contourPoints->GetPoint(secondPointIndex, secondPointArray);
-  double thirdPointArray[3] = {0.0,0.0,0.0};
-  contourPoints->GetPoint(thirdPointIndex, thirdPointArray);
-  vtkVector3d firstPlanePoint(firstPointArray[0], firstPointArray[1], firstPointArray[2]);
-  vtkVector3d secondPlanePoint(secondPointArray[0], secondPointArray[1], secondPointArray[2]);
-  vtkVector3d thirdPlanePoint(thirdPointArray[0], thirdPointArray[1], thirdPointArray[2]);
-  // Compute plane vectors: two vectors on the plane, and the normal
-  vtkVector3d currentPlaneIVector(secondPlanePoint - firstPlanePoint);
-  vtkVector3d currentPlaneJVector(thirdPlanePoint - firstPlanePoint);
-  vtkVector3d currentPlaneKVector(currentPlaneIVector.Cross(currentPlaneJVector));
-
-  // Attempt to compute plane equation with brute force
-  // if the heuristic choice of plane points produces collinear vectors
-  if (currentPlaneKVector.GetX() == 0 && currentPlaneKVector.GetY() == 0 && currentPlaneKVector.GetZ() == 0)
+  // Compute plane spacing of contours
+  double sliceThickness = this->ComputeContourPlaneSpacing(planes);
+  double halfWidth = sliceThickness / 2.0;
+
+  // Generate the ribbons of all contours
+  vtkSmartPointer<vtkPoints> ribbonPoints = vtkSmartPointer<vtkPoints>::New();
+  ribbonPoints->Allocate(2 * planarContourPolyData->GetNumberOfPoints());
+  vtkSmartPointer<vtkFloatArray> ribbonNormals = vtkSmartPointer<vtkFloatArray>::New();
+  ribbonNormals->SetName("Normals");
+  ribbonNormals->SetNumberOfComponents(3);
+  ribbonNormals->Allocate(6 * planarContourPolyData->GetNumberOfPoints());
+  vtkSmartPointer<vtkCellArray> ribbonStrips = vtkSmartPointer<vtkCellArray>::New();
+
+  std::vector<const double*> contourPoints;
+  for (std::vector<ContourPlane>::const_iterator planeIt = planes.begin(); planeIt != planes.end(); ++planeIt)
   {
-    for (int pointIndex=0; pointIndex<numberOfPoints-2; ++pointIndex)
+    int numberOfContours = (int)planeIt->Offsets.size() - 1;
+    for (int contourIndex = 0; contourIndex < numberOfContours; ++contourIndex)
     {
-      contourPoints->GetPoint(pointIndex, firstPointArray);
-      contourPoints->GetPoint(pointIndex+1, secondPointArray);
-      contourPoints->GetPoint(pointIndex+2, thirdPointArray);
-      firstPlanePoint = vtkVector3d(firstPointArray[0], firstPointArray[1], firstPointArray[2]);
-      secondPlanePoint = vtkVector3d(secondPointArray[0], secondPointArray[1], secondPointArray[2]);
-      thirdPlanePoint = vtkVector3d(thirdPointArray[0], thirdPointArray[1], thirdPointArray[2]);
-      currentPlaneIVector = secondPlanePoint - firstPlanePoint;
-      currentPlaneJVector = thirdPlanePoint - firstPlanePoint;
-      currentPlaneKVector = currentPlaneIVector.Cross(currentPlaneJVector);
-
-      if (!(currentPlaneKVector.GetX() == 0 && currentPlaneKVector.GetY() == 0 && currentPlaneKVector.GetZ() == 0))
+      // Remove coincident points (the same position repeated would make the ribbon normals undefined)
+      contourPoints.clear();
+      for (vtkIdType pointIndex = planeIt->Offsets[contourIndex]; pointIndex < planeIt->Offsets[contourIndex+1]; ++pointIndex)
       {
-        break;
+        const double* point = &planeIt->Coordinates[3*pointIndex];
+        if (contourPoints.empty() || vtkMath::Distance2BetweenPoints(point, contourPoints.back()) > 0.0)
+        {
+          contourPoints.push_back(point);
+        }
       }
-    }
+      if (contourPoints.size() > 1 && vtkMath::Distance2BetweenPoints(contourPoints.front(), contourPoints.back()) == 0.0)
+      {
+        contourPoints.pop_back();
+      }
+      int numberOfContourPoints = (int)contourPoints.size();
+      if (numberOfContourPoints < 2)
+      {
+        continue;
+      }
+      bool closed = (numberOfContourPoints > 2);
 
-    // Check for valid plane vector and report failure if all attempts failed to produce a valid one
-    if (currentPlaneKVector.GetX() == 0 && currentPlaneKVector.GetY() == 0 && currentPlaneKVector.GetZ() == 0)
-    {
-      vtkErrorMacro("ComputePlaneForContour: All points in contour plane produce co-linear vectors. Unable to determine equation of the plane.");
-      return false;
+      // Each contour point becomes a pair of ribbon points on the two sides of the contour plane.
+      // The normal of the ribbon is perpendicular to the contour within the plane
+      vtkIdType firstRibbonPointId = ribbonPoints->GetNumberOfPoints();
+      double ribbonNormal[3] = {0.0, 0.0, 0.0};
+      for (int pointIndex = 0; pointIndex < numberOfContourPoints; ++pointIndex)
+      {
+        const double* point = contourPoints[pointIndex];
+        const double* previousPoint = contourPoints[ pointIndex > 0 ? pointIndex-1 : (closed ? numberOfContourPoints-1 : 0) ];
+        const double* nextPoint = contourPoints[ pointIndex < numberOfContourPoints-1 ? pointIndex+1 : (closed ? 0 : pointIndex) ];
+        double tangent[3] = { nextPoint[0]-previousPoint[0], nextPoint[1]-previousPoint[1], nextPoint[2]-previousPoint[2] };
+        double pointNormal[3] = {0.0, 0.0, 0.0};
+        vtkMath::Cross(tangent, contourNormal, pointNormal);
+        if (vtkMath::Normalize(pointNormal) > 0.0)
+        {
+          ribbonNormal[0] = pointNormal[0];
+          ribbonNormal[1] = pointNormal[1];
+          ribbonNormal[2] = pointNormal[2];
+        }
+
+        for (int side=0; side<2; ++side)
+        {
+          double offset = (side ? halfWidth : -halfWidth);
+          ribbonPoints->InsertNextPoint( point[0] + offset*contourNormal[0],
+            point[1] + offset*contourNormal[1], point[2] + offset*contourNormal[2] );
+          ribbonNormals->InsertNextTuple(ribbonNormal);
+        }
+      }
+
+      ribbonStrips->InsertNextCell(2 * numberOfContourPoints + (closed ? 2 : 0));
+      for (int pointIndex = 0; pointIndex < numberOfContourPoints; ++pointIndex)
+      {
+        ribbonStrips->InsertCellPoint(firstRibbonPointId + 2*pointIndex);
+        ribbonStrips->InsertCellPoint(firstRibbonPointId + 2*pointIndex + 1);
+      }
+      if (closed)
+      {
+        ribbonStrips->InsertCellPoint(firstRibbonPointId);
+        ribbonStrips->InsertCellPoint(firstRibbonPointId + 1);
+      }
     }
   }
 
-  // Normalize normal vector
-  currentPlaneKVector.Normalize();
-
-  // Setup output computed plane
-  contourPlane->SetNormal(currentPlaneKVector.GetX(), currentPlaneKVector.GetY(), currentPlaneKVector.GetZ());
-  contourPlane->SetOrigin(firstPlanePoint.GetX(), firstPlanePoint.GetY(), firstPlanePoint.GetZ());
+  ribbonModelPolyData->Initialize();
+  ribbonModelPolyData->SetPoints(ribbonPoints);
+  ribbonModelPolyData->SetStrips(ribbonStrips);
+  ribbonModelPolyData->GetPointData()->SetNormals(ribbonNormals);
 
   return true;
 }
 
 //----------------------------------------------------------------------------
-double vtkPlanarContourToRibbonModelConversionRule::ComputeContourPlaneSpacing(vtkPolyData* planarContourPolyData, vtkPlane* contoursPlane)
+double vtkPlanarContourToRibbonModelConversionRule::ComputeContourPlaneSpacing(const std::vector<ContourPlane>& planes)
 {
   // Check input planar contour for suitable number of planes
-  int numberOfPlanes = planarContourPolyData->GetNumberOfCells();
-  if (!numberOfPlanes)
-  {
-    vtkErrorMacro("ComputeContourPlaneSpacing: Empty planar contour. Returning default spacing 1.0.");
-    return 1.0;
-  }
-  if (numberOfPlanes < 2)
+  if (planes.size() < 2)
   {
+    double defaultSliceThickness = vtkVariant(this->ConversionParameters[
+      vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()].first).ToDouble();
+    if (defaultSliceThickness > 0.0)
+    {
+      return defaultSliceThickness;
+    }
     vtkErrorMacro("ComputeContourPlaneSpacing: Less than two planes detected, thus it is not possible to calculate plane spacing. Returning default spacing 1.0");
     return 1.0;
   }
 
-  // Get all contour points
-  vtkPoints* points = planarContourPolyData->GetPoints();
-
   // Computed output variables
   std::vector<double> planeSpacingValues;
   bool consistentPlaneSpacing = true;
   double distanceBetweenContourPlanes = -1.0; // The found distance between planes if consistent
 
-  // All contour planes, with their distances from the first plane
-  std::map< vtkSmartPointer<vtkPlane>, double > contourPlanes;
-  double firstNormal[3] = {0.0,0.0,0.0};
-  double firstOrigin[3] = {0.0,0.0,0.0};
-
-  // Iterate over each contour in the set, computing planar spacing values for every contour
-  for (int contourIndex = 0; contourIndex < planarContourPolyData->GetNumberOfCells(); ++contourIndex)
+  // Compute distances between adjacent planes. The planes are sorted by position, and contours on the same plane
+  // are already merged, so all distances are positive
+  for (size_t planeIndex = 1; planeIndex < planes.size(); ++planeIndex)
   {
-    // Get contour cell
-    vtkCell* currentContour = planarContourPolyData->GetCell(contourIndex);
-
-    // Compute contour plane
-    vtkSmartPointer<vtkPlane> currentContourPlane = vtkSmartPointer<vtkPlane>::New();
-    bool validPlane = this->ComputePlaneForContour(points, currentContour, currentContourPlane);
-    if (!validPlane)
-    {
-      vtkWarningMacro("ComputeContourPlaneSpacing: Unable to calculate plane for contour " << contourIndex << ". Skipping contour.");
-      continue;
-    }
-
-    // Store first plane parameters to compute distances
-    if (contourPlanes.empty())
-    {
-      currentContourPlane->GetNormal(firstNormal);
-      currentContourPlane->GetOrigin(firstOrigin);
-      contourPlanes[currentContourPlane] = 0.0;
+    double currentDistance = planes[planeIndex].Position - planes[planeIndex-1].Position;
+    planeSpacingValues.push_back(currentDistance);
 
-      // Set first valid plane as output contours plane
-      if (contoursPlane)
-      {
-        contoursPlane->SetOrigin(currentContourPlane->GetOrigin());
-        contoursPlane->SetNormal(currentContourPlane->GetNormal());
-      }
-    }
-    // Compute distance from first plane (also check if they are parallel)
-    else
+    // Store current spacing as found spacing if has not been set
+    if (distanceBetweenContourPlanes == -1.0)
     {
-      double normal[3] = {0.0,0.0,0.0};
-      currentContourPlane->GetNormal(normal);
-      // We accept normal vectors with the exact opposite direction, so we accept if their dot product is 1 or -1 (normal vectors have magnitude of 1)
-      double dotProduct = (normal[0]*firstNormal[0]) + (normal[1]*firstNormal[1]) + (normal[2]*firstNormal[2]);
-      if (!AreEqualWithTolerance(fabs(dotProduct), 1.0))
-      {
-        vtkErrorMacro("ComputeContourPlaneSpacing: Contour planes in structures set are not parallel!");
-      }
-
-      // Store distance of current plane from first plane
-      double distanceFromFirstPlane = vtkPlane::DistanceToPlane(firstOrigin, normal, currentContourPlane->GetOrigin());
-      contourPlanes[currentContourPlane] = distanceFromFirstPlane;
+      distanceBetweenContourPlanes = currentDistance;
     }
-  } // For all contour planes
-
-  // Order computed contour planes
-  std::map< double, vtkSmartPointer<vtkPlane> > orderedContourPlanes;
-  std::map< vtkSmartPointer<vtkPlane>, double >::iterator planesIt;
-  for (planesIt=contourPlanes.begin(); planesIt != contourPlanes.end(); ++planesIt)
-  {
-    // Swap map to have the ordering by distance from first plane
-    orderedContourPlanes[planesIt->second] = planesIt->first;
-  }
 
-  // Compute distances between adjacent planes
-  std::map< double, vtkSmartPointer<vtkPlane> >::iterator orderedPlanesIt;
-  double previousDistance = 0.0;
-  for (orderedPlanesIt=orderedContourPlanes.begin(); orderedPlanesIt != orderedContourPlanes.end(); ++orderedPlanesIt)
-  {
-    if (orderedPlanesIt != orderedContourPlanes.begin()) // We skip the first one, just save its distance as previous
+    // Check for inconsistency
+    if ( !AreEqualWithTolerance(currentDistance, distanceBetweenContourPlanes)
+      && consistentPlaneSpacing ) // Only prompt the warning once
     {
-      double currentDistance = fabs(orderedPlanesIt->first - previousDistance);
-      if (!AreEqualWithTolerance(currentDistance, 0.0))
-      {
-        // Only add spacing value if it's not 0 - multiple contours may be drawn on the same plane and it's not considered for slice thickness computation
-        planeSpacingValues.push_back(currentDistance);
-
-        // Store current spacing as found spacing if has not been set
-        if (distanceBetweenContourPlanes == -1.0)
-        {
-          distanceBetweenContourPlanes = currentDistance;
-        }
-
-        // Check for inconsistency
-        if ( !AreEqualWithTolerance(currentDistance, distanceBetweenContourPlanes)
-          && consistentPlaneSpacing ) // Only prompt the warning once
-        {
-          vtkWarningMacro("ComputeContourPlaneSpacing: Contour does not have consistent plane spacing (" << currentDistance << " != " << distanceBetweenContourPlanes << "). Using majority spacing value.");
-          consistentPlaneSpacing = false;
-        }
-      } // If non-zero
+      vtkWarningMacro("ComputeContourPlaneSpacing: Contour does not have consistent plane spacing (" << currentDistance << " != " << distanceBetweenContourPlanes << "). Using majority spacing value.");
+      consistentPlaneSpacing = false;
     }
-    previousDistance = orderedPlanesIt->first;
   }
 
   // Calculate the majority value for the plane spacing from plane spacing values if inconsistent spacing was found
@@ -28,17 +28,22 @@
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+
 #include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
 
 class vtkPolyData;
-class vtkPoints;
-class vtkCell;
-class vtkPlane;
 
 /// \ingroup DicomRtImportImportExportConversionRules
 /// \brief Convert planar contour representation (vtkPolyData type) to ribbon
 ///   model representation (also vtkPolyData) by thickening the contours along
 ///   a normal vector orthogonal to the planes
+///
+/// The contour normal and the plane positions are computed in a single pass over the contours, then the ribbon
+/// points, normals and triangle strips of all contours are generated directly. Each contour becomes one triangle
+/// strip, in which each contour point is replaced by a pair of points moved along the contour normal by half of the
+/// plane spacing. This structure is used by \sa vtkRibbonModelToBinaryLabelmapConversionRule to rasterize the ribbons.
 class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToRibbonModelConversionRule
   : public vtkSegmentationConverterRule
 {
@@ -73,17 +78,12 @@ public:
   virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSlicerRtCommon::SEGMENTATION_RIBBON_MODEL_REPRESENTATION_NAME; };
 
 protected:
-  /// Compute plane for a given contour
-  /// \param contourPoints Point list containing all the points (from which \sa contourCell selects a subset)
-  /// \param contourCell Input contour cell, indices of the points in \sa contourPoints belonging to the contour
-  /// \param contourPlane Computed contour plane (output argument)
-  bool ComputePlaneForContour(vtkPoints* contourPoints, vtkCell* contourCell, vtkPlane* contourPlane);
-
   /// Determine the distance between contour planes based on the actual planar contour data
-  /// \param planarContourPolyData Input poly data containing the planar contours
-  /// \param contoursPlane Output argument for plane of the contours
-  /// \return Computed plane spacing. 1mm in case of critical errors (so that the ribbon can be visualized in all cases)
-  double ComputeContourPlaneSpacing(vtkPolyData* planarContourPolyData, vtkPlane* contoursPlane);
+  /// \param planes Contour planes sorted by their position \sa vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes
+  /// \return Computed plane spacing. If it cannot be computed, then the default slice thickness conversion parameter
+  ///   (which is set for the whole structure set on import), or 1mm if that is not set either (so that the ribbon
+  ///   can be visualized in all cases)
+  double ComputeContourPlaneSpacing(const std::vector<vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane>& planes);
 
 protected:
   vtkPlanarContourToRibbonModelConversionRule();
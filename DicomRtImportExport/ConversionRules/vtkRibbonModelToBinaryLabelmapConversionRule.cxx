@@ -20,9 +20,30 @@
 
 // DicomRtImportExport includes
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
 
 // VTK includes
 #include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkMath.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  /// Maximum difference between the vectors of the ribbon point pairs, in mm. Larger differences mean that the ribbons
+  /// are not of the same width and direction, so the ribbon model is converted through the stencil instead
+  const double RIBBON_OFFSET_TOLERANCE = 0.01;
+}
 
 //----------------------------------------------------------------------------
 vtkSegmentationConverterRuleNewMacro(vtkRibbonModelToBinaryLabelmapConversionRule);
@@ -36,3 +57,134 @@ vtkRibbonModelToBinaryLabelmapConversionRule::vtkRibbonModelToBinaryLabelmapConv
 vtkRibbonModelToBinaryLabelmapConversionRule::~vtkRibbonModelToBinaryLabelmapConversionRule()
 {
 }
+
+//----------------------------------------------------------------------------
+bool vtkRibbonModelToBinaryLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* ribbonModelPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!ribbonModelPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!binaryLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+
+  // Recover the contours and their planes from the ribbons
+  vtkSmartPointer<vtkPolyData> planarContourPolyData = vtkSmartPointer<vtkPolyData>::New();
+  double ribbonOffset[3] = {0.0, 0.0, 0.0};
+  double contourNormal[3] = {0.0, 0.0, 1.0};
+  std::vector<vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane> planes;
+  if ( !this->ExtractRibbonContours(ribbonModelPolyData, planarContourPolyData, ribbonOffset)
+    || !vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes(planarContourPolyData, contourNormal, planes) )
+  {
+    vtkDebugMacro("Convert: Contours cannot be recovered from the ribbon model, converting as closed surface");
+    return this->Superclass::Convert(sourceRepresentation, targetRepresentation);
+  }
+  double halfWidth = fabs(vtkMath::Dot(ribbonOffset, contourNormal)) / 2.0;
+  if (halfWidth == 0.0)
+  {
+    vtkDebugMacro("Convert: Ribbon model has zero width, converting as closed surface");
+    return this->Superclass::Convert(sourceRepresentation, targetRepresentation);
+  }
+
+  // Each plane fills the slices within the ribbon width. If the ribbons of adjacent planes overlap,
+  // then the overlapping part is filled from the lower plane
+  for (size_t planeIndex = 0; planeIndex < planes.size(); ++planeIndex)
+  {
+    vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane& plane = planes[planeIndex];
+    plane.SlabMinimum = plane.Position - halfWidth;
+    if (planeIndex > 0)
+    {
+      plane.SlabMinimum = std::max(plane.SlabMinimum, planes[planeIndex-1].SlabMaximum);
+    }
+    plane.SlabMaximum = std::max(plane.Position + halfWidth, plane.SlabMinimum);
+  }
+
+  vtkSmartPointer<vtkPolyData> slabPolyData = vtkSmartPointer<vtkPolyData>::New();
+  vtkPlanarContourToBinaryLabelmapConversionRule::CreateSlabBoundaryPolyData(planarContourPolyData, contourNormal, planes, slabPolyData);
+  if (!this->CalculateOutputGeometry(slabPolyData, binaryLabelmap))
+  {
+    vtkErrorMacro("Convert: Failed to calculate output image geometry!");
+    return false;
+  }
+
+  double originPosition = 0.0;
+  double sliceStep = 0.0;
+  if (!vtkPlanarContourToBinaryLabelmapConversionRule::GetSlicePositionsAlongNormal(binaryLabelmap, contourNormal, originPosition, sliceStep))
+  {
+    vtkDebugMacro("Convert: Ribbons are not parallel with the labelmap slices, converting as closed surface");
+    return this->Superclass::Convert(sourceRepresentation, targetRepresentation);
+  }
+
+  return vtkPlanarContourToBinaryLabelmapConversionRule::RasterizeContourPlanes(planes, originPosition, sliceStep, binaryLabelmap);
+}
+
+//----------------------------------------------------------------------------
+bool vtkRibbonModelToBinaryLabelmapConversionRule::ExtractRibbonContours(vtkPolyData* ribbonModelPolyData, vtkPolyData* planarContourPolyData, double ribbonOffset[3])
+{
+  vtkPoints* ribbonPoints = ribbonModelPolyData->GetPoints();
+  vtkCellArray* ribbonStrips = ribbonModelPolyData->GetStrips();
+  if ( !ribbonPoints || !ribbonStrips || ribbonStrips->GetNumberOfCells() == 0
+    || ribbonModelPolyData->GetNumberOfPolys() > 0 )
+  {
+    return false;
+  }
+
+  vtkSmartPointer<vtkPoints> contourPoints = vtkSmartPointer<vtkPoints>::New();
+  contourPoints->Allocate(ribbonPoints->GetNumberOfPoints() / 2);
+  vtkSmartPointer<vtkCellArray> contourLines = vtkSmartPointer<vtkCellArray>::New();
+  bool firstPair = true;
+  vtkIdType numberOfStripPoints = 0;
+  vtkIdType* stripPointIds = NULL;
+  for (ribbonStrips->InitTraversal(); ribbonStrips->GetNextCell(numberOfStripPoints, stripPointIds); )
+  {
+    if (numberOfStripPoints < 4 || numberOfStripPoints % 2 != 0)
+    {
+      return false;
+    }
+
+    // The first pair is repeated at the end of the strip of closed contours
+    vtkIdType numberOfPairs = numberOfStripPoints / 2;
+    if ( numberOfPairs > 2 && stripPointIds[numberOfStripPoints-2] == stripPointIds[0]
+      && stripPointIds[numberOfStripPoints-1] == stripPointIds[1] )
+    {
+      --numberOfPairs;
+    }
+
+    contourLines->InsertNextCell(numberOfPairs);
+    for (vtkIdType pairIndex = 0; pairIndex < numberOfPairs; ++pairIndex)
+    {
+      double lowerPoint[3] = {0.0, 0.0, 0.0};
+      double upperPoint[3] = {0.0, 0.0, 0.0};
+      ribbonPoints->GetPoint(stripPointIds[2*pairIndex], lowerPoint);
+      ribbonPoints->GetPoint(stripPointIds[2*pairIndex+1], upperPoint);
+      double pairOffset[3] = {0.0, 0.0, 0.0};
+      vtkMath::Subtract(upperPoint, lowerPoint, pairOffset);
+      if (firstPair)
+      {
+        ribbonOffset[0] = pairOffset[0];
+        ribbonOffset[1] = pairOffset[1];
+        ribbonOffset[2] = pairOffset[2];
+        firstPair = false;
+      }
+      else if (vtkMath::Distance2BetweenPoints(pairOffset, ribbonOffset) > RIBBON_OFFSET_TOLERANCE * RIBBON_OFFSET_TOLERANCE)
+      {
+        // The contours cannot be recovered with a single ribbon width
+        return false;
+      }
+      contourLines->InsertCellPoint( contourPoints->InsertNextPoint( (lowerPoint[0] + upperPoint[0]) / 2.0,
+        (lowerPoint[1] + upperPoint[1]) / 2.0, (lowerPoint[2] + upperPoint[2]) / 2.0 ) );
+    }
+  }
+
+  planarContourPolyData->Initialize();
+  planarContourPolyData->SetPoints(contourPoints);
+  planarContourPolyData->SetLines(contourLines);
+  return true;
+}
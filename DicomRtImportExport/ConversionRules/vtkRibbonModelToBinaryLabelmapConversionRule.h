@@ -30,18 +30,29 @@
 
 #include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
 
+class vtkPolyData;
+
 /// \ingroup DicomRtImportImportExportConversionRules
 /// \brief Convert ribbon model representation (vtkPolyData type) to binary
-///   labelmap representation (vtkOrientedImageData type). The conversion algorithm
-///   is the same as the base class \sa vtkClosedSurfaceToBinaryLabelmapConversionRule
+///   labelmap representation (vtkOrientedImageData type).
+///
+/// Ribbons created by \sa vtkPlanarContourToRibbonModelConversionRule contain one triangle strip for each contour,
+/// made of pairs of points on the two sides of the contour plane. The contours are recovered from the midpoints of
+/// the pairs, and rasterized directly into the slices within the ribbon width using
+/// \sa vtkPlanarContourToBinaryLabelmapConversionRule::RasterizeContourPlanes.
+/// Other ribbon models, including those whose point pairs are not all the same distance and direction apart,
+/// are converted using the algorithm of the base class \sa vtkClosedSurfaceToBinaryLabelmapConversionRule
 class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkRibbonModelToBinaryLabelmapConversionRule
   : public vtkClosedSurfaceToBinaryLabelmapConversionRule
 {
 public:
   static vtkRibbonModelToBinaryLabelmapConversionRule* New();
-  vtkTypeMacro(vtkRibbonModelToBinaryLabelmapConversionRule, vtkSegmentationConverterRule);
+  vtkTypeMacro(vtkRibbonModelToBinaryLabelmapConversionRule, vtkClosedSurfaceToBinaryLabelmapConversionRule);
   virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
 
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
   /// Human-readable name of the converter rule
   virtual const char* GetName() VTK_OVERRIDE { return "Ribbon model to binary labelmap"; };
   
@@ -51,6 +62,15 @@ public:
   /// Human-readable name of the target representation
   virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(); };
 
+protected:
+  /// Recover the contours from the triangle strips of a ribbon model
+  /// \param ribbonModelPolyData Input ribbon model
+  /// \param planarContourPolyData Output contours, made of the midpoints of the ribbon point pairs
+  /// \param ribbonOffset Output vector between the two points of the first pair
+  /// \return False if the ribbon model does not consist of strips of point pairs, or if the vector between the
+  ///   two points of any pair differs from ribbonOffset
+  bool ExtractRibbonContours(vtkPolyData* ribbonModelPolyData, vtkPolyData* planarContourPolyData, double ribbonOffset[3]);
+
 protected:
   vtkRibbonModelToBinaryLabelmapConversionRule();
   ~vtkRibbonModelToBinaryLabelmapConversionRule();
@@ -0,0 +1,322 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtConversionCache.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkFieldData.h>
+#include <vtkStringArray.h>
+#include <vtkErrorCode.h>
+#include <vtkXMLPolyDataReader.h>
+#include <vtkXMLPolyDataWriter.h>
+#include <vtksys/SystemTools.hxx>
+#include <vtksys/Directory.hxx>
+
+// STD includes
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  /// Version of the conversion algorithms and the entry files. Entries of other versions are not found, as it is part of the keys
+  const char* CACHE_FORMAT_VERSION = "1";
+  const char* CACHE_KEY_ARRAY_NAME = "DicomRtConversionCacheKey";
+  const std::string ENTRY_FILE_EXTENSION = ".vtp";
+
+  /// 64-bit FNV-1a hash, can be continued by passing the previous hash
+  vtkTypeUInt64 HashBytes(const void* data, size_t length, vtkTypeUInt64 hash=14695981039346656037ULL)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t index = 0; index < length; ++index)
+    {
+      hash ^= bytes[index];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  std::string HashToString(vtkTypeUInt64 hash)
+  {
+    std::stringstream hashStream;
+    hashStream << std::hex;
+    hashStream.width(16);
+    hashStream.fill('0');
+    hashStream << hash;
+    return hashStream.str();
+  }
+
+  /// Cache entry file, ordered by last use
+  struct CacheEntryFile
+  {
+    std::string Path;
+    vtkTypeUInt64 Size;
+    long ModifiedTime;
+
+    bool operator<(const CacheEntryFile& other) const
+    {
+      return this->ModifiedTime < other.ModifiedTime;
+    }
+  };
+
+  /// Collect the cache entry files in a directory
+  void GetCacheEntryFiles(const char* cacheDirectory, std::vector<CacheEntryFile>& entryFiles)
+  {
+    entryFiles.clear();
+    vtksys::Directory directory;
+    if (!cacheDirectory || !directory.Load(cacheDirectory))
+    {
+      return;
+    }
+    for (unsigned long fileIndex = 0; fileIndex < directory.GetNumberOfFiles(); ++fileIndex)
+    {
+      std::string fileName(directory.GetFile(fileIndex));
+      std::string extension = vtksys::SystemTools::GetFilenameLastExtension(fileName);
+      if (extension != ENTRY_FILE_EXTENSION)
+      {
+        continue;
+      }
+      CacheEntryFile entryFile;
+      entryFile.Path = std::string(cacheDirectory) + "/" + fileName;
+      entryFile.Size = vtksys::SystemTools::FileLength(entryFile.Path);
+      entryFile.ModifiedTime = vtksys::SystemTools::ModifiedTime(entryFile.Path);
+      entryFiles.push_back(entryFile);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerDicomRtConversionCache);
+
+//----------------------------------------------------------------------------
+vtkSlicerDicomRtConversionCache::vtkSlicerDicomRtConversionCache()
+{
+  this->CacheDirectory = NULL;
+  this->MaximumCacheSizeMB = 1024;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerDicomRtConversionCache::~vtkSlicerDicomRtConversionCache()
+{
+  this->SetCacheDirectory(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtConversionCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "CacheDirectory: " << (this->CacheDirectory ? this->CacheDirectory : "NULL") << "\n";
+  os << indent << "MaximumCacheSizeMB: " << this->MaximumCacheSizeMB << "\n";
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerDicomRtConversionCache::ComputeKey(const char* sopInstanceUid, unsigned int roiNumber,
+  const char* representationName, std::string conversionParameters, vtkPolyData* planarContourPolyData)
+{
+  if (!sopInstanceUid || !representationName || !planarContourPolyData)
+  {
+    vtkGenericWarningMacro("vtkSlicerDicomRtConversionCache::ComputeKey: Invalid input arguments");
+    return "";
+  }
+
+  // Hash the contour point coordinates and the contour connectivity
+  vtkTypeUInt64 contentHash = HashBytes(NULL, 0);
+  double point[3] = {0.0, 0.0, 0.0};
+  for (vtkIdType pointIndex = 0; pointIndex < planarContourPolyData->GetNumberOfPoints(); ++pointIndex)
+  {
+    planarContourPolyData->GetPoint(pointIndex, point);
+    contentHash = HashBytes(point, sizeof(point), contentHash);
+  }
+  vtkCellArray* lines = planarContourPolyData->GetLines();
+  if (lines)
+  {
+    vtkIdType numberOfPoints = 0;
+    vtkIdType* pointIds = NULL;
+    for (lines->InitTraversal(); lines->GetNextCell(numberOfPoints, pointIds); )
+    {
+      contentHash = HashBytes(&numberOfPoints, sizeof(vtkIdType), contentHash);
+      contentHash = HashBytes(pointIds, numberOfPoints * sizeof(vtkIdType), contentHash);
+    }
+  }
+
+  std::stringstream keyStream;
+  keyStream << CACHE_FORMAT_VERSION << "|" << sopInstanceUid << "|" << roiNumber << "|" << representationName << "|"
+    << HashToString(HashBytes(conversionParameters.c_str(), conversionParameters.size())) << "|"
+    << HashToString(contentHash);
+  return keyStream.str();
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerDicomRtConversionCache::GetEntryFilePathBase(std::string key)
+{
+  if (!this->CacheDirectory || !this->CacheDirectory[0] || key.empty())
+  {
+    return "";
+  }
+  return std::string(this->CacheDirectory) + "/" + HashToString(HashBytes(key.c_str(), key.size()));
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtConversionCache::Load(std::string key, vtkPolyData* closedSurfacePolyData)
+{
+  std::string entryFilePathBase = this->GetEntryFilePathBase(key);
+  if (entryFilePathBase.empty() || !closedSurfacePolyData)
+  {
+    return false;
+  }
+
+  std::string entryFilePath = entryFilePathBase + ENTRY_FILE_EXTENSION;
+  if (!vtksys::SystemTools::FileExists(entryFilePath.c_str(), true))
+  {
+    return false;
+  }
+
+  // Read entry
+  vtkSmartPointer<vtkXMLPolyDataReader> reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+  reader->SetFileName(entryFilePath.c_str());
+  reader->Update();
+  vtkPolyData* entryPolyData = (reader->GetErrorCode() == vtkErrorCode::NoError ? reader->GetOutput() : NULL);
+
+  // Check that the entry belongs to the key (file names are hashes of the keys)
+  vtkFieldData* entryFieldData = (entryPolyData ? entryPolyData->GetFieldData() : NULL);
+  vtkStringArray* keyArray = (entryFieldData ? vtkStringArray::SafeDownCast(entryFieldData->GetAbstractArray(CACHE_KEY_ARRAY_NAME)) : NULL);
+  if (!keyArray || keyArray->GetNumberOfValues() != 1 || keyArray->GetValue(0) != key)
+  {
+    vtkWarningMacro("Load: Removing invalid cache entry " << entryFilePath);
+    vtksys::SystemTools::RemoveFile(entryFilePath);
+    return false;
+  }
+  entryFieldData->RemoveArray(CACHE_KEY_ARRAY_NAME);
+  closedSurfacePolyData->ShallowCopy(entryPolyData);
+
+  // Mark entry as recently used
+  vtksys::SystemTools::Touch(entryFilePath, false);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtConversionCache::Store(std::string key, vtkPolyData* closedSurfacePolyData)
+{
+  std::string entryFilePathBase = this->GetEntryFilePathBase(key);
+  if (entryFilePathBase.empty() || !closedSurfacePolyData)
+  {
+    return false;
+  }
+  if (!vtksys::SystemTools::MakeDirectory(this->CacheDirectory))
+  {
+    vtkErrorMacro("Store: Failed to create cache directory " << this->CacheDirectory);
+    return false;
+  }
+
+  // Add key to the field data of a copy, so that the closed surface is not modified
+  vtkSmartPointer<vtkFieldData> entryFieldData = vtkSmartPointer<vtkFieldData>::New();
+  entryFieldData->ShallowCopy(closedSurfacePolyData->GetFieldData());
+  vtkSmartPointer<vtkStringArray> keyArray = vtkSmartPointer<vtkStringArray>::New();
+  keyArray->SetName(CACHE_KEY_ARRAY_NAME);
+  keyArray->InsertNextValue(key);
+  entryFieldData->AddArray(keyArray);
+  vtkSmartPointer<vtkPolyData> entryPolyData = vtkSmartPointer<vtkPolyData>::New();
+  entryPolyData->ShallowCopy(closedSurfacePolyData);
+  entryPolyData->SetFieldData(entryFieldData);
+
+  // Write to a temporary file first, so that partially written entries are never read
+  std::string entryFilePath = entryFilePathBase + ENTRY_FILE_EXTENSION;
+  std::string temporaryFilePath = entryFilePath + ".tmp";
+  vtkSmartPointer<vtkXMLPolyDataWriter> writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+  writer->SetInputData(entryPolyData);
+  writer->SetFileName(temporaryFilePath.c_str());
+  writer->SetDataModeToBinary();
+  writer->SetCompressorTypeToZLib();
+  if (!writer->Write())
+  {
+    vtkErrorMacro("Store: Failed to write cache entry " << temporaryFilePath);
+    vtksys::SystemTools::RemoveFile(temporaryFilePath);
+    return false;
+  }
+  vtksys::SystemTools::RemoveFile(entryFilePath);
+  if (std::rename(temporaryFilePath.c_str(), entryFilePath.c_str()) != 0)
+  {
+    vtkErrorMacro("Store: Failed to rename cache entry " << temporaryFilePath << " to " << entryFilePath);
+    vtksys::SystemTools::RemoveFile(temporaryFilePath);
+    return false;
+  }
+
+  this->EvictEntries();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtConversionCache::EvictEntries()
+{
+  std::vector<CacheEntryFile> entryFiles;
+  GetCacheEntryFiles(this->CacheDirectory, entryFiles);
+
+  vtkTypeUInt64 cacheSize = 0;
+  for (std::vector<CacheEntryFile>::iterator entryIt = entryFiles.begin(); entryIt != entryFiles.end(); ++entryIt)
+  {
+    cacheSize += entryIt->Size;
+  }
+  vtkTypeUInt64 maximumCacheSize = (vtkTypeUInt64)std::max(this->MaximumCacheSizeMB, 0) * 1024 * 1024;
+  if (cacheSize <= maximumCacheSize)
+  {
+    return;
+  }
+
+  // Remove least recently used entries first
+  std::sort(entryFiles.begin(), entryFiles.end());
+  for (std::vector<CacheEntryFile>::iterator entryIt = entryFiles.begin();
+    entryIt != entryFiles.end() && cacheSize > maximumCacheSize; ++entryIt)
+  {
+    if (vtksys::SystemTools::RemoveFile(entryIt->Path))
+    {
+      cacheSize -= entryIt->Size;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtConversionCache::Clear()
+{
+  std::vector<CacheEntryFile> entryFiles;
+  GetCacheEntryFiles(this->CacheDirectory, entryFiles);
+  for (std::vector<CacheEntryFile>::iterator entryIt = entryFiles.begin(); entryIt != entryFiles.end(); ++entryIt)
+  {
+    vtksys::SystemTools::RemoveFile(entryIt->Path);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkSlicerDicomRtConversionCache::GetCacheSize()
+{
+  std::vector<CacheEntryFile> entryFiles;
+  GetCacheEntryFiles(this->CacheDirectory, entryFiles);
+  vtkTypeUInt64 cacheSize = 0;
+  for (std::vector<CacheEntryFile>::iterator entryIt = entryFiles.begin(); entryIt != entryFiles.end(); ++entryIt)
+  {
+    cacheSize += entryIt->Size;
+  }
+  return cacheSize;
+}
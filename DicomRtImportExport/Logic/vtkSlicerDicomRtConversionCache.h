@@ -0,0 +1,111 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSlicerDicomRtConversionCache_h
+#define __vtkSlicerDicomRtConversionCache_h
+
+#include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <string>
+
+class vtkPolyData;
+
+/// \ingroup SlicerRt_QtModules_DicomRtImport
+/// \brief Disk cache of closed surfaces converted from the planar contours of RT structure sets
+///
+/// Each entry is identified by the cache format version, the SOP instance UID of the structure set, the ROI number,
+/// the name of the converted representation, the serialized conversion parameters of the segmentation and a hash of
+/// the planar contours. If any of these change, the entry is not found and the conversion is done again.
+/// The format version needs to be increased whenever the conversion algorithms or the entry files change.
+/// Closed surfaces are stored as compressed binary VTK XML poly data (.vtp).
+/// When the total size of the entries exceeds the maximum size, the least recently used entries are removed.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkSlicerDicomRtConversionCache : public vtkObject
+{
+public:
+  static vtkSlicerDicomRtConversionCache *New();
+  vtkTypeMacro(vtkSlicerDicomRtConversionCache, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Compute the key of a converted representation
+  /// \param sopInstanceUid SOP instance UID of the RT structure set
+  /// \param roiNumber ROI number (as defined in DICOM)
+  /// \param representationName Name of the converted representation
+  /// \param conversionParameters Serialized conversion parameters used for the conversion
+  /// \param planarContourPolyData Planar contours the representation is converted from
+  static std::string ComputeKey(const char* sopInstanceUid, unsigned int roiNumber, const char* representationName,
+    std::string conversionParameters, vtkPolyData* planarContourPolyData);
+
+  /// Read a cached closed surface
+  /// \param key Key of the closed surface \sa ComputeKey
+  /// \param closedSurfacePolyData Output closed surface
+  /// \return True if a valid entry was found and read
+  bool Load(std::string key, vtkPolyData* closedSurfacePolyData);
+
+  /// Write a closed surface to the cache, and remove the least recently used entries if the cache is too large
+  /// \param key Key of the closed surface \sa ComputeKey
+  /// \param closedSurfacePolyData Closed surface to store
+  /// \return Success flag
+  bool Store(std::string key, vtkPolyData* closedSurfacePolyData);
+
+  /// Remove all entries from the cache
+  void Clear();
+
+  /// Get total size of the cache entries in bytes
+  vtkTypeUInt64 GetCacheSize();
+
+public:
+  /// Get directory containing the cache entries
+  vtkGetStringMacro(CacheDirectory);
+  /// Set directory containing the cache entries. It is created when the first entry is stored
+  vtkSetStringMacro(CacheDirectory);
+
+  /// Get maximum total size of the cache entries in megabytes
+  vtkGetMacro(MaximumCacheSizeMB, int);
+  /// Set maximum total size of the cache entries in megabytes
+  vtkSetMacro(MaximumCacheSizeMB, int);
+
+protected:
+  /// Get file path of the entry for a key, without extension
+  std::string GetEntryFilePathBase(std::string key);
+
+  /// Remove the least recently used entries until the total size is within the limit
+  void EvictEntries();
+
+protected:
+  /// Directory containing the cache entries
+  char* CacheDirectory;
+
+  /// Maximum total size of the cache entries in megabytes
+  int MaximumCacheSizeMB;
+
+protected:
+  vtkSlicerDicomRtConversionCache();
+  virtual ~vtkSlicerDicomRtConversionCache();
+
+private:
+  vtkSlicerDicomRtConversionCache(const vtkSlicerDicomRtConversionCache&); // Not implemented
+  void operator=(const vtkSlicerDicomRtConversionCache&);                  // Not implemented
+};
+
+#endif
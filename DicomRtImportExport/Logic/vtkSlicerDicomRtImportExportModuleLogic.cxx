@@ -27,9 +27,12 @@
 #include "vtkSlicerDicomRtImportExportModuleLogic.h"
 #include "vtkSlicerDicomRtReader.h"
 #include "vtkSlicerDicomRtWriter.h"
+#include "vtkSlicerDicomRtConversionCache.h"
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
 #include "vtkPlanarContourToRibbonModelConversionRule.h"
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
 #include "vtkClosedSurfaceToFractionalLabelmapConversionRule.h"
 #include "vtkFractionalLabelmapToClosedSurfaceConversionRule.h"
 
@@ -68,6 +71,7 @@
 
 // DCMTK includes
 #include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcmetinf.h>
 #include <dcmtk/dcmdata/dcdeftag.h>
 #include <dcmtk/dcmdata/dcdatset.h>
 #include <dcmtk/dcmdata/dcuid.h>
@@ -108,6 +112,12 @@
 #include <vtkCutter.h>
 #include <vtkStripper.h>
 #include <vtkPlane.h>
+#include <vtkSMPTools.h>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <map>
 
 // ITK includes
 #include <itkImage.h>
@@ -132,6 +142,34 @@ public:
   vtkInternal(vtkSlicerDicomRtImportExportModuleLogic* external);
   ~vtkInternal() { };
 
+  /// Result of examining one DICOM file (\sa ExamineForLoad)
+  struct ExaminedFile
+  {
+    ExaminedFile() : FileSize(0), ModifiedTime(0), LastUse(0), Loadable(false), RtDose(false) { };
+
+    /// Size and modification time of the file when it was examined
+    unsigned long FileSize;
+    long ModifiedTime;
+    /// Number of the \sa ExamineForLoad call that last used this result. The least recently used results are
+    /// removed from the cache first
+    unsigned long LastUse;
+    /// Flag indicating whether the file contains a loadable RT object
+    bool Loadable;
+    /// Flag indicating whether the file contains an RT dose. The label of the referenced plan is added to
+    /// the name of doses from the DICOM database when creating the loadable
+    bool RtDose;
+    std::string Name;
+    std::vector<std::string> ReferencedSOPInstanceUIDs;
+  };
+
+  /// Read the header of a DICOM file up to the elements needed for determining whether it is loadable, and
+  /// examine the RT object in it. Pixel data and ROI sequences are not read.
+  /// Does not access the DICOM database, so files can be examined in parallel
+  void ExamineFile(const std::string& fileName, ExaminedFile& examinedFile);
+
+  /// Examine files in parallel
+  class ExamineFileFunctor;
+
   /// Examine RT Dose dataset and assemble name and referenced SOP instances
   void ExamineRtDoseDataset(DcmDataset* dataset, OFString &name, std::vector<OFString> &referencedSOPInstanceUIDs);
 
@@ -160,6 +198,34 @@ public:
   /// \return Success flag
   bool LoadRtImage(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable);
 
+  /// Segment created from a contour ROI of a structure set
+  struct RoiSegment
+  {
+    vtkSmartPointer<vtkSegment> Segment;
+    unsigned int RoiNumber;
+    vtkPolyData* PlanarContourPolyData;
+  };
+
+  /// Conversion of the planar contours of one structure set ROI to closed surface (\sa CreateClosedSurfaces)
+  struct RoiConversionJob
+  {
+    /// Conversion rule used only by this job, with the conversion parameters of the structure set
+    vtkSmartPointer<vtkSegmentationConverterRule> Rule;
+    vtkPolyData* PlanarContourPolyData;
+    vtkSmartPointer<vtkPolyData> ClosedSurfacePolyData;
+    /// Flag indicating whether the conversion succeeded
+    bool Success;
+  };
+
+  /// Convert ROIs in parallel
+  class RoiConversionFunctor;
+
+  /// Add closed surface representation to the segments of a loaded structure set before they are added to the
+  /// segmentation. If the conversion cache is used, then the closed surfaces found there are read from the cache.
+  /// The other ROIs are converted in parallel, each with its own planar contour to closed surface rule that has the
+  /// conversion parameters of the segmentation. The cache is only accessed before and after the parallel conversion
+  void CreateClosedSurfaces(vtkSlicerDicomRtReader* rtReader, vtkSegmentation* segmentation, std::vector<RoiSegment>& roiSegments);
+
   /// Add an ROI point to the scene
   vtkMRMLMarkupsFiducialNode* AddRoiPoint(double* roiPosition, std::string baseName, double* roiColor);
 
@@ -178,6 +244,67 @@ public:
 
 public:
   vtkSlicerDicomRtImportExportModuleLogic* External;
+
+  /// Examined files by path. Entries are valid while the size and modification time of the file are unchanged.
+  /// Contains at most ExaminedFileCacheMaximumSize entries, the least recently used ones are removed
+  std::map<std::string, ExaminedFile> ExaminedFileCache;
+  /// Number of ExamineForLoad calls, for tracking the use of the examined file cache entries
+  unsigned long NumberOfExaminations;
+};
+
+//----------------------------------------------------------------------------
+class vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFileFunctor
+{
+public:
+  ExamineFileFunctor(vtkInternal* internal, const std::vector<std::string>& fileNames,
+    const std::vector<int>& fileIndices, std::vector<ExaminedFile>& examinedFiles)
+    : Internal(internal)
+    , FileNames(fileNames)
+    , FileIndices(fileIndices)
+    , ExaminedFiles(examinedFiles)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end) const
+  {
+    for (vtkIdType index=begin; index<end; ++index)
+    {
+      int fileIndex = this->FileIndices[index];
+      this->Internal->ExamineFile(this->FileNames[fileIndex], this->ExaminedFiles[fileIndex]);
+    }
+  }
+
+private:
+  vtkInternal* Internal;
+  const std::vector<std::string>& FileNames;
+  /// Indices of the files to examine
+  const std::vector<int>& FileIndices;
+  /// Examination results, indexed the same way as the file names. Each job writes only its own element
+  std::vector<ExaminedFile>& ExaminedFiles;
+};
+
+//----------------------------------------------------------------------------
+class vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::RoiConversionFunctor
+{
+public:
+  RoiConversionFunctor(std::vector<RoiConversionJob>& jobs)
+    : Jobs(jobs)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end) const
+  {
+    for (vtkIdType jobIndex=begin; jobIndex<end; ++jobIndex)
+    {
+      RoiConversionJob& job = this->Jobs[jobIndex];
+      job.Success = job.Rule->Convert(job.PlanarContourPolyData, job.ClosedSurfacePolyData);
+    }
+  }
+
+private:
+  /// Conversion jobs. Each job only accesses its own rule and polydata, so the closed surfaces are the same
+  /// as when the ROIs are converted one by one
+  std::vector<RoiConversionJob>& Jobs;
 };
 
 //----------------------------------------------------------------------------
@@ -186,6 +313,7 @@ public:
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::vtkInternal(vtkSlicerDicomRtImportExportModuleLogic* external)
   : External(external)
+  , NumberOfExaminations(0)
 {
 }
 
@@ -212,7 +340,7 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtDoseDataset(
     name += " [" + instanceNumber + "]";
   }
 
-  // Find RTPlan name for RTDose series
+  // Find RTPlan for RTDose series. Its name is added from the DICOM database in ExamineForLoad
   OFString referencedSOPInstanceUID("");
   DRTDoseIOD rtDoseObject;
   if (rtDoseObject.read(*dataset).good())
@@ -230,27 +358,6 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtDoseDataset(
       }
     }
   }
-
-  // Create and open DICOM database to perform database operations for getting RTPlan name
-  QSettings settings;
-  QString databaseDirectory = settings.value("DatabaseDirectory").toString();
-  QString databaseFile = databaseDirectory + vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME.c_str();
-  ctkDICOMDatabase* dicomDatabase = new ctkDICOMDatabase();
-  dicomDatabase->openDatabase(databaseFile, vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
-
-  // Get RTPlan name to show it with the dose
-  QString rtPlanLabelTag("300a,0002");
-  QString rtPlanFileName = dicomDatabase->fileForInstance(referencedSOPInstanceUID.c_str());
-  if (!rtPlanFileName.isEmpty())
-  {
-    name += OFString(": ") + OFString(dicomDatabase->fileValue(rtPlanFileName,rtPlanLabelTag).toLatin1().constData());
-  }
-
-  // Close and delete DICOM database
-  dicomDatabase->closeDatabase();
-  delete dicomDatabase;
-  QSqlDatabase::removeDatabase(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
-  QSqlDatabase::removeDatabase(QString(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str()) + "TagCache");
 }
 
 //-----------------------------------------------------------------------------
@@ -306,29 +413,35 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtStructureSet
     name += ": " + structLabel;
   }
 
-  // Get referenced image instance UIDs
-  OFString referencedSOPInstanceUID("");
-  DRTStructureSetIOD rtStructureSetObject;
-  if (rtStructureSetObject.read(*dataset).good())
+  // Get referenced image instance UIDs from the contour image sequence of the referenced frame of reference.
+  // The dataset is only read up to the structure set ROI sequence (\sa ExamineFile), so the contour sequences of the
+  // ROIs are not available. The referenced frame of reference sequence is before it, and lists the same images
+  DRTReferencedFrameOfReferenceSequence rtReferencedFrameOfReferenceSequenceObject;
+  if (rtReferencedFrameOfReferenceSequenceObject.read(*dataset, "1-n", "3", "StructureSetModule").bad())
   {
-    DRTROIContourSequence &rtROIContourSequenceObject = rtStructureSetObject.getROIContourSequence();
-    if (rtROIContourSequenceObject.gotoFirstItem().good())
+    return;
+  }
+  if (rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
+  {
+    DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
+    if (currentReferencedFrameOfReferenceSequenceItem.isValid())
     {
-      do // For all ROIs
+      DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
+      if (rtReferencedStudySequenceObject.gotoFirstItem().good())
       {
-        DRTROIContourSequence::Item &currentRoiObject = rtROIContourSequenceObject.getCurrentItem();
-        if (currentRoiObject.isValid())
+        DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
+        if (rtReferencedStudySequenceItem.isValid())
         {
-          DRTContourSequence &rtContourSequenceObject = currentRoiObject.getContourSequence();
-          if (rtContourSequenceObject.gotoFirstItem().good())
+          DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
+          if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
           {
-            do // For all contours
+            DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject.getCurrentItem();
+            if (rtReferencedSeriesSequenceItem.isValid())
             {
-              DRTContourSequence::Item &contourItem = rtContourSequenceObject.getCurrentItem();
-              if (!contourItem.isValid())
+              DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
+              if (rtContourImageSequenceObject.gotoFirstItem().good())
               {
-                DRTContourImageSequence &rtContourImageSequenceObject = contourItem.getContourImageSequence();
-                if (rtContourImageSequenceObject.gotoFirstItem().good())
+                do // For all referenced images
                 {
                   DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
                   if (rtContourImageSequenceItem.isValid())
@@ -339,65 +452,15 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtStructureSet
                       referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
                     }
                   }
-                }
-              }
-            } // For all contours
-            while (rtContourSequenceObject.gotoNextItem().good());
-          }
-        }
-      } // For all ROIs
-      while (rtROIContourSequenceObject.gotoNextItem().good());
-    } // End ROIContourSequence
-
-    // If the above tags do not store the referenced instance UIDs, then look at the other possible place
-    if (referencedSOPInstanceUIDs.empty())
-    {
-      DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject = rtStructureSetObject.getReferencedFrameOfReferenceSequence();
-      if (rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
-      {
-        DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
-        if (currentReferencedFrameOfReferenceSequenceItem.isValid())
-        {
-          DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
-          if (rtReferencedStudySequenceObject.gotoFirstItem().good())
-          {
-            DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
-            if (rtReferencedStudySequenceItem.isValid())
-            {
-              DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
-              if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
-              {
-                if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
-                {
-                  DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject.getCurrentItem();
-                  if (rtReferencedSeriesSequenceItem.isValid())
-                  {
-                    DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
-                    if (rtContourImageSequenceObject.gotoFirstItem().good())
-                    {
-                      do
-                      {
-                        DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                        if (rtContourImageSequenceItem.isValid())
-                        {
-                          OFString referencedSOPInstanceUID("");
-                          if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                          {
-                            referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                          }
-                        }
-                      } // For all contours
-                      while (rtContourImageSequenceObject.gotoNextItem().good());
-                    }
-                  }
-                }
+                } // For all referenced images
+                while (rtContourImageSequenceObject.gotoNextItem().good());
               }
             }
           }
         }
       }
-    } // End DRTReferencedFrameOfReferenceSequence
-  } // End finding referenced instance UIDs
+    }
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -434,6 +497,102 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtImageDataset
   }
 }
 
+//-----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFile(const std::string& fileName, ExaminedFile& examinedFile)
+{
+  examinedFile.Loadable = false;
+  examinedFile.RtDose = false;
+  examinedFile.Name.clear();
+  examinedFile.ReferencedSOPInstanceUIDs.clear();
+
+  // Get the SOP class from the meta header, so that the dataset is only parsed once, up to the class-specific element.
+  // If the file has no meta header, then the first elements of the dataset are read to get the SOP class
+  OFString sopClass;
+  DcmMetaInfo metaInfo;
+  if (metaInfo.loadFile(fileName.c_str()).good())
+  {
+    metaInfo.findAndGetOFString(DCM_MediaStorageSOPClassUID, sopClass);
+  }
+  if (sopClass.empty())
+  {
+    DcmFileFormat sopClassFileFormat;
+    if ( sopClassFileFormat.loadFileUntilTag(fileName.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+      ERM_autoDetect, DCM_SOPInstanceUID).bad()
+      || sopClassFileFormat.getDataset()->findAndGetOFString(DCM_SOPClassUID, sopClass).bad() || sopClass.empty() )
+    {
+      return; // Failed to parse this file, skip it
+    }
+  }
+
+  // Read the dataset up to the large elements that are not needed for examination
+  DcmTagKey stopParsingAtElement;
+  if (sopClass == UID_RTDoseStorage || sopClass == UID_RTImageStorage)
+  {
+    stopParsingAtElement = DCM_PixelData;
+  }
+  else if (sopClass == UID_RTPlanStorage)
+  {
+    stopParsingAtElement = DCM_FractionGroupSequence;
+  }
+  else if (sopClass == UID_RTStructureSetStorage)
+  {
+    // Only the elements before the ROI sequences are needed (\sa ExamineRtStructureSetDataset)
+    stopParsingAtElement = DCM_StructureSetROISequence;
+  }
+  /* Not yet supported
+  else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
+  else if (sopClass == UID_RTIonPlanStorage)
+  else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
+  */
+  else
+  {
+    return; // Not an RT file
+  }
+  DcmFileFormat fileformat;
+  OFCondition result = fileformat.loadFileUntilTag(fileName.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+    ERM_autoDetect, stopParsingAtElement);
+  if (!result.good())
+  {
+    return; // Failed to parse this file, skip it
+  }
+
+  // DICOM parsing is successful, now assemble name and referenced instances
+  DcmDataset *dataset = fileformat.getDataset();
+  OFString name("");
+  OFString seriesNumber("");
+  std::vector<OFString> referencedSOPInstanceUIDs;
+  dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
+  if (!seriesNumber.empty())
+  {
+    name += seriesNumber + ": ";
+  }
+
+  if (sopClass == UID_RTDoseStorage)
+  {
+    this->ExamineRtDoseDataset(dataset, name, referencedSOPInstanceUIDs);
+    examinedFile.RtDose = true;
+  }
+  else if (sopClass == UID_RTPlanStorage)
+  {
+    this->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  else if (sopClass == UID_RTStructureSetStorage)
+  {
+    this->ExamineRtStructureSetDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  else
+  {
+    this->ExamineRtImageDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+
+  examinedFile.Name = name.c_str();
+  for (std::vector<OFString>::iterator uidIt = referencedSOPInstanceUIDs.begin(); uidIt != referencedSOPInstanceUIDs.end(); ++uidIt)
+  {
+    examinedFile.ReferencedSOPInstanceUIDs.push_back(uidIt->c_str());
+  }
+  examinedFile.Loadable = true;
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtDose(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
@@ -834,6 +993,8 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
   // Number of loaded points. Used to prevent unreasonably long loading times with the downside of a less nice initial representation
   long maximumNumberOfPoints = -1;
   long totalNumberOfPoints = 0;
+  // Segments created from the contour ROIs, used for looking up the converted representations in the conversion cache
+  std::vector<RoiSegment> roiSegments;
 
   // Add ROIs
   int numberOfRois = rtReader->GetNumberOfRois();
@@ -965,22 +1126,46 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
         segmentationNode->GetSegmentation()->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(), defaultSliceThicknessStream.str());
       }
 
-      // Add segment for current structure
+      // Create segment for current structure. Segments are added to the segmentation after converting all ROIs
       vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
       segment->SetName(roiLabel);
       segment->SetColor(roiColor[0], roiColor[1], roiColor[2]);
       segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(), roiPolyData);
-      segmentationNode->GetSegmentation()->AddSegment(segment);
+
+      RoiSegment roiSegment;
+      roiSegment.Segment = segment;
+      roiSegment.RoiNumber = rtReader->GetRoiNumber(internalROIIndex);
+      roiSegment.PlanarContourPolyData = roiPolyData;
+      roiSegments.push_back(roiSegment);
     }
   } // for all ROIs
 
+  // Do not create closed surface display in case of extremely large structures, to prevent unreasonably long load times
+  // Arbitrary thresholds, can revisit
+  vtkDebugWithObjectMacro(this->External, "LoadRtStructureSet: Maximum number of points in a segment = " << maximumNumberOfPoints << ", Total number of points in segmentation = " << totalNumberOfPoints);
+  bool showClosedSurface = (maximumNumberOfPoints < 800000 && totalNumberOfPoints < 3000000);
+
+  if (segmentationNode.GetPointer())
+  {
+    // Convert all ROIs to closed surface at once, instead of one by one when the display representation is created
+    if (showClosedSurface && segmentationDisplayNode.GetPointer())
+    {
+      this->CreateClosedSurfaces(rtReader, segmentationNode->GetSegmentation(), roiSegments);
+    }
+
+    // Add segments in ROI order, in one batched modification
+    int wasModified = segmentationNode->StartModify();
+    for (std::vector<RoiSegment>::iterator roiSegmentIt = roiSegments.begin(); roiSegmentIt != roiSegments.end(); ++roiSegmentIt)
+    {
+      segmentationNode->GetSegmentation()->AddSegment(roiSegmentIt->Segment);
+    }
+    segmentationNode->EndModify(wasModified);
+  }
+
   // Force showing closed surface model instead of contour points and calculate auto opacity values for segments
-  // Do not set closed surface display in case of extremely large structures, to prevent unreasonably long load times
   if (segmentationDisplayNode.GetPointer())
   {
-    // Arbitrary thresholds, can revisit
-    vtkDebugWithObjectMacro(this->External, "LoadRtStructureSet: Maximum number of points in a segment = " << maximumNumberOfPoints << ", Total number of points in segmentation = " << totalNumberOfPoints);
-    if (maximumNumberOfPoints < 800000 && totalNumberOfPoints < 3000000)
+    if (showClosedSurface)
     {
       segmentationDisplayNode->SetPreferredDisplayRepresentationName3D(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
       segmentationDisplayNode->SetPreferredDisplayRepresentationName2D(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
@@ -1005,6 +1190,97 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
   return true;
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::CreateClosedSurfaces(
+  vtkSlicerDicomRtReader* rtReader, vtkSegmentation* segmentation, std::vector<RoiSegment>& roiSegments)
+{
+  const char* closedSurfaceName = vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName();
+
+  vtkSlicerDicomRtConversionCache* conversionCache = NULL;
+  if (this->External->UseConversionCache)
+  {
+    conversionCache = this->External->ConversionCache;
+    if (!conversionCache->GetCacheDirectory() && qSlicerApplication::application())
+    {
+      QString cacheDirectory = qSlicerApplication::application()->temporaryPath() + "/DicomRtConversionCache";
+      conversionCache->SetCacheDirectory(cacheDirectory.toLatin1().constData());
+    }
+    if (!conversionCache->GetCacheDirectory())
+    {
+      vtkWarningWithObjectMacro(this->External, "CreateClosedSurfaces: No conversion cache directory is set");
+      conversionCache = NULL;
+    }
+  }
+
+  // Parameters of the planar contour to closed surface rule, with the values set in the segmentation
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  vtkSegmentationConverterRule::ConversionParameterListType ruleParameters;
+  closedSurfaceRule->GetRuleConversionParameters(ruleParameters);
+
+  // Read cached closed surfaces, and set up a conversion job for the other ROIs.
+  // Each job gets its own rule instance, so that the conversion threads do not access shared objects
+  std::string conversionParameters = segmentation->SerializeAllConversionParameters();
+  std::vector<std::string> cacheKeys(roiSegments.size());
+  std::vector<int> jobIndices(roiSegments.size(), -1);
+  std::vector<RoiConversionJob> jobs;
+  for (size_t roiIndex = 0; roiIndex < roiSegments.size(); ++roiIndex)
+  {
+    RoiSegment& roiSegment = roiSegments[roiIndex];
+    if (conversionCache)
+    {
+      cacheKeys[roiIndex] = vtkSlicerDicomRtConversionCache::ComputeKey(rtReader->GetSOPInstanceUID(), roiSegment.RoiNumber,
+        closedSurfaceName, conversionParameters, roiSegment.PlanarContourPolyData);
+      vtkSmartPointer<vtkPolyData> closedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+      if (conversionCache->Load(cacheKeys[roiIndex], closedSurfacePolyData))
+      {
+        roiSegment.Segment->AddRepresentation(closedSurfaceName, closedSurfacePolyData);
+        continue;
+      }
+    }
+
+    RoiConversionJob job;
+    job.Rule = vtkSmartPointer<vtkSegmentationConverterRule>::Take(closedSurfaceRule->CreateRuleInstance());
+    for (vtkSegmentationConverterRule::ConversionParameterListType::iterator parameterIt = ruleParameters.begin();
+      parameterIt != ruleParameters.end(); ++parameterIt)
+    {
+      job.Rule->SetConversionParameter(parameterIt->first, segmentation->GetConversionParameter(parameterIt->first));
+    }
+    job.PlanarContourPolyData = roiSegment.PlanarContourPolyData;
+    job.ClosedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+    job.Success = false;
+    jobIndices[roiIndex] = (int)jobs.size();
+    jobs.push_back(job);
+  }
+
+  if (!jobs.empty())
+  {
+    RoiConversionFunctor functor(jobs);
+    vtkSMPTools::For(0, (vtkIdType)jobs.size(), 1, functor);
+  }
+
+  // Add converted closed surfaces to the segments and store them in the cache, in ROI order
+  for (size_t roiIndex = 0; roiIndex < roiSegments.size(); ++roiIndex)
+  {
+    if (jobIndices[roiIndex] < 0)
+    {
+      continue;
+    }
+    RoiSegment& roiSegment = roiSegments[roiIndex];
+    RoiConversionJob& job = jobs[jobIndices[roiIndex]];
+    if (!job.Success)
+    {
+      vtkWarningWithObjectMacro(this->External, "CreateClosedSurfaces: Failed to convert ROI number " << roiSegment.RoiNumber
+        << " to " << closedSurfaceName);
+      continue;
+    }
+    roiSegment.Segment->AddRepresentation(closedSurfaceName, job.ClosedSurfacePolyData);
+    if (conversionCache)
+    {
+      conversionCache->Store(cacheKeys[roiIndex], job.ClosedSurfacePolyData);
+    }
+  }
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtImage(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
@@ -1567,6 +1843,11 @@ vtkSlicerDicomRtImportExportModuleLogic::vtkSlicerDicomRtImportExportModuleLogic
   this->BeamsLogic = NULL;
 
   this->BeamModelsInSeparateBranch = true;
+
+  this->UseConversionCache = false;
+  this->ConversionCache = vtkSlicerDicomRtConversionCache::New();
+
+  this->ExaminedFileCacheMaximumSize = 10000;
 }
 
 //----------------------------------------------------------------------------
@@ -1576,6 +1857,12 @@ vtkSlicerDicomRtImportExportModuleLogic::~vtkSlicerDicomRtImportExportModuleLogi
   this->SetPlanarImageLogic(NULL);
   this->SetBeamsLogic(NULL);
 
+  if (this->ConversionCache)
+  {
+    this->ConversionCache->Delete();
+    this->ConversionCache = NULL;
+  }
+
   if (this->Internal)
   {
     delete this->Internal;
@@ -1623,6 +1910,10 @@ void vtkSlicerDicomRtImportExportModuleLogic::RegisterNodes()
     vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New() );
   vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
     vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToFractionalLabelmapConversionRule>::New() );
 
 }
 
@@ -1635,78 +1926,115 @@ void vtkSlicerDicomRtImportExportModuleLogic::ExamineForLoad(vtkStringArray* fil
   }
   loadables->RemoveAllItems();
 
-  for (int fileIndex=0; fileIndex<fileList->GetNumberOfValues(); ++fileIndex)
+  // Take the examination results from the cache if the file has not changed since it was examined
+  unsigned long examination = ++this->Internal->NumberOfExaminations;
+  int numberOfFiles = fileList->GetNumberOfValues();
+  std::vector<std::string> fileNames(numberOfFiles);
+  std::vector<vtkInternal::ExaminedFile> examinedFiles(numberOfFiles);
+  std::vector<int> fileIndicesToExamine;
+  for (int fileIndex=0; fileIndex<numberOfFiles; ++fileIndex)
   {
-    // Load file in DCMTK
-    DcmFileFormat fileformat;
-    vtkStdString fileName = fileList->GetValue(fileIndex);
-    OFCondition result = fileformat.loadFile(fileName.c_str(), EXS_Unknown);
-    if (!result.good())
+    fileNames[fileIndex] = fileList->GetValue(fileIndex);
+    unsigned long fileSize = vtksys::SystemTools::FileLength(fileNames[fileIndex]);
+    long modifiedTime = vtksys::SystemTools::ModifiedTime(fileNames[fileIndex]);
+    std::map<std::string, vtkInternal::ExaminedFile>::iterator cacheIt = this->Internal->ExaminedFileCache.find(fileNames[fileIndex]);
+    if ( cacheIt != this->Internal->ExaminedFileCache.end()
+      && cacheIt->second.FileSize == fileSize && cacheIt->second.ModifiedTime == modifiedTime )
     {
-      continue; // Failed to parse this file, skip it
+      examinedFiles[fileIndex] = cacheIt->second;
     }
-
-    // Check SOP Class UID for one of the supported RT objects
-    DcmDataset *dataset = fileformat.getDataset();
-    OFString sopClass;
-    if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
+    else
     {
-      continue; // Failed to parse this file, skip it
+      examinedFiles[fileIndex].FileSize = fileSize;
+      examinedFiles[fileIndex].ModifiedTime = modifiedTime;
+      fileIndicesToExamine.push_back(fileIndex);
     }
+    examinedFiles[fileIndex].LastUse = examination;
+  }
 
-    // DICOM parsing is successful, now check if the object is loadable
-    OFString name("");
-    OFString seriesNumber("");
-    std::vector<OFString> referencedSOPInstanceUIDs;
-    dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
-    if (!seriesNumber.empty())
-    {
-      name += seriesNumber + ": ";
-    }
+  // Examine the other files in parallel
+  if (!fileIndicesToExamine.empty())
+  {
+    vtkInternal::ExamineFileFunctor functor(this->Internal, fileNames, fileIndicesToExamine, examinedFiles);
+    vtkSMPTools::For(0, (vtkIdType)fileIndicesToExamine.size(), 1, functor);
+  }
 
-    // RTDose
-    if (sopClass == UID_RTDoseStorage)
-    {
-      this->Internal->ExamineRtDoseDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTPlan
-    else if (sopClass == UID_RTPlanStorage)
+  // Update the cache, then remove the least recently used files if it is too large
+  std::map<std::string, vtkInternal::ExaminedFile>& examinedFileCache = this->Internal->ExaminedFileCache;
+  for (int fileIndex=0; fileIndex<numberOfFiles; ++fileIndex)
+  {
+    examinedFileCache[fileNames[fileIndex]] = examinedFiles[fileIndex];
+  }
+  size_t maximumCacheSize = (size_t)std::max(this->ExaminedFileCacheMaximumSize, 0);
+  if (examinedFileCache.size() > maximumCacheSize)
+  {
+    std::vector< std::pair<unsigned long, std::string> > cacheEntriesByUse;
+    cacheEntriesByUse.reserve(examinedFileCache.size());
+    for (std::map<std::string, vtkInternal::ExaminedFile>::iterator cacheIt = examinedFileCache.begin(); cacheIt != examinedFileCache.end(); ++cacheIt)
     {
-      this->Internal->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
+      cacheEntriesByUse.push_back(std::make_pair(cacheIt->second.LastUse, cacheIt->first));
     }
-    // RTStructureSet
-    else if (sopClass == UID_RTStructureSetStorage)
+    size_t numberOfEntriesToRemove = examinedFileCache.size() - maximumCacheSize;
+    std::nth_element(cacheEntriesByUse.begin(), cacheEntriesByUse.begin() + numberOfEntriesToRemove, cacheEntriesByUse.end());
+    for (size_t entryIndex=0; entryIndex<numberOfEntriesToRemove; ++entryIndex)
     {
-      this->Internal->ExamineRtStructureSetDataset(dataset, name, referencedSOPInstanceUIDs);
+      examinedFileCache.erase(cacheEntriesByUse[entryIndex].second);
     }
-    // RTImage
-    else if (sopClass == UID_RTImageStorage)
+  }
+
+  // Create loadables in the order of the files. The DICOM database is only accessed here, from the main thread
+  ctkDICOMDatabase* dicomDatabase = NULL;
+  for (int fileIndex=0; fileIndex<numberOfFiles; ++fileIndex)
+  {
+    vtkInternal::ExaminedFile& examinedFile = examinedFiles[fileIndex];
+    if (!examinedFile.Loadable)
     {
-      this->Internal->ExamineRtImageDataset(dataset, name, referencedSOPInstanceUIDs);
+      continue;
     }
-    /* Not yet supported
-    else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
-    else if (sopClass == UID_RTIonPlanStorage)
-    else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
-    */
-    else
+
+    // Get RTPlan name to show it with the dose
+    std::string name(examinedFile.Name);
+    if (examinedFile.RtDose && !examinedFile.ReferencedSOPInstanceUIDs.empty())
     {
-      continue; // Not an RT file
+      if (!dicomDatabase)
+      {
+        // Create and open DICOM database to perform database operations for getting RTPlan name
+        QSettings settings;
+        QString databaseDirectory = settings.value("DatabaseDirectory").toString();
+        QString databaseFile = databaseDirectory + vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME.c_str();
+        dicomDatabase = new ctkDICOMDatabase();
+        dicomDatabase->openDatabase(databaseFile, vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
+      }
+      QString rtPlanLabelTag("300a,0002");
+      QString rtPlanFileName = dicomDatabase->fileForInstance(examinedFile.ReferencedSOPInstanceUIDs[0].c_str());
+      if (!rtPlanFileName.isEmpty())
+      {
+        name += std::string(": ") + dicomDatabase->fileValue(rtPlanFileName, rtPlanLabelTag).toLatin1().constData();
+      }
     }
 
     // The file is a loadable RT object, create and set up loadable
     vtkSmartPointer<vtkSlicerDICOMLoadable> loadable = vtkSmartPointer<vtkSlicerDICOMLoadable>::New();
     loadable->SetName(name.c_str());
-    loadable->AddFile(fileName.c_str());
+    loadable->AddFile(fileNames[fileIndex].c_str());
     loadable->SetConfidence(1.0);
     loadable->SetSelected(true);
-    std::vector<OFString>::iterator uidIt;
-    for (uidIt = referencedSOPInstanceUIDs.begin(); uidIt != referencedSOPInstanceUIDs.end(); ++uidIt)
+    std::vector<std::string>::iterator uidIt;
+    for (uidIt = examinedFile.ReferencedSOPInstanceUIDs.begin(); uidIt != examinedFile.ReferencedSOPInstanceUIDs.end(); ++uidIt)
     {
       loadable->AddReferencedInstanceUID(uidIt->c_str());
     }
     loadables->AddItem(loadable);
   }
+
+  // Close and delete DICOM database
+  if (dicomDatabase)
+  {
+    dicomDatabase->closeDatabase();
+    delete dicomDatabase;
+    QSqlDatabase::removeDatabase(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
+    QSqlDatabase::removeDatabase(QString(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str()) + "TagCache");
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -40,6 +40,7 @@
 class vtkSlicerIsodoseModuleLogic;
 class vtkSlicerPlanarImageModuleLogic;
 class vtkSlicerBeamsModuleLogic;
+class vtkSlicerDicomRtConversionCache;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLSegmentationNode;
 class vtkSlicerDICOMLoadable;
@@ -85,6 +86,21 @@ public:
   vtkGetMacro(BeamModelsInSeparateBranch, bool);
   vtkBooleanMacro(BeamModelsInSeparateBranch, bool);
 
+  /// Flag determining whether the closed surfaces converted from the structure set contours are stored in and
+  /// read from a disk cache, so that reloading the same structure set does not convert them again. Off by default
+  vtkSetMacro(UseConversionCache, bool);
+  vtkGetMacro(UseConversionCache, bool);
+  vtkBooleanMacro(UseConversionCache, bool);
+
+  /// Get conversion cache, to set its directory and size limit. If no directory is set, then the
+  /// conversion cache is in the temporary directory of the application
+  vtkGetObjectMacro(ConversionCache, vtkSlicerDicomRtConversionCache);
+
+  /// Maximum number of files whose examination results are kept for the next \sa ExamineForLoad calls.
+  /// The least recently examined files are removed first. 10000 by default
+  vtkSetMacro(ExaminedFileCacheMaximumSize, int);
+  vtkGetMacro(ExaminedFileCacheMaximumSize, int);
+
 protected:
   virtual void SetMRMLSceneInternal(vtkMRMLScene* newScene) VTK_OVERRIDE;
   virtual void OnMRMLSceneEndClose() VTK_OVERRIDE;
@@ -116,6 +132,15 @@ private:
   /// Flag determining whether the generated beam models are arranged in a separate subject hierarchy
   /// branch, or each beam model is added under its corresponding isocenter fiducial
   bool BeamModelsInSeparateBranch;
+
+  /// Flag determining whether the conversion cache is used when loading structure sets
+  bool UseConversionCache;
+
+  /// Disk cache of representations converted from structure set contours
+  vtkSlicerDicomRtConversionCache* ConversionCache;
+
+  /// Maximum number of files in the cache of examined files
+  int ExaminedFileCacheMaximumSize;
 };
 
 #endif
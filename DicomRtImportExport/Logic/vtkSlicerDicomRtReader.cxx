@@ -1339,6 +1339,17 @@ const char* vtkSlicerDicomRtReader::GetRoiName(unsigned int internalIndex)
   return (this->Internal->RoiSequenceVector[internalIndex].Name.empty() ? vtkSlicerRtCommon::DICOMRTIMPORT_NO_NAME : this->Internal->RoiSequenceVector[internalIndex].Name).c_str();
 }
 
+//----------------------------------------------------------------------------
+unsigned int vtkSlicerDicomRtReader::GetRoiNumber(unsigned int internalIndex)
+{
+  if (internalIndex >= this->Internal->RoiSequenceVector.size())
+  {
+    vtkErrorMacro("GetRoiNumber: Cannot get ROI with internal index: " << internalIndex);
+    return 0;
+  }
+  return this->Internal->RoiSequenceVector[internalIndex].Number;
+}
+
 //----------------------------------------------------------------------------
 double* vtkSlicerDicomRtReader::GetRoiDisplayColor(unsigned int internalIndex)
 {
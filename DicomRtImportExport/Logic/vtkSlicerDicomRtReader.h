@@ -60,6 +60,10 @@ public:
   /// \param internalIndex Internal index of ROI to get
   const char* GetRoiName(unsigned int internalIndex);
 
+  /// Get ROI number (as defined in DICOM) of a certain ROI by internal index
+  /// \param internalIndex Internal index of ROI to get
+  unsigned int GetRoiNumber(unsigned int internalIndex);
+
   /// Get display color of a certain ROI by internal index
   /// \param internalIndex Internal index of ROI to get
   double* GetRoiDisplayColor(unsigned int internalIndex);
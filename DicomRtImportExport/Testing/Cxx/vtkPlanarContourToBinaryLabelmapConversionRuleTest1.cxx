@@ -0,0 +1,213 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  const int REFERENCE_IMAGE_SIZE = 40;
+
+  //-----------------------------------------------------------------------------
+  /// Add a closed axis-aligned square contour to the contour polydata
+  void AddSquareContour(vtkPolyData* contours, double minimum, double maximum, double z)
+  {
+    vtkPoints* points = contours->GetPoints();
+    vtkCellArray* lines = contours->GetLines();
+    vtkIdType firstPointId = points->GetNumberOfPoints();
+    lines->InsertNextCell(5);
+    lines->InsertCellPoint(points->InsertNextPoint(minimum, minimum, z));
+    lines->InsertCellPoint(points->InsertNextPoint(maximum, minimum, z));
+    lines->InsertCellPoint(points->InsertNextPoint(maximum, maximum, z));
+    lines->InsertCellPoint(points->InsertNextPoint(minimum, maximum, z));
+    lines->InsertCellPoint(firstPointId);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create contours of a square with a square hole on the given planes
+  vtkSmartPointer<vtkPolyData> CreateContours(const std::vector<double>& planePositions)
+  {
+    vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    contours->SetPoints(points);
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    contours->SetLines(lines);
+    for (size_t planeIndex=0; planeIndex<planePositions.size(); ++planeIndex)
+    {
+      AddSquareContour(contours, 5.5, 30.5, planePositions[planeIndex]);
+      AddSquareContour(contours, 15.5, 20.5, planePositions[planeIndex]);
+    }
+    return contours;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Convert the contours to binary labelmap in a reference geometry with unit spacing and zero origin,
+  /// so that the voxel indices are the same as the world coordinates
+  vtkSmartPointer<vtkOrientedImageData> ConvertToBinaryLabelmap(vtkPolyData* contours, double defaultSliceThickness)
+  {
+    vtkSmartPointer<vtkOrientedImageData> referenceImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    referenceImage->SetExtent(0, REFERENCE_IMAGE_SIZE-1, 0, REFERENCE_IMAGE_SIZE-1, 0, REFERENCE_IMAGE_SIZE-1);
+
+    vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule> rule = vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule>::New();
+    rule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
+      vtkSegmentationConverter::SerializeImageGeometry(referenceImage));
+    std::ostringstream defaultSliceThicknessStream;
+    defaultSliceThicknessStream << defaultSliceThickness;
+    rule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(),
+      defaultSliceThicknessStream.str());
+
+    vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!rule->Convert(contours, labelmap))
+    {
+      return NULL;
+    }
+    return labelmap;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get if a voxel is filled in the labelmap. Voxels outside the extent are empty
+  bool IsVoxelFilled(vtkOrientedImageData* labelmap, int i, int j, int k)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return false;
+    }
+    return labelmap->GetScalarComponentAsDouble(i, j, k, 0) != 0.0;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check that the slices in the given range are filled with the square but not the hole, and the other slices are empty
+  bool CheckFilledSlices(vtkOrientedImageData* labelmap, const std::vector<int>& filledSlices, const std::string& caseName, std::ostream& errorStream)
+  {
+    for (int k=0; k<REFERENCE_IMAGE_SIZE; ++k)
+    {
+      bool sliceExpected = (std::find(filledSlices.begin(), filledSlices.end(), k) != filledSlices.end());
+      if (IsVoxelFilled(labelmap, 10, 10, k) != sliceExpected)
+      {
+        errorStream << "ERROR: " << caseName << ": slice " << k << " is " << (sliceExpected ? "empty" : "filled")
+          << " but it should be " << (sliceExpected ? "filled" : "empty") << std::endl;
+        return false;
+      }
+      if (IsVoxelFilled(labelmap, 18, 18, k))
+      {
+        errorStream << "ERROR: " << caseName << ": hole is filled in slice " << k << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkPlanarContourToBinaryLabelmapConversionRuleTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  std::ostream& errorStream = std::cerr;
+
+  // Planes 2 mm apart. Each plane fills the slices within 1 mm, the first and last planes as well.
+  // The inner square of each plane is a hole.
+  std::vector<double> planePositions;
+  planePositions.push_back(10.0);
+  planePositions.push_back(12.0);
+  planePositions.push_back(14.0);
+  vtkSmartPointer<vtkOrientedImageData> labelmap = ConvertToBinaryLabelmap(CreateContours(planePositions), 0.0);
+  if (!labelmap)
+  {
+    errorStream << "ERROR: Conversion of the regular planes failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<int> filledSlices;
+  for (int k=9; k<=14; ++k)
+  {
+    filledSlices.push_back(k);
+  }
+  if (!CheckFilledSlices(labelmap, filledSlices, "Regular planes", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Missing planes between 14 and 20 mm. The slices in the gap are filled from the nearest plane.
+  planePositions.push_back(20.0);
+  planePositions.push_back(22.0);
+  planePositions.push_back(24.0);
+  planePositions.push_back(26.0);
+  labelmap = ConvertToBinaryLabelmap(CreateContours(planePositions), 0.0);
+  if (!labelmap)
+  {
+    errorStream << "ERROR: Conversion of the planes with a gap failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  filledSlices.clear();
+  for (int k=9; k<=27; ++k)
+  {
+    filledSlices.push_back(k);
+  }
+  if (!CheckFilledSlices(labelmap, filledSlices, "Planes with gap", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // A single plane fills the slices within half of the default slice thickness
+  planePositions.clear();
+  planePositions.push_back(10.0);
+  labelmap = ConvertToBinaryLabelmap(CreateContours(planePositions), 3.0);
+  if (!labelmap)
+  {
+    errorStream << "ERROR: Conversion of a single plane with default slice thickness failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  filledSlices.clear();
+  filledSlices.push_back(9);
+  filledSlices.push_back(10);
+  filledSlices.push_back(11);
+  if (!CheckFilledSlices(labelmap, filledSlices, "Single plane with default slice thickness", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Without default slice thickness a single plane fills only the slice it is in
+  labelmap = ConvertToBinaryLabelmap(CreateContours(planePositions), 0.0);
+  if (!labelmap)
+  {
+    errorStream << "ERROR: Conversion of a single plane without default slice thickness failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  filledSlices.clear();
+  filledSlices.push_back(10);
+  if (!CheckFilledSlices(labelmap, filledSlices, "Single plane without default slice thickness", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
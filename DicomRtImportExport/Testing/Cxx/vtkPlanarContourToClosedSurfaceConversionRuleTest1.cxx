@@ -0,0 +1,384 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkLine.h>
+#include <vtkMassProperties.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  const int GRID_CYLINDER_COUNT = 3;
+  const int GRID_PLANE_COUNT = 4;
+  const int GRID_CONTOUR_POINT_COUNT = 24;
+
+  //-----------------------------------------------------------------------------
+  /// Add a closed circular contour to the contour polydata. The first point is repeated at the end of the line.
+  void AddCircleContour(vtkPolyData* contours, double centerX, double centerY, double z, double radius, int numberOfPoints, bool clockwise=false)
+  {
+    vtkPoints* points = contours->GetPoints();
+    vtkCellArray* lines = contours->GetLines();
+    vtkIdType firstPointId = points->GetNumberOfPoints();
+    lines->InsertNextCell(numberOfPoints+1);
+    for (int pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+    {
+      double angle = (clockwise ? -2.0 : 2.0) * vtkMath::Pi() * pointIndex / numberOfPoints;
+      lines->InsertCellPoint(points->InsertNextPoint(centerX + radius*cos(angle), centerY + radius*sin(angle), z));
+    }
+    lines->InsertCellPoint(firstPointId);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create contours of a cylinder that splits into two smaller cylinders, so that the conversion needs branching.
+  /// If shuffled, then the planes are added out of order and every second plane is oriented clockwise.
+  vtkSmartPointer<vtkPolyData> CreateBranchingContours(bool shuffled=false)
+  {
+    const int shuffledPlaneIndices[8] = {5, 2, 7, 0, 3, 6, 1, 4};
+    vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    contours->SetPoints(points);
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    contours->SetLines(lines);
+    for (int i=0; i<8; ++i)
+    {
+      int planeIndex = (shuffled ? shuffledPlaneIndices[i] : i);
+      bool clockwise = (shuffled && planeIndex % 2 == 1);
+      if (planeIndex < 4)
+      {
+        AddCircleContour(contours, 0.0, 0.0, 2.0*planeIndex, 10.0, 36, clockwise);
+      }
+      else
+      {
+        AddCircleContour(contours, -5.0, 0.0, 2.0*planeIndex, 4.0, 24, clockwise);
+        AddCircleContour(contours, 5.0, 0.0, 2.0*planeIndex, 4.0, 24, clockwise);
+      }
+    }
+    return contours;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create contours of cylinders arranged in a grid. The contours are added plane by plane, and in each plane
+  /// cylinder by cylinder, so the plane and the cylinder of an input point can be computed from its id.
+  vtkSmartPointer<vtkPolyData> CreateCylinderGridContours()
+  {
+    vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    contours->SetPoints(points);
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    contours->SetLines(lines);
+    for (int planeIndex=0; planeIndex<GRID_PLANE_COUNT; ++planeIndex)
+    {
+      for (int y=0; y<GRID_CYLINDER_COUNT; ++y)
+      {
+        for (int x=0; x<GRID_CYLINDER_COUNT; ++x)
+        {
+          AddCircleContour(contours, 20.0*x, 20.0*y, 2.0*planeIndex, 4.0, GRID_CONTOUR_POINT_COUNT);
+        }
+      }
+    }
+    return contours;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Conversion rule giving access to the decimation of the end cap contour lines
+  class DecimationTesterRule : public vtkPlanarContourToClosedSurfaceConversionRule
+  {
+  public:
+    static DecimationTesterRule* New();
+    vtkTypeMacro(DecimationTesterRule, vtkPlanarContourToClosedSurfaceConversionRule);
+    void Decimate(vtkPolyData* lines, double decimationFactor) { this->DecimateLines(lines, decimationFactor); };
+  };
+  vtkStandardNewMacro(DecimationTesterRule);
+
+  //-----------------------------------------------------------------------------
+  /// Compute the largest distance of the points of an original line from the polyline of a decimated line.
+  /// The points of the decimated line are a subset of the original points, so this is the Hausdorff distance.
+  double GetDecimationError(vtkPoints* points, vtkIdList* originalLine, vtkIdList* decimatedLine)
+  {
+    double maximumDistance = 0.0;
+    for (vtkIdType originalIndex=0; originalIndex<originalLine->GetNumberOfIds(); ++originalIndex)
+    {
+      double originalPoint[3] = {0.0, 0.0, 0.0};
+      points->GetPoint(originalLine->GetId(originalIndex), originalPoint);
+      double minimumDistance2 = VTK_DOUBLE_MAX;
+      for (vtkIdType segmentIndex=0; segmentIndex+1<decimatedLine->GetNumberOfIds(); ++segmentIndex)
+      {
+        double segmentStart[3] = {0.0, 0.0, 0.0};
+        double segmentEnd[3] = {0.0, 0.0, 0.0};
+        points->GetPoint(decimatedLine->GetId(segmentIndex), segmentStart);
+        points->GetPoint(decimatedLine->GetId(segmentIndex+1), segmentEnd);
+        double t = 0.0;
+        double closestPoint[3] = {0.0, 0.0, 0.0};
+        minimumDistance2 = std::min(minimumDistance2, vtkLine::DistanceToLine(originalPoint, segmentStart, segmentEnd, t, closestPoint));
+      }
+      maximumDistance = std::max(maximumDistance, sqrt(minimumDistance2));
+    }
+    return maximumDistance;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Convert the contours to closed surface
+  vtkSmartPointer<vtkPolyData> ConvertToClosedSurface(vtkPolyData* contours)
+  {
+    vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> rule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+    vtkSmartPointer<vtkPolyData> closedSurface = vtkSmartPointer<vtkPolyData>::New();
+    if (!rule->Convert(contours, closedSurface))
+    {
+      return NULL;
+    }
+    return closedSurface;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check that two surfaces have the same points and the same polygons in the same order
+  bool AreSurfacesEqual(vtkPolyData* surface1, vtkPolyData* surface2, std::ostream& errorStream)
+  {
+    if ( surface1->GetNumberOfPoints() != surface2->GetNumberOfPoints()
+      || surface1->GetNumberOfPolys() != surface2->GetNumberOfPolys() )
+    {
+      errorStream << "ERROR: Surfaces differ in size: " << surface1->GetNumberOfPoints() << " points and "
+        << surface1->GetNumberOfPolys() << " polygons vs " << surface2->GetNumberOfPoints() << " points and "
+        << surface2->GetNumberOfPolys() << " polygons" << std::endl;
+      return false;
+    }
+    for (vtkIdType pointId=0; pointId<surface1->GetNumberOfPoints(); ++pointId)
+    {
+      double point1[3] = {0.0, 0.0, 0.0};
+      double point2[3] = {0.0, 0.0, 0.0};
+      surface1->GetPoint(pointId, point1);
+      surface2->GetPoint(pointId, point2);
+      if (point1[0] != point2[0] || point1[1] != point2[1] || point1[2] != point2[2])
+      {
+        errorStream << "ERROR: Surfaces differ in point " << pointId << std::endl;
+        return false;
+      }
+    }
+    vtkCellArray* polys1 = surface1->GetPolys();
+    vtkCellArray* polys2 = surface2->GetPolys();
+    vtkIdType numberOfCellPoints1 = 0;
+    vtkIdType* cellPointIds1 = NULL;
+    vtkIdType numberOfCellPoints2 = 0;
+    vtkIdType* cellPointIds2 = NULL;
+    vtkIdType cellIndex = 0;
+    polys1->InitTraversal();
+    polys2->InitTraversal();
+    while (polys1->GetNextCell(numberOfCellPoints1, cellPointIds1) && polys2->GetNextCell(numberOfCellPoints2, cellPointIds2))
+    {
+      bool cellsEqual = (numberOfCellPoints1 == numberOfCellPoints2);
+      for (vtkIdType i=0; cellsEqual && i<numberOfCellPoints1; ++i)
+      {
+        cellsEqual = (cellPointIds1[i] == cellPointIds2[i]);
+      }
+      if (!cellsEqual)
+      {
+        errorStream << "ERROR: Surfaces differ in polygon " << cellIndex << std::endl;
+        return false;
+      }
+      ++cellIndex;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkPlanarContourToClosedSurfaceConversionRuleTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  std::ostream& errorStream = std::cerr;
+
+  vtkSmartPointer<vtkPolyData> contours = CreateBranchingContours();
+
+  // Triangulate the plane pairs one by one
+  vtkSMPTools::Initialize(1);
+  vtkSmartPointer<vtkPolyData> serialSurface = ConvertToClosedSurface(contours);
+  if (!serialSurface || serialSurface->GetNumberOfPolys() == 0)
+  {
+    errorStream << "ERROR: Serial conversion to closed surface failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Triangulate the plane pairs with the default number of threads. The branching plane pair shares its lines
+  // with the neighboring pairs, and the result is repeated to catch differences that only occur sometimes.
+  vtkSMPTools::Initialize();
+  for (int repeatIndex=0; repeatIndex<10; ++repeatIndex)
+  {
+    vtkSmartPointer<vtkPolyData> parallelSurface = ConvertToClosedSurface(contours);
+    if (!parallelSurface)
+    {
+      errorStream << "ERROR: Parallel conversion to closed surface failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (!AreSurfacesEqual(serialSurface, parallelSurface, errorStream))
+    {
+      errorStream << "ERROR: Parallel closed surface differs from the serial one in repetition " << repeatIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Cylinders in a grid, so that the overlapping lines of the planes are found in different cells of the grid index.
+  // Each cylinder contour must be connected only to the contour of the same cylinder in the next plane, with one
+  // triangle for each segment of the two contours.
+  vtkSmartPointer<vtkPolyData> gridContours = CreateCylinderGridContours();
+  vtkSmartPointer<vtkPolyData> gridSurface = ConvertToClosedSurface(gridContours);
+  if (!gridSurface)
+  {
+    errorStream << "ERROR: Conversion of the cylinder grid to closed surface failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const int numberOfGridCylinders = GRID_CYLINDER_COUNT * GRID_CYLINDER_COUNT;
+  const vtkIdType numberOfGridContourPoints = gridContours->GetNumberOfPoints();
+  std::vector<int> numberOfConnectingTriangles(numberOfGridCylinders * (GRID_PLANE_COUNT-1), 0);
+  vtkCellArray* gridPolys = gridSurface->GetPolys();
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  for (gridPolys->InitTraversal(); gridPolys->GetNextCell(numberOfCellPoints, cellPointIds); )
+  {
+    // Triangles using points added by end-capping are not between two planes
+    bool onContourPoints = true;
+    int minimumPlaneIndex = GRID_PLANE_COUNT;
+    int maximumPlaneIndex = -1;
+    int cylinderIndex = (int)(cellPointIds[0] / GRID_CONTOUR_POINT_COUNT) % numberOfGridCylinders;
+    bool onSameCylinder = true;
+    for (vtkIdType i=0; i<numberOfCellPoints; ++i)
+    {
+      if (cellPointIds[i] >= numberOfGridContourPoints)
+      {
+        onContourPoints = false;
+        break;
+      }
+      int planeIndex = (int)(cellPointIds[i] / (GRID_CONTOUR_POINT_COUNT * numberOfGridCylinders));
+      minimumPlaneIndex = std::min(minimumPlaneIndex, planeIndex);
+      maximumPlaneIndex = std::max(maximumPlaneIndex, planeIndex);
+      onSameCylinder = onSameCylinder && ((int)(cellPointIds[i] / GRID_CONTOUR_POINT_COUNT) % numberOfGridCylinders == cylinderIndex);
+    }
+    if (!onContourPoints || minimumPlaneIndex == maximumPlaneIndex)
+    {
+      continue;
+    }
+    if (!onSameCylinder || maximumPlaneIndex != minimumPlaneIndex+1)
+    {
+      errorStream << "ERROR: Triangle connects contours of different cylinders or non-consecutive planes" << std::endl;
+      return EXIT_FAILURE;
+    }
+    ++numberOfConnectingTriangles[minimumPlaneIndex * numberOfGridCylinders + cylinderIndex];
+  }
+  for (size_t pairIndex=0; pairIndex<numberOfConnectingTriangles.size(); ++pairIndex)
+  {
+    if (numberOfConnectingTriangles[pairIndex] != 2*GRID_CONTOUR_POINT_COUNT)
+    {
+      errorStream << "ERROR: Cylinder " << pairIndex % numberOfGridCylinders << " is connected between plane "
+        << pairIndex / numberOfGridCylinders << " and the next plane by " << numberOfConnectingTriangles[pairIndex]
+        << " triangles instead of " << 2*GRID_CONTOUR_POINT_COUNT << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The contours are sorted and oriented before triangulation, so the order of the planes and the orientation of the
+  // contours in the input must not change the surface
+  vtkSmartPointer<vtkPolyData> shuffledSurface = ConvertToClosedSurface(CreateBranchingContours(true));
+  if (!shuffledSurface)
+  {
+    errorStream << "ERROR: Conversion of the shuffled contours to closed surface failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkMassProperties> serialSurfaceProperties = vtkSmartPointer<vtkMassProperties>::New();
+  serialSurfaceProperties->SetInputData(serialSurface);
+  serialSurfaceProperties->Update();
+  vtkSmartPointer<vtkMassProperties> shuffledSurfaceProperties = vtkSmartPointer<vtkMassProperties>::New();
+  shuffledSurfaceProperties->SetInputData(shuffledSurface);
+  shuffledSurfaceProperties->Update();
+  if ( shuffledSurface->GetNumberOfPoints() != serialSurface->GetNumberOfPoints()
+    || shuffledSurface->GetNumberOfPolys() != serialSurface->GetNumberOfPolys()
+    || fabs(shuffledSurfaceProperties->GetVolume() - serialSurfaceProperties->GetVolume()) > 1e-6 * serialSurfaceProperties->GetVolume() )
+  {
+    errorStream << "ERROR: Surface of the shuffled contours (" << shuffledSurface->GetNumberOfPoints() << " points, "
+      << shuffledSurface->GetNumberOfPolys() << " polygons, volume " << shuffledSurfaceProperties->GetVolume()
+      << ") differs from the surface of the ordered contours (" << serialSurface->GetNumberOfPoints() << " points, "
+      << serialSurface->GetNumberOfPolys() << " polygons, volume " << serialSurfaceProperties->GetVolume() << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Decimate a square with ten points on each side and a circle with 64 points to a quarter of their points.
+  // Only the collinear points of the square are removed, which does not move the line. The circle is decimated until
+  // 16 of its 65 point ids remain (including the closing point), and the remaining polygon must stay close to the circle.
+  vtkSmartPointer<vtkPolyData> decimationLines = vtkSmartPointer<vtkPolyData>::New();
+  vtkSmartPointer<vtkPoints> decimationPoints = vtkSmartPointer<vtkPoints>::New();
+  decimationLines->SetPoints(decimationPoints);
+  vtkSmartPointer<vtkCellArray> decimationCells = vtkSmartPointer<vtkCellArray>::New();
+  decimationLines->SetLines(decimationCells);
+  decimationCells->InsertNextCell(41);
+  for (int sideIndex=0; sideIndex<4; ++sideIndex)
+  {
+    for (int i=0; i<10; ++i)
+    {
+      double sidePoints[4][2] = { {(double)i, 0.0}, {10.0, (double)i}, {10.0-i, 10.0}, {0.0, 10.0-i} };
+      decimationCells->InsertCellPoint(decimationPoints->InsertNextPoint(sidePoints[sideIndex][0], sidePoints[sideIndex][1], 0.0));
+    }
+  }
+  decimationCells->InsertCellPoint(0);
+  AddCircleContour(decimationLines, 30.0, 5.0, 0.0, 10.0, 64);
+
+  vtkSmartPointer<vtkPolyData> decimatedLines = vtkSmartPointer<vtkPolyData>::New();
+  decimatedLines->DeepCopy(decimationLines);
+  vtkSmartPointer<DecimationTesterRule> decimationRule = vtkSmartPointer<DecimationTesterRule>::New();
+  decimationRule->Decimate(decimatedLines, 0.25);
+  if (decimatedLines->GetNumberOfLines() != 2)
+  {
+    errorStream << "ERROR: Decimation returned " << decimatedLines->GetNumberOfLines() << " lines instead of 2" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const vtkIdType expectedNumberOfDecimatedIds[2] = {5, 16};
+  const double maximumDecimationErrors[2] = {1e-9, 1.0};
+  vtkSmartPointer<vtkIdList> originalLine = vtkSmartPointer<vtkIdList>::New();
+  vtkSmartPointer<vtkIdList> decimatedLine = vtkSmartPointer<vtkIdList>::New();
+  decimationLines->GetLines()->InitTraversal();
+  decimatedLines->GetLines()->InitTraversal();
+  for (int lineIndex=0; lineIndex<2; ++lineIndex)
+  {
+    decimationLines->GetLines()->GetNextCell(originalLine);
+    decimatedLines->GetLines()->GetNextCell(decimatedLine);
+    if ( decimatedLine->GetNumberOfIds() != expectedNumberOfDecimatedIds[lineIndex]
+      || decimatedLine->GetId(0) != decimatedLine->GetId(decimatedLine->GetNumberOfIds()-1) )
+    {
+      errorStream << "ERROR: Decimated line " << lineIndex << " has " << decimatedLine->GetNumberOfIds()
+        << " point ids instead of " << expectedNumberOfDecimatedIds[lineIndex] << ", or is not closed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    double decimationError = GetDecimationError(decimationPoints, originalLine, decimatedLine);
+    if (decimationError > maximumDecimationErrors[lineIndex])
+    {
+      errorStream << "ERROR: Decimated line " << lineIndex << " is " << decimationError
+        << " mm from the original line, more than the allowed " << maximumDecimationErrors[lineIndex] << " mm" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
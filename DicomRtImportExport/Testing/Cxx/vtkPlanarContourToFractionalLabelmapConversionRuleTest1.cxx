@@ -0,0 +1,141 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  const int REFERENCE_IMAGE_SIZE = 30;
+
+  /// Value range of fractional labelmaps
+  const double FRACTIONAL_LABELMAP_MINIMUM_VALUE = -108.0;
+  const double FRACTIONAL_LABELMAP_MAXIMUM_VALUE = 108.0;
+
+  /// Corners of the outer square and of the hole inside it (minimum X, minimum Y, maximum X, maximum Y)
+  const double OUTER_SQUARE[4] = {2.3, 3.6, 9.8, 8.2};
+  const double HOLE_SQUARE[4] = {4.1, 5.2, 6.7, 6.9};
+
+  //-----------------------------------------------------------------------------
+  /// Add a closed axis-aligned rectangle contour to the contour polydata
+  void AddRectangleContour(vtkPolyData* contours, const double corners[4], double z)
+  {
+    vtkPoints* points = contours->GetPoints();
+    vtkCellArray* lines = contours->GetLines();
+    vtkIdType firstPointId = points->GetNumberOfPoints();
+    lines->InsertNextCell(5);
+    lines->InsertCellPoint(points->InsertNextPoint(corners[0], corners[1], z));
+    lines->InsertCellPoint(points->InsertNextPoint(corners[2], corners[1], z));
+    lines->InsertCellPoint(points->InsertNextPoint(corners[2], corners[3], z));
+    lines->InsertCellPoint(points->InsertNextPoint(corners[0], corners[3], z));
+    lines->InsertCellPoint(firstPointId);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Length of the part of [minimum, maximum] within the voxel centered at the given index (unit spacing)
+  double GetOverlap(double minimum, double maximum, int index)
+  {
+    return std::max(0.0, std::min(maximum, index + 0.5) - std::max(minimum, index - 0.5));
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get a voxel value of the labelmap. Voxels outside the extent are empty
+  double GetVoxelValue(vtkOrientedImageData* labelmap, int i, int j, int k)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return FRACTIONAL_LABELMAP_MINIMUM_VALUE;
+    }
+    return labelmap->GetScalarComponentAsDouble(i, j, k, 0);
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkPlanarContourToFractionalLabelmapConversionRuleTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  std::ostream& errorStream = std::cerr;
+
+  // Square with a hole on planes 1 mm apart, followed by a gap and three more planes.
+  // The reference geometry has unit spacing and zero origin, so the voxel indices are the same as the world coordinates,
+  // and the slabs of the planes before the gap are the same as the slices.
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  contours->SetPoints(points);
+  vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+  contours->SetLines(lines);
+  const double planePositions[6] = {10.0, 11.0, 12.0, 16.0, 17.0, 18.0};
+  for (int planeIndex=0; planeIndex<6; ++planeIndex)
+  {
+    AddRectangleContour(contours, OUTER_SQUARE, planePositions[planeIndex]);
+    AddRectangleContour(contours, HOLE_SQUARE, planePositions[planeIndex]);
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> referenceImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  referenceImage->SetExtent(0, REFERENCE_IMAGE_SIZE-1, 0, REFERENCE_IMAGE_SIZE-1, 0, REFERENCE_IMAGE_SIZE-1);
+  vtkSmartPointer<vtkPlanarContourToFractionalLabelmapConversionRule> rule = vtkSmartPointer<vtkPlanarContourToFractionalLabelmapConversionRule>::New();
+  rule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
+    vtkSegmentationConverter::SerializeImageGeometry(referenceImage));
+  vtkSmartPointer<vtkOrientedImageData> fractionalLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!rule->Convert(contours, fractionalLabelmap))
+  {
+    errorStream << "ERROR: Conversion to fractional labelmap failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The fraction of each voxel in the slice of the middle plane is the covered area of the voxel.
+  // The slices in the gap between the planes are filled from the nearest planes, which have the same contours,
+  // so their fractions are the same. Slice 14 is halfway between planes 12 and 16, so it is filled from both.
+  for (int k=11; k<=15; ++k)
+  {
+    for (int j=0; j<=REFERENCE_IMAGE_SIZE/2; ++j)
+    {
+      for (int i=0; i<=REFERENCE_IMAGE_SIZE/2; ++i)
+      {
+        double coveredArea = GetOverlap(OUTER_SQUARE[0], OUTER_SQUARE[2], i) * GetOverlap(OUTER_SQUARE[1], OUTER_SQUARE[3], j)
+          - GetOverlap(HOLE_SQUARE[0], HOLE_SQUARE[2], i) * GetOverlap(HOLE_SQUARE[1], HOLE_SQUARE[3], j);
+        double expectedValue = FRACTIONAL_LABELMAP_MINIMUM_VALUE
+          + coveredArea * (FRACTIONAL_LABELMAP_MAXIMUM_VALUE - FRACTIONAL_LABELMAP_MINIMUM_VALUE);
+        double value = GetVoxelValue(fractionalLabelmap, i, j, k);
+        // The value is rounded to the nearest integer
+        if (fabs(value - expectedValue) > 0.5 + 1e-3)
+        {
+          errorStream << "ERROR: Fractional value of voxel (" << i << ", " << j << ", " << k << ") is " << value
+            << " instead of " << expectedValue << " (covered area " << coveredArea << ")" << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
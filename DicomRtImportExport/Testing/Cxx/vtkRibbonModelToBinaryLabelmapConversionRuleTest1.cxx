@@ -0,0 +1,299 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkPlanarContourToRibbonModelConversionRule.h"
+#include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+#include "vtkOrientedImageData.h"
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  const int REFERENCE_IMAGE_SIZE = 40;
+
+  /// End points of the open contour, far from the closed contours. No voxel center is on the line between them
+  const double OPEN_CONTOUR_START[2] = {31.3, 32.2};
+  const double OPEN_CONTOUR_END[2] = {36.7, 34.6};
+
+  //-----------------------------------------------------------------------------
+  /// Add a closed axis-aligned square contour to the contour polydata
+  void AddSquareContour(vtkPolyData* contours, double minimum, double maximum, double z)
+  {
+    vtkPoints* points = contours->GetPoints();
+    vtkCellArray* lines = contours->GetLines();
+    vtkIdType firstPointId = points->GetNumberOfPoints();
+    lines->InsertNextCell(5);
+    lines->InsertCellPoint(points->InsertNextPoint(minimum, minimum, z));
+    lines->InsertCellPoint(points->InsertNextPoint(maximum, minimum, z));
+    lines->InsertCellPoint(points->InsertNextPoint(maximum, maximum, z));
+    lines->InsertCellPoint(points->InsertNextPoint(minimum, maximum, z));
+    lines->InsertCellPoint(firstPointId);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create contours of a square with a square hole on the given planes, and an open contour of two points
+  /// on the first plane.
+  /// The square edges are halfway between voxel centers, so the filled voxels do not depend on the fill rule at the boundary
+  vtkSmartPointer<vtkPolyData> CreateContours(const std::vector<double>& planePositions)
+  {
+    vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    contours->SetPoints(points);
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    contours->SetLines(lines);
+    for (size_t planeIndex=0; planeIndex<planePositions.size(); ++planeIndex)
+    {
+      AddSquareContour(contours, 5.5, 25.5, planePositions[planeIndex]);
+      AddSquareContour(contours, 12.5, 18.5, planePositions[planeIndex]);
+    }
+    lines->InsertNextCell(2);
+    lines->InsertCellPoint(points->InsertNextPoint(OPEN_CONTOUR_START[0], OPEN_CONTOUR_START[1], planePositions[0]));
+    lines->InsertCellPoint(points->InsertNextPoint(OPEN_CONTOUR_END[0], OPEN_CONTOUR_END[1], planePositions[0]));
+    return contours;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get if a voxel is filled in the labelmap. Voxels outside the extent are empty
+  bool IsVoxelFilled(vtkOrientedImageData* labelmap, int i, int j, int k)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return false;
+    }
+    return labelmap->GetScalarComponentAsDouble(i, j, k, 0) != 0.0;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check that the ribbon of the open contour is a strip of two point pairs, not closed back to its first pair
+  bool CheckOpenContourRibbon(vtkPolyData* ribbonModel, const std::string& caseName, std::ostream& errorStream)
+  {
+    vtkCellArray* strips = ribbonModel->GetStrips();
+    vtkIdType numberOfStripPoints = 0;
+    vtkIdType* stripPointIds = NULL;
+    int numberOfOpenStrips = 0;
+    for (strips->InitTraversal(); strips->GetNextCell(numberOfStripPoints, stripPointIds); )
+    {
+      if (numberOfStripPoints == 4 && stripPointIds[2] != stripPointIds[0])
+      {
+        ++numberOfOpenStrips;
+      }
+    }
+    if (numberOfOpenStrips != 1)
+    {
+      errorStream << "ERROR: " << caseName << ": ribbon model contains " << numberOfOpenStrips
+        << " strips of two point pairs instead of one for the open contour" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Convert the contours on the given planes to ribbon model
+  bool CreateRibbonModel(const std::vector<double>& planePositions, double defaultSliceThickness, vtkPolyData* ribbonModel,
+    const std::string& caseName, std::ostream& errorStream)
+  {
+    vtkSmartPointer<vtkPolyData> contours = CreateContours(planePositions);
+
+    vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule> ribbonRule = vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New();
+    std::ostringstream defaultSliceThicknessStream;
+    defaultSliceThicknessStream << defaultSliceThickness;
+    ribbonRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(),
+      defaultSliceThicknessStream.str());
+    if (!ribbonRule->Convert(contours, ribbonModel))
+    {
+      errorStream << "ERROR: " << caseName << ": conversion to ribbon model failed" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Convert the ribbon model to binary labelmap directly and through the polydata stencil of the closed surface rule,
+  /// and check that the two labelmaps are the same. The reference geometry has unit spacing and zero origin, so the
+  /// voxel indices are the same as the world coordinates
+  bool ConvertAndCompareWithStencil(vtkPolyData* ribbonModel, vtkOrientedImageData* ribbonLabelmap,
+    const std::string& caseName, std::ostream& errorStream)
+  {
+    vtkSmartPointer<vtkOrientedImageData> referenceImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    referenceImage->SetExtent(0, REFERENCE_IMAGE_SIZE-1, 0, REFERENCE_IMAGE_SIZE-1, 0, REFERENCE_IMAGE_SIZE-1);
+    std::string referenceGeometry = vtkSegmentationConverter::SerializeImageGeometry(referenceImage);
+
+    vtkSmartPointer<vtkRibbonModelToBinaryLabelmapConversionRule> ribbonLabelmapRule = vtkSmartPointer<vtkRibbonModelToBinaryLabelmapConversionRule>::New();
+    ribbonLabelmapRule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), referenceGeometry);
+    if (!ribbonLabelmapRule->Convert(ribbonModel, ribbonLabelmap))
+    {
+      errorStream << "ERROR: " << caseName << ": conversion of ribbon model to binary labelmap failed" << std::endl;
+      return false;
+    }
+
+    vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule> stencilRule = vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule>::New();
+    stencilRule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), referenceGeometry);
+    vtkSmartPointer<vtkOrientedImageData> stencilLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!stencilRule->Convert(ribbonModel, stencilLabelmap))
+    {
+      errorStream << "ERROR: " << caseName << ": conversion of ribbon model to binary labelmap through stencil failed" << std::endl;
+      return false;
+    }
+
+    int numberOfDifferentVoxels = 0;
+    for (int k=0; k<REFERENCE_IMAGE_SIZE; ++k)
+    {
+      for (int j=0; j<REFERENCE_IMAGE_SIZE; ++j)
+      {
+        for (int i=0; i<REFERENCE_IMAGE_SIZE; ++i)
+        {
+          if (IsVoxelFilled(ribbonLabelmap, i, j, k) != IsVoxelFilled(stencilLabelmap, i, j, k))
+          {
+            ++numberOfDifferentVoxels;
+          }
+        }
+      }
+    }
+    if (numberOfDifferentVoxels > 0)
+    {
+      errorStream << "ERROR: " << caseName << ": labelmap of the ribbon model differs from the stencil labelmap in "
+        << numberOfDifferentVoxels << " voxels" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Convert the contours to ribbon model, then convert the ribbon model to binary labelmap directly and through the
+  /// polydata stencil of the closed surface rule. Check that the two labelmaps are the same, and that the filled slices
+  /// are the expected ones
+  bool CheckRoundTrip(const std::vector<double>& planePositions, double defaultSliceThickness, int firstFilledSlice,
+    int lastFilledSlice, const std::string& caseName, std::ostream& errorStream)
+  {
+    vtkSmartPointer<vtkPolyData> ribbonModel = vtkSmartPointer<vtkPolyData>::New();
+    if (!CreateRibbonModel(planePositions, defaultSliceThickness, ribbonModel, caseName, errorStream))
+    {
+      return false;
+    }
+    if (!CheckOpenContourRibbon(ribbonModel, caseName, errorStream))
+    {
+      return false;
+    }
+    vtkSmartPointer<vtkOrientedImageData> ribbonLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!ConvertAndCompareWithStencil(ribbonModel, ribbonLabelmap, caseName, errorStream))
+    {
+      return false;
+    }
+
+    // The square is filled in the slices within the ribbons but not the hole, and the open contour has no inside
+    for (int k=0; k<REFERENCE_IMAGE_SIZE; ++k)
+    {
+      bool sliceExpected = (k >= firstFilledSlice && k <= lastFilledSlice);
+      if (IsVoxelFilled(ribbonLabelmap, 8, 8, k) != sliceExpected)
+      {
+        errorStream << "ERROR: " << caseName << ": slice " << k << " is " << (sliceExpected ? "empty" : "filled")
+          << " but it should be " << (sliceExpected ? "filled" : "empty") << std::endl;
+        return false;
+      }
+      if (IsVoxelFilled(ribbonLabelmap, 15, 15, k))
+      {
+        errorStream << "ERROR: " << caseName << ": hole is filled in slice " << k << std::endl;
+        return false;
+      }
+      for (int j=(int)OPEN_CONTOUR_START[1]; j<=(int)OPEN_CONTOUR_END[1]+1; ++j)
+      {
+        for (int i=(int)OPEN_CONTOUR_START[0]; i<=(int)OPEN_CONTOUR_END[0]+1; ++i)
+        {
+          if (IsVoxelFilled(ribbonLabelmap, i, j, k))
+          {
+            errorStream << "ERROR: " << caseName << ": voxel (" << i << ", " << j << ", " << k
+              << ") is filled around the open contour" << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkRibbonModelToBinaryLabelmapConversionRuleTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  std::ostream& errorStream = std::cerr;
+
+  // Planes 3 mm apart, so that the ribbon boundaries (1.5 mm from the planes) are halfway between slices
+  std::vector<double> planePositions;
+  planePositions.push_back(10.0);
+  planePositions.push_back(13.0);
+  planePositions.push_back(16.0);
+  if (!CheckRoundTrip(planePositions, 0.0, 9, 17, "Multiple planes", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The ribbon of a single plane is as wide as the default slice thickness
+  planePositions.clear();
+  planePositions.push_back(10.0);
+  if (!CheckRoundTrip(planePositions, 3.0, 9, 11, "Single plane", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Ribbons of different widths are converted through the stencil. The ribbon of the first contour is widened
+  // upwards by 1 mm, so the labelmap differs from the one the ribbon width of its first point pair would give
+  vtkSmartPointer<vtkPolyData> ribbonModel = vtkSmartPointer<vtkPolyData>::New();
+  if (!CreateRibbonModel(planePositions, 3.0, ribbonModel, "Different widths", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+  vtkIdType numberOfStripPoints = 0;
+  vtkIdType* stripPointIds = NULL;
+  ribbonModel->GetStrips()->InitTraversal();
+  ribbonModel->GetStrips()->GetNextCell(numberOfStripPoints, stripPointIds);
+  std::set<vtkIdType> upperPointIds;
+  for (vtkIdType index=1; index<numberOfStripPoints; index+=2)
+  {
+    upperPointIds.insert(stripPointIds[index]);
+  }
+  for (std::set<vtkIdType>::iterator pointIdIt = upperPointIds.begin(); pointIdIt != upperPointIds.end(); ++pointIdIt)
+  {
+    double point[3] = {0.0, 0.0, 0.0};
+    ribbonModel->GetPoints()->GetPoint(*pointIdIt, point);
+    ribbonModel->GetPoints()->SetPoint(*pointIdIt, point[0], point[1], point[2] + 1.0);
+  }
+  ribbonModel->GetPoints()->Modified();
+  vtkSmartPointer<vtkOrientedImageData> ribbonLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!ConvertAndCompareWithStencil(ribbonModel, ribbonLabelmap, "Different widths", errorStream))
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
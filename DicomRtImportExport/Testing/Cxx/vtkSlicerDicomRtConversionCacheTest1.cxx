@@ -0,0 +1,306 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtConversionCache.h"
+
+// SegmentationCore includes
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkFieldData.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cstdio>
+#include <string>
+
+namespace
+{
+  const char* SOP_INSTANCE_UID = "1.2.826.0.1.3680043.2.1125.1.1";
+  const char* CONVERSION_PARAMETERS = "Default slice thickness&0.0|";
+
+  /// Entries are removed by last use, which is only known with a precision of one second
+  const unsigned int LAST_USE_DELAY_MS = 1100;
+
+  //-----------------------------------------------------------------------------
+  /// Conversion cache giving access to the entry files
+  class ConversionCacheTester : public vtkSlicerDicomRtConversionCache
+  {
+  public:
+    static ConversionCacheTester* New();
+    vtkTypeMacro(ConversionCacheTester, vtkSlicerDicomRtConversionCache);
+    std::string GetEntryFilePath(std::string key) { return this->GetEntryFilePathBase(key) + ".vtp"; };
+  };
+  vtkStandardNewMacro(ConversionCacheTester);
+
+  //-----------------------------------------------------------------------------
+  /// Create a square planar contour
+  vtkSmartPointer<vtkPolyData> CreateContour(double size)
+  {
+    vtkSmartPointer<vtkPolyData> contour = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->InsertNextPoint(0.0, 0.0, 0.0);
+    points->InsertNextPoint(size, 0.0, 0.0);
+    points->InsertNextPoint(size, size, 0.0);
+    points->InsertNextPoint(0.0, size, 0.0);
+    contour->SetPoints(points);
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    lines->InsertNextCell(5);
+    for (vtkIdType pointId=0; pointId<5; ++pointId)
+    {
+      lines->InsertCellPoint(pointId % 4);
+    }
+    contour->SetLines(lines);
+    return contour;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create a closed surface of a tetrahedron
+  vtkSmartPointer<vtkPolyData> CreateClosedSurface()
+  {
+    vtkSmartPointer<vtkPolyData> closedSurface = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->InsertNextPoint(0.0, 0.0, 0.0);
+    points->InsertNextPoint(10.0, 0.0, 0.0);
+    points->InsertNextPoint(0.0, 10.0, 0.0);
+    points->InsertNextPoint(0.0, 0.0, 10.0);
+    closedSurface->SetPoints(points);
+    const vtkIdType triangles[4][3] = { {0,2,1}, {0,1,3}, {0,3,2}, {1,2,3} };
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    for (int triangleIndex=0; triangleIndex<4; ++triangleIndex)
+    {
+      polys->InsertNextCell(3, triangles[triangleIndex]);
+    }
+    closedSurface->SetPolys(polys);
+    return closedSurface;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create poly data with random point coordinates, so that its entry file cannot be compressed much
+  vtkSmartPointer<vtkPolyData> CreateLargePolyData(vtkIdType numberOfPoints)
+  {
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToDouble();
+    points->SetNumberOfPoints(numberOfPoints);
+    for (vtkIdType pointId=0; pointId<numberOfPoints; ++pointId)
+    {
+      points->SetPoint(pointId, vtkMath::Random(), vtkMath::Random(), vtkMath::Random());
+    }
+    polyData->SetPoints(points);
+    return polyData;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check that two poly data have the same points and polygons
+  bool ArePolyDataEqual(vtkPolyData* polyData1, vtkPolyData* polyData2)
+  {
+    if ( polyData1->GetNumberOfPoints() != polyData2->GetNumberOfPoints()
+      || polyData1->GetNumberOfPolys() != polyData2->GetNumberOfPolys() )
+    {
+      return false;
+    }
+    for (vtkIdType pointId=0; pointId<polyData1->GetNumberOfPoints(); ++pointId)
+    {
+      double point1[3] = {0.0, 0.0, 0.0};
+      double point2[3] = {0.0, 0.0, 0.0};
+      polyData1->GetPoint(pointId, point1);
+      polyData2->GetPoint(pointId, point2);
+      if (vtkMath::Distance2BetweenPoints(point1, point2) > 0.0)
+      {
+        return false;
+      }
+    }
+    vtkCellArray* polys1 = polyData1->GetPolys();
+    vtkCellArray* polys2 = polyData2->GetPolys();
+    vtkIdType numberOfPoints1 = 0;
+    vtkIdType numberOfPoints2 = 0;
+    vtkIdType* pointIds1 = NULL;
+    vtkIdType* pointIds2 = NULL;
+    polys1->InitTraversal();
+    polys2->InitTraversal();
+    while (polys1->GetNextCell(numberOfPoints1, pointIds1))
+    {
+      if (!polys2->GetNextCell(numberOfPoints2, pointIds2) || numberOfPoints1 != numberOfPoints2)
+      {
+        return false;
+      }
+      for (vtkIdType index=0; index<numberOfPoints1; ++index)
+      {
+        if (pointIds1[index] != pointIds2[index])
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDicomRtConversionCacheTest1(int argc, char* argv[])
+{
+  std::ostream& errorStream = std::cerr;
+
+  if (argc < 3 || STRCASECMP(argv[1], "-CacheDirectoryPath") != 0)
+  {
+    errorStream << "ERROR: Missing arguments! Usage: vtkSlicerDicomRtConversionCacheTest1 -CacheDirectoryPath <directory>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<ConversionCacheTester> cache = vtkSmartPointer<ConversionCacheTester>::New();
+  cache->SetCacheDirectory(argv[2]);
+  cache->Clear();
+  const char* closedSurfaceName = vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName();
+
+  // Keys differ if any of the conversion inputs differ
+  vtkSmartPointer<vtkPolyData> contour = CreateContour(10.0);
+  std::string key = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 1, closedSurfaceName, CONVERSION_PARAMETERS, contour);
+  std::string otherParametersKey = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 1, closedSurfaceName,
+    "Default slice thickness&2.5|", contour);
+  std::string otherContourKey = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 1, closedSurfaceName,
+    CONVERSION_PARAMETERS, CreateContour(20.0));
+  std::string otherRoiKey = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 2, closedSurfaceName, CONVERSION_PARAMETERS, contour);
+  if ( key.empty() || key == otherParametersKey || key == otherContourKey || key == otherRoiKey
+    || key != vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 1, closedSurfaceName, CONVERSION_PARAMETERS, CreateContour(10.0)) )
+  {
+    errorStream << "ERROR: Cache keys do not identify the conversion inputs" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Store and load
+  vtkSmartPointer<vtkPolyData> closedSurface = CreateClosedSurface();
+  if (!cache->Store(key, closedSurface))
+  {
+    errorStream << "ERROR: Failed to store closed surface" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (closedSurface->GetFieldData()->GetNumberOfArrays() != 0)
+  {
+    errorStream << "ERROR: Storing modified the field data of the closed surface" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (cache->GetCacheSize() == 0)
+  {
+    errorStream << "ERROR: Cache size is zero after storing an entry" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkPolyData> loadedClosedSurface = vtkSmartPointer<vtkPolyData>::New();
+  if (!cache->Load(key, loadedClosedSurface))
+  {
+    errorStream << "ERROR: Failed to load stored closed surface" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!ArePolyDataEqual(closedSurface, loadedClosedSurface) || loadedClosedSurface->GetFieldData()->GetNumberOfArrays() != 0)
+  {
+    errorStream << "ERROR: Loaded closed surface differs from the stored one" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (cache->Load(otherParametersKey, loadedClosedSurface))
+  {
+    errorStream << "ERROR: Closed surface loaded for a key that was not stored" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // An entry file containing another key (as if the file names of the keys collided) is not loaded, and it is removed
+  std::string otherParametersEntryFilePath = cache->GetEntryFilePath(otherParametersKey);
+  if (std::rename(cache->GetEntryFilePath(key).c_str(), otherParametersEntryFilePath.c_str()) != 0)
+  {
+    errorStream << "ERROR: Failed to rename entry file to " << otherParametersEntryFilePath << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (cache->Load(otherParametersKey, loadedClosedSurface))
+  {
+    errorStream << "ERROR: Closed surface loaded from an entry file of another key" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (vtksys::SystemTools::FileExists(otherParametersEntryFilePath.c_str(), true))
+  {
+    errorStream << "ERROR: Entry file of another key is not removed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  cache->Clear();
+  if (cache->GetCacheSize() != 0)
+  {
+    errorStream << "ERROR: Cache size is " << cache->GetCacheSize() << " bytes after clearing" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Eviction. Two entries fit in the cache, three do not, so adding the third one removes the least recently used
+  cache->SetMaximumCacheSizeMB(2);
+  const vtkIdType numberOfLargePoints = 35000;
+  std::string firstKey = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 1, closedSurfaceName, CONVERSION_PARAMETERS, contour);
+  std::string secondKey = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 2, closedSurfaceName, CONVERSION_PARAMETERS, contour);
+  std::string thirdKey = vtkSlicerDicomRtConversionCache::ComputeKey(SOP_INSTANCE_UID, 3, closedSurfaceName, CONVERSION_PARAMETERS, contour);
+  if (!cache->Store(firstKey, CreateLargePolyData(numberOfLargePoints)))
+  {
+    errorStream << "ERROR: Failed to store first large entry" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::Delay(LAST_USE_DELAY_MS);
+  if (!cache->Store(secondKey, CreateLargePolyData(numberOfLargePoints)))
+  {
+    errorStream << "ERROR: Failed to store second large entry" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const vtkTypeUInt64 maximumCacheSize = 2 * 1024 * 1024;
+  vtkTypeUInt64 twoEntriesCacheSize = cache->GetCacheSize();
+  if (twoEntriesCacheSize > maximumCacheSize || 3 * twoEntriesCacheSize / 2 <= maximumCacheSize)
+  {
+    errorStream << "ERROR: Size of two large entries (" << twoEntriesCacheSize << " bytes) is not suitable for testing eviction" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Using the first entry makes the second one the least recently used
+  vtksys::SystemTools::Delay(LAST_USE_DELAY_MS);
+  vtkSmartPointer<vtkPolyData> loadedPolyData = vtkSmartPointer<vtkPolyData>::New();
+  if (!cache->Load(firstKey, loadedPolyData) || loadedPolyData->GetNumberOfPoints() != numberOfLargePoints)
+  {
+    errorStream << "ERROR: Failed to load first large entry" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::Delay(LAST_USE_DELAY_MS);
+  if (!cache->Store(thirdKey, CreateLargePolyData(numberOfLargePoints)))
+  {
+    errorStream << "ERROR: Failed to store third large entry" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (cache->GetCacheSize() > maximumCacheSize)
+  {
+    errorStream << "ERROR: Cache size " << cache->GetCacheSize() << " exceeds the maximum " << maximumCacheSize << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (vtksys::SystemTools::FileExists(cache->GetEntryFilePath(secondKey).c_str(), true))
+  {
+    errorStream << "ERROR: Least recently used entry is not removed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !vtksys::SystemTools::FileExists(cache->GetEntryFilePath(firstKey).c_str(), true)
+    || !vtksys::SystemTools::FileExists(cache->GetEntryFilePath(thirdKey).c_str(), true) )
+  {
+    errorStream << "ERROR: Recently used entries are removed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  cache->Clear();
+  return EXIT_SUCCESS;
+}
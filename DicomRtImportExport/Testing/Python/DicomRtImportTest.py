@@ -36,8 +36,10 @@ class DicomRtImportTest(unittest.TestCase):
     self.TestSection_RetrieveInputData()
     self.TestSection_OpenTempDatabase()
     self.TestSection_ImportStudy()
+    self.TestSection_ExamineForLoad()
     self.TestSection_SelectLoadables()
     self.TestSection_LoadIntoSlicer()
+    self.TestSection_CompareSerialAndParallelStructureSetImport()
     self.TestSection_SaveScene()
     self.TestSection_ClearDatabase()
 
@@ -105,6 +107,54 @@ class DicomRtImportTest(unittest.TestCase):
     self.assertEqual( len(slicer.dicomDatabase.patients()), 1 )
     self.assertIsNotNone( slicer.dicomDatabase.patients()[0] )
 
+  #------------------------------------------------------------------------------
+  def examineFiles(self, fileNames):
+    fileList = vtk.vtkStringArray()
+    for fileName in fileNames:
+      fileList.InsertNextValue(self.dataDir + '/' + fileName)
+    loadablesCollection = vtk.vtkCollection()
+    slicer.modules.dicomrtimportexport.logic().ExamineForLoad(fileList, loadablesCollection)
+    examinedLoadables = {}
+    for loadableIndex in xrange(loadablesCollection.GetNumberOfItems()):
+      loadable = loadablesCollection.GetItemAsObject(loadableIndex)
+      referencedInstanceUIDs = loadable.GetReferencedInstanceUIDs()
+      examinedLoadables[loadable.GetName()] = [referencedInstanceUIDs.GetValue(uidIndex) for uidIndex in xrange(referencedInstanceUIDs.GetNumberOfValues())]
+    return examinedLoadables
+
+  #------------------------------------------------------------------------------
+  def TestSection_ExamineForLoad(self):
+    logging.info("Examine for load")
+
+    fileNames = os.listdir(self.dataDir)
+    structureSetFileName = 'RS.1.2.246.352.71.4.2088656855.2404649.20110920153449.dcm'
+    self.assertIn( structureSetFileName, fileNames )
+
+    # Each RT file is a loadable. The structure set references the images listed in its referenced frame of reference
+    examinedLoadables = self.examineFiles(fileNames)
+    self.assertEqual( len(examinedLoadables), 4 )
+    structureSetNames = [name for name in examinedLoadables if 'RTSTRUCT' in name]
+    self.assertEqual( len(structureSetNames), 1 )
+    self.assertGreater( len(examinedLoadables[structureSetNames[0]]), 0 )
+
+    # Examining the same files again gives the same results from the examined file cache
+    self.assertEqual( self.examineFiles(fileNames), examinedLoadables )
+    structureSetLoadables = self.examineFiles([structureSetFileName])
+    self.assertEqual( structureSetLoadables, { structureSetNames[0] : examinedLoadables[structureSetNames[0]] } )
+
+    # Examine two series in turn, then the first one again. The results are the same whether the first series is
+    # still in the cache, or it has been removed from the cache as the least recently used one
+    otherFileNames = [fileName for fileName in fileNames if fileName != structureSetFileName]
+    otherLoadables = dict([(name, examinedLoadables[name]) for name in examinedLoadables if name != structureSetNames[0]])
+    logic = slicer.modules.dicomrtimportexport.logic()
+    examinedFileCacheMaximumSize = logic.GetExaminedFileCacheMaximumSize()
+    for cacheMaximumSize in [examinedFileCacheMaximumSize, len(otherFileNames)]:
+      logic.SetExaminedFileCacheMaximumSize(cacheMaximumSize)
+      self.assertEqual( self.examineFiles([structureSetFileName]), structureSetLoadables )
+      self.assertEqual( self.examineFiles(otherFileNames), otherLoadables )
+      self.assertEqual( self.examineFiles([structureSetFileName]), structureSetLoadables )
+    logic.SetExaminedFileCacheMaximumSize(examinedFileCacheMaximumSize)
+    self.assertEqual( self.examineFiles(fileNames), examinedLoadables )
+
   #------------------------------------------------------------------------------
   def TestSection_SelectLoadables(self):
     # slicer.util.delayDisplay("Select loadables",self.delayMs)
@@ -156,6 +206,75 @@ class DicomRtImportTest(unittest.TestCase):
     shNode = slicer.vtkMRMLSubjectHierarchyNode.GetSubjectHierarchyNode(slicer.mrmlScene)
     self.assertEqual( shNode.GetNumberOfItems(), 24 )
 
+  #------------------------------------------------------------------------------
+  def TestSection_CompareSerialAndParallelStructureSetImport(self):
+    logging.info("Compare serial and parallel structure set import")
+
+    structureSetFileName = self.dataDir + '/RS.1.2.246.352.71.4.2088656855.2404649.20110920153449.dcm'
+    fileList = vtk.vtkStringArray()
+    fileList.InsertNextValue(structureSetFileName)
+    loadablesCollection = vtk.vtkCollection()
+    logic = slicer.modules.dicomrtimportexport.logic()
+    logic.ExamineForLoad(fileList, loadablesCollection)
+    self.assertEqual( loadablesCollection.GetNumberOfItems(), 1 )
+    loadable = loadablesCollection.GetItemAsObject(0)
+
+    # Load the structure set with one thread and with the default number of threads. The conversion cache is
+    # not used, so that both loads convert the ROIs
+    useConversionCache = logic.GetUseConversionCache()
+    logic.SetUseConversionCache(False)
+    segmentationNodes = []
+    for numberOfThreads in [1, 0]:
+      vtk.vtkSMPTools.Initialize(numberOfThreads)
+      numOfSegmentationNodesBeforeLoad = slicer.mrmlScene.GetNumberOfNodesByClass('vtkMRMLSegmentationNode')
+      self.assertTrue( logic.LoadDicomRT(loadable) )
+      self.assertEqual( slicer.mrmlScene.GetNumberOfNodesByClass('vtkMRMLSegmentationNode'), numOfSegmentationNodesBeforeLoad + 1 )
+      segmentationNodes.append( slicer.mrmlScene.GetNthNodeByClass(numOfSegmentationNodesBeforeLoad, 'vtkMRMLSegmentationNode') )
+    vtk.vtkSMPTools.Initialize(0)
+    logic.SetUseConversionCache(useConversionCache)
+
+    # Segments and their closed surfaces are the same, in the same order
+    serialSegmentation = segmentationNodes[0].GetSegmentation()
+    parallelSegmentation = segmentationNodes[1].GetSegmentation()
+    serialSegmentIDs = vtk.vtkStringArray()
+    serialSegmentation.GetSegmentIDs(serialSegmentIDs)
+    parallelSegmentIDs = vtk.vtkStringArray()
+    parallelSegmentation.GetSegmentIDs(parallelSegmentIDs)
+    self.assertGreater( serialSegmentIDs.GetNumberOfValues(), 1 )
+    self.assertEqual( serialSegmentIDs.GetNumberOfValues(), parallelSegmentIDs.GetNumberOfValues() )
+    closedSurfaceName = slicer.vtkSegmentationConverter.GetSegmentationClosedSurfaceRepresentationName()
+    for segmentIndex in xrange(serialSegmentIDs.GetNumberOfValues()):
+      segmentID = serialSegmentIDs.GetValue(segmentIndex)
+      self.assertEqual( segmentID, parallelSegmentIDs.GetValue(segmentIndex) )
+      serialClosedSurface = serialSegmentation.GetSegment(segmentID).GetRepresentation(closedSurfaceName)
+      parallelClosedSurface = parallelSegmentation.GetSegment(segmentID).GetRepresentation(closedSurfaceName)
+      self.assertIsNotNone( serialClosedSurface )
+      self.assertIsNotNone( parallelClosedSurface )
+      self.assertPolyDataEqual( serialClosedSurface, parallelClosedSurface )
+
+    # Remove the additional segmentations, so that the saved scene contains the objects loaded from the database
+    for segmentationNode in segmentationNodes:
+      slicer.mrmlScene.RemoveNode(segmentationNode)
+
+  #------------------------------------------------------------------------------
+  def assertPolyDataEqual(self, expectedPolyData, polyData):
+    """Check that the point coordinates and the cells of two polydata are the same
+    """
+    self.assertEqual( polyData.GetNumberOfPoints(), expectedPolyData.GetNumberOfPoints() )
+    for pointIndex in xrange(expectedPolyData.GetNumberOfPoints()):
+      self.assertEqual( polyData.GetPoint(pointIndex), expectedPolyData.GetPoint(pointIndex) )
+
+    self.assertEqual( polyData.GetNumberOfCells(), expectedPolyData.GetNumberOfCells() )
+    expectedCellPointIds = vtk.vtkIdList()
+    cellPointIds = vtk.vtkIdList()
+    for cellIndex in xrange(expectedPolyData.GetNumberOfCells()):
+      self.assertEqual( polyData.GetCellType(cellIndex), expectedPolyData.GetCellType(cellIndex) )
+      expectedPolyData.GetCellPoints(cellIndex, expectedCellPointIds)
+      polyData.GetCellPoints(cellIndex, cellPointIds)
+      self.assertEqual( cellPointIds.GetNumberOfIds(), expectedCellPointIds.GetNumberOfIds() )
+      for idIndex in xrange(expectedCellPointIds.GetNumberOfIds()):
+        self.assertEqual( cellPointIds.GetId(idIndex), expectedCellPointIds.GetId(idIndex) )
+
   #------------------------------------------------------------------------------
   def TestSection_SaveScene(self):
     # slicer.util.delayDisplay("Save scene",self.delayMs)
@@ -0,0 +1,632 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkDeformableDoseAccumulationFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkAbstractTransform.h>
+#include <vtkImageData.h>
+#include <vtkLinearTransform.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkDeformableDoseAccumulationFilter);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Tolerance (in voxels) for sampling positions that are just outside of an image due to rounding
+  const double SAMPLING_TOLERANCE = 1.0e-5;
+
+  //----------------------------------------------------------------------------
+  /// Trilinear interpolation in an image buffer using continuous index
+  /// \return False if the position is outside the image, true otherwise
+  template<class T> bool InterpolateTrilinear(const T* scalars, const int extent[6], const vtkIdType increments[3],
+    int numberOfComponents, const double ijk[3], double* value)
+  {
+    vtkIdType offset = 0;
+    vtkIdType step[3] = {0, 0, 0};
+    double fraction[3] = {0.0, 0.0, 0.0};
+    for (int axis=0; axis<3; ++axis)
+    {
+      double index = ijk[axis];
+      if (index < extent[2*axis] - SAMPLING_TOLERANCE || index > extent[2*axis+1] + SAMPLING_TOLERANCE)
+      {
+        return false;
+      }
+      int baseIndex = vtkMath::Floor(index);
+      fraction[axis] = index - baseIndex;
+      if (baseIndex < extent[2*axis])
+      {
+        baseIndex = extent[2*axis];
+        fraction[axis] = 0.0;
+      }
+      if (baseIndex >= extent[2*axis+1])
+      {
+        baseIndex = extent[2*axis+1];
+        fraction[axis] = 0.0;
+      }
+      else
+      {
+        step[axis] = increments[axis];
+      }
+      offset += (baseIndex - extent[2*axis]) * increments[axis];
+    }
+
+    for (int component=0; component<numberOfComponents; ++component)
+    {
+      const T* corner = scalars + offset + component;
+      double v00 = corner[0]                 + fraction[0] * (corner[step[0]]                 - corner[0]);
+      double v10 = corner[step[1]]           + fraction[0] * (corner[step[1]+step[0]]         - corner[step[1]]);
+      double v01 = corner[step[2]]           + fraction[0] * (corner[step[2]+step[0]]         - corner[step[2]]);
+      double v11 = corner[step[2]+step[1]]   + fraction[0] * (corner[step[2]+step[1]+step[0]] - corner[step[2]+step[1]]);
+      double v0 = v00 + fraction[1] * (v10 - v00);
+      double v1 = v01 + fraction[1] * (v11 - v01);
+      value[component] = v0 + fraction[2] * (v1 - v0);
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Apply homogeneous matrix to a point (affine part only)
+  inline void TransformPoint(const double matrix[4][4], const double in[3], double out[3])
+  {
+    for (int row=0; row<3; ++row)
+    {
+      out[row] = matrix[row][0]*in[0] + matrix[row][1]*in[1] + matrix[row][2]*in[2] + matrix[row][3];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<class T> void CopySlabToOutput(const double* accumulator, vtkIdType numberOfVoxels, T* outputPtr)
+  {
+    for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+    {
+      outputPtr[voxelIndex] = static_cast<T>(accumulator[voxelIndex]);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Image buffer with the matrix that maps reference RAS positions to its continuous index
+  struct ImageSampler
+  {
+    void* Scalars;
+    int ScalarType;
+    int Extent[6];
+    vtkIdType Increments[3];
+    double ReferenceRasToIjk[4][4];
+  };
+
+  //----------------------------------------------------------------------------
+  struct DoseSampler
+  {
+    ImageSampler Dose;
+    /// Matrix mapping the RAS frame of the input to its continuous index (used with non-linear transform)
+    double InputRasToIjk[4][4];
+    /// Non-linear reference to input transform, NULL if linear (then it is folded into Dose.ReferenceRasToIjk)
+    vtkAbstractTransform* NonLinearTransform;
+    /// Jacobian determinant of the linear reference to input transform
+    double LinearJacobianDeterminant;
+    /// Index of the displacement field in the field list, -1 if none
+    int FieldIndex;
+    double Weight;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Per-thread buffers. Displacement slabs are cached in three slots per field (slot is slice index modulo 3)
+  /// so that consecutive slices processed by the same thread reuse the neighboring slabs for the Jacobian
+  struct ThreadBuffers
+  {
+    std::vector<double> Accumulator;
+    std::vector< std::vector<double> > DisplacementSlabs;
+    std::vector<int> DisplacementSlabSliceIndices;
+  };
+
+  //----------------------------------------------------------------------------
+  class DeformableDoseAccumulationFunctor
+  {
+  public:
+    DeformableDoseAccumulationFunctor(const int outputExtent[6], const double referenceIjkToRas[4][4],
+        const double referenceRasToIjk[4][4], std::vector<DoseSampler>& doseSamplers,
+        std::vector<ImageSampler>& fieldSamplers, bool jacobianWeighting, vtkImageData* outputImage)
+      : DoseSamplers(doseSamplers)
+      , FieldSamplers(fieldSamplers)
+      , JacobianWeighting(jacobianWeighting)
+      , OutputScalars(outputImage->GetScalarPointer())
+      , OutputScalarType(outputImage->GetScalarType())
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->OutputExtent[i] = outputExtent[i];
+      }
+      for (int row=0; row<4; ++row)
+      {
+        for (int col=0; col<4; ++col)
+        {
+          this->ReferenceIjkToRas[row][col] = referenceIjkToRas[row][col];
+          this->ReferenceRasToIjk[row][col] = referenceRasToIjk[row][col];
+        }
+      }
+      this->SliceSize = (vtkIdType)(outputExtent[1]-outputExtent[0]+1) * (vtkIdType)(outputExtent[3]-outputExtent[2]+1);
+    }
+
+    void Initialize()
+    {
+      ThreadBuffers& buffers = this->Buffers.Local();
+      buffers.Accumulator.resize(this->SliceSize);
+      buffers.DisplacementSlabs.resize(3 * this->FieldSamplers.size());
+      buffers.DisplacementSlabSliceIndices.assign(3 * this->FieldSamplers.size(), VTK_INT_MIN);
+      for (std::vector< std::vector<double> >::iterator slabIt=buffers.DisplacementSlabs.begin(); slabIt!=buffers.DisplacementSlabs.end(); ++slabIt)
+      {
+        slabIt->resize(3 * this->SliceSize);
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      ThreadBuffers& buffers = this->Buffers.Local();
+      double* accumulator = &(buffers.Accumulator[0]);
+
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        std::fill(buffers.Accumulator.begin(), buffers.Accumulator.end(), 0.0);
+
+        for (std::vector<DoseSampler>::iterator samplerIt=this->DoseSamplers.begin(); samplerIt!=this->DoseSamplers.end(); ++samplerIt)
+        {
+          DoseSampler& sampler = (*samplerIt);
+          switch (sampler.Dose.ScalarType)
+          {
+            vtkTemplateMacro(this->AccumulateSlab<VTK_TT>(sampler, (int)k, buffers, accumulator));
+          }
+        }
+
+        // Store accumulated slab in the output
+        vtkIdType sliceOffset = (k - this->OutputExtent[4]) * this->SliceSize;
+        switch (this->OutputScalarType)
+        {
+          vtkTemplateMacro(CopySlabToOutput<VTK_TT>(accumulator, this->SliceSize, static_cast<VTK_TT*>(this->OutputScalars) + sliceOffset));
+        }
+      }
+    }
+
+    void Reduce()
+    {
+    }
+
+  protected:
+    //----------------------------------------------------------------------------
+    /// Get displacement vectors of a slab. The field is sampled at the reference voxel positions
+    /// only if the slab is not in the per-thread cache yet
+    const double* GetDisplacementSlab(int fieldIndex, int k, ThreadBuffers& buffers)
+    {
+      int slot = 3 * fieldIndex + ((k % 3) + 3) % 3;
+      std::vector<double>& slab = buffers.DisplacementSlabs[slot];
+      if (buffers.DisplacementSlabSliceIndices[slot] == k)
+      {
+        return &(slab[0]);
+      }
+
+      ImageSampler& field = this->FieldSamplers[fieldIndex];
+      switch (field.ScalarType)
+      {
+        vtkTemplateMacro(this->SampleDisplacementSlab<VTK_TT>(field, k, &(slab[0])));
+      }
+      buffers.DisplacementSlabSliceIndices[slot] = k;
+      return &(slab[0]);
+    }
+
+    //----------------------------------------------------------------------------
+    template<class T> void SampleDisplacementSlab(ImageSampler& field, int k, double* displacementSlab)
+    {
+      const T* fieldScalars = static_cast<const T*>(field.Scalars);
+      double* displacement = displacementSlab;
+      for (int j=this->OutputExtent[2]; j<=this->OutputExtent[3]; ++j)
+      {
+        for (int i=this->OutputExtent[0]; i<=this->OutputExtent[1]; ++i, displacement+=3)
+        {
+          double referenceIjk[3] = {(double)i, (double)j, (double)k};
+          double referenceRas[3] = {0.0, 0.0, 0.0};
+          TransformPoint(this->ReferenceIjkToRas, referenceIjk, referenceRas);
+          double fieldIjk[3] = {0.0, 0.0, 0.0};
+          TransformPoint(field.ReferenceRasToIjk, referenceRas, fieldIjk);
+          if (!InterpolateTrilinear<T>(fieldScalars, field.Extent, field.Increments, 3, fieldIjk, displacement))
+          {
+            // No displacement outside the field
+            displacement[0] = displacement[1] = displacement[2] = 0.0;
+          }
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    /// Compute the Jacobian determinant of the displacement (det(I + grad u)) at a voxel of a slab
+    double GetDisplacementJacobianDeterminant(int i, int j, int k, int fieldIndex, ThreadBuffers& buffers)
+    {
+      int dimensions[2] = { this->OutputExtent[1]-this->OutputExtent[0]+1, this->OutputExtent[3]-this->OutputExtent[2]+1 };
+      int previousK = std::max(k-1, this->OutputExtent[4]);
+      int nextK = std::min(k+1, this->OutputExtent[5]);
+      const double* currentSlab = this->GetDisplacementSlab(fieldIndex, k, buffers);
+      const double* previousSlab = this->GetDisplacementSlab(fieldIndex, previousK, buffers);
+      const double* nextSlab = this->GetDisplacementSlab(fieldIndex, nextK, buffers);
+
+      int localI = i - this->OutputExtent[0];
+      int localJ = j - this->OutputExtent[2];
+      int previousI = std::max(localI-1, 0);
+      int nextI = std::min(localI+1, dimensions[0]-1);
+      int previousJ = std::max(localJ-1, 0);
+      int nextJ = std::min(localJ+1, dimensions[1]-1);
+
+      // Derivatives of the displacement components along the reference IJK axes
+      double displacementDerivativeIjk[3][3] = {{0.0,0.0,0.0},{0.0,0.0,0.0},{0.0,0.0,0.0}};
+      for (int component=0; component<3; ++component)
+      {
+        if (nextI > previousI)
+        {
+          displacementDerivativeIjk[component][0] = ( currentSlab[3*(localJ*dimensions[0]+nextI)+component]
+            - currentSlab[3*(localJ*dimensions[0]+previousI)+component] ) / (nextI-previousI);
+        }
+        if (nextJ > previousJ)
+        {
+          displacementDerivativeIjk[component][1] = ( currentSlab[3*(nextJ*dimensions[0]+localI)+component]
+            - currentSlab[3*(previousJ*dimensions[0]+localI)+component] ) / (nextJ-previousJ);
+        }
+        if (nextK > previousK)
+        {
+          displacementDerivativeIjk[component][2] = ( nextSlab[3*(localJ*dimensions[0]+localI)+component]
+            - previousSlab[3*(localJ*dimensions[0]+localI)+component] ) / (nextK-previousK);
+        }
+      }
+
+      // Jacobian in RAS: I + dU/dIjk * dIjk/dRas
+      double jacobian[3][3] = {{1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,0.0,1.0}};
+      for (int row=0; row<3; ++row)
+      {
+        for (int col=0; col<3; ++col)
+        {
+          for (int axis=0; axis<3; ++axis)
+          {
+            jacobian[row][col] += displacementDerivativeIjk[row][axis] * this->ReferenceRasToIjk[axis][col];
+          }
+        }
+      }
+      return vtkMath::Determinant3x3(jacobian);
+    }
+
+    //----------------------------------------------------------------------------
+    template<class T> void AccumulateSlab(DoseSampler& sampler, int k, ThreadBuffers& buffers, double* accumulator)
+    {
+      const T* doseScalars = static_cast<const T*>(sampler.Dose.Scalars);
+      const double* displacement = NULL;
+      if (sampler.FieldIndex >= 0)
+      {
+        displacement = this->GetDisplacementSlab(sampler.FieldIndex, k, buffers);
+      }
+
+      double* accumulatorPtr = accumulator;
+      for (int j=this->OutputExtent[2]; j<=this->OutputExtent[3]; ++j)
+      {
+        for (int i=this->OutputExtent[0]; i<=this->OutputExtent[1]; ++i, ++accumulatorPtr)
+        {
+          double referenceIjk[3] = {(double)i, (double)j, (double)k};
+          double position[3] = {0.0, 0.0, 0.0};
+          TransformPoint(this->ReferenceIjkToRas, referenceIjk, position);
+          if (displacement)
+          {
+            position[0] += displacement[0];
+            position[1] += displacement[1];
+            position[2] += displacement[2];
+            displacement += 3;
+          }
+
+          double jacobianDeterminant = sampler.LinearJacobianDeterminant;
+          double doseIjk[3] = {0.0, 0.0, 0.0};
+          if (sampler.NonLinearTransform)
+          {
+            double inputRas[3] = {0.0, 0.0, 0.0};
+            if (this->JacobianWeighting)
+            {
+              double transformDerivative[3][3] = {{1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,0.0,1.0}};
+              sampler.NonLinearTransform->InternalTransformDerivative(position, inputRas, transformDerivative);
+              jacobianDeterminant *= vtkMath::Determinant3x3(transformDerivative);
+            }
+            else
+            {
+              sampler.NonLinearTransform->InternalTransformPoint(position, inputRas);
+            }
+            TransformPoint(sampler.InputRasToIjk, inputRas, doseIjk);
+          }
+          else
+          {
+            TransformPoint(sampler.Dose.ReferenceRasToIjk, position, doseIjk);
+          }
+
+          double doseValue = 0.0;
+          if (!InterpolateTrilinear<T>(doseScalars, sampler.Dose.Extent, sampler.Dose.Increments, 1, doseIjk, &doseValue))
+          {
+            continue;
+          }
+
+          if (this->JacobianWeighting && sampler.FieldIndex >= 0)
+          {
+            jacobianDeterminant *= this->GetDisplacementJacobianDeterminant(i, j, k, sampler.FieldIndex, buffers);
+          }
+          (*accumulatorPtr) += sampler.Weight * doseValue * (this->JacobianWeighting ? jacobianDeterminant : 1.0);
+        }
+      }
+    }
+
+  protected:
+    int OutputExtent[6];
+    double ReferenceIjkToRas[4][4];
+    double ReferenceRasToIjk[4][4];
+    vtkIdType SliceSize;
+    std::vector<DoseSampler>& DoseSamplers;
+    std::vector<ImageSampler>& FieldSamplers;
+    bool JacobianWeighting;
+    void* OutputScalars;
+    int OutputScalarType;
+    vtkSMPThreadLocal<ThreadBuffers> Buffers;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Set up sampler for an oriented image. The reference RAS to image IJK matrix is
+  /// referenceRasToImageRas (may be NULL for identity) followed by the image RAS to IJK matrix
+  void InitializeImageSampler(vtkOrientedImageData* image, vtkMatrix4x4* referenceRasToImageRas, ImageSampler& sampler)
+  {
+    sampler.Scalars = image->GetScalarPointer();
+    sampler.ScalarType = image->GetScalarType();
+    image->GetExtent(sampler.Extent);
+    image->GetIncrements(sampler.Increments);
+
+    vtkSmartPointer<vtkMatrix4x4> imageRasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    image->GetWorldToImageMatrix(imageRasToIjkMatrix);
+    vtkSmartPointer<vtkMatrix4x4> referenceRasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (referenceRasToImageRas)
+    {
+      vtkMatrix4x4::Multiply4x4(imageRasToIjkMatrix, referenceRasToImageRas, referenceRasToIjkMatrix);
+    }
+    else
+    {
+      referenceRasToIjkMatrix->DeepCopy(imageRasToIjkMatrix);
+    }
+    for (int row=0; row<4; ++row)
+    {
+      for (int col=0; col<4; ++col)
+      {
+        sampler.ReferenceRasToIjk[row][col] = referenceRasToIjkMatrix->GetElement(row, col);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkDeformableDoseAccumulationFilter::vtkDeformableDoseAccumulationFilter()
+{
+  this->Output = vtkSmartPointer<vtkImageData>::New();
+  this->OutputScalarType = -1;
+  this->JacobianWeighting = false;
+}
+
+//----------------------------------------------------------------------------
+vtkDeformableDoseAccumulationFilter::~vtkDeformableDoseAccumulationFilter()
+{
+  this->Inputs.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkDeformableDoseAccumulationFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfInputs: " << this->Inputs.size() << "\n";
+  os << indent << "OutputScalarType: " << this->OutputScalarType << "\n";
+  os << indent << "JacobianWeighting: " << (this->JacobianWeighting ? "true" : "false") << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkDeformableDoseAccumulationFilter::SetReferenceImage(vtkOrientedImageData* referenceImage)
+{
+  this->ReferenceImage = referenceImage;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkDeformableDoseAccumulationFilter::AddInput(vtkOrientedImageData* doseImage, double weight,
+  vtkOrientedImageData* displacementField/*=NULL*/, vtkAbstractTransform* referenceToInputTransform/*=NULL*/)
+{
+  if (!doseImage)
+  {
+    vtkErrorMacro("AddInput: Invalid dose image");
+    return;
+  }
+
+  DoseInput input;
+  input.DoseImage = doseImage;
+  input.Weight = weight;
+  input.DisplacementField = displacementField;
+  input.ReferenceToInputTransform = referenceToInputTransform;
+  this->Inputs.push_back(input);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkDeformableDoseAccumulationFilter::RemoveAllInputs()
+{
+  this->Inputs.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkDeformableDoseAccumulationFilter::GetOutput()
+{
+  return this->Output;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDeformableDoseAccumulationFilter::Update()
+{
+  if (!this->ReferenceImage)
+  {
+    vtkErrorMacro("Update: Invalid reference image");
+    return false;
+  }
+  if (this->Inputs.empty())
+  {
+    vtkErrorMacro("Update: No input dose images");
+    return false;
+  }
+
+  // Set up samplers for the displacement fields. Fields shared by several inputs are sampled once
+  std::vector<ImageSampler> fieldSamplers;
+  std::vector<vtkOrientedImageData*> fields;
+  std::vector<DoseSampler> doseSamplers;
+  for (std::vector<DoseInput>::iterator inputIt=this->Inputs.begin(); inputIt!=this->Inputs.end(); ++inputIt)
+  {
+    DoseInput& input = (*inputIt);
+    if (!input.DoseImage->GetPointData() || !input.DoseImage->GetPointData()->GetScalars()
+      || input.DoseImage->GetNumberOfScalarComponents() != 1)
+    {
+      vtkErrorMacro("Update: Input dose images must have single component scalars");
+      return false;
+    }
+
+    DoseSampler doseSampler;
+    doseSampler.Weight = input.Weight;
+    doseSampler.FieldIndex = -1;
+    doseSampler.NonLinearTransform = NULL;
+    doseSampler.LinearJacobianDeterminant = 1.0;
+
+    if (input.DisplacementField)
+    {
+      std::vector<vtkOrientedImageData*>::iterator fieldIt = std::find(fields.begin(), fields.end(), input.DisplacementField.GetPointer());
+      if (fieldIt != fields.end())
+      {
+        doseSampler.FieldIndex = (int)(fieldIt - fields.begin());
+      }
+      else
+      {
+        int fieldScalarType = input.DisplacementField->GetScalarType();
+        if ( input.DisplacementField->GetNumberOfScalarComponents() != 3
+          || (fieldScalarType != VTK_FLOAT && fieldScalarType != VTK_DOUBLE) )
+        {
+          vtkErrorMacro("Update: Displacement fields must have 3 float or double components");
+          return false;
+        }
+        ImageSampler fieldSampler;
+        InitializeImageSampler(input.DisplacementField, NULL, fieldSampler);
+        doseSampler.FieldIndex = (int)fields.size();
+        fields.push_back(input.DisplacementField);
+        fieldSamplers.push_back(fieldSampler);
+      }
+    }
+
+    // Fold linear transform into the sampling matrix, keep non-linear one for per-voxel evaluation
+    vtkSmartPointer<vtkMatrix4x4> referenceRasToInputRasMatrix;
+    vtkLinearTransform* linearTransform = vtkLinearTransform::SafeDownCast(input.ReferenceToInputTransform);
+    if (linearTransform)
+    {
+      linearTransform->Update();
+      referenceRasToInputRasMatrix = linearTransform->GetMatrix();
+      double linearPart[3][3] = {{1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,0.0,1.0}};
+      for (int row=0; row<3; ++row)
+      {
+        for (int col=0; col<3; ++col)
+        {
+          linearPart[row][col] = referenceRasToInputRasMatrix->GetElement(row, col);
+        }
+      }
+      doseSampler.LinearJacobianDeterminant = vtkMath::Determinant3x3(linearPart);
+    }
+    else if (input.ReferenceToInputTransform)
+    {
+      // Transform needs to be up-to-date before it is evaluated from multiple threads
+      input.ReferenceToInputTransform->Update();
+      doseSampler.NonLinearTransform = input.ReferenceToInputTransform;
+    }
+    InitializeImageSampler(input.DoseImage, referenceRasToInputRasMatrix, doseSampler.Dose);
+
+    vtkSmartPointer<vtkMatrix4x4> inputRasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    input.DoseImage->GetWorldToImageMatrix(inputRasToIjkMatrix);
+    for (int row=0; row<4; ++row)
+    {
+      for (int col=0; col<4; ++col)
+      {
+        doseSampler.InputRasToIjk[row][col] = inputRasToIjkMatrix->GetElement(row, col);
+      }
+    }
+
+    doseSamplers.push_back(doseSampler);
+  }
+
+  // Allocate output on the reference lattice
+  int outputScalarType = this->OutputScalarType;
+  if (outputScalarType < 0)
+  {
+    outputScalarType = this->ReferenceImage->GetScalarType();
+    if (outputScalarType != VTK_FLOAT && outputScalarType != VTK_DOUBLE)
+    {
+      outputScalarType = VTK_FLOAT;
+    }
+  }
+  int outputExtent[6] = {0,-1,0,-1,0,-1};
+  this->ReferenceImage->GetExtent(outputExtent);
+  this->Output = vtkSmartPointer<vtkImageData>::New();
+  this->Output->SetExtent(outputExtent);
+  this->Output->AllocateScalars(outputScalarType, 1);
+  if (outputExtent[1] < outputExtent[0] || outputExtent[3] < outputExtent[2] || outputExtent[5] < outputExtent[4])
+  {
+    vtkErrorMacro("Update: Empty reference image extent");
+    return false;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> referenceIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->ReferenceImage->GetImageToWorldMatrix(referenceIjkToRasMatrix);
+  vtkSmartPointer<vtkMatrix4x4> referenceRasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->ReferenceImage->GetWorldToImageMatrix(referenceRasToIjkMatrix);
+  double referenceIjkToRas[4][4];
+  double referenceRasToIjk[4][4];
+  for (int row=0; row<4; ++row)
+  {
+    for (int col=0; col<4; ++col)
+    {
+      referenceIjkToRas[row][col] = referenceIjkToRasMatrix->GetElement(row, col);
+      referenceRasToIjk[row][col] = referenceRasToIjkMatrix->GetElement(row, col);
+    }
+  }
+
+  // Warp and accumulate slabs in parallel
+  DeformableDoseAccumulationFunctor functor(outputExtent, referenceIjkToRas, referenceRasToIjk,
+    doseSamplers, fieldSamplers, this->JacobianWeighting, this->Output);
+  vtkSMPTools::For(outputExtent[4], outputExtent[5]+1, functor);
+
+  this->Output->Modified();
+  return true;
+}
@@ -0,0 +1,125 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkDeformableDoseAccumulationFilter - Warp and accumulate dose volumes in one pass
+// .SECTION Description
+
+#ifndef __vtkDeformableDoseAccumulationFilter_h
+#define __vtkDeformableDoseAccumulationFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerDoseAccumulationModuleLogicExport.h"
+
+class vtkAbstractTransform;
+class vtkImageData;
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_DoseAccumulation
+/// \brief Accumulate weighted dose volumes on a reference lattice, pulling each input through
+///   an optional displacement field, without creating resampled intermediate volumes.
+///
+/// For every reference voxel position p (in the RAS frame of the reference) the accumulated dose is
+///   sum_n( weight_n * dose_n( T_n( p + u_n(p) ) ) [* det(J_n(p))] )
+/// where u_n is the displacement field of the n-th input (zero if not specified) and T_n is the
+/// transform from the reference RAS to the RAS frame of the n-th input (identity if not specified).
+/// Displacement fields are 3-component float or double images defined in the reference RAS frame,
+/// and are sampled with trilinear interpolation once per output slab even if shared by several inputs.
+/// If Jacobian weighting is enabled, the warped dose is multiplied by the determinant of the
+/// deformation Jacobian (energy/mass mapping assuming uniform density).
+///
+/// The reference geometry and the inputs are given as oriented image data, so that the input volume
+/// buffers can be shared (shallow copied) instead of copied. Slabs of the output are processed in parallel.
+class VTK_SLICER_DOSEACCUMULATION_LOGIC_EXPORT vtkDeformableDoseAccumulationFilter : public vtkObject
+{
+public:
+  static vtkDeformableDoseAccumulationFilter *New();
+  vtkTypeMacro(vtkDeformableDoseAccumulationFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set reference image defining the output lattice (only the geometry is used)
+  void SetReferenceImage(vtkOrientedImageData* referenceImage);
+
+  /// Add input dose image
+  /// \param doseImage Single component dose image. Its geometry is interpreted in its own RAS frame
+  /// \param weight Weight of the input dose in the accumulated dose
+  /// \param displacementField Optional 3-component displacement field defined in the reference RAS frame.
+  ///   The same field object can be shared by several inputs, in which case it is only sampled once per slab
+  /// \param referenceToInputTransform Optional transform from the reference RAS to the RAS frame of the input.
+  ///   Linear transforms are folded into the sampling matrix, non-linear transforms are evaluated per voxel
+  void AddInput(vtkOrientedImageData* doseImage, double weight,
+    vtkOrientedImageData* displacementField=NULL, vtkAbstractTransform* referenceToInputTransform=NULL);
+
+  /// Remove all input doses
+  void RemoveAllInputs();
+
+  /// Get number of input doses
+  int GetNumberOfInputs() { return (int)this->Inputs.size(); };
+
+  /// Compute accumulated dose
+  /// \return Success flag
+  bool Update();
+
+  /// Get accumulated dose. The image has the extent of the reference image with unit spacing
+  /// and zero origin, as stored in volume nodes (i.e. the geometry needs to be set on the node)
+  vtkImageData* GetOutput();
+
+  /// Scalar type of the output. If not set (-1) then the type of the reference image is used,
+  /// or float if that is an integer type
+  vtkGetMacro(OutputScalarType, int);
+  vtkSetMacro(OutputScalarType, int);
+
+  /// Flag determining whether the warped doses are weighted by the Jacobian determinant of the deformation
+  vtkGetMacro(JacobianWeighting, bool);
+  vtkSetMacro(JacobianWeighting, bool);
+  vtkBooleanMacro(JacobianWeighting, bool);
+
+protected:
+  /// Input dose with the parameters of the warping
+  struct DoseInput
+  {
+    vtkSmartPointer<vtkOrientedImageData> DoseImage;
+    vtkSmartPointer<vtkOrientedImageData> DisplacementField;
+    vtkSmartPointer<vtkAbstractTransform> ReferenceToInputTransform;
+    double Weight;
+  };
+
+protected:
+  vtkSmartPointer<vtkOrientedImageData> ReferenceImage;
+  vtkSmartPointer<vtkImageData> Output;
+  std::vector<DoseInput> Inputs;
+  int OutputScalarType;
+  bool JacobianWeighting;
+
+protected:
+  vtkDeformableDoseAccumulationFilter();
+  ~vtkDeformableDoseAccumulationFilter();
+
+private:
+  vtkDeformableDoseAccumulationFilter(const vtkDeformableDoseAccumulationFilter&); // Not implemented
+  void operator=(const vtkDeformableDoseAccumulationFilter&);               // Not implemented
+};
+
+#endif
@@ -44,7 +44,9 @@ vtkMRMLNodeNewMacro(vtkMRMLDoseAccumulationNode);
 vtkMRMLDoseAccumulationNode::vtkMRMLDoseAccumulationNode()
 {
   this->ShowDoseVolumesOnly = true;
+  this->JacobianWeighting = false;
   this->VolumeNodeIdsToWeightsMap.clear();
+  this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.clear();
 
   this->HideFromEditors = false;
 }
@@ -53,6 +55,7 @@ vtkMRMLDoseAccumulationNode::vtkMRMLDoseAccumulationNode()
 vtkMRMLDoseAccumulationNode::~vtkMRMLDoseAccumulationNode()
 {
   this->VolumeNodeIdsToWeightsMap.clear();
+  this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -71,6 +74,17 @@ void vtkMRMLDoseAccumulationNode::WriteXML(ostream& of, int nIndent)
       }
     of << "\"";
   }
+
+  of << " JacobianWeighting=\"" << (this->JacobianWeighting ? "true" : "false") << "\"";
+
+  {
+    of << " VolumeNodeIdsToDisplacementFieldNodeIdsMap=\"";
+    for (std::map<std::string,std::string>::iterator it = this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.begin(); it != this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.end(); ++it)
+      {
+      of << it->first << ":" << it->second << "|";
+      }
+    of << "\"";
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -121,6 +135,30 @@ void vtkMRMLDoseAccumulationNode::ReadXMLAttributes(const char** atts)
           }
         }
       }
+    else if (!strcmp(attName, "JacobianWeighting")) 
+      {
+      this->JacobianWeighting = 
+        (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "VolumeNodeIdsToDisplacementFieldNodeIdsMap")) 
+      {
+      std::string valueStr(attValue);
+      std::string separatorCharacter("|");
+
+      this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.clear();
+      size_t separatorPosition = valueStr.find( separatorCharacter );
+      while (separatorPosition != std::string::npos)
+        {
+        std::string mapPairStr = valueStr.substr(0, separatorPosition);
+        size_t colonPosition = mapPairStr.find( ":" );
+        if (colonPosition != std::string::npos)
+          {
+          this->VolumeNodeIdsToDisplacementFieldNodeIdsMap[mapPairStr.substr(0, colonPosition)] = mapPairStr.substr(colonPosition+1);
+          }
+        valueStr = valueStr.substr( separatorPosition+1 );
+        separatorPosition = valueStr.find( separatorCharacter );
+        }
+      }
     }
 }
 
@@ -138,6 +176,10 @@ void vtkMRMLDoseAccumulationNode::Copy(vtkMRMLNode *anode)
 
   this->VolumeNodeIdsToWeightsMap = node->VolumeNodeIdsToWeightsMap;
 
+  this->SetJacobianWeighting(node->JacobianWeighting);
+
+  this->VolumeNodeIdsToDisplacementFieldNodeIdsMap = node->VolumeNodeIdsToDisplacementFieldNodeIdsMap;
+
   this->DisableModifiedEventOff();
   this->InvokePendingModifiedEvent();
 }
@@ -157,6 +199,17 @@ void vtkMRMLDoseAccumulationNode::PrintSelf(ostream& os, vtkIndent indent)
       }
     os << "\n";
   }
+
+  os << indent << "JacobianWeighting:   " << (this->JacobianWeighting ? "true" : "false") << "\n";
+
+  {
+    os << indent << "VolumeNodeIdsToDisplacementFieldNodeIdsMap:   ";
+    for (std::map<std::string,std::string>::iterator it = this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.begin(); it != this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.end(); ++it)
+      {
+      os << it->first << ":" << it->second << "|";
+      }
+    os << "\n";
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -270,3 +323,45 @@ double vtkMRMLDoseAccumulationNode::GetWeightForDoseVolume(vtkMRMLScalarVolumeNo
 
   return weightIt->second;
 }
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseAccumulationNode::SetDisplacementFieldForDoseVolume(vtkMRMLScalarVolumeNode* node, vtkMRMLNode* displacementFieldNode)
+{
+  if (!node)
+  {
+    vtkErrorMacro("SetDisplacementFieldForDoseVolume: Invalid dose volume node given");
+    return;
+  }
+  if (displacementFieldNode && !displacementFieldNode->IsA("vtkMRMLVectorVolumeNode") && !displacementFieldNode->IsA("vtkMRMLTransformNode"))
+  {
+    vtkErrorMacro("SetDisplacementFieldForDoseVolume: Displacement field needs to be a vector volume or a transform node");
+    return;
+  }
+
+  if (displacementFieldNode)
+  {
+    this->VolumeNodeIdsToDisplacementFieldNodeIdsMap[node->GetID()] = displacementFieldNode->GetID();
+  }
+  else
+  {
+    this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.erase(node->GetID());
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLNode* vtkMRMLDoseAccumulationNode::GetDisplacementFieldForDoseVolume(vtkMRMLScalarVolumeNode* node)
+{
+  if (!node || !this->Scene)
+  {
+    return NULL;
+  }
+
+  std::map<std::string, std::string>::iterator fieldIt = this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.find(node->GetID());
+  if (fieldIt == this->VolumeNodeIdsToDisplacementFieldNodeIdsMap.end())
+  {
+    return NULL;
+  }
+
+  return this->Scene->GetNodeByID(fieldIt->second);
+}
@@ -61,6 +61,11 @@ public:
   vtkGetMacro(ShowDoseVolumesOnly, bool);
   vtkSetMacro(ShowDoseVolumesOnly, bool);
 
+  /// Enable/Disable weighting the warped doses by the Jacobian determinant of the deformation
+  vtkBooleanMacro(JacobianWeighting, bool);
+  vtkGetMacro(JacobianWeighting, bool);
+  vtkSetMacro(JacobianWeighting, bool);
+
   /// Get input reference dose volume node
   vtkMRMLScalarVolumeNode* GetReferenceDoseVolumeNode();
   /// Set and observe input reference dose volume node
@@ -91,6 +96,19 @@ public:
     return &this->VolumeNodeIdsToWeightsMap;
   }
 
+  /// Set displacement field for an input dose volume node. The dose is pulled through the field
+  /// onto the reference lattice during accumulation.
+  /// \param displacementFieldNode Vector volume (displacements in RAS) or transform node, NULL to remove
+  void SetDisplacementFieldForDoseVolume(vtkMRMLScalarVolumeNode* node, vtkMRMLNode* displacementFieldNode);
+  /// Get displacement field (vector volume or transform node) for an input dose volume node
+  /// \return Displacement field node, NULL if the dose volume is not warped
+  vtkMRMLNode* GetDisplacementFieldForDoseVolume(vtkMRMLScalarVolumeNode* node);
+  /// Get volume node IDs to displacement field node IDs map
+  std::map<std::string,std::string>* GetVolumeNodeIdsToDisplacementFieldNodeIdsMap()
+  {
+    return &this->VolumeNodeIdsToDisplacementFieldNodeIdsMap;
+  }
+
 protected:
   vtkMRMLDoseAccumulationNode();
   ~vtkMRMLDoseAccumulationNode();
@@ -104,6 +122,12 @@ protected:
   /// Map assigning a weight to the available input volume nodes
   /// (as the user set it on the module GUI)
   std::map<std::string, double> VolumeNodeIdsToWeightsMap;
+
+  /// Flag determining whether the warped doses are weighted by the Jacobian determinant of the deformation
+  bool JacobianWeighting;
+
+  /// Map assigning a displacement field (vector volume or transform node) to input volume nodes
+  std::map<std::string, std::string> VolumeNodeIdsToDisplacementFieldNodeIdsMap;
 };
 
 #endif
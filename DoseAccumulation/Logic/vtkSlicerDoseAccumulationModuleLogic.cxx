@@ -22,6 +22,7 @@
 // DoseAccumulation includes
 #include "vtkSlicerDoseAccumulationModuleLogic.h"
 #include "vtkMRMLDoseAccumulationNode.h"
+#include "vtkDeformableDoseAccumulationFilter.h"
 
 // Subject Hierarchy includes
 #include "vtkMRMLSubjectHierarchyConstants.h"
@@ -40,18 +41,22 @@
 #include <vtkMRMLHierarchyNode.h>
 #include <vtkMRMLSelectionNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLVectorVolumeNode.h>
 
-// Slicer includes
-#include <vtkSlicerVolumesLogic.h>
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// vtkAddon includes
+#include <vtkOrientedGridTransform.h>
 
 // VTK includes
 #include <vtkNew.h>
-#include <vtkImageMathematics.h>
 #include <vtkImageData.h>
 #include <vtkSmartPointer.h>
-#include <vtkImageReslice.h>
 #include <vtkGeneralTransform.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
+#include <vtkTransform.h>
 
 //----------------------------------------------------------------------------
 const std::string vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_ATTRIBUTE_PREFIX = "DoseAccumulation.";
@@ -150,6 +155,30 @@ void vtkSlicerDoseAccumulationModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* n
     }
   }
 
+  // Remove displacement field assignments of the removed node (either as dose or as displacement field)
+  if (volumeNode || node->IsA("vtkMRMLTransformNode"))
+  {
+    std::vector<vtkMRMLNode*> nodes;
+    this->GetMRMLScene()->GetNodesByClass("vtkMRMLDoseAccumulationNode", nodes);
+    for (std::vector<vtkMRMLNode*>::iterator nodeIt=nodes.begin(); nodeIt!=nodes.end(); ++nodeIt)
+    {
+      std::map<std::string,std::string>* displacementFieldsMap =
+        vtkMRMLDoseAccumulationNode::SafeDownCast(*nodeIt)->GetVolumeNodeIdsToDisplacementFieldNodeIdsMap();
+      displacementFieldsMap->erase(node->GetID());
+      for (std::map<std::string,std::string>::iterator fieldIt=displacementFieldsMap->begin(); fieldIt!=displacementFieldsMap->end(); )
+      {
+        if (fieldIt->second == node->GetID())
+        {
+          displacementFieldsMap->erase(fieldIt++);
+        }
+        else
+        {
+          ++fieldIt;
+        }
+      }
+    }
+  }
+
   if (node->IsA("vtkMRMLScalarVolumeNode") || node->IsA("vtkMRMLDoseAccumulationNode"))
   {
     this->Modified();
@@ -203,12 +232,21 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     return errorMessage;
   }
 
-  // Get reference image info
-  int referenceDimensions[3] = {0, 0, 0};
-  referenceDoseVolumeNode->GetImageData()->GetDimensions(referenceDimensions);
+  if (!referenceDoseVolumeNode->GetImageData())
+  {
+    std::string errorMessage("No image data in reference volume");
+    vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Set up accumulation on the reference lattice. The input images share the voxel buffers of the volume nodes,
+  // and each input is resampled (and warped if a displacement field is given) directly into the accumulated dose
+  vtkSmartPointer<vtkDeformableDoseAccumulationFilter> accumulationFilter = vtkSmartPointer<vtkDeformableDoseAccumulationFilter>::New();
+  accumulationFilter->SetJacobianWeighting(parameterNode->GetJacobianWeighting());
+  accumulationFilter->SetReferenceImage(this->GetVolumeNodeImageInLocalRas(referenceDoseVolumeNode));
 
-  // Apply weight and accumulate input dose volumes
-  vtkSmartPointer<vtkImageData> accumulatedImageData = vtkSmartPointer<vtkImageData>::New();
+  // Displacement fields are shared if used for multiple inputs
+  std::map<vtkMRMLNode*, vtkSmartPointer<vtkOrientedImageData> > displacementFieldImages;
   for (int inputVolumeIndex = 0; inputVolumeIndex<numberOfInputDoseVolumes; inputVolumeIndex++)
   {
     vtkMRMLScalarVolumeNode* currentInputDoseVolumeNode = parameterNode->GetNthSelectedInputVolumeNode(inputVolumeIndex);
@@ -222,38 +260,73 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     std::map<std::string,double>* volumeNodeIdsToWeightsMap = parameterNode->GetVolumeNodeIdsToWeightsMap();
     double currentWeight = (*volumeNodeIdsToWeightsMap)[currentInputDoseVolumeNode->GetID()];
 
-    vtkMRMLScalarVolumeNode* resampledInputDoseVolumeNode = 
-      vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(currentInputDoseVolumeNode, referenceDoseVolumeNode);
-
-    // Apply weight
-    vtkSmartPointer<vtkImageMathematics> multiplyFilter = vtkSmartPointer<vtkImageMathematics>::New();
-    multiplyFilter->SetInputConnection(resampledInputDoseVolumeNode->GetImageDataConnection());
-    multiplyFilter->SetConstantK(currentWeight);
-    multiplyFilter->SetOperationToMultiplyByK();
-    multiplyFilter->Update();
-
-    // Add (accumulate) current input volume to the intermediate accumulated volume
-    if (inputVolumeIndex > 0)
+    // Transform from the reference RAS to the input RAS (includes the parent transforms of both)
+    vtkSmartPointer<vtkGeneralTransform> referenceToInputGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+    vtkMRMLTransformNode::GetTransformBetweenNodes(referenceDoseVolumeNode->GetParentTransformNode(),
+      currentInputDoseVolumeNode->GetParentTransformNode(), referenceToInputGeneralTransform);
+    vtkSmartPointer<vtkAbstractTransform> referenceToInputTransform = referenceToInputGeneralTransform.GetPointer();
+    vtkSmartPointer<vtkTransform> referenceToInputLinearTransform = vtkSmartPointer<vtkTransform>::New();
+    if (vtkMRMLTransformNode::IsGeneralTransformLinear(referenceToInputGeneralTransform, referenceToInputLinearTransform))
     {
-      vtkSmartPointer<vtkImageMathematics> addFilter = vtkSmartPointer<vtkImageMathematics>::New(); 
-      addFilter->SetInput1Data(accumulatedImageData);
-      addFilter->SetInput2Data(multiplyFilter->GetOutput());
-      addFilter->SetOperationToAdd();
-      addFilter->Update();
-
-      accumulatedImageData->DeepCopy(addFilter->GetOutput());
+      referenceToInputTransform = referenceToInputLinearTransform.GetPointer();
     }
-    // If intermediate accumulated volume is empty (first iteration)
-    // then just copy the weighted input dose volume in it
-    else
+
+    // Get displacement field if specified
+    vtkSmartPointer<vtkOrientedImageData> displacementFieldImage;
+    vtkMRMLNode* displacementFieldNode = parameterNode->GetDisplacementFieldForDoseVolume(currentInputDoseVolumeNode);
+    if (displacementFieldNode)
     {
-      accumulatedImageData->DeepCopy(multiplyFilter->GetOutput());
+      if (displacementFieldImages.find(displacementFieldNode) != displacementFieldImages.end())
+      {
+        displacementFieldImage = displacementFieldImages[displacementFieldNode];
+      }
+      else if (vtkMRMLVectorVolumeNode::SafeDownCast(displacementFieldNode))
+      {
+        displacementFieldImage = this->GetVolumeNodeImageInLocalRas(vtkMRMLVectorVolumeNode::SafeDownCast(displacementFieldNode));
+        displacementFieldImages[displacementFieldNode] = displacementFieldImage;
+      }
+      else if (vtkMRMLTransformNode::SafeDownCast(displacementFieldNode))
+      {
+        // Dose is sampled through the from parent transform, as when the dose is resampled after being put under the transform.
+        // If it is stored as a displacement grid, then the grid is used directly, otherwise the transform is evaluated per voxel
+        vtkMRMLTransformNode* transformNode = vtkMRMLTransformNode::SafeDownCast(displacementFieldNode);
+        vtkOrientedGridTransform* gridTransform = vtkOrientedGridTransform::SafeDownCast(
+          transformNode->GetTransformFromParentAs("vtkOrientedGridTransform", false, true) );
+        if ( gridTransform && gridTransform->GetDisplacementGrid()
+          && gridTransform->GetDisplacementScale() == 1.0 && gridTransform->GetDisplacementShift() == 0.0 )
+        {
+          displacementFieldImage = vtkSmartPointer<vtkOrientedImageData>::New();
+          displacementFieldImage->ShallowCopy(gridTransform->GetDisplacementGrid());
+          if (gridTransform->GetGridDirectionMatrix())
+          {
+            displacementFieldImage->SetDirectionMatrix(gridTransform->GetGridDirectionMatrix());
+          }
+          displacementFieldImages[displacementFieldNode] = displacementFieldImage;
+        }
+        else
+        {
+          vtkSmartPointer<vtkGeneralTransform> warpedToInputTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+          warpedToInputTransform->PostMultiply();
+          warpedToInputTransform->Concatenate(transformNode->GetTransformFromParent());
+          warpedToInputTransform->Concatenate(referenceToInputTransform);
+          referenceToInputTransform = warpedToInputTransform.GetPointer();
+        }
+      }
     }
 
-    // Remove the resample dose currentNode from scene and release the memory
-    this->GetMRMLScene()->RemoveNode(resampledInputDoseVolumeNode);
+    accumulationFilter->AddInput(this->GetVolumeNodeImageInLocalRas(currentInputDoseVolumeNode), currentWeight,
+      displacementFieldImage, referenceToInputTransform);
   }
 
+  // Warp and accumulate all inputs in one pass
+  if (!accumulationFilter->Update())
+  {
+    std::string errorMessage("Failed to accumulate dose volumes");
+    vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage);
+    return errorMessage;
+  }
+  vtkSmartPointer<vtkImageData> accumulatedImageData = accumulationFilter->GetOutput();
+
   // Create display currentNode for the accumulated volume
   vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> outputAccumulatedDoseVolumeDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
   this->GetMRMLScene()->AddNode(outputAccumulatedDoseVolumeDisplayNode); 
@@ -309,8 +382,16 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     return errorMessage;
   }
 
-  // Setup subject hierarchy item for the accumulated dose volume
-  shNode->CreateItem(studyItemID, outputAccumulatedDoseVolumeNode);
+  // Setup subject hierarchy item for the accumulated dose volume (it already exists if the accumulation is repeated)
+  vtkIdType outputShItemID = shNode->GetItemByDataNode(outputAccumulatedDoseVolumeNode);
+  if (outputShItemID == vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    shNode->CreateItem(studyItemID, outputAccumulatedDoseVolumeNode);
+  }
+  else
+  {
+    shNode->SetItemParent(outputShItemID, studyItemID);
+  }
 
   // Set threshold values so that the background is black
   double doseUnitScaling = 1.0;
@@ -325,3 +406,20 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
 
   return "";
 }
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkOrientedImageData> vtkSlicerDoseAccumulationModuleLogic::GetVolumeNodeImageInLocalRas(vtkMRMLVolumeNode* volumeNode)
+{
+  vtkSmartPointer<vtkOrientedImageData> orientedImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!volumeNode || !volumeNode->GetImageData())
+  {
+    return orientedImage;
+  }
+
+  // Shallow copy so that the voxels are not duplicated
+  orientedImage->ShallowCopy(volumeNode->GetImageData());
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  volumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  orientedImage->SetGeometryFromImageToWorldMatrix(ijkToRasMatrix);
+  return orientedImage;
+}
@@ -31,9 +31,14 @@
 // Slicer includes
 #include "vtkSlicerModuleLogic.h"
 
+// VTK includes
+#include <vtkSmartPointer.h>
+
 #include "vtkSlicerDoseAccumulationModuleLogicExport.h"
 
 class vtkMRMLDoseAccumulationNode;
+class vtkMRMLVolumeNode;
+class vtkOrientedImageData;
 
 /// \ingroup SlicerRt_QtModules_DoseAccumulation
 class VTK_SLICER_DOSEACCUMULATION_LOGIC_EXPORT vtkSlicerDoseAccumulationModuleLogic :
@@ -50,7 +55,9 @@ public:
   vtkTypeMacro(vtkSlicerDoseAccumulationModuleLogic,vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
-  /// Accumulates dose volumes with the given IDs and corresponding weights
+  /// Accumulates dose volumes with the given IDs and corresponding weights.
+  /// Inputs that have a displacement field set in the parameter node are warped through the field
+  /// during the accumulation pass (optionally with Jacobian weighting), without intermediate volumes.
   /// \return Error message on failure, NULL otherwise
   std::string AccumulateDoseVolumes(vtkMRMLDoseAccumulationNode* parameterNode);
 
@@ -68,6 +75,10 @@ protected:
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) VTK_OVERRIDE;
   virtual void OnMRMLSceneEndClose() VTK_OVERRIDE;
 
+  /// Get image of a volume node as oriented image in the local RAS frame of the node,
+  /// sharing the voxel buffer of the node (i.e. parent transforms are not applied)
+  vtkSmartPointer<vtkOrientedImageData> GetVolumeNodeImageInLocalRas(vtkMRMLVolumeNode* volumeNode);
+
 private:
   vtkSlicerDoseAccumulationModuleLogic(const vtkSlicerDoseAccumulationModuleLogic&); // Not implemented
   void operator=(const vtkSlicerDoseAccumulationModuleLogic&);               // Not implemented
@@ -34,6 +34,7 @@
 #include <vtkMRMLCoreTestingMacros.h>
 #include <vtkMRMLVolumeArchetypeStorageNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLVectorVolumeNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLScene.h>
 
@@ -43,6 +44,7 @@
 #include <vtkImageAccumulate.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkPointData.h>
 
 // ITK includes
 #if ITK_VERSION_MAJOR > 3
@@ -233,6 +235,86 @@ int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Warp the second dose through a zero displacement field with Jacobian weighting, which needs to give the same result
+  vtkSmartPointer<vtkImageData> displacementFieldImageData = vtkSmartPointer<vtkImageData>::New();
+  displacementFieldImageData->SetExtent(doseScalarVolumeNode->GetImageData()->GetExtent());
+  displacementFieldImageData->AllocateScalars(VTK_FLOAT, 3);
+  displacementFieldImageData->GetPointData()->GetScalars()->FillComponent(0, 0.0);
+  displacementFieldImageData->GetPointData()->GetScalars()->FillComponent(1, 0.0);
+  displacementFieldImageData->GetPointData()->GetScalars()->FillComponent(2, 0.0);
+  vtkSmartPointer<vtkMRMLVectorVolumeNode> displacementFieldNode = vtkSmartPointer<vtkMRMLVectorVolumeNode>::New();
+  displacementFieldNode->SetName("DisplacementField");
+  displacementFieldNode->CopyOrientation(doseScalarVolumeNode);
+  displacementFieldNode->SetAndObserveImageData(displacementFieldImageData);
+  mrmlScene->AddNode(displacementFieldNode);
+
+  paramNode->SetDisplacementFieldForDoseVolume(doseScalarVolumeNode2, displacementFieldNode);
+  paramNode->JacobianWeightingOn();
+  errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  math->SetInput2Data(accumulatedDoseVolumeNode->GetImageData());
+  math->Update();
+  histogram->SetInputData(math->GetOutput());
+  histogram->Update();
+  maxDiff = histogram->GetMax()[0];
+  minDiff = histogram->GetMin()[0];
+
+  if (maxDiff > doseDifferenceCriterion || minDiff < -doseDifferenceCriterion)
+  {
+    std::cerr << "ERROR: Difference between baseline and dose accumulated with displacement field exceeds threshold" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Warp the second dose through a constant displacement of one voxel along the I axis. The warped dose at each
+  // voxel is then the dose of its neighbor along I, and the Jacobian determinant of a constant field is one
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseScalarVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
+  for (int component=0; component<3; ++component)
+  {
+    displacementFieldImageData->GetPointData()->GetScalars()->FillComponent(component, doseIjkToRasMatrix->GetElement(component, 0));
+  }
+  displacementFieldImageData->Modified();
+
+  errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkImageData* doseImageData = doseScalarVolumeNode->GetImageData();
+  vtkImageData* shiftedAccumulatedImageData = accumulatedDoseVolumeNode->GetImageData();
+  int doseExtent[6] = {0, -1, 0, -1, 0, -1};
+  doseImageData->GetExtent(doseExtent);
+  double maxShiftDifference = 0.0;
+  for (int k=doseExtent[4]; k<=doseExtent[5]; ++k)
+  {
+    for (int j=doseExtent[2]; j<=doseExtent[3]; ++j)
+    {
+      // The last column is warped from outside of the dose volume, so it is not checked
+      for (int i=doseExtent[0]; i<doseExtent[1]; ++i)
+      {
+        double expectedDose = 0.5 * doseImageData->GetScalarComponentAsDouble(i, j, k, 0)
+          + 0.5 * doseImageData->GetScalarComponentAsDouble(i+1, j, k, 0);
+        double difference = fabs(shiftedAccumulatedImageData->GetScalarComponentAsDouble(i, j, k, 0) - expectedDose);
+        if (difference > maxShiftDifference)
+        {
+          maxShiftDifference = difference;
+        }
+      }
+    }
+  }
+  if (maxShiftDifference > doseDifferenceCriterion)
+  {
+    std::cerr << "ERROR: Dose warped by one voxel differs from the shifted dose by " << maxShiftDifference << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,1513 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkGammaDoseComparisonFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkImageCast.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkGammaDoseComparisonFilter);
+vtkStandardNewMacro(vtkGammaDoseComparisonFilter::PreparedReferenceData);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Number of progress steps (the slices are processed in this many parallel batches)
+  const int NUMBER_OF_PROGRESS_STEPS = 20;
+
+  /// Lower bound of the dose difference tolerance to avoid division by zero for zero local dose
+  const double MINIMUM_DOSE_DIFFERENCE_TOLERANCE_GY = 1.0e-6;
+
+  /// Tolerance (in voxels) for sampling positions that are just outside of an image due to rounding
+  const double SAMPLING_TOLERANCE = 1.0e-5;
+
+  /// Relative margin of the multi-resolution fail bound. Voxels are only classified as failed if gamma
+  /// is larger than one by this margin, so that rounding cannot change the classification
+  const double MULTI_RESOLUTION_FAIL_MARGIN = 1.0e-3;
+
+  /// Classification of a voxel by the multi-resolution bounds
+  enum VoxelClassification
+  {
+    VoxelPassed,
+    VoxelFailed,
+    VoxelUncertain
+  };
+
+  //----------------------------------------------------------------------------
+  /// Get image with float scalars. No copy is made if the scalars are already float
+  vtkSmartPointer<vtkImageData> GetFloatImage(vtkImageData* image)
+  {
+    if (image->GetScalarType() == VTK_FLOAT)
+    {
+      return image;
+    }
+    vtkNew<vtkImageCast> imageCast;
+    imageCast->SetInputData(image);
+    imageCast->SetOutputScalarTypeToFloat();
+    imageCast->Update();
+    return imageCast->GetOutput();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get image resampled to the reference lattice (if the geometries differ) with float scalars
+  /// \return NULL if resampling failed
+  vtkSmartPointer<vtkImageData> GetFloatImageOnReferenceLattice(vtkOrientedImageData* image,
+    vtkOrientedImageData* referenceImage, bool linearInterpolation)
+  {
+    vtkSmartPointer<vtkOrientedImageData> resampledImage = image;
+    if (!vtkOrientedImageDataResample::DoGeometriesMatch(referenceImage, image))
+    {
+      resampledImage = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+        image, referenceImage, resampledImage, linearInterpolation))
+      {
+        return NULL;
+      }
+    }
+    return GetFloatImage(resampledImage);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Voxel access in a float image by the (i,j,k) index of the reference lattice.
+  /// Voxels outside the extent of the image have zero value
+  struct FloatImageAccessor
+  {
+    FloatImageAccessor()
+      : Scalars(NULL)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = 0;
+      }
+      this->Increments[0] = this->Increments[1] = this->Increments[2] = 0;
+    }
+
+    void SetImage(vtkImageData* image)
+    {
+      this->Scalars = static_cast<const float*>(image->GetScalarPointer());
+      image->GetExtent(this->Extent);
+      image->GetIncrements(this->Increments);
+    }
+
+    inline bool IsInside(int i, int j, int k) const
+    {
+      return i >= this->Extent[0] && i <= this->Extent[1]
+        && j >= this->Extent[2] && j <= this->Extent[3]
+        && k >= this->Extent[4] && k <= this->Extent[5];
+    }
+
+    inline float GetValue(int i, int j, int k) const
+    {
+      if (!this->IsInside(i, j, k))
+      {
+        return 0.0f;
+      }
+      return this->Scalars[ (i-this->Extent[0])*this->Increments[0]
+        + (j-this->Extent[2])*this->Increments[1] + (k-this->Extent[4])*this->Increments[2] ];
+    }
+
+    /// Trilinear interpolation at a continuous index. Positions outside the image have zero value
+    inline double InterpolateValue(const double ijk[3]) const
+    {
+      vtkIdType offset = 0;
+      vtkIdType step[3] = {0, 0, 0};
+      double fraction[3] = {0.0, 0.0, 0.0};
+      for (int axis=0; axis<3; ++axis)
+      {
+        double index = ijk[axis];
+        if (index < this->Extent[2*axis] - SAMPLING_TOLERANCE || index > this->Extent[2*axis+1] + SAMPLING_TOLERANCE)
+        {
+          return 0.0;
+        }
+        int baseIndex = vtkMath::Floor(index);
+        fraction[axis] = index - baseIndex;
+        if (baseIndex < this->Extent[2*axis])
+        {
+          baseIndex = this->Extent[2*axis];
+          fraction[axis] = 0.0;
+        }
+        if (baseIndex >= this->Extent[2*axis+1])
+        {
+          baseIndex = this->Extent[2*axis+1];
+          fraction[axis] = 0.0;
+        }
+        else
+        {
+          step[axis] = this->Increments[axis];
+        }
+        offset += (baseIndex - this->Extent[2*axis]) * this->Increments[axis];
+      }
+
+      const float* corner = this->Scalars + offset;
+      double value00 = corner[0] + fraction[0] * (corner[step[0]] - corner[0]);
+      double value10 = corner[step[1]] + fraction[0] * (corner[step[1]+step[0]] - corner[step[1]]);
+      double value01 = corner[step[2]] + fraction[0] * (corner[step[2]+step[0]] - corner[step[2]]);
+      double value11 = corner[step[2]+step[1]] + fraction[0] * (corner[step[2]+step[1]+step[0]] - corner[step[2]+step[1]]);
+      double value0 = value00 + fraction[1] * (value10 - value00);
+      double value1 = value01 + fraction[1] * (value11 - value01);
+      return value0 + fraction[2] * (value1 - value0);
+    }
+
+    const float* Scalars;
+    int Extent[6];
+    vtkIdType Increments[3];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Gamma parameters in the form used in the voxel loop
+  struct GammaParameters
+  {
+    double ReferenceDoseGy;
+    double DoseDifferenceTolerance;
+    double AnalysisThresholdGy;
+    double MaximumGamma;
+    bool LocalDoseDifference;
+    bool DoseThresholdOnReferenceOnly;
+    double InterpolationGammaBand;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Gamma statistics accumulated by one thread
+  struct GammaStatistics
+  {
+    GammaStatistics()
+      : NumberOfAnalyzedVoxels(0)
+      , NumberOfPassedVoxels(0)
+      , NumberOfRefinedVoxels(0)
+      , NumberOfFullResolutionVoxels(0)
+    {
+    }
+
+    void Reset(int numberOfHistogramBins, int numberOfRegions)
+    {
+      this->NumberOfAnalyzedVoxels = 0;
+      this->NumberOfPassedVoxels = 0;
+      this->NumberOfRefinedVoxels = 0;
+      this->NumberOfFullResolutionVoxels = 0;
+      this->Histogram.assign(numberOfHistogramBins, 0);
+      this->RegionNumberOfAnalyzedVoxels.assign(numberOfRegions, 0);
+      this->RegionNumberOfPassedVoxels.assign(numberOfRegions, 0);
+    }
+
+    void Add(const GammaStatistics& other)
+    {
+      this->NumberOfAnalyzedVoxels += other.NumberOfAnalyzedVoxels;
+      this->NumberOfPassedVoxels += other.NumberOfPassedVoxels;
+      this->NumberOfRefinedVoxels += other.NumberOfRefinedVoxels;
+      this->NumberOfFullResolutionVoxels += other.NumberOfFullResolutionVoxels;
+      for (size_t bin=0; bin<this->Histogram.size() && bin<other.Histogram.size(); ++bin)
+      {
+        this->Histogram[bin] += other.Histogram[bin];
+      }
+      for (size_t region=0; region<this->RegionNumberOfAnalyzedVoxels.size() && region<other.RegionNumberOfAnalyzedVoxels.size(); ++region)
+      {
+        this->RegionNumberOfAnalyzedVoxels[region] += other.RegionNumberOfAnalyzedVoxels[region];
+        this->RegionNumberOfPassedVoxels[region] += other.RegionNumberOfPassedVoxels[region];
+      }
+    }
+
+    vtkIdType NumberOfAnalyzedVoxels;
+    vtkIdType NumberOfPassedVoxels;
+    vtkIdType NumberOfRefinedVoxels;
+    vtkIdType NumberOfFullResolutionVoxels;
+    std::vector<vtkIdType> Histogram;
+    std::vector<vtkIdType> RegionNumberOfAnalyzedVoxels;
+    std::vector<vtkIdType> RegionNumberOfPassedVoxels;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Coarse level of the compare dose for multi-resolution evaluation. Stores the minimum and maximum compare
+  /// dose in blocks of the reference lattice, dilated so that the range of a block contains every compare dose
+  /// within the DTA of any of its voxels
+  struct MultiResolutionBounds
+  {
+    MultiResolutionBounds()
+      : BlockSize(1)
+      , ClassifyFailed(false)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = 0;
+      }
+      this->NumberOfBlocks[0] = this->NumberOfBlocks[1] = this->NumberOfBlocks[2] = 0;
+    }
+
+    /// Build the coarse level
+    /// \param compare Compare dose on the reference lattice
+    /// \param extent Extent of the reference lattice
+    /// \param blockSize Size of the blocks in voxels along each axis
+    /// \param dilation Maximum offset (in voxels along each axis) of the compare doses that can be within the DTA
+    void Build(const FloatImageAccessor& compare, const int extent[6], int blockSize, const int dilation[3])
+    {
+      this->BlockSize = blockSize;
+      for (int axis=0; axis<3; ++axis)
+      {
+        this->Extent[2*axis] = extent[2*axis];
+        this->Extent[2*axis+1] = extent[2*axis+1];
+        this->NumberOfBlocks[axis] = (extent[2*axis+1] - extent[2*axis]) / blockSize + 1;
+      }
+      vtkIdType numberOfBlocks = (vtkIdType)this->NumberOfBlocks[0] * this->NumberOfBlocks[1] * this->NumberOfBlocks[2];
+
+      // Range of each block
+      std::vector<float> blockMinimum(numberOfBlocks, VTK_FLOAT_MAX);
+      std::vector<float> blockMaximum(numberOfBlocks, VTK_FLOAT_MIN);
+      for (int k=extent[4]; k<=extent[5]; ++k)
+      {
+        for (int j=extent[2]; j<=extent[3]; ++j)
+        {
+          for (int i=extent[0]; i<=extent[1]; ++i)
+          {
+            vtkIdType blockIndex = this->GetBlockIndex(i, j, k);
+            float value = compare.GetValue(i, j, k);
+            blockMinimum[blockIndex] = std::min(blockMinimum[blockIndex], value);
+            blockMaximum[blockIndex] = std::max(blockMaximum[blockIndex], value);
+          }
+        }
+      }
+
+      // Dilate block ranges by the neighbor blocks that contain voxels within the DTA of the block
+      int blockDilation[3] = {0, 0, 0};
+      for (int axis=0; axis<3; ++axis)
+      {
+        blockDilation[axis] = (dilation[axis] + blockSize - 1) / blockSize;
+      }
+      this->Minimum.assign(numberOfBlocks, VTK_FLOAT_MAX);
+      this->Maximum.assign(numberOfBlocks, VTK_FLOAT_MIN);
+      for (int bk=0; bk<this->NumberOfBlocks[2]; ++bk)
+      {
+        for (int bj=0; bj<this->NumberOfBlocks[1]; ++bj)
+        {
+          for (int bi=0; bi<this->NumberOfBlocks[0]; ++bi)
+          {
+            vtkIdType blockIndex = bi + this->NumberOfBlocks[0] * ((vtkIdType)bj + (vtkIdType)this->NumberOfBlocks[1] * bk);
+            float minimum = VTK_FLOAT_MAX;
+            float maximum = VTK_FLOAT_MIN;
+            for (int nk=std::max(0, bk-blockDilation[2]); nk<=std::min(this->NumberOfBlocks[2]-1, bk+blockDilation[2]); ++nk)
+            {
+              for (int nj=std::max(0, bj-blockDilation[1]); nj<=std::min(this->NumberOfBlocks[1]-1, bj+blockDilation[1]); ++nj)
+              {
+                for (int ni=std::max(0, bi-blockDilation[0]); ni<=std::min(this->NumberOfBlocks[0]-1, bi+blockDilation[0]); ++ni)
+                {
+                  vtkIdType neighborIndex = ni + this->NumberOfBlocks[0] * ((vtkIdType)nj + (vtkIdType)this->NumberOfBlocks[1] * nk);
+                  minimum = std::min(minimum, blockMinimum[neighborIndex]);
+                  maximum = std::max(maximum, blockMaximum[neighborIndex]);
+                }
+              }
+            }
+            this->Minimum[blockIndex] = minimum;
+            this->Maximum[blockIndex] = maximum;
+          }
+        }
+      }
+    }
+
+    /// Get index of the block containing a voxel of the reference lattice
+    inline vtkIdType GetBlockIndex(int i, int j, int k) const
+    {
+      int bi = (i - this->Extent[0]) / this->BlockSize;
+      int bj = (j - this->Extent[2]) / this->BlockSize;
+      int bk = (k - this->Extent[4]) / this->BlockSize;
+      return bi + this->NumberOfBlocks[0] * ((vtkIdType)bj + (vtkIdType)this->NumberOfBlocks[1] * bk);
+    }
+
+    int BlockSize;
+    int Extent[6];
+    int NumberOfBlocks[3];
+    /// Dilated minimum and maximum compare dose of the blocks
+    std::vector<float> Minimum;
+    std::vector<float> Maximum;
+    /// Flag indicating whether the range can be used to classify failed voxels. If false, only passed voxels
+    /// are classified (e.g. if the sub-voxel search may reach compare doses outside the range)
+    bool ClassifyFailed;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Computes gamma for the voxels of the reference lattice. Gamma values are written to the output
+  /// if it is specified, and are accumulated into statistics in any case. Statistics are identical
+  /// with and without output, and do not depend on the number of threads
+  class GammaFunctor
+  {
+  public:
+    GammaFunctor(const FloatImageAccessor& reference, const FloatImageAccessor& compare, const FloatImageAccessor* mask,
+        const std::vector<vtkGammaDoseComparisonFilter::SearchOffset>& offsets, const GammaParameters& parameters,
+        const int extent[6], const int analysisExtent[6], float* outputScalars, int numberOfHistogramBins,
+        const std::vector<FloatImageAccessor>& regionMasks, const bool* abortExecute)
+      : Reference(reference)
+      , Compare(compare)
+      , Mask(mask)
+      , Offsets(offsets)
+      , Parameters(parameters)
+      , InterpolatedCompare(NULL)
+      , InterpolatedOffsets(NULL)
+      , Bounds(NULL)
+      , OutputScalars(outputScalars)
+      , NumberOfHistogramBins(numberOfHistogramBins)
+      , RegionMasks(regionMasks)
+      , AbortExecute(abortExecute)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = extent[i];
+        this->AnalysisExtent[i] = analysisExtent[i];
+      }
+      this->RowSize = analysisExtent[1] - analysisExtent[0] + 1;
+      this->NumberOfRowsPerSlice = analysisExtent[3] - analysisExtent[2] + 1;
+      this->MaximumGammaSquared = parameters.MaximumGamma * parameters.MaximumGamma;
+      this->Total.Reset(numberOfHistogramBins, (int)regionMasks.size());
+      this->RowGammaSums.assign(this->GetNumberOfRows(), 0.0);
+      for (int row=0; row<3; ++row)
+      {
+        for (int col=0; col<4; ++col)
+        {
+          this->ReferenceIjkToCompareIjk[row][col] = (row == col ? 1.0 : 0.0);
+        }
+      }
+    }
+
+    /// Enable sub-voxel search
+    /// \param compare Compare dose in its original lattice, interpolated at the sub-voxel positions
+    /// \param offsets Sub-voxel search offsets in the reference lattice
+    /// \param referenceIjkToCompareIjk Transform from reference voxel index to compare voxel index
+    void SetInterpolation(const FloatImageAccessor* compare,
+      const std::vector<vtkGammaDoseComparisonFilter::InterpolatedSearchOffset>* offsets, const double referenceIjkToCompareIjk[3][4])
+    {
+      this->InterpolatedCompare = compare;
+      this->InterpolatedOffsets = offsets;
+      for (int row=0; row<3; ++row)
+      {
+        for (int col=0; col<4; ++col)
+        {
+          this->ReferenceIjkToCompareIjk[row][col] = referenceIjkToCompareIjk[row][col];
+        }
+      }
+    }
+
+    /// Enable multi-resolution evaluation. Only pass/fail is determined, the voxels classified by the bounds
+    /// are not searched. Gamma values are not available, so output and gamma statistics are not computed
+    void SetMultiResolutionBounds(const MultiResolutionBounds* bounds)
+    {
+      this->Bounds = bounds;
+    }
+
+    void Initialize()
+    {
+      this->Statistics.Local().Reset(this->NumberOfHistogramBins, (int)this->RegionMasks.size());
+    }
+
+    /// Get number of rows (along the first axis) in the analysis extent
+    vtkIdType GetNumberOfRows() const
+    {
+      if ( this->AnalysisExtent[1] < this->AnalysisExtent[0] || this->AnalysisExtent[3] < this->AnalysisExtent[2]
+        || this->AnalysisExtent[5] < this->AnalysisExtent[4] )
+      {
+        return 0;
+      }
+      return (vtkIdType)this->NumberOfRowsPerSlice * (this->AnalysisExtent[5] - this->AnalysisExtent[4] + 1);
+    }
+
+    /// Compute gamma in rows of the analysis extent. Rows are indexed slice by slice, so that
+    /// the work can be split evenly even if the analysis extent is a single slice
+    void operator()(vtkIdType beginRow, vtkIdType endRow)
+    {
+      GammaStatistics& statistics = this->Statistics.Local();
+      for (vtkIdType rowIndex=beginRow; rowIndex<endRow; ++rowIndex)
+      {
+        if (this->AbortExecute && *(this->AbortExecute))
+        {
+          return;
+        }
+        int j = this->AnalysisExtent[2] + (int)(rowIndex % this->NumberOfRowsPerSlice);
+        int k = this->AnalysisExtent[4] + (int)(rowIndex / this->NumberOfRowsPerSlice);
+        if (this->Bounds)
+        {
+          this->ClassifyRow(statistics, j, k);
+          continue;
+        }
+        float* outputRow = NULL;
+        if (this->OutputScalars)
+        {
+          outputRow = this->OutputScalars + rowIndex * this->RowSize;
+        }
+        // Gamma sum is accumulated per row in a fixed order, so that the mean is reproducible
+        double rowGammaSum = 0.0;
+        for (int i=this->AnalysisExtent[0]; i<=this->AnalysisExtent[1]; ++i)
+        {
+          // Voxels outside the mask are only evaluated for the statistics regions containing them
+          bool inMask = this->IsVoxelInMask(i, j, k);
+          double gamma = 0.0;
+          bool refined = false;
+          bool analyzed = false;
+          if (inMask || this->IsVoxelInAnyRegion(i, j, k))
+          {
+            analyzed = this->ComputeVoxelGamma(i, j, k, gamma, refined);
+          }
+          // Statistics are computed from the stored (float) value so that they match the output image
+          float gammaValue = (analyzed && inMask ? (float)gamma : 0.0f);
+          if (outputRow)
+          {
+            outputRow[i-this->AnalysisExtent[0]] = gammaValue;
+          }
+          if (!analyzed)
+          {
+            continue;
+          }
+          this->AccumulateVoxel(statistics, i, j, k, ((float)gamma <= 1.0f), refined, true, inMask);
+          if (!inMask)
+          {
+            continue;
+          }
+          int bin = (int)(gammaValue / this->Parameters.MaximumGamma * this->NumberOfHistogramBins);
+          bin = std::max(0, std::min(bin, this->NumberOfHistogramBins-1));
+          ++statistics.Histogram[bin];
+          rowGammaSum += gammaValue;
+        }
+        this->RowGammaSums[rowIndex] = rowGammaSum;
+      }
+    }
+
+    void Reduce()
+    {
+      for (vtkSMPThreadLocal<GammaStatistics>::iterator statisticsIt=this->Statistics.begin(); statisticsIt!=this->Statistics.end(); ++statisticsIt)
+      {
+        this->Total.Add(*statisticsIt);
+        // Reset so that the statistics are not added again if the functor is reused for another batch
+        statisticsIt->Reset(this->NumberOfHistogramBins, (int)this->RegionMasks.size());
+      }
+    }
+
+    /// Get accumulated statistics
+    const GammaStatistics& GetStatistics() { return this->Total; }
+
+    /// Get sum of gamma values of the analyzed voxels, summed in row order
+    double GetGammaSum()
+    {
+      double gammaSum = 0.0;
+      for (std::vector<double>::iterator sumIt=this->RowGammaSums.begin(); sumIt!=this->RowGammaSums.end(); ++sumIt)
+      {
+        gammaSum += (*sumIt);
+      }
+      return gammaSum;
+    }
+
+    //----------------------------------------------------------------------------
+    /// Classify the voxels of a row using the multi-resolution bounds, and compute gamma at full resolution
+    /// for the voxels that cannot be classified. Pass/fail is identical to the full evaluation
+    void ClassifyRow(GammaStatistics& statistics, int j, int k) const
+    {
+      for (int i=this->AnalysisExtent[0]; i<=this->AnalysisExtent[1]; ++i)
+      {
+        bool inMask = this->IsVoxelInMask(i, j, k);
+        if (!inMask && !this->IsVoxelInAnyRegion(i, j, k))
+        {
+          continue;
+        }
+        double referenceDose = 0.0;
+        if (!this->IsVoxelAboveThreshold(i, j, k, referenceDose))
+        {
+          continue;
+        }
+        VoxelClassification classification = this->ClassifyVoxel(i, j, k, referenceDose);
+        if (classification != VoxelUncertain)
+        {
+          this->AccumulateVoxel(statistics, i, j, k, (classification == VoxelPassed), false, false, inMask);
+          continue;
+        }
+        double gamma = 0.0;
+        bool refined = false;
+        this->ComputeVoxelGamma(i, j, k, gamma, refined);
+        this->AccumulateVoxel(statistics, i, j, k, ((float)gamma <= 1.0f), refined, true, inMask);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    /// Classify an analyzed voxel using conservative bounds of gamma
+    inline VoxelClassification ClassifyVoxel(int i, int j, int k, double referenceDose) const
+    {
+      double inverseSquaredDoseDifferenceTolerance = this->GetInverseSquaredDoseDifferenceTolerance(referenceDose);
+
+      // The search includes the compare dose at the same position (zero distance), and the sub-voxel search
+      // can only decrease gamma. The expression is the same as in the search, so the bound is exact
+      double doseDifference = referenceDose - this->Compare.GetValue(i, j, k);
+      if (doseDifference * doseDifference * inverseSquaredDoseDifferenceTolerance <= 1.0)
+      {
+        return VoxelPassed;
+      }
+
+      // Gamma is larger than one (by the margin) if all compare doses within the DTA differ by more than the tolerance
+      if (!this->Bounds->ClassifyFailed)
+      {
+        return VoxelUncertain;
+      }
+      vtkIdType blockIndex = this->Bounds->GetBlockIndex(i, j, k);
+      double minimumDoseDifference = std::max(referenceDose - this->Bounds->Maximum[blockIndex],
+        this->Bounds->Minimum[blockIndex] - referenceDose);
+      if ( minimumDoseDifference > 0.0 && minimumDoseDifference * minimumDoseDifference * inverseSquaredDoseDifferenceTolerance
+        > (1.0 + MULTI_RESOLUTION_FAIL_MARGIN) * (1.0 + MULTI_RESOLUTION_FAIL_MARGIN) )
+      {
+        return VoxelFailed;
+      }
+      return VoxelUncertain;
+    }
+
+    //----------------------------------------------------------------------------
+    /// Add an analyzed voxel to the statistics
+    /// \param fullResolution Flag indicating whether gamma was computed by the full resolution search
+    /// \param inMask Flag indicating whether the voxel is in the mask. Voxels outside the mask are only
+    ///   added to the statistics of the regions containing them
+    inline void AccumulateVoxel(GammaStatistics& statistics, int i, int j, int k, bool passed, bool refined, bool fullResolution, bool inMask) const
+    {
+      if (inMask)
+      {
+        ++statistics.NumberOfAnalyzedVoxels;
+        if (passed)
+        {
+          ++statistics.NumberOfPassedVoxels;
+        }
+        if (refined)
+        {
+          ++statistics.NumberOfRefinedVoxels;
+        }
+        if (fullResolution)
+        {
+          ++statistics.NumberOfFullResolutionVoxels;
+        }
+      }
+
+      for (size_t region=0; region<this->RegionMasks.size(); ++region)
+      {
+        if (this->RegionMasks[region].GetValue(i, j, k) != 0.0f)
+        {
+          ++statistics.RegionNumberOfAnalyzedVoxels[region];
+          if (passed)
+          {
+            ++statistics.RegionNumberOfPassedVoxels[region];
+          }
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    /// Compute gamma for a reference voxel. The mask is not checked, as voxels outside the mask are
+    /// still evaluated for the statistics regions
+    /// \param refined Output flag set to true if the sub-voxel search was performed
+    /// \return False if the voxel is not analyzed (below threshold), true otherwise
+    inline bool ComputeVoxelGamma(int i, int j, int k, double& gamma, bool& refined) const
+    {
+      refined = false;
+      double referenceDose = 0.0;
+      if (!this->IsVoxelAboveThreshold(i, j, k, referenceDose))
+      {
+        return false;
+      }
+      double inverseSquaredDoseDifferenceTolerance = this->GetInverseSquaredDoseDifferenceTolerance(referenceDose);
+
+      // Offsets are sorted by distance, so once the distance term reaches the best gamma
+      // no farther voxel can improve it
+      double bestGammaSquared = this->MaximumGammaSquared;
+      for (std::vector<vtkGammaDoseComparisonFilter::SearchOffset>::const_iterator offsetIt=this->Offsets.begin();
+        offsetIt!=this->Offsets.end(); ++offsetIt)
+      {
+        if (offsetIt->NormalizedSquaredDistance >= bestGammaSquared)
+        {
+          break;
+        }
+        int compareI = i + offsetIt->Offset[0];
+        int compareJ = j + offsetIt->Offset[1];
+        int compareK = k + offsetIt->Offset[2];
+        if ( compareI < this->Extent[0] || compareI > this->Extent[1]
+          || compareJ < this->Extent[2] || compareJ > this->Extent[3]
+          || compareK < this->Extent[4] || compareK > this->Extent[5] )
+        {
+          continue;
+        }
+        double doseDifference = referenceDose - this->Compare.GetValue(compareI, compareJ, compareK);
+        double gammaSquared = offsetIt->NormalizedSquaredDistance
+          + doseDifference * doseDifference * inverseSquaredDoseDifferenceTolerance;
+        if (gammaSquared < bestGammaSquared)
+        {
+          bestGammaSquared = gammaSquared;
+        }
+      }
+
+      gamma = sqrt(bestGammaSquared);
+
+      // Refine the search at sub-voxel positions if the result is close to the pass/fail boundary.
+      // The sub-voxel offsets are sorted by distance as well, and the coarse result is the starting point
+      if (this->InterpolatedOffsets && fabs(gamma - 1.0) <= this->Parameters.InterpolationGammaBand)
+      {
+        refined = true;
+        double compareIjkBase[3] = {0.0, 0.0, 0.0};
+        for (int row=0; row<3; ++row)
+        {
+          compareIjkBase[row] = this->ReferenceIjkToCompareIjk[row][0] * i + this->ReferenceIjkToCompareIjk[row][1] * j
+            + this->ReferenceIjkToCompareIjk[row][2] * k + this->ReferenceIjkToCompareIjk[row][3];
+        }
+        for (std::vector<vtkGammaDoseComparisonFilter::InterpolatedSearchOffset>::const_iterator offsetIt=this->InterpolatedOffsets->begin();
+          offsetIt!=this->InterpolatedOffsets->end(); ++offsetIt)
+        {
+          if (offsetIt->NormalizedSquaredDistance >= bestGammaSquared)
+          {
+            break;
+          }
+          // Positions are restricted to the reference lattice as in the coarse search
+          double referenceIjk[3] = { i + offsetIt->Offset[0], j + offsetIt->Offset[1], k + offsetIt->Offset[2] };
+          if ( referenceIjk[0] < this->Extent[0] || referenceIjk[0] > this->Extent[1]
+            || referenceIjk[1] < this->Extent[2] || referenceIjk[1] > this->Extent[3]
+            || referenceIjk[2] < this->Extent[4] || referenceIjk[2] > this->Extent[5] )
+          {
+            continue;
+          }
+          double compareIjk[3] = {0.0, 0.0, 0.0};
+          for (int row=0; row<3; ++row)
+          {
+            compareIjk[row] = compareIjkBase[row] + this->ReferenceIjkToCompareIjk[row][0] * offsetIt->Offset[0]
+              + this->ReferenceIjkToCompareIjk[row][1] * offsetIt->Offset[1] + this->ReferenceIjkToCompareIjk[row][2] * offsetIt->Offset[2];
+          }
+          double doseDifference = referenceDose - this->InterpolatedCompare->InterpolateValue(compareIjk);
+          double gammaSquared = offsetIt->NormalizedSquaredDistance
+            + doseDifference * doseDifference * inverseSquaredDoseDifferenceTolerance;
+          if (gammaSquared < bestGammaSquared)
+          {
+            bestGammaSquared = gammaSquared;
+          }
+        }
+        gamma = sqrt(bestGammaSquared);
+      }
+
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    /// Determine whether a reference voxel is in the mask (all voxels are if there is no mask)
+    inline bool IsVoxelInMask(int i, int j, int k) const
+    {
+      return (!this->Mask || this->Mask->GetValue(i, j, k) != 0.0f);
+    }
+
+    //----------------------------------------------------------------------------
+    /// Determine whether a reference voxel is in any of the statistics regions
+    inline bool IsVoxelInAnyRegion(int i, int j, int k) const
+    {
+      for (size_t region=0; region<this->RegionMasks.size(); ++region)
+      {
+        if (this->RegionMasks[region].GetValue(i, j, k) != 0.0f)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    //----------------------------------------------------------------------------
+    /// Determine whether a reference voxel is analyzed based on the dose (not below the analysis threshold)
+    /// \param referenceDose Output reference dose of the voxel
+    inline bool IsVoxelAboveThreshold(int i, int j, int k, double& referenceDose) const
+    {
+      referenceDose = this->Reference.GetValue(i, j, k);
+      if (referenceDose < this->Parameters.AnalysisThresholdGy)
+      {
+        if ( this->Parameters.DoseThresholdOnReferenceOnly
+          || this->Compare.GetValue(i, j, k) < this->Parameters.AnalysisThresholdGy )
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    inline double GetInverseSquaredDoseDifferenceTolerance(double referenceDose) const
+    {
+      double doseDifferenceTolerance = this->Parameters.DoseDifferenceTolerance
+        * (this->Parameters.LocalDoseDifference ? referenceDose : this->Parameters.ReferenceDoseGy);
+      doseDifferenceTolerance = std::max(doseDifferenceTolerance, MINIMUM_DOSE_DIFFERENCE_TOLERANCE_GY);
+      return 1.0 / (doseDifferenceTolerance * doseDifferenceTolerance);
+    }
+
+  protected:
+    const FloatImageAccessor& Reference;
+    const FloatImageAccessor& Compare;
+    const FloatImageAccessor* Mask;
+    const std::vector<vtkGammaDoseComparisonFilter::SearchOffset>& Offsets;
+    GammaParameters Parameters;
+    const FloatImageAccessor* InterpolatedCompare;
+    const std::vector<vtkGammaDoseComparisonFilter::InterpolatedSearchOffset>* InterpolatedOffsets;
+    double ReferenceIjkToCompareIjk[3][4];
+    const MultiResolutionBounds* Bounds;
+    double MaximumGammaSquared;
+    float* OutputScalars;
+    /// Extent of the images, limiting the search
+    int Extent[6];
+    /// Extent of the voxels for which gamma is computed
+    int AnalysisExtent[6];
+    vtkIdType RowSize;
+    int NumberOfRowsPerSlice;
+    int NumberOfHistogramBins;
+    const std::vector<FloatImageAccessor>& RegionMasks;
+    const bool* AbortExecute;
+    vtkSMPThreadLocal<GammaStatistics> Statistics;
+    GammaStatistics Total;
+    std::vector<double> RowGammaSums;
+  };
+
+  //----------------------------------------------------------------------------
+  bool CompareSearchOffsets(const vtkGammaDoseComparisonFilter::SearchOffset& a, const vtkGammaDoseComparisonFilter::SearchOffset& b)
+  {
+    return a.NormalizedSquaredDistance < b.NormalizedSquaredDistance;
+  }
+
+  //----------------------------------------------------------------------------
+  bool CompareInterpolatedSearchOffsets(const vtkGammaDoseComparisonFilter::InterpolatedSearchOffset& a,
+    const vtkGammaDoseComparisonFilter::InterpolatedSearchOffset& b)
+  {
+    return a.NormalizedSquaredDistance < b.NormalizedSquaredDistance;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparisonFilter::vtkGammaDoseComparisonFilter()
+{
+  this->DtaDistanceToleranceMm = 3.0;
+  this->DoseDifferenceTolerance = 0.03;
+  this->ReferenceDoseGy = 0.0;
+  this->AnalysisThreshold = 0.1;
+  this->MaximumGamma = 2.0;
+  this->UseLinearInterpolation = true;
+  this->LocalDoseDifference = false;
+  this->DoseThresholdOnReferenceOnly = false;
+  this->InterpolationFactor = 1;
+  this->InterpolationGammaBand = 0.3;
+  this->GenerateGammaImage = true;
+  this->NumberOfGammaHistogramBins = 20;
+  this->MultiResolution = false;
+  this->MultiResolutionBlockSize = 4;
+  this->AnalysisExtent[0] = this->AnalysisExtent[2] = this->AnalysisExtent[4] = 0;
+  this->AnalysisExtent[1] = this->AnalysisExtent[3] = this->AnalysisExtent[5] = -1;
+  this->AbortExecute = false;
+
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfPassedVoxels = 0;
+  this->NumberOfRefinedVoxels = 0;
+  this->NumberOfFullResolutionVoxels = 0;
+  this->MeanGamma = 0.0;
+  this->ReferenceDoseUsedGy = 0.0;
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparisonFilter::~vtkGammaDoseComparisonFilter()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "DtaDistanceToleranceMm: " << this->DtaDistanceToleranceMm << "\n";
+  os << indent << "DoseDifferenceTolerance: " << this->DoseDifferenceTolerance << "\n";
+  os << indent << "ReferenceDoseGy: " << this->ReferenceDoseGy << "\n";
+  os << indent << "AnalysisThreshold: " << this->AnalysisThreshold << "\n";
+  os << indent << "MaximumGamma: " << this->MaximumGamma << "\n";
+  os << indent << "UseLinearInterpolation: " << (this->UseLinearInterpolation ? "true" : "false") << "\n";
+  os << indent << "LocalDoseDifference: " << (this->LocalDoseDifference ? "true" : "false") << "\n";
+  os << indent << "DoseThresholdOnReferenceOnly: " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "InterpolationFactor: " << this->InterpolationFactor << "\n";
+  os << indent << "InterpolationGammaBand: " << this->InterpolationGammaBand << "\n";
+  os << indent << "GenerateGammaImage: " << (this->GenerateGammaImage ? "true" : "false") << "\n";
+  os << indent << "NumberOfGammaHistogramBins: " << this->NumberOfGammaHistogramBins << "\n";
+  os << indent << "MultiResolution: " << (this->MultiResolution ? "true" : "false") << "\n";
+  os << indent << "MultiResolutionBlockSize: " << this->MultiResolutionBlockSize << "\n";
+  os << indent << "NumberOfStatisticsRegionMasks: " << this->StatisticsRegionMasks.size() << "\n";
+  os << indent << "AnalysisExtent: " << this->AnalysisExtent[0] << " " << this->AnalysisExtent[1] << " " << this->AnalysisExtent[2]
+    << " " << this->AnalysisExtent[3] << " " << this->AnalysisExtent[4] << " " << this->AnalysisExtent[5] << "\n";
+  os << indent << "AbortExecute: " << (this->AbortExecute ? "true" : "false") << "\n";
+  os << indent << "NumberOfAnalyzedVoxels: " << this->NumberOfAnalyzedVoxels << "\n";
+  os << indent << "NumberOfPassedVoxels: " << this->NumberOfPassedVoxels << "\n";
+  os << indent << "NumberOfRefinedVoxels: " << this->NumberOfRefinedVoxels << "\n";
+  os << indent << "NumberOfFullResolutionVoxels: " << this->NumberOfFullResolutionVoxels << "\n";
+  os << indent << "MeanGamma: " << this->MeanGamma << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::SetReferenceDoseImage(vtkOrientedImageData* referenceDoseImage)
+{
+  this->ReferenceDoseImage = referenceDoseImage;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::SetCompareDoseImage(vtkOrientedImageData* compareDoseImage)
+{
+  this->CompareDoseImage = compareDoseImage;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::SetMaskImage(vtkOrientedImageData* maskImage)
+{
+  this->MaskImage = maskImage;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkGammaDoseComparisonFilter::AddStatisticsRegionMask(vtkOrientedImageData* regionMask)
+{
+  if (!regionMask)
+  {
+    vtkErrorMacro("AddStatisticsRegionMask: Invalid region mask");
+    return -1;
+  }
+  this->StatisticsRegionMasks.push_back(regionMask);
+  this->Modified();
+  return (int)this->StatisticsRegionMasks.size() - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::RemoveAllStatisticsRegionMasks()
+{
+  this->StatisticsRegionMasks.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkGammaDoseComparisonFilter::GetOutput()
+{
+  return this->Output;
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetPassFraction()
+{
+  if (this->NumberOfAnalyzedVoxels == 0)
+  {
+    return 0.0;
+  }
+  return (double)this->NumberOfPassedVoxels / (double)this->NumberOfAnalyzedVoxels;
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetFullResolutionFraction()
+{
+  if (this->NumberOfAnalyzedVoxels == 0)
+  {
+    return 0.0;
+  }
+  return (double)this->NumberOfFullResolutionVoxels / (double)this->NumberOfAnalyzedVoxels;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkGammaDoseComparisonFilter::GetGammaHistogramBinCount(int bin)
+{
+  if (bin < 0 || bin >= (int)this->GammaHistogram.size())
+  {
+    vtkErrorMacro("GetGammaHistogramBinCount: Invalid bin index " << bin);
+    return 0;
+  }
+  return this->GammaHistogram[bin];
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkGammaDoseComparisonFilter::GetNumberOfAnalyzedVoxelsInRegion(int regionIndex)
+{
+  if (regionIndex < 0 || regionIndex >= (int)this->RegionNumberOfAnalyzedVoxels.size())
+  {
+    vtkErrorMacro("GetNumberOfAnalyzedVoxelsInRegion: Invalid region index " << regionIndex);
+    return 0;
+  }
+  return this->RegionNumberOfAnalyzedVoxels[regionIndex];
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkGammaDoseComparisonFilter::GetNumberOfPassedVoxelsInRegion(int regionIndex)
+{
+  if (regionIndex < 0 || regionIndex >= (int)this->RegionNumberOfPassedVoxels.size())
+  {
+    vtkErrorMacro("GetNumberOfPassedVoxelsInRegion: Invalid region index " << regionIndex);
+    return 0;
+  }
+  return this->RegionNumberOfPassedVoxels[regionIndex];
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetPassFractionInRegion(int regionIndex)
+{
+  vtkIdType numberOfAnalyzedVoxels = this->GetNumberOfAnalyzedVoxelsInRegion(regionIndex);
+  if (numberOfAnalyzedVoxels == 0)
+  {
+    return 0.0;
+  }
+  return (double)this->GetNumberOfPassedVoxelsInRegion(regionIndex) / (double)numberOfAnalyzedVoxels;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::ComputeSearchOffsets(vtkMatrix4x4* imageToWorldMatrix, double searchRadiusMm,
+  double dtaDistanceToleranceMm, std::vector<SearchOffset>& offsets)
+{
+  offsets.clear();
+  if (!imageToWorldMatrix || dtaDistanceToleranceMm <= 0.0)
+  {
+    return;
+  }
+
+  // Lattice axes (scaled by the spacing) in world coordinates
+  double axes[3][3] = {{0.0,0.0,0.0},{0.0,0.0,0.0},{0.0,0.0,0.0}};
+  int maximumOffset[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    for (int row=0; row<3; ++row)
+    {
+      axes[axis][row] = imageToWorldMatrix->GetElement(row, axis);
+    }
+    double spacing = vtkMath::Norm(axes[axis]);
+    maximumOffset[axis] = (spacing > 0.0 ? (int)ceil(searchRadiusMm / spacing) : 0);
+  }
+
+  double squaredSearchRadius = searchRadiusMm * searchRadiusMm;
+  double squaredDtaDistanceTolerance = dtaDistanceToleranceMm * dtaDistanceToleranceMm;
+  for (int k=-maximumOffset[2]; k<=maximumOffset[2]; ++k)
+  {
+    for (int j=-maximumOffset[1]; j<=maximumOffset[1]; ++j)
+    {
+      for (int i=-maximumOffset[0]; i<=maximumOffset[0]; ++i)
+      {
+        double offsetMm[3] = {0.0, 0.0, 0.0};
+        for (int row=0; row<3; ++row)
+        {
+          offsetMm[row] = i * axes[0][row] + j * axes[1][row] + k * axes[2][row];
+        }
+        double squaredDistance = vtkMath::Dot(offsetMm, offsetMm);
+        if (squaredDistance > squaredSearchRadius)
+        {
+          continue;
+        }
+        SearchOffset offset;
+        offset.Offset[0] = i;
+        offset.Offset[1] = j;
+        offset.Offset[2] = k;
+        offset.NormalizedSquaredDistance = squaredDistance / squaredDtaDistanceTolerance;
+        offsets.push_back(offset);
+      }
+    }
+  }
+
+  // Stable sort keeps the order deterministic for offsets of equal distance
+  std::stable_sort(offsets.begin(), offsets.end(), CompareSearchOffsets);
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::ComputeInterpolatedSearchOffsets(vtkMatrix4x4* imageToWorldMatrix, double searchRadiusMm,
+  double dtaDistanceToleranceMm, int interpolationFactor, std::vector<InterpolatedSearchOffset>& offsets)
+{
+  offsets.clear();
+  if (!imageToWorldMatrix || dtaDistanceToleranceMm <= 0.0 || interpolationFactor < 2)
+  {
+    return;
+  }
+
+  double axes[3][3] = {{0.0,0.0,0.0},{0.0,0.0,0.0},{0.0,0.0,0.0}};
+  int maximumOffset[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    for (int row=0; row<3; ++row)
+    {
+      axes[axis][row] = imageToWorldMatrix->GetElement(row, axis) / interpolationFactor;
+    }
+    double spacing = vtkMath::Norm(axes[axis]);
+    maximumOffset[axis] = (spacing > 0.0 ? (int)ceil(searchRadiusMm / spacing) : 0);
+  }
+
+  double squaredSearchRadius = searchRadiusMm * searchRadiusMm;
+  double squaredDtaDistanceTolerance = dtaDistanceToleranceMm * dtaDistanceToleranceMm;
+  for (int k=-maximumOffset[2]; k<=maximumOffset[2]; ++k)
+  {
+    for (int j=-maximumOffset[1]; j<=maximumOffset[1]; ++j)
+    {
+      for (int i=-maximumOffset[0]; i<=maximumOffset[0]; ++i)
+      {
+        if (i % interpolationFactor == 0 && j % interpolationFactor == 0 && k % interpolationFactor == 0)
+        {
+          // Lattice position, already evaluated by the voxel search
+          continue;
+        }
+        double offsetMm[3] = {0.0, 0.0, 0.0};
+        for (int row=0; row<3; ++row)
+        {
+          offsetMm[row] = i * axes[0][row] + j * axes[1][row] + k * axes[2][row];
+        }
+        double squaredDistance = vtkMath::Dot(offsetMm, offsetMm);
+        if (squaredDistance > squaredSearchRadius)
+        {
+          continue;
+        }
+        InterpolatedSearchOffset offset;
+        offset.Offset[0] = (double)i / interpolationFactor;
+        offset.Offset[1] = (double)j / interpolationFactor;
+        offset.Offset[2] = (double)k / interpolationFactor;
+        offset.NormalizedSquaredDistance = squaredDistance / squaredDtaDistanceTolerance;
+        offsets.push_back(offset);
+      }
+    }
+  }
+
+  std::stable_sort(offsets.begin(), offsets.end(), CompareInterpolatedSearchOffsets);
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::ShareReference(vtkGammaDoseComparisonFilter* sourceFilter)
+{
+  if (!sourceFilter || sourceFilter == this)
+  {
+    return;
+  }
+
+  this->ReferenceDoseImage = sourceFilter->ReferenceDoseImage;
+  this->MaskImage = sourceFilter->MaskImage;
+  this->StatisticsRegionMasks = sourceFilter->StatisticsRegionMasks;
+
+  this->DtaDistanceToleranceMm = sourceFilter->DtaDistanceToleranceMm;
+  this->DoseDifferenceTolerance = sourceFilter->DoseDifferenceTolerance;
+  this->ReferenceDoseGy = sourceFilter->ReferenceDoseGy;
+  this->AnalysisThreshold = sourceFilter->AnalysisThreshold;
+  this->MaximumGamma = sourceFilter->MaximumGamma;
+  this->UseLinearInterpolation = sourceFilter->UseLinearInterpolation;
+  this->LocalDoseDifference = sourceFilter->LocalDoseDifference;
+  this->DoseThresholdOnReferenceOnly = sourceFilter->DoseThresholdOnReferenceOnly;
+  this->InterpolationFactor = sourceFilter->InterpolationFactor;
+  this->InterpolationGammaBand = sourceFilter->InterpolationGammaBand;
+  this->NumberOfGammaHistogramBins = sourceFilter->NumberOfGammaHistogramBins;
+  this->MultiResolution = sourceFilter->MultiResolution;
+  this->MultiResolutionBlockSize = sourceFilter->MultiResolutionBlockSize;
+
+  // Prepared data is shared, not copied. It is not modified after preparation (a new instance is created
+  // by \sa PrepareReference), so it can be used concurrently by the filters
+  if (sourceFilter->IsPreparedReferenceValid())
+  {
+    this->PreparedReference = sourceFilter->PreparedReference;
+  }
+  else
+  {
+    this->PreparedReference = NULL;
+  }
+
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkGammaDoseComparisonFilter::PrepareReference()
+{
+  this->PreparedReference = NULL;
+
+  if (!this->ReferenceDoseImage || !this->ReferenceDoseImage->GetPointData()->GetScalars()
+    || this->ReferenceDoseImage->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("PrepareReference: Invalid reference dose image");
+    return false;
+  }
+  if (this->DtaDistanceToleranceMm <= 0.0 || this->MaximumGamma <= 0.0)
+  {
+    vtkErrorMacro("PrepareReference: DTA and maximum gamma must be positive");
+    return false;
+  }
+
+  vtkSmartPointer<PreparedReferenceData> prepared = vtkSmartPointer<PreparedReferenceData>::New();
+
+  // Reference dose with float scalars
+  prepared->ReferenceFloatImage = GetFloatImage(this->ReferenceDoseImage);
+
+  // Mask on the reference lattice
+  if (this->MaskImage)
+  {
+    prepared->MaskFloatImage = GetFloatImageOnReferenceLattice(this->MaskImage, this->ReferenceDoseImage, false);
+    if (!prepared->MaskFloatImage)
+    {
+      vtkErrorMacro("PrepareReference: Failed to resample mask to the reference lattice");
+      return false;
+    }
+  }
+
+  // Statistics region masks on the reference lattice
+  for (size_t region=0; region<this->StatisticsRegionMasks.size(); ++region)
+  {
+    vtkSmartPointer<vtkImageData> regionMaskFloatImage = GetFloatImageOnReferenceLattice(
+      this->StatisticsRegionMasks[region], this->ReferenceDoseImage, false);
+    if (!regionMaskFloatImage)
+    {
+      vtkErrorMacro("PrepareReference: Failed to resample statistics region mask " << region << " to the reference lattice");
+      return false;
+    }
+    prepared->RegionMaskFloatImages.push_back(regionMaskFloatImage);
+  }
+
+  // Reference dose used for normalization
+  if (this->ReferenceDoseGy > 0.0)
+  {
+    prepared->ReferenceDoseUsedGy = this->ReferenceDoseGy;
+  }
+  else
+  {
+    double referenceRange[2] = {0.0, 0.0};
+    prepared->ReferenceFloatImage->GetPointData()->GetScalars()->GetRange(referenceRange);
+    prepared->ReferenceDoseUsedGy = referenceRange[1];
+  }
+
+  // Search offsets within the maximum gamma radius
+  vtkNew<vtkMatrix4x4> referenceImageToWorldMatrix;
+  this->ReferenceDoseImage->GetImageToWorldMatrix(referenceImageToWorldMatrix.GetPointer());
+  vtkGammaDoseComparisonFilter::ComputeSearchOffsets(referenceImageToWorldMatrix.GetPointer(),
+    this->DtaDistanceToleranceMm * this->MaximumGamma, this->DtaDistanceToleranceMm, prepared->SearchOffsets);
+  if (this->InterpolationFactor > 1)
+  {
+    // Only voxels with coarse gamma at most 1+band are refined, and the search stops at the distance of the
+    // coarse result, so farther sub-voxel offsets are never visited. The table grows with the cube of both
+    // the factor and the radius, so it is limited to the radius that can actually improve gamma
+    double interpolatedSearchRadiusMm = this->DtaDistanceToleranceMm
+      * std::min(this->MaximumGamma, 1.0 + std::max(this->InterpolationGammaBand, 0.0));
+    vtkGammaDoseComparisonFilter::ComputeInterpolatedSearchOffsets(referenceImageToWorldMatrix.GetPointer(),
+      interpolatedSearchRadiusMm, this->DtaDistanceToleranceMm, this->InterpolationFactor,
+      prepared->InterpolatedSearchOffsets);
+  }
+
+  // Record the inputs the data was prepared from
+  prepared->ReferenceDoseImage = this->ReferenceDoseImage;
+  prepared->MaskImage = this->MaskImage;
+  prepared->StatisticsRegionMasks = this->StatisticsRegionMasks;
+  prepared->DtaDistanceToleranceMm = this->DtaDistanceToleranceMm;
+  prepared->ReferenceDoseGy = this->ReferenceDoseGy;
+  prepared->MaximumGamma = this->MaximumGamma;
+  prepared->InterpolationFactor = this->InterpolationFactor;
+  prepared->InterpolationGammaBand = this->InterpolationGammaBand;
+  prepared->PreparationTime.Modified();
+
+  this->PreparedReference = prepared;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkGammaDoseComparisonFilter::IsPreparedReferenceValid()
+{
+  const PreparedReferenceData* prepared = this->PreparedReference;
+  if ( !prepared || !prepared->ReferenceFloatImage
+    || prepared->ReferenceDoseImage.GetPointer() != this->ReferenceDoseImage.GetPointer()
+    || prepared->MaskImage.GetPointer() != this->MaskImage.GetPointer()
+    || prepared->StatisticsRegionMasks != this->StatisticsRegionMasks
+    || prepared->DtaDistanceToleranceMm != this->DtaDistanceToleranceMm
+    || prepared->ReferenceDoseGy != this->ReferenceDoseGy
+    || prepared->MaximumGamma != this->MaximumGamma
+    || prepared->InterpolationFactor != this->InterpolationFactor
+    || (this->InterpolationFactor > 1 && prepared->InterpolationGammaBand != this->InterpolationGammaBand) )
+  {
+    return false;
+  }
+
+  // Inputs must not have been modified since the preparation
+  vtkMTimeType preparationTime = prepared->PreparationTime.GetMTime();
+  if ( this->ReferenceDoseImage->GetMTime() > preparationTime
+    || (this->MaskImage && this->MaskImage->GetMTime() > preparationTime) )
+  {
+    return false;
+  }
+  for (size_t region=0; region<this->StatisticsRegionMasks.size(); ++region)
+  {
+    if (this->StatisticsRegionMasks[region]->GetMTime() > preparationTime)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkGammaDoseComparisonFilter::Update()
+{
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfPassedVoxels = 0;
+  this->NumberOfRefinedVoxels = 0;
+  this->NumberOfFullResolutionVoxels = 0;
+  this->MeanGamma = 0.0;
+  this->GammaHistogram.clear();
+  this->RegionNumberOfAnalyzedVoxels.clear();
+  this->RegionNumberOfPassedVoxels.clear();
+  this->ReferenceDoseUsedGy = 0.0;
+  this->ReportString.clear();
+  this->AbortExecute = false;
+
+  if (!this->ReferenceDoseImage || !this->CompareDoseImage)
+  {
+    vtkErrorMacro("Update: Invalid reference or compare dose image");
+    return false;
+  }
+  if ( !this->ReferenceDoseImage->GetPointData()->GetScalars() || this->ReferenceDoseImage->GetNumberOfScalarComponents() != 1
+    || !this->CompareDoseImage->GetPointData()->GetScalars() || this->CompareDoseImage->GetNumberOfScalarComponents() != 1 )
+  {
+    vtkErrorMacro("Update: Dose images must have single component scalars");
+    return false;
+  }
+  if (this->DtaDistanceToleranceMm <= 0.0 || this->DoseDifferenceTolerance <= 0.0 || this->MaximumGamma <= 0.0)
+  {
+    vtkErrorMacro("Update: DTA, dose difference tolerance and maximum gamma must be positive");
+    return false;
+  }
+
+  // Reference dose, masks, normalization and search offsets do not depend on the compare dose,
+  // so they are only prepared if they are not up to date (e.g. shared from another filter)
+  if (!this->IsPreparedReferenceValid() && !this->PrepareReference())
+  {
+    return false;
+  }
+  const PreparedReferenceData* prepared = this->PreparedReference;
+  this->ReferenceDoseUsedGy = prepared->ReferenceDoseUsedGy;
+
+  FloatImageAccessor reference;
+  reference.SetImage(prepared->ReferenceFloatImage);
+
+  // Compare dose on the reference lattice with float scalars
+  vtkSmartPointer<vtkImageData> compareFloatImage = GetFloatImageOnReferenceLattice(
+    this->CompareDoseImage, this->ReferenceDoseImage, this->UseLinearInterpolation);
+  if (!compareFloatImage)
+  {
+    vtkErrorMacro("Update: Failed to resample compare dose to the reference lattice");
+    return false;
+  }
+  FloatImageAccessor compare;
+  compare.SetImage(compareFloatImage);
+
+  FloatImageAccessor mask;
+  if (prepared->MaskFloatImage)
+  {
+    mask.SetImage(prepared->MaskFloatImage);
+  }
+  std::vector<FloatImageAccessor> regionMasks(prepared->RegionMaskFloatImages.size());
+  for (size_t region=0; region<prepared->RegionMaskFloatImages.size(); ++region)
+  {
+    regionMasks[region].SetImage(prepared->RegionMaskFloatImages[region]);
+  }
+
+  GammaParameters parameters;
+  parameters.ReferenceDoseGy = this->ReferenceDoseUsedGy;
+  parameters.DoseDifferenceTolerance = this->DoseDifferenceTolerance;
+  parameters.AnalysisThresholdGy = this->AnalysisThreshold * this->ReferenceDoseUsedGy;
+  parameters.MaximumGamma = this->MaximumGamma;
+  parameters.LocalDoseDifference = this->LocalDoseDifference;
+  parameters.DoseThresholdOnReferenceOnly = this->DoseThresholdOnReferenceOnly;
+  parameters.InterpolationGammaBand = this->InterpolationGammaBand;
+
+  const std::vector<SearchOffset>& offsets = prepared->SearchOffsets;
+
+  // Determine the analyzed voxels. The search may extend beyond the analysis extent within the reference extent
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  this->ReferenceDoseImage->GetExtent(extent);
+  int analysisExtent[6] = {extent[0], extent[1], extent[2], extent[3], extent[4], extent[5]};
+  if ( this->AnalysisExtent[0] <= this->AnalysisExtent[1] && this->AnalysisExtent[2] <= this->AnalysisExtent[3]
+    && this->AnalysisExtent[4] <= this->AnalysisExtent[5] )
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      analysisExtent[2*axis] = std::max(extent[2*axis], this->AnalysisExtent[2*axis]);
+      analysisExtent[2*axis+1] = std::min(extent[2*axis+1], this->AnalysisExtent[2*axis+1]);
+      if (analysisExtent[2*axis] > analysisExtent[2*axis+1])
+      {
+        vtkErrorMacro("Update: Analysis extent does not intersect the reference dose extent");
+        return false;
+      }
+    }
+  }
+
+  // Allocate output unless only statistics are requested. Gamma is not computed for all voxels in multi-resolution mode
+  this->Output = NULL;
+  float* outputScalars = NULL;
+  if (this->GenerateGammaImage && !this->MultiResolution)
+  {
+    this->Output = vtkSmartPointer<vtkImageData>::New();
+    this->Output->SetExtent(analysisExtent);
+    this->Output->AllocateScalars(VTK_FLOAT, 1);
+    outputScalars = static_cast<float*>(this->Output->GetScalarPointer());
+  }
+
+  GammaFunctor functor(reference, compare, (prepared->MaskFloatImage ? &mask : NULL), offsets, parameters,
+    extent, analysisExtent, outputScalars, this->NumberOfGammaHistogramBins, regionMasks, &this->AbortExecute);
+
+  // Set up sub-voxel search. The compare dose is interpolated in its original lattice
+  vtkSmartPointer<vtkImageData> compareOriginalFloatImage;
+  FloatImageAccessor compareOriginal;
+  const std::vector<InterpolatedSearchOffset>& interpolatedOffsets = prepared->InterpolatedSearchOffsets;
+  if (this->InterpolationFactor > 1)
+  {
+    vtkNew<vtkMatrix4x4> referenceImageToWorldMatrix;
+    this->ReferenceDoseImage->GetImageToWorldMatrix(referenceImageToWorldMatrix.GetPointer());
+    compareOriginalFloatImage = GetFloatImage(this->CompareDoseImage);
+    compareOriginal.SetImage(compareOriginalFloatImage);
+
+    vtkNew<vtkMatrix4x4> worldToCompareImageMatrix;
+    this->CompareDoseImage->GetWorldToImageMatrix(worldToCompareImageMatrix.GetPointer());
+    vtkNew<vtkMatrix4x4> referenceImageToCompareImageMatrix;
+    vtkMatrix4x4::Multiply4x4(worldToCompareImageMatrix.GetPointer(), referenceImageToWorldMatrix.GetPointer(),
+      referenceImageToCompareImageMatrix.GetPointer());
+    double referenceIjkToCompareIjk[3][4];
+    for (int row=0; row<3; ++row)
+    {
+      for (int col=0; col<4; ++col)
+      {
+        referenceIjkToCompareIjk[row][col] = referenceImageToCompareImageMatrix->GetElement(row, col);
+      }
+    }
+    functor.SetInterpolation(&compareOriginal, &interpolatedOffsets, referenceIjkToCompareIjk);
+  }
+
+  // Build the coarse level of the compare dose for multi-resolution evaluation. The block ranges are dilated
+  // by the largest voxel offset within the DTA (with margin), including the interpolation neighbors of the
+  // sub-voxel positions
+  MultiResolutionBounds bounds;
+  if (this->MultiResolution)
+  {
+    double maximumNormalizedSquaredDistance = (1.0 + MULTI_RESOLUTION_FAIL_MARGIN) * (1.0 + MULTI_RESOLUTION_FAIL_MARGIN);
+    int dilation[3] = {0, 0, 0};
+    for (std::vector<SearchOffset>::const_iterator offsetIt=offsets.begin();
+      offsetIt!=offsets.end() && offsetIt->NormalizedSquaredDistance <= maximumNormalizedSquaredDistance; ++offsetIt)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        dilation[axis] = std::max(dilation[axis], std::abs(offsetIt->Offset[axis]));
+      }
+    }
+    for (std::vector<InterpolatedSearchOffset>::const_iterator offsetIt=interpolatedOffsets.begin();
+      this->InterpolationFactor > 1 && offsetIt!=interpolatedOffsets.end()
+      && offsetIt->NormalizedSquaredDistance <= maximumNormalizedSquaredDistance; ++offsetIt)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        dilation[axis] = std::max(dilation[axis], (int)ceil(fabs(offsetIt->Offset[axis])));
+      }
+    }
+    bounds.Build(compare, extent, this->MultiResolutionBlockSize, dilation);
+
+    // Failed voxels can only be classified if gamma is not capped at one, and the sub-voxel search
+    // interpolates the same lattice as the coarse level
+    bounds.ClassifyFailed = ( this->MaximumGamma > 1.0 + MULTI_RESOLUTION_FAIL_MARGIN
+      && (this->InterpolationFactor < 2 || vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceDoseImage, this->CompareDoseImage)) );
+    functor.SetMultiResolutionBounds(&bounds);
+  }
+
+  // Compute gamma. Rows are processed in batches so that progress can be reported from this thread,
+  // and the computation can be aborted between batches (observers may set the abort flag)
+  vtkIdType numberOfRows = functor.GetNumberOfRows();
+  double progress = 0.0;
+  this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  for (int step=0; step<NUMBER_OF_PROGRESS_STEPS && !this->AbortExecute; ++step)
+  {
+    vtkIdType beginRow = numberOfRows * step / NUMBER_OF_PROGRESS_STEPS;
+    vtkIdType endRow = numberOfRows * (step+1) / NUMBER_OF_PROGRESS_STEPS;
+    if (endRow > beginRow)
+    {
+      vtkSMPTools::For(beginRow, endRow, functor);
+    }
+    progress = (double)(step+1) / NUMBER_OF_PROGRESS_STEPS;
+    this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  }
+  if (this->AbortExecute)
+  {
+    vtkDebugMacro("Update: Gamma computation aborted");
+    this->Output = NULL;
+    return false;
+  }
+
+  const GammaStatistics& statistics = functor.GetStatistics();
+  this->NumberOfAnalyzedVoxels = statistics.NumberOfAnalyzedVoxels;
+  this->NumberOfPassedVoxels = statistics.NumberOfPassedVoxels;
+  this->NumberOfRefinedVoxels = statistics.NumberOfRefinedVoxels;
+  this->NumberOfFullResolutionVoxels = statistics.NumberOfFullResolutionVoxels;
+  if (this->MultiResolution)
+  {
+    this->MeanGamma = -1.0;
+  }
+  else
+  {
+    this->MeanGamma = (this->NumberOfAnalyzedVoxels > 0 ? functor.GetGammaSum() / this->NumberOfAnalyzedVoxels : 0.0);
+    this->GammaHistogram = statistics.Histogram;
+  }
+  this->RegionNumberOfAnalyzedVoxels = statistics.RegionNumberOfAnalyzedVoxels;
+  this->RegionNumberOfPassedVoxels = statistics.RegionNumberOfPassedVoxels;
+
+  // Assemble report
+  std::ostringstream reportStream;
+  reportStream << "Reference dose: " << this->ReferenceDoseUsedGy << " Gy"
+    << (this->ReferenceDoseGy > 0.0 ? "" : " (maximum of reference dose)") << std::endl;
+  reportStream << "DTA distance tolerance: " << this->DtaDistanceToleranceMm << " mm" << std::endl;
+  reportStream << "Dose difference tolerance: " << this->DoseDifferenceTolerance * 100.0 << " %"
+    << (this->LocalDoseDifference ? " (local)" : " (global)") << std::endl;
+  reportStream << "Analysis threshold: " << this->AnalysisThreshold * 100.0 << " % ("
+    << parameters.AnalysisThresholdGy << " Gy" << (this->DoseThresholdOnReferenceOnly ? ", reference only" : "") << ")" << std::endl;
+  reportStream << "Maximum gamma: " << this->MaximumGamma << std::endl;
+  reportStream << "Number of search offsets: " << offsets.size() << std::endl;
+  if (this->InterpolationFactor > 1)
+  {
+    reportStream << "Interpolation factor: " << this->InterpolationFactor << " (" << interpolatedOffsets.size()
+      << " sub-voxel offsets, refined if |gamma-1| <= " << this->InterpolationGammaBand << ")" << std::endl;
+    reportStream << "Number of voxels refined: " << this->NumberOfRefinedVoxels << std::endl;
+  }
+  reportStream << "Number of voxels analyzed: " << this->NumberOfAnalyzedVoxels << std::endl;
+  reportStream << "Number of voxels passed: " << this->NumberOfPassedVoxels << std::endl;
+  reportStream << "Pass rate: " << this->GetPassFraction() * 100.0 << " %" << std::endl;
+  if (this->MultiResolution)
+  {
+    reportStream << "Multi-resolution block size: " << this->MultiResolutionBlockSize
+      << (bounds.ClassifyFailed ? "" : " (only passed voxels classified)") << std::endl;
+    reportStream << "Number of voxels evaluated at full resolution: " << this->NumberOfFullResolutionVoxels
+      << " (" << this->GetFullResolutionFraction() * 100.0 << " %)" << std::endl;
+  }
+  else
+  {
+    reportStream << "Mean gamma: " << this->MeanGamma << std::endl;
+    reportStream << "Gamma histogram:" << std::endl;
+    double binWidth = this->MaximumGamma / this->NumberOfGammaHistogramBins;
+    for (int bin=0; bin<(int)this->GammaHistogram.size(); ++bin)
+    {
+      reportStream << "  [" << bin * binWidth << ", " << (bin+1) * binWidth << (bin+1 < (int)this->GammaHistogram.size() ? ")" : "]")
+        << ": " << this->GammaHistogram[bin] << std::endl;
+    }
+  }
+  for (int region=0; region<this->GetNumberOfStatisticsRegionMasks(); ++region)
+  {
+    reportStream << "Region " << region << ": " << this->RegionNumberOfPassedVoxels[region] << " of "
+      << this->RegionNumberOfAnalyzedVoxels[region] << " voxels passed (" << this->GetPassFractionInRegion(region) * 100.0 << " %)" << std::endl;
+  }
+  this->ReportString = reportStream.str();
+
+  return true;
+}
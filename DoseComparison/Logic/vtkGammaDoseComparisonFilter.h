@@ -0,0 +1,360 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkGammaDoseComparisonFilter - Compute gamma index of a compare dose against a reference dose
+// .SECTION Description
+
+#ifndef __vtkGammaDoseComparisonFilter_h
+#define __vtkGammaDoseComparisonFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimeStamp.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerDoseComparisonModuleLogicExport.h"
+
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_DoseComparison
+/// \brief Multi-threaded 3D gamma dose comparison
+///
+/// The compare dose is resampled to the lattice of the reference dose (if the geometries differ),
+/// then for each analyzed reference voxel r the gamma index
+///   gamma(r) = min_c( sqrt( |r-c|^2 / DTA^2 + (D_ref(r) - D_cmp(c))^2 / dD^2 ) )
+/// is computed, clamped to the maximum gamma. The search is done using a table of voxel offsets within
+/// the radius DTA * MaximumGamma, sorted by distance, so the search of a voxel stops as soon as the
+/// distance term alone reaches the best gamma found so far. The result is identical to an exhaustive
+/// search within the radius. Slices of the reference are processed in parallel.
+///
+/// Pass rate, mean gamma, gamma histogram and pass rates within additional region masks (e.g. structures)
+/// are accumulated while computing gamma. If only these statistics are needed, then the generation of the
+/// gamma image can be turned off, in which case no output volume is allocated. The statistics are identical
+/// in both cases.
+///
+/// The data derived from the reference dose (float reference, masks on the reference lattice, normalization dose
+/// and search offset tables) is prepared once and reused as long as the reference inputs and the parameters it
+/// depends on are unchanged. It can also be shared by multiple filters evaluating different compare doses against
+/// the same reference (\sa ShareReference), which can then be updated concurrently.
+///
+/// Gamma can be restricted to a sub-extent of the reference (e.g. a single slice for interactive preview) while
+/// the search still covers the whole reference extent, and the computation can be aborted from progress observers.
+///
+/// If the interpolation factor is greater than one, then the search of the voxels with a coarse gamma near one
+/// is repeated at sub-voxel positions (the reference lattice subdivided by the interpolation factor), where the
+/// compare dose is interpolated on the fly. No upsampled compare volume is created.
+///
+/// In multi-resolution mode only the pass/fail classification is needed, so most voxels are classified
+/// using conservative bounds instead of the search: a voxel clearly passes if the compare dose at the same
+/// position is within the dose difference tolerance, and clearly fails if its dose differs by more than the
+/// tolerance from the whole range of compare doses within the DTA. The ranges are taken from a coarse level
+/// of the compare dose (minimum and maximum in blocks of voxels, dilated by the DTA). Only the remaining
+/// voxels are evaluated at full resolution, so the pass rates are identical to the full evaluation.
+///
+/// The parameters and their semantics follow the Plastimatch gamma implementation (Gamma_dose_comparison).
+class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkGammaDoseComparisonFilter : public vtkObject
+{
+public:
+  static vtkGammaDoseComparisonFilter *New();
+  vtkTypeMacro(vtkGammaDoseComparisonFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set reference dose image. Its lattice defines the lattice of the gamma output
+  void SetReferenceDoseImage(vtkOrientedImageData* referenceDoseImage);
+  /// Get reference dose image
+  vtkOrientedImageData* GetReferenceDoseImage() { return this->ReferenceDoseImage; };
+  /// Set compare dose image. It is resampled to the reference lattice if the geometries differ
+  void SetCompareDoseImage(vtkOrientedImageData* compareDoseImage);
+  /// Set optional mask image. Only voxels where the mask is non-zero are included in the gamma image and in the
+  /// overall statistics
+  void SetMaskImage(vtkOrientedImageData* maskImage);
+
+  /// Add mask of a region (e.g. a structure) in which the pass rate is computed separately.
+  /// The region statistics include all voxels where the region mask is non-zero and the dose is above the
+  /// analysis threshold, regardless of the mask (\sa SetMaskImage), so they do not depend on the mask choice
+  /// \return Index of the region
+  int AddStatisticsRegionMask(vtkOrientedImageData* regionMask);
+  /// Remove all statistics region masks
+  void RemoveAllStatisticsRegionMasks();
+  /// Get number of statistics region masks
+  int GetNumberOfStatisticsRegionMasks() { return (int)this->StatisticsRegionMasks.size(); };
+
+  /// Prepare the data derived from the reference dose (\sa ShareReference). It is called by \sa Update
+  /// if the prepared data is not up to date, so calling it explicitly is only needed to share the data
+  /// \return Success flag
+  bool PrepareReference();
+
+  /// Use the reference dose, masks and parameters of another filter, together with its prepared reference data
+  /// (if up to date). The filters can then be updated concurrently with different compare doses
+  void ShareReference(vtkGammaDoseComparisonFilter* sourceFilter);
+
+  /// Compute gamma
+  /// \return Success flag
+  bool Update();
+
+  /// Get gamma image. The image has the analysis extent (by default the extent of the reference image) with unit spacing
+  /// and zero origin, as stored in volume nodes (i.e. the geometry needs to be set on the node).
+  /// Voxels that are not analyzed have zero gamma. NULL if the gamma image generation is turned off or if aborted
+  vtkImageData* GetOutput();
+
+  /// Get number of analyzed voxels (output)
+  vtkGetMacro(NumberOfAnalyzedVoxels, vtkIdType);
+  /// Get number of analyzed voxels with gamma not greater than one (output)
+  vtkGetMacro(NumberOfPassedVoxels, vtkIdType);
+  /// Get number of voxels where the sub-voxel search was performed (output)
+  vtkGetMacro(NumberOfRefinedVoxels, vtkIdType);
+  /// Get number of analyzed voxels that could not be classified by the multi-resolution bounds, thus were
+  /// evaluated at full resolution (output). All analyzed voxels are evaluated at full resolution if multi-resolution is off
+  vtkGetMacro(NumberOfFullResolutionVoxels, vtkIdType);
+  /// Get fraction of the analyzed voxels evaluated at full resolution (output)
+  double GetFullResolutionFraction();
+  /// Get fraction of the analyzed voxels that passed (output)
+  double GetPassFraction();
+  /// Get mean gamma of the analyzed voxels (output). -1 in multi-resolution mode, as gamma is not computed for all voxels
+  vtkGetMacro(MeanGamma, double);
+  /// Get number of analyzed voxels in a gamma histogram bin (output). Bins cover [0, MaximumGamma] uniformly.
+  /// The histogram is empty in multi-resolution mode
+  vtkIdType GetGammaHistogramBinCount(int bin);
+  /// Get number of analyzed voxels in each gamma histogram bin (output)
+  void GetGammaHistogram(std::vector<vtkIdType>& binCounts) { binCounts = this->GammaHistogram; };
+  /// Get number of analyzed voxels in a statistics region (output)
+  vtkIdType GetNumberOfAnalyzedVoxelsInRegion(int regionIndex);
+  /// Get number of passed voxels in a statistics region (output)
+  vtkIdType GetNumberOfPassedVoxelsInRegion(int regionIndex);
+  /// Get fraction of the analyzed voxels that passed in a statistics region (output)
+  double GetPassFractionInRegion(int regionIndex);
+  /// Get reference dose used for normalization (output). It is either the specified reference dose
+  /// or the maximum of the reference dose image
+  vtkGetMacro(ReferenceDoseUsedGy, double);
+  /// Get report listing the parameters and the results of the last computation
+  std::string GetReportString() { return this->ReportString; };
+
+  /// Distance to agreement (DTA) tolerance, in mm
+  vtkGetMacro(DtaDistanceToleranceMm, double);
+  vtkSetMacro(DtaDistanceToleranceMm, double);
+
+  /// Dose difference tolerance as a fraction of the reference dose (e.g. 0.03 for 3%).
+  /// In case of local dose difference it is a fraction of the reference voxel dose
+  vtkGetMacro(DoseDifferenceTolerance, double);
+  vtkSetMacro(DoseDifferenceTolerance, double);
+
+  /// Reference dose (prescription dose) in Gy. If not positive, then the maximum dose
+  /// in the reference image is used
+  vtkGetMacro(ReferenceDoseGy, double);
+  vtkSetMacro(ReferenceDoseGy, double);
+
+  /// Analysis threshold as a fraction of the reference dose. Voxels below it are not analyzed
+  vtkGetMacro(AnalysisThreshold, double);
+  vtkSetMacro(AnalysisThreshold, double);
+
+  /// Maximum gamma. It determines the search radius (DTA * MaximumGamma)
+  vtkGetMacro(MaximumGamma, double);
+  vtkSetMacro(MaximumGamma, double);
+
+  /// Flag determining whether linear (or nearest neighbor) interpolation is used when resampling
+  /// the compare dose to the reference lattice
+  vtkGetMacro(UseLinearInterpolation, bool);
+  vtkSetMacro(UseLinearInterpolation, bool);
+  vtkBooleanMacro(UseLinearInterpolation, bool);
+
+  /// Flag determining whether local dose difference is used. Global if false (default)
+  vtkGetMacro(LocalDoseDifference, bool);
+  vtkSetMacro(LocalDoseDifference, bool);
+  vtkBooleanMacro(LocalDoseDifference, bool);
+
+  /// Flag determining whether only the reference dose is thresholded. If false (default), then
+  /// a voxel is analyzed if either the reference or the compare dose is above the threshold
+  vtkGetMacro(DoseThresholdOnReferenceOnly, bool);
+  vtkSetMacro(DoseThresholdOnReferenceOnly, bool);
+  vtkBooleanMacro(DoseThresholdOnReferenceOnly, bool);
+
+  /// Number of sub-voxel search positions per voxel along each axis. Default is 1 (no sub-voxel search).
+  /// The sub-voxel offset table grows with the cube of the factor, so it is limited to 10
+  vtkGetMacro(InterpolationFactor, int);
+  vtkSetClampMacro(InterpolationFactor, int, 1, 10);
+
+  /// Voxels are refined by the sub-voxel search if their coarse gamma is within this distance from one.
+  /// Default is 0.3
+  vtkGetMacro(InterpolationGammaBand, double);
+  vtkSetMacro(InterpolationGammaBand, double);
+
+  /// Flag determining whether the gamma image is generated. If false, then only the statistics are computed
+  /// and no output image is allocated. Default is true
+  vtkGetMacro(GenerateGammaImage, bool);
+  vtkSetMacro(GenerateGammaImage, bool);
+  vtkBooleanMacro(GenerateGammaImage, bool);
+
+  /// Number of bins of the gamma histogram. Default is 20
+  vtkGetMacro(NumberOfGammaHistogramBins, int);
+  vtkSetClampMacro(NumberOfGammaHistogramBins, int, 1, 1000);
+
+  /// Flag determining whether multi-resolution evaluation is used. Only the pass rates are computed then
+  /// (identical to the full evaluation): no gamma image, mean gamma or histogram. Default is false
+  vtkGetMacro(MultiResolution, bool);
+  vtkSetMacro(MultiResolution, bool);
+  vtkBooleanMacro(MultiResolution, bool);
+
+  /// Size (in voxels along each axis) of the blocks of the coarse level in multi-resolution mode. Default is 4
+  vtkGetMacro(MultiResolutionBlockSize, int);
+  vtkSetClampMacro(MultiResolutionBlockSize, int, 1, 32);
+
+  /// Extent of the reference voxels for which gamma is computed. The search for the compare dose is not limited
+  /// by it, only by the reference extent. The whole reference extent is analyzed if empty (default)
+  vtkGetVector6Macro(AnalysisExtent, int);
+  vtkSetVector6Macro(AnalysisExtent, int);
+
+  /// Flag requesting the computation to stop. It can be set by progress event observers (or from another thread)
+  /// during \sa Update, which then returns false. It is reset at the beginning of \sa Update
+  vtkGetMacro(AbortExecute, bool);
+  vtkSetMacro(AbortExecute, bool);
+  vtkBooleanMacro(AbortExecute, bool);
+
+public:
+  /// Voxel offset within the search radius with its squared distance normalized by the DTA
+  struct SearchOffset
+  {
+    int Offset[3];
+    double NormalizedSquaredDistance;
+  };
+
+  /// Compute voxel offsets within the search radius, sorted by increasing distance
+  /// \param imageToWorldMatrix Image to world matrix of the lattice (spacing and directions are used)
+  /// \param searchRadiusMm Radius of the search sphere in mm
+  /// \param dtaDistanceToleranceMm Distance normalization
+  /// \param offsets Output offset table
+  static void ComputeSearchOffsets(vtkMatrix4x4* imageToWorldMatrix, double searchRadiusMm,
+    double dtaDistanceToleranceMm, std::vector<SearchOffset>& offsets);
+
+  /// Sub-voxel offset within the search radius with its squared distance normalized by the DTA
+  struct InterpolatedSearchOffset
+  {
+    double Offset[3];
+    double NormalizedSquaredDistance;
+  };
+
+  /// Compute sub-voxel offsets within the search radius, sorted by increasing distance.
+  /// Offsets on the voxel lattice are omitted, as those are covered by \sa ComputeSearchOffsets
+  /// \param interpolationFactor Number of positions per voxel along each axis
+  static void ComputeInterpolatedSearchOffsets(vtkMatrix4x4* imageToWorldMatrix, double searchRadiusMm,
+    double dtaDistanceToleranceMm, int interpolationFactor, std::vector<InterpolatedSearchOffset>& offsets);
+
+protected:
+  /// Data derived from the reference dose, independent of the compare dose. It is not modified after
+  /// preparation, so filters sharing the reference hold the same instance (the offset tables can be large)
+  class PreparedReferenceData : public vtkObject
+  {
+  public:
+    static PreparedReferenceData* New();
+    vtkTypeMacro(PreparedReferenceData, vtkObject);
+
+    vtkSmartPointer<vtkImageData> ReferenceFloatImage;
+    vtkSmartPointer<vtkImageData> MaskFloatImage;
+    std::vector< vtkSmartPointer<vtkImageData> > RegionMaskFloatImages;
+    double ReferenceDoseUsedGy;
+    std::vector<SearchOffset> SearchOffsets;
+    std::vector<InterpolatedSearchOffset> InterpolatedSearchOffsets;
+
+    // Inputs and parameters the data was prepared from
+    vtkSmartPointer<vtkOrientedImageData> ReferenceDoseImage;
+    vtkSmartPointer<vtkOrientedImageData> MaskImage;
+    std::vector< vtkSmartPointer<vtkOrientedImageData> > StatisticsRegionMasks;
+    double DtaDistanceToleranceMm;
+    double ReferenceDoseGy;
+    double MaximumGamma;
+    int InterpolationFactor;
+    double InterpolationGammaBand;
+    vtkTimeStamp PreparationTime;
+
+  protected:
+    PreparedReferenceData()
+      : ReferenceDoseUsedGy(0.0)
+      , DtaDistanceToleranceMm(0.0)
+      , ReferenceDoseGy(0.0)
+      , MaximumGamma(0.0)
+      , InterpolationFactor(0)
+      , InterpolationGammaBand(0.0)
+    {
+    }
+    ~PreparedReferenceData()
+    {
+    }
+
+  private:
+    PreparedReferenceData(const PreparedReferenceData&); // Not implemented
+    void operator=(const PreparedReferenceData&);        // Not implemented
+  };
+
+  /// Determine whether the prepared reference data matches the current reference inputs and parameters
+  bool IsPreparedReferenceValid();
+
+protected:
+  vtkSmartPointer<vtkOrientedImageData> ReferenceDoseImage;
+  vtkSmartPointer<vtkOrientedImageData> CompareDoseImage;
+  vtkSmartPointer<vtkOrientedImageData> MaskImage;
+  std::vector< vtkSmartPointer<vtkOrientedImageData> > StatisticsRegionMasks;
+  vtkSmartPointer<vtkImageData> Output;
+
+  double DtaDistanceToleranceMm;
+  double DoseDifferenceTolerance;
+  double ReferenceDoseGy;
+  double AnalysisThreshold;
+  double MaximumGamma;
+  bool UseLinearInterpolation;
+  bool LocalDoseDifference;
+  bool DoseThresholdOnReferenceOnly;
+  int InterpolationFactor;
+  double InterpolationGammaBand;
+  bool GenerateGammaImage;
+  int NumberOfGammaHistogramBins;
+  bool MultiResolution;
+  int MultiResolutionBlockSize;
+  int AnalysisExtent[6];
+  bool AbortExecute;
+
+  vtkIdType NumberOfAnalyzedVoxels;
+  vtkIdType NumberOfPassedVoxels;
+  vtkIdType NumberOfRefinedVoxels;
+  vtkIdType NumberOfFullResolutionVoxels;
+  double MeanGamma;
+  std::vector<vtkIdType> GammaHistogram;
+  std::vector<vtkIdType> RegionNumberOfAnalyzedVoxels;
+  std::vector<vtkIdType> RegionNumberOfPassedVoxels;
+  double ReferenceDoseUsedGy;
+  std::string ReportString;
+
+  /// Prepared reference data, shared with the filters set up by \sa ShareReference
+  vtkSmartPointer<PreparedReferenceData> PreparedReference;
+
+protected:
+  vtkGammaDoseComparisonFilter();
+  ~vtkGammaDoseComparisonFilter();
+
+private:
+  vtkGammaDoseComparisonFilter(const vtkGammaDoseComparisonFilter&); // Not implemented
+  void operator=(const vtkGammaDoseComparisonFilter&);               // Not implemented
+};
+
+#endif
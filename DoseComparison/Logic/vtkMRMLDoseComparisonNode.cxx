@@ -58,6 +58,11 @@ vtkMRMLDoseComparisonNode::vtkMRMLDoseComparisonNode()
   this->ResultsValid = false;
   this->ReportString = NULL;
   this->LocalDoseDifference = false;
+  this->UseNativeGammaEngine = false;
+  this->InterpolationFactor = 1;
+  this->StatisticsOnly = false;
+  this->MultiResolution = false;
+  this->MeanGamma = -1.0;
 
   this->HideFromEditors = false;
 }
@@ -84,7 +89,24 @@ void vtkMRMLDoseComparisonNode::WriteXML(ostream& of, int nIndent)
   of << " UseLinearInterpolation=\"" << (this->UseLinearInterpolation ? "true" : "false") << "\"";
   of << " LocalDoseDifference=\"" << (this->LocalDoseDifference ? "true" : "false") << "\"";
   of << " DoseThresholdOnReferenceOnly=\"" << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\"";
+  of << " UseNativeGammaEngine=\"" << (this->UseNativeGammaEngine ? "true" : "false") << "\"";
+  of << " InterpolationFactor=\"" << this->InterpolationFactor << "\"";
+  of << " StatisticsOnly=\"" << (this->StatisticsOnly ? "true" : "false") << "\"";
+  of << " MultiResolution=\"" << (this->MultiResolution ? "true" : "false") << "\"";
   of << " PassFractionPercent=\"" << this->PassFractionPercent << "\"";
+  of << " MeanGamma=\"" << this->MeanGamma << "\"";
+  of << " SegmentPassFractionPercents=\"";
+  for (std::map<std::string, double>::iterator it=this->SegmentPassFractionPercents.begin(); it!=this->SegmentPassFractionPercents.end(); ++it)
+    {
+    of << it->first << ":" << it->second << "|";
+    }
+  of << "\"";
+  of << " GammaHistogram=\"";
+  for (std::vector<vtkIdType>::iterator binIt=this->GammaHistogram.begin(); binIt!=this->GammaHistogram.end(); ++binIt)
+    {
+    of << (binIt == this->GammaHistogram.begin() ? "" : " ") << (*binIt);
+    }
+  of << "\"";
   of << " ResultsValid=\"" << (this->ResultsValid ? "true" : "false") << "\"";
   of << " ReportString=\"" << (this->ReportString ? this->ReportString : "") << "\"";
 }
@@ -143,10 +165,60 @@ void vtkMRMLDoseComparisonNode::ReadXMLAttributes(const char** atts)
       {
       this->DoseThresholdOnReferenceOnly = (strcmp(attValue,"true") ? false : true);
       }
+    else if (!strcmp(attName, "UseNativeGammaEngine")) 
+      {
+      this->UseNativeGammaEngine = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "InterpolationFactor")) 
+      {
+      // Clamped by the setter, as the size of the sub-voxel search grows with the cube of the factor
+      this->SetInterpolationFactor(vtkVariant(attValue).ToInt());
+      }
+    else if (!strcmp(attName, "StatisticsOnly")) 
+      {
+      this->StatisticsOnly = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "MultiResolution")) 
+      {
+      this->MultiResolution = (strcmp(attValue,"true") ? false : true);
+      }
     else if (!strcmp(attName, "PassFractionPercent")) 
       {
       this->PassFractionPercent = vtkVariant(attValue).ToDouble();
       }
+    else if (!strcmp(attName, "MeanGamma")) 
+      {
+      this->MeanGamma = vtkVariant(attValue).ToDouble();
+      }
+    else if (!strcmp(attName, "SegmentPassFractionPercents")) 
+      {
+      this->SegmentPassFractionPercents.clear();
+      std::stringstream ss;
+      ss << attValue;
+      std::string entry;
+      while (std::getline(ss, entry, '|'))
+        {
+        // Segment IDs may contain colons, so split at the last one
+        size_t separatorPosition = entry.rfind(':');
+        if (separatorPosition == std::string::npos)
+          {
+          continue;
+          }
+        this->SegmentPassFractionPercents[entry.substr(0, separatorPosition)] =
+          vtkVariant(entry.substr(separatorPosition+1)).ToDouble();
+        }
+      }
+    else if (!strcmp(attName, "GammaHistogram")) 
+      {
+      this->GammaHistogram.clear();
+      std::stringstream ss;
+      ss << attValue;
+      vtkIdType binCount = 0;
+      while (ss >> binCount)
+        {
+        this->GammaHistogram.push_back(binCount);
+        }
+      }
     else if (!strcmp(attName, "ResultsValid")) 
       {
       this->ResultsValid = (strcmp(attValue,"true") ? false : true);
@@ -177,6 +249,13 @@ void vtkMRMLDoseComparisonNode::Copy(vtkMRMLNode *anode)
   this->UseLinearInterpolation = node->UseLinearInterpolation;
   this->LocalDoseDifference = node->LocalDoseDifference;
   this->DoseThresholdOnReferenceOnly = node->DoseThresholdOnReferenceOnly;
+  this->UseNativeGammaEngine = node->UseNativeGammaEngine;
+  this->InterpolationFactor = node->InterpolationFactor;
+  this->StatisticsOnly = node->StatisticsOnly;
+  this->MultiResolution = node->MultiResolution;
+  this->MeanGamma = node->MeanGamma;
+  this->SegmentPassFractionPercents = node->SegmentPassFractionPercents;
+  this->GammaHistogram = node->GammaHistogram;
   this->ResultsValid = node->ResultsValid;
   this->ReportString = node->ReportString;
 
@@ -199,7 +278,22 @@ void vtkMRMLDoseComparisonNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "UseLinearInterpolation:   " << (this->UseLinearInterpolation ? "true" : "false") << "\n";
   os << indent << "LocalDoseDifference:   " << (this->LocalDoseDifference ? "true" : "false") << "\n";
   os << indent << "DoseThresholdOnReferenceOnly:   " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "UseNativeGammaEngine:   " << (this->UseNativeGammaEngine ? "true" : "false") << "\n";
+  os << indent << "InterpolationFactor:   " << this->InterpolationFactor << "\n";
+  os << indent << "StatisticsOnly:   " << (this->StatisticsOnly ? "true" : "false") << "\n";
+  os << indent << "MultiResolution:   " << (this->MultiResolution ? "true" : "false") << "\n";
   os << indent << "PassFractionPercent:   " << this->PassFractionPercent << "\n";
+  os << indent << "MeanGamma:   " << this->MeanGamma << "\n";
+  for (std::map<std::string, double>::iterator it=this->SegmentPassFractionPercents.begin(); it!=this->SegmentPassFractionPercents.end(); ++it)
+    {
+    os << indent << "SegmentPassFractionPercent[" << it->first << "]:   " << it->second << "\n";
+    }
+  os << indent << "GammaHistogram:  ";
+  for (std::vector<vtkIdType>::iterator binIt=this->GammaHistogram.begin(); binIt!=this->GammaHistogram.end(); ++binIt)
+    {
+    os << " " << (*binIt);
+    }
+  os << "\n";
   os << indent << "ResultsValid:   " << (this->ResultsValid ? "true" : "false") << "\n";
   os << indent << "ReportString:   " << (this->ReportString ? this->ReportString : "") << "\n";
 }
@@ -275,3 +369,68 @@ void vtkMRMLDoseComparisonNode::SetAndObserveGammaVolumeNode(vtkMRMLScalarVolume
 
   this->SetNodeReferenceID(GAMMA_VOLUME_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 }
+
+//----------------------------------------------------------------------------
+double vtkMRMLDoseComparisonNode::GetSegmentPassFractionPercent(const char* segmentID)
+{
+  if (!segmentID)
+    {
+    return -1.0;
+    }
+  std::map<std::string, double>::iterator it = this->SegmentPassFractionPercents.find(segmentID);
+  if (it == this->SegmentPassFractionPercents.end())
+    {
+    return -1.0;
+    }
+  return it->second;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetSegmentPassFractionPercent(const char* segmentID, double passFractionPercent)
+{
+  if (!segmentID)
+    {
+    vtkErrorMacro("SetSegmentPassFractionPercent: Invalid segment ID");
+    return;
+    }
+  this->SegmentPassFractionPercents[segmentID] = passFractionPercent;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::RemoveAllSegmentPassFractionPercents()
+{
+  if (this->SegmentPassFractionPercents.empty())
+    {
+    return;
+    }
+  this->SegmentPassFractionPercents.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::GetSegmentPassFractionSegmentIDs(std::vector<std::string>& segmentIDs)
+{
+  segmentIDs.clear();
+  for (std::map<std::string, double>::iterator it=this->SegmentPassFractionPercents.begin(); it!=this->SegmentPassFractionPercents.end(); ++it)
+    {
+    segmentIDs.push_back(it->first);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::GetGammaHistogram(std::vector<vtkIdType>& binCounts)
+{
+  binCounts = this->GammaHistogram;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetGammaHistogram(const std::vector<vtkIdType>& binCounts)
+{
+  if (this->GammaHistogram == binCounts)
+    {
+    return;
+    }
+  this->GammaHistogram = binCounts;
+  this->Modified();
+}
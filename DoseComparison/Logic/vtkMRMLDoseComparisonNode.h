@@ -28,6 +28,8 @@
 // STD includes
 #include <vector>
 #include <set>
+#include <map>
+#include <string>
 
 #include "vtkSlicerDoseComparisonModuleLogicExport.h"
 
@@ -136,6 +138,32 @@ public:
   /// Set local dose difference flag
   vtkBooleanMacro(LocalDoseDifference, bool);
 
+  /// Get use native gamma engine flag. Off by default, in which case Plastimatch computes the gamma volume
+  vtkGetMacro(UseNativeGammaEngine, bool);
+  /// Set use native gamma engine flag
+  vtkSetMacro(UseNativeGammaEngine, bool);
+  /// Set use native gamma engine flag
+  vtkBooleanMacro(UseNativeGammaEngine, bool);
+
+  /// Get sub-voxel interpolation factor
+  vtkGetMacro(InterpolationFactor, int);
+  /// Set sub-voxel interpolation factor (between 1 and 10)
+  vtkSetClampMacro(InterpolationFactor, int, 1, 10);
+
+  /// Get statistics only flag
+  vtkGetMacro(StatisticsOnly, bool);
+  /// Set statistics only flag
+  vtkSetMacro(StatisticsOnly, bool);
+  /// Set statistics only flag
+  vtkBooleanMacro(StatisticsOnly, bool);
+
+  /// Get multi-resolution flag
+  vtkGetMacro(MultiResolution, bool);
+  /// Set multi-resolution flag
+  vtkSetMacro(MultiResolution, bool);
+  /// Set multi-resolution flag
+  vtkBooleanMacro(MultiResolution, bool);
+
   /// Get valid flag
   vtkGetMacro(ResultsValid, bool);
   /// Set valid flag
@@ -148,6 +176,27 @@ public:
   /// Set pass fraction
   vtkSetMacro(PassFractionPercent, double);
 
+  /// Get mean gamma
+  vtkGetMacro(MeanGamma, double);
+  /// Set mean gamma
+  vtkSetMacro(MeanGamma, double);
+
+  /// Get pass fraction in a segment of the mask segmentation
+  /// \return Pass fraction in percent, -1 if not computed for the given segment
+  double GetSegmentPassFractionPercent(const char* segmentID);
+  /// Set pass fraction in a segment of the mask segmentation
+  void SetSegmentPassFractionPercent(const char* segmentID, double passFractionPercent);
+  /// Remove all segment pass fractions
+  void RemoveAllSegmentPassFractionPercents();
+  /// Get IDs of the segments for which pass fractions are available
+  void GetSegmentPassFractionSegmentIDs(std::vector<std::string>& segmentIDs);
+
+  /// Get gamma histogram: number of analyzed voxels in each bin, the bins covering [0, MaximumGamma] uniformly.
+  /// Empty if not computed (Plastimatch or multi-resolution)
+  void GetGammaHistogram(std::vector<vtkIdType>& binCounts);
+  /// Set gamma histogram
+  void SetGammaHistogram(const std::vector<vtkIdType>& binCounts);
+
   /// Get report string
   vtkGetStringMacro(ReportString);
   /// Set report string
@@ -197,10 +246,37 @@ protected:
   /// Flag determining whether dose thresholding should be performed using only the reference image
   /// Default value is false, meaning that both images will be used
   bool DoseThresholdOnReferenceOnly;
+
+  /// Flag determining whether the native multi-threaded gamma engine (vtkGammaDoseComparisonFilter)
+  /// is used. Plastimatch is used if false. Default value is false.
+  bool UseNativeGammaEngine;
+
+  /// Number of sub-voxel search positions per voxel along each axis, used for the voxels with gamma near one.
+  /// Default value is 1 (no sub-voxel search). Only supported by the native gamma engine.
+  int InterpolationFactor;
+
+  /// Flag determining whether only the statistics (pass fractions, mean gamma, gamma histogram) are computed,
+  /// without creating the gamma volume. Always uses the native gamma engine. Default value is false.
+  bool StatisticsOnly;
+
+  /// Flag determining whether the pass rates are computed using coarse-to-fine evaluation, where only the voxels
+  /// that cannot be classified by conservative bounds are searched at full resolution. The pass rates are identical
+  /// to the full evaluation, but mean gamma is not computed. Only used in statistics only mode. Default value is false.
+  bool MultiResolution;
   
   /// Percentage of voxels that passed (output)
   double PassFractionPercent;
 
+  /// Mean gamma of the analyzed voxels (output)
+  double MeanGamma;
+
+  /// Percentage of voxels that passed in each segment of the mask segmentation, keyed by segment ID (output).
+  /// All voxels of the segment above the analysis threshold are counted, regardless of the mask segment
+  std::map<std::string, double> SegmentPassFractionPercents;
+
+  /// Number of analyzed voxels in each gamma histogram bin (output)
+  std::vector<vtkIdType> GammaHistogram;
+
   /// Flag indicating if the results are valid
   bool ResultsValid;
 
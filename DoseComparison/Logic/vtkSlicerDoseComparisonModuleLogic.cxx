@@ -21,6 +21,7 @@
 // DoseComparison includes
 #include "vtkSlicerDoseComparisonModuleLogic.h"
 #include "vtkMRMLDoseComparisonNode.h"
+#include "vtkGammaDoseComparisonFilter.h"
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
@@ -33,6 +34,7 @@
 #include "vtkMRMLSegmentationNode.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 #include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
 
 // MRML includes
@@ -51,13 +53,22 @@
 #include <vtkSlicerSubjectHierarchyModuleLogic.h>
 
 // VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkCollection.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMutexLock.h>
 #include <vtkNew.h>
+#include <vtkSMPTools.h>
 #include <vtkTimerLog.h>
 #include <vtkLookupTable.h>
 #include <vtkImageConstantPad.h>
 #include <vtkObjectFactory.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <algorithm>
+
 // SlicerBase includes
 #include "vtkSlicerApplicationLogic.h"
 
@@ -68,14 +79,206 @@ const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_OUTPUT_BASE
 const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_REFERENCE_DOSE_VOLUME_REFERENCE_ROLE = "referenceDoseVolumeRef"; // Reference
 const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_COMPARE_DOSE_VOLUME_REFERENCE_ROLE = "compareDoseVolumeRef"; // Reference
 
-//---------------------------------------------------------------------------
-vtkSlicerDoseComparisonModuleLogic* LogicInstance = NULL;
-void GammaProgressCallback(float progress)
+namespace
+{
+  //---------------------------------------------------------------------------
+  /// Progress of one gamma computation job. Each job reports into its own channel, so that
+  /// concurrent computations do not interfere
+  struct GammaProgressChannel
+  {
+    GammaProgressChannel()
+      : Logic(NULL)
+      , ForwardProgress(false)
+      , CancelRequestCount(0)
+      , Progress(0.0)
+    {
+    }
+
+    /// Logic that started the job
+    vtkSlicerDoseComparisonModuleLogic* Logic;
+    /// Flag determining whether the progress is forwarded to the logic. Only set for jobs running on the main thread
+    bool ForwardProgress;
+    /// Number of cancel requests of the logic when the job was started. The job is aborted if it changes
+    unsigned long CancelRequestCount;
+    /// Last reported progress of the job (between 0 and 1)
+    double Progress;
+  };
+
+  //---------------------------------------------------------------------------
+  void GammaFilterProgressCallback(vtkObject* caller, unsigned long vtkNotUsed(eid), void* clientData, void* callData)
+  {
+    GammaProgressChannel* channel = reinterpret_cast<GammaProgressChannel*>(clientData);
+    double* progress = reinterpret_cast<double*>(callData);
+    if (!channel || !progress)
+    {
+      return;
+    }
+
+    channel->Progress = (*progress);
+    if (!channel->Logic)
+    {
+      return;
+    }
+    if (channel->ForwardProgress)
+    {
+      channel->Logic->GammaProgressUpdated((float)(*progress));
+    }
+
+    // Abort the computation if cancel has been requested since the job was started
+    vtkGammaDoseComparisonFilter* gammaFilter = vtkGammaDoseComparisonFilter::SafeDownCast(caller);
+    if (gammaFilter && channel->Logic->GetGammaCancelRequestCount() != channel->CancelRequestCount)
+    {
+      gammaFilter->AbortExecuteOn();
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // Plastimatch only accepts a plain function as progress callback, so the channel of the running
+  // Plastimatch computation is stored here and Plastimatch computations are serialized
+  vtkSimpleMutexLock PlastimatchGammaMutex;
+  GammaProgressChannel* PlastimatchGammaProgressChannel = NULL;
+
+  void PlastimatchGammaProgressCallback(float progress)
+  {
+    double progressDouble = (double)progress;
+    GammaFilterProgressCallback(NULL, vtkCommand::ProgressEvent, PlastimatchGammaProgressChannel, &progressDouble);
+  }
+
+  //---------------------------------------------------------------------------
+  /// Gamma computation of one compare dose in a batch (\sa ComputeGammaDoseDifferenceBatch)
+  struct GammaJob
+  {
+    GammaJob()
+      : ParameterNode(NULL)
+      , Success(false)
+    {
+    }
+
+    vtkMRMLDoseComparisonNode* ParameterNode;
+    vtkSmartPointer<vtkGammaDoseComparisonFilter> GammaFilter;
+    GammaProgressChannel Progress;
+    bool Success;
+  };
+
+  //---------------------------------------------------------------------------
+  /// Run gamma jobs in parallel. The filters only access their own compare dose and the shared
+  /// reference data, which is not modified during the computation
+  class GammaJobFunctor
+  {
+  public:
+    GammaJobFunctor(std::vector<GammaJob>& jobs)
+      : Jobs(jobs)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      for (vtkIdType jobIndex=begin; jobIndex<end; ++jobIndex)
+      {
+        this->Jobs[jobIndex].Success = this->Jobs[jobIndex].GammaFilter->Update();
+      }
+    }
+
+  private:
+    std::vector<GammaJob>& Jobs;
+  };
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerDoseComparisonModuleLogic::vtkInternal
+{
+public:
+  vtkInternal()
+    : SlicePreviewMaskMTime(0)
+  {
+  }
+
+  /// Image converted from a volume node, with the node state it was converted from
+  struct CachedVolumeImage
+  {
+    CachedVolumeImage()
+      : ContentMTime(0)
+    {
+    }
+
+    std::string NodeID;
+    vtkMTimeType ContentMTime;
+    vtkSmartPointer<vtkOrientedImageData> Image;
+  };
+
+  /// Get image of a volume node in world coordinate frame. The conversion is only done if the node
+  /// (its image data or parent transform) has changed since the last call with the same cache
+  vtkOrientedImageData* GetVolumeImage(vtkMRMLScalarVolumeNode* volumeNode, CachedVolumeImage& cache);
+
+  /// Get modification time of the contents of a volume node (node, image data and parent transform)
+  static vtkMTimeType GetVolumeNodeContentMTime(vtkMRMLScalarVolumeNode* volumeNode);
+
+  /// Get modification time of the contents of a segmentation node (node, segmentation and parent transform)
+  static vtkMTimeType GetSegmentationNodeContentMTime(vtkMRMLSegmentationNode* segmentationNode);
+
+public:
+  /// Inputs of the slice preview, reused while the nodes are unchanged
+  CachedVolumeImage SlicePreviewReferenceDose;
+  CachedVolumeImage SlicePreviewCompareDose;
+  std::string SlicePreviewMaskSegmentationNodeID;
+  std::string SlicePreviewMaskSegmentID;
+  vtkMTimeType SlicePreviewMaskMTime;
+  vtkSmartPointer<vtkOrientedImageData> SlicePreviewMask;
+};
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkSlicerDoseComparisonModuleLogic::vtkInternal::GetVolumeImage(
+  vtkMRMLScalarVolumeNode* volumeNode, CachedVolumeImage& cache)
+{
+  if (!volumeNode || !volumeNode->GetID())
+  {
+    return NULL;
+  }
+  vtkMTimeType contentMTime = vtkInternal::GetVolumeNodeContentMTime(volumeNode);
+  if (cache.Image && cache.NodeID == volumeNode->GetID() && cache.ContentMTime == contentMTime)
+  {
+    return cache.Image;
+  }
+
+  cache.Image = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(volumeNode, cache.Image))
+  {
+    cache.Image = NULL;
+    return NULL;
+  }
+  cache.NodeID = volumeNode->GetID();
+  cache.ContentMTime = contentMTime;
+  return cache.Image;
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkSlicerDoseComparisonModuleLogic::vtkInternal::GetVolumeNodeContentMTime(vtkMRMLScalarVolumeNode* volumeNode)
+{
+  vtkMTimeType contentMTime = volumeNode->GetMTime();
+  if (volumeNode->GetImageData())
+  {
+    contentMTime = std::max(contentMTime, volumeNode->GetImageData()->GetMTime());
+  }
+  if (volumeNode->GetParentTransformNode())
+  {
+    contentMTime = std::max(contentMTime, volumeNode->GetParentTransformNode()->GetMTime());
+  }
+  return contentMTime;
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkSlicerDoseComparisonModuleLogic::vtkInternal::GetSegmentationNodeContentMTime(vtkMRMLSegmentationNode* segmentationNode)
 {
-  if (LogicInstance)
+  vtkMTimeType contentMTime = segmentationNode->GetMTime();
+  if (segmentationNode->GetSegmentation())
   {
-    LogicInstance->GammaProgressUpdated(progress);
+    contentMTime = std::max(contentMTime, segmentationNode->GetSegmentation()->GetMTime());
   }
+  if (segmentationNode->GetParentTransformNode())
+  {
+    contentMTime = std::max(contentMTime, segmentationNode->GetParentTransformNode()->GetMTime());
+  }
+  return contentMTime;
 }
 
 //----------------------------------------------------------------------------
@@ -87,9 +290,12 @@ vtkSlicerDoseComparisonModuleLogic::vtkSlicerDoseComparisonModuleLogic()
   this->DefaultGammaColorTableNodeId = NULL;
   this->Progress = 0.0;
 
+  this->BatchMemoryLimitMb = 2048.0;
+  this->GammaCancelRequestCount = 0;
+
   this->LogSpeedMeasurementsOff();
 
-  LogicInstance = this;
+  this->Internal = new vtkInternal;
 }
 
 //----------------------------------------------------------------------------
@@ -97,7 +303,7 @@ vtkSlicerDoseComparisonModuleLogic::~vtkSlicerDoseComparisonModuleLogic()
 {
   this->SetDefaultGammaColorTableNodeId(NULL);
 
-  LogicInstance = NULL;
+  delete this->Internal;
 }
 
 //---------------------------------------------------------------------------
@@ -191,107 +397,467 @@ void vtkSlicerDoseComparisonModuleLogic::GammaProgressUpdated(float progress)
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode)
 {
+  if (!parameterNode || !parameterNode->GetReferenceDoseVolumeNode() || !parameterNode->GetCompareDoseVolumeNode())
+  {
+    std::string errorMessage("Invalid parameter set node or input dose volumes");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
+
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
 
   parameterNode->ResultsValidOff();
+  parameterNode->RemoveAllSegmentPassFractionPercents();
+  parameterNode->SetGammaHistogram(std::vector<vtkIdType>());
 
-  double checkpointConvertStart = timer->GetUniversalTime();
-  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
-  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
-  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
-
-  Plm_image::Pointer maskVolume;
-  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
-  const char* maskSegmentID = parameterNode->GetMaskSegmentID();
-  if (maskSegmentationNode && maskSegmentID)
+  // Only compute the statistics without creating gamma volume if requested. It is supported by the native engine only
+  if (parameterNode->GetStatisticsOnly())
   {
-    // Extract a labelmap for the dose comparison to use it as a mask
-    vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
-    vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
-    if (!maskSegment)
+    std::string errorMessage = this->ComputeGammaDoseDifferenceNative(parameterNode, NULL);
+    if (!errorMessage.empty())
     {
-      std::string errorMessage("Failed to get mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
 
-    // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
-    vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
-    segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
-    segmentationCopy->CopyConversionParameters(maskSegmentation);
-    segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
-    if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+    parameterNode->ResultsValidOn();
+
+    if (this->LogSpeedMeasurements)
     {
-      std::string errorMessage("Failed to create binary labelmap representation for mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-      return errorMessage;
+      double checkpointEnd = timer->GetUniversalTime();
+      std::cout << "Total gamma statistics computation time: " << checkpointEnd-checkpointStart << " s" << std::endl;
     }
-    // Get segment binary labelmap
-    vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
-      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
 
-    // Apply parent transformation nodes if necessary
-    if ( maskSegmentationNode->GetParentTransformNode()
-      && (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(maskSegmentationNode, maskSegmentLabelmap)) )
+    return "";
+  }
+
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+  if (gammaVolumeNode == NULL)
+  {
+    std::string errorMessage("Invalid gamma volume node in parameter set node");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Compute gamma dose volume
+  std::string errorMessage;
+  if (parameterNode->GetUseNativeGammaEngine())
+  {
+    errorMessage = this->ComputeGammaDoseDifferenceNative(parameterNode, gammaVolumeNode);
+  }
+  else
+  {
+    errorMessage = this->ComputeGammaDoseDifferencePlastimatch(parameterNode, gammaVolumeNode);
+  }
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  parameterNode->ResultsValidOn();
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifferenceBatch(vtkCollection* parameterNodes)
+{
+  if (!parameterNodes || parameterNodes->GetNumberOfItems() == 0)
+  {
+    std::string errorMessage("No parameter set nodes given");
+    vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Validate parameter nodes. The reference dose, the masks and the parameters of the gamma computation must be shared
+  std::vector<GammaJob> jobs(parameterNodes->GetNumberOfItems());
+  vtkMRMLDoseComparisonNode* firstParameterNode = NULL;
+  for (int jobIndex=0; jobIndex<parameterNodes->GetNumberOfItems(); ++jobIndex)
+  {
+    vtkMRMLDoseComparisonNode* parameterNode = vtkMRMLDoseComparisonNode::SafeDownCast(parameterNodes->GetItemAsObject(jobIndex));
+    if (!parameterNode || !parameterNode->GetReferenceDoseVolumeNode() || !parameterNode->GetCompareDoseVolumeNode())
     {
-      std::string errorMessage("Failed to apply parent transform on mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+      std::string errorMessage("Invalid parameter set node or input dose volumes");
+      vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << errorMessage);
       return errorMessage;
     }
+    if (!parameterNode->GetStatisticsOnly() && !parameterNode->GetGammaVolumeNode())
+    {
+      std::string errorMessage("Invalid gamma volume node in parameter set node ");
+      errorMessage.append(parameterNode->GetName() ? parameterNode->GetName() : "");
+      vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << errorMessage);
+      return errorMessage;
+    }
+    if (!firstParameterNode)
+    {
+      firstParameterNode = parameterNode;
+    }
+    else if ( parameterNode->GetReferenceDoseVolumeNode() != firstParameterNode->GetReferenceDoseVolumeNode()
+      || parameterNode->GetMaskSegmentationNode() != firstParameterNode->GetMaskSegmentationNode()
+      || (parameterNode->GetMaskSegmentID() ? std::string(parameterNode->GetMaskSegmentID()) : std::string())
+         != (firstParameterNode->GetMaskSegmentID() ? std::string(firstParameterNode->GetMaskSegmentID()) : std::string())
+      || parameterNode->GetDtaDistanceToleranceMm() != firstParameterNode->GetDtaDistanceToleranceMm()
+      || parameterNode->GetDoseDifferenceTolerancePercent() != firstParameterNode->GetDoseDifferenceTolerancePercent()
+      || parameterNode->GetUseMaximumDose() != firstParameterNode->GetUseMaximumDose()
+      || (!parameterNode->GetUseMaximumDose() && parameterNode->GetReferenceDoseGy() != firstParameterNode->GetReferenceDoseGy())
+      || parameterNode->GetAnalysisThresholdPercent() != firstParameterNode->GetAnalysisThresholdPercent()
+      || parameterNode->GetMaximumGamma() != firstParameterNode->GetMaximumGamma()
+      || parameterNode->GetUseLinearInterpolation() != firstParameterNode->GetUseLinearInterpolation()
+      || parameterNode->GetLocalDoseDifference() != firstParameterNode->GetLocalDoseDifference()
+      || parameterNode->GetDoseThresholdOnReferenceOnly() != firstParameterNode->GetDoseThresholdOnReferenceOnly()
+      || parameterNode->GetInterpolationFactor() != firstParameterNode->GetInterpolationFactor() )
+    {
+      std::string errorMessage("Parameter set nodes in a batch must share the reference dose, the mask and the gamma parameters");
+      vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << errorMessage);
+      return errorMessage;
+    }
+    if (!parameterNode->GetUseNativeGammaEngine())
+    {
+      vtkWarningMacro("ComputeGammaDoseDifferenceBatch: Batch computation always uses the native gamma engine");
+    }
+    jobs[jobIndex].ParameterNode = parameterNode;
+  }
 
-    // Convert mask to Plm image
-    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
-    if (!maskVolume)
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+
+  for (std::vector<GammaJob>::iterator jobIt=jobs.begin(); jobIt!=jobs.end(); ++jobIt)
+  {
+    jobIt->ParameterNode->ResultsValidOff();
+    jobIt->ParameterNode->RemoveAllSegmentPassFractionPercents();
+    jobIt->ParameterNode->SetGammaHistogram(std::vector<vtkIdType>());
+  }
+
+  // Prepare reference dose, masks and normalization once
+  vtkSmartPointer<vtkGammaDoseComparisonFilter> referenceGammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+  std::vector<std::string> regionSegmentIDs;
+  std::string errorMessage = this->SetupGammaFilterReference(firstParameterNode, referenceGammaFilter, regionSegmentIDs);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+  if (!referenceGammaFilter->PrepareReference())
+  {
+    errorMessage = "Failed to prepare reference dose";
+    vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << errorMessage);
+    return errorMessage;
+  }
+  int* referenceDimensions = referenceGammaFilter->GetReferenceDoseImage()->GetDimensions();
+  double numberOfReferenceVoxels = (double)referenceDimensions[0] * referenceDimensions[1] * referenceDimensions[2];
+
+  // Get compare doses. MRML nodes are only accessed from this thread.
+  // Memory needed by a job: float compare dose on the reference lattice, gamma image, and float copy of the compare dose
+  double checkpointPrepareEnd = timer->GetUniversalTime();
+  double maximumJobMemoryMb = 0.0;
+  for (std::vector<GammaJob>::iterator jobIt=jobs.begin(); jobIt!=jobs.end(); ++jobIt)
+  {
+    vtkSmartPointer<vtkOrientedImageData> compareDoseImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(jobIt->ParameterNode->GetCompareDoseVolumeNode(), compareDoseImage))
     {
-      std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+      errorMessage = "Failed to get compare dose image";
+      vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << errorMessage);
       return errorMessage;
     }
+
+    jobIt->GammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+    jobIt->GammaFilter->ShareReference(referenceGammaFilter);
+    jobIt->GammaFilter->SetCompareDoseImage(compareDoseImage);
+    jobIt->GammaFilter->SetGenerateGammaImage(!jobIt->ParameterNode->GetStatisticsOnly());
+    jobIt->GammaFilter->SetMultiResolution(jobIt->ParameterNode->GetStatisticsOnly() && jobIt->ParameterNode->GetMultiResolution());
+
+    vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    progressCallback->SetCallback(GammaFilterProgressCallback);
+    jobIt->Progress.Logic = this;
+    jobIt->Progress.CancelRequestCount = this->GammaCancelRequestCount;
+    progressCallback->SetClientData(&(jobIt->Progress));
+    jobIt->GammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+
+    int* compareDimensions = compareDoseImage->GetDimensions();
+    double numberOfCompareVoxels = (double)compareDimensions[0] * compareDimensions[1] * compareDimensions[2];
+    double jobMemoryMb = (numberOfReferenceVoxels * (jobIt->ParameterNode->GetStatisticsOnly() ? 1 : 2) + numberOfCompareVoxels)
+      * sizeof(float) / (1024.0 * 1024.0);
+    maximumJobMemoryMb = std::max(maximumJobMemoryMb, jobMemoryMb);
   }
 
-  // Compute gamma dose volume
+  // Compute gamma. Jobs are run concurrently in groups that fit in the memory limit.
+  // Progress of the jobs is collected from their channels and reported from this thread between groups
   double checkpointGammaStart = timer->GetUniversalTime();
-  Gamma_dose_comparison gamma;
-  gamma.set_reference_image(referenceDose->itk_float());
-  gamma.set_compare_image(compareDose->itk_float());
-  if (maskSegmentationNode && maskSegmentID)
+  int numberOfJobs = (int)jobs.size();
+  int numberOfConcurrentJobs = std::max(1, std::min(numberOfJobs,
+    (int)(maximumJobMemoryMb > 0.0 ? this->BatchMemoryLimitMb / maximumJobMemoryMb : numberOfJobs)));
+  GammaJobFunctor functor(jobs);
+  for (int groupStart=0; groupStart<numberOfJobs; groupStart+=numberOfConcurrentJobs)
   {
-    gamma.set_mask_image(maskVolume->itk_uchar());
+    int groupEnd = std::min(groupStart + numberOfConcurrentJobs, numberOfJobs);
+    vtkSMPTools::For(groupStart, groupEnd, 1, functor);
+
+    double progressSum = 0.0;
+    for (std::vector<GammaJob>::iterator jobIt=jobs.begin(); jobIt!=jobs.end(); ++jobIt)
+    {
+      progressSum += jobIt->Progress.Progress;
+    }
+    this->GammaProgressUpdated((float)(progressSum / numberOfJobs));
   }
-  gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
-  gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
-  gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
-  gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
-  if (!parameterNode->GetUseMaximumDose())
+
+  if (jobs[0].Progress.CancelRequestCount != this->GammaCancelRequestCount)
   {
-    gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
+    return "Gamma computation cancelled";
   }
-  gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
-  gamma.set_gamma_max(parameterNode->GetMaximumGamma());
-  gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
-  gamma.set_progress_callback(&GammaProgressCallback);
 
-  gamma.run();
+  // Store results and set up output volumes
+  double checkpointResultsStart = timer->GetUniversalTime();
+  std::string batchErrorMessage;
+  for (std::vector<GammaJob>::iterator jobIt=jobs.begin(); jobIt!=jobs.end(); ++jobIt)
+  {
+    vtkMRMLDoseComparisonNode* parameterNode = jobIt->ParameterNode;
+    if (!jobIt->Success)
+    {
+      batchErrorMessage = "Gamma computation failed for parameter set node ";
+      batchErrorMessage.append(parameterNode->GetName() ? parameterNode->GetName() : "");
+      vtkErrorMacro("ComputeGammaDoseDifferenceBatch: " << batchErrorMessage);
+      continue;
+    }
 
-  itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
-  parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
-  parameterNode->SetReportString(gamma.get_report_string().c_str());
+    vtkMRMLScalarVolumeNode* gammaVolumeNode = (parameterNode->GetStatisticsOnly() ? NULL : parameterNode->GetGammaVolumeNode());
+    this->SetGammaFilterResults(parameterNode, jobIt->GammaFilter, regionSegmentIDs, gammaVolumeNode);
+    if (gammaVolumeNode)
+    {
+      errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+      if (!errorMessage.empty())
+      {
+        batchErrorMessage = errorMessage;
+        continue;
+      }
+    }
 
-  // Convert output to VTK
-  double checkpointVtkConvertStart = timer->GetUniversalTime();
+    parameterNode->ResultsValidOn();
+  }
 
-  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
-  if (gammaVolumeNode == NULL)
+  if (this->LogSpeedMeasurements)
   {
-    std::string errorMessage("Invalid gamma volume node in parameter set node");
-    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    double checkpointEnd = timer->GetUniversalTime();
+    std::cout << "Total batch gamma computation time for " << numberOfJobs << " compare doses ("
+              << numberOfConcurrentJobs << " concurrently): " << checkpointEnd-checkpointStart << " s" << std::endl
+              << "\tPreparing reference: " << checkpointPrepareEnd-checkpointStart << " s" << std::endl
+              << "\tGetting compare images: " << checkpointGammaStart-checkpointPrepareEnd << " s" << std::endl
+              << "\tGamma computation: " << checkpointResultsStart-checkpointGammaStart << " s" << std::endl
+              << "\tSetting up outputs: " << checkpointEnd-checkpointResultsStart << " s" << std::endl;
+  }
+
+  return batchErrorMessage;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseComparisonModuleLogic::CancelGammaComputation()
+{
+  ++this->GammaCancelRequestCount;
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaSlicePreview(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkMatrix4x4* sliceToRasMatrix, bool inPlaneSearch, vtkMRMLScalarVolumeNode* outputSliceVolumeNode)
+{
+  if ( !parameterNode || !parameterNode->GetReferenceDoseVolumeNode() || !parameterNode->GetCompareDoseVolumeNode()
+    || !sliceToRasMatrix || !outputSliceVolumeNode )
+  {
+    std::string errorMessage("Invalid parameter set node, input dose volumes, slice or output volume");
+    vtkErrorMacro("ComputeGammaSlicePreview: " << errorMessage);
     return errorMessage;
   }
 
-  vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
-  gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
+  // A new preview supersedes the ones still running (e.g. if started from a progress event)
+  this->CancelGammaComputation();
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
 
+  // Get inputs in world coordinate frame. They are only converted again if the nodes have changed
+  vtkOrientedImageData* referenceDoseImage = this->Internal->GetVolumeImage(
+    parameterNode->GetReferenceDoseVolumeNode(), this->Internal->SlicePreviewReferenceDose);
+  vtkOrientedImageData* compareDoseImage = this->Internal->GetVolumeImage(
+    parameterNode->GetCompareDoseVolumeNode(), this->Internal->SlicePreviewCompareDose);
+  if (!referenceDoseImage || !compareDoseImage)
+  {
+    std::string errorMessage("Failed to get input dose images");
+    vtkErrorMacro("ComputeGammaSlicePreview: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
+  const char* maskSegmentID = parameterNode->GetMaskSegmentID();
+  vtkOrientedImageData* maskLabelmap = NULL;
+  if (maskSegmentationNode && maskSegmentID && maskSegmentationNode->GetSegmentation()->GetSegment(maskSegmentID))
+  {
+    vtkMTimeType maskMTime = vtkInternal::GetSegmentationNodeContentMTime(maskSegmentationNode);
+    vtkDataObject* maskMasterRepresentation = maskSegmentationNode->GetSegmentation()->GetSegment(maskSegmentID)->GetRepresentation(
+      maskSegmentationNode->GetSegmentation()->GetMasterRepresentationName() );
+    if (maskMasterRepresentation)
+    {
+      maskMTime = std::max(maskMTime, maskMasterRepresentation->GetMTime());
+    }
+    if ( !this->Internal->SlicePreviewMask
+      || this->Internal->SlicePreviewMaskSegmentationNodeID != maskSegmentationNode->GetID()
+      || this->Internal->SlicePreviewMaskSegmentID != maskSegmentID
+      || this->Internal->SlicePreviewMaskMTime != maskMTime )
+    {
+      this->Internal->SlicePreviewMask = vtkSmartPointer<vtkOrientedImageData>::New();
+      std::string errorMessage = this->GetSegmentLabelmap(maskSegmentationNode, maskSegmentID, this->Internal->SlicePreviewMask);
+      if (!errorMessage.empty())
+      {
+        this->Internal->SlicePreviewMask = NULL;
+        return errorMessage;
+      }
+      this->Internal->SlicePreviewMaskSegmentationNodeID = maskSegmentationNode->GetID();
+      this->Internal->SlicePreviewMaskSegmentID = maskSegmentID;
+      this->Internal->SlicePreviewMaskMTime = maskMTime;
+    }
+    maskLabelmap = this->Internal->SlicePreviewMask;
+  }
+
+  // Slice axes and center in world coordinate frame
+  double sliceAxes[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+  double sliceCenter[3] = {0.0, 0.0, 0.0};
+  for (int row=0; row<3; ++row)
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      sliceAxes[axis][row] = sliceToRasMatrix->GetElement(row, axis);
+    }
+    sliceCenter[row] = sliceToRasMatrix->GetElement(row, 3);
+  }
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (vtkMath::Normalize(sliceAxes[axis]) == 0.0)
+    {
+      std::string errorMessage("Invalid slice orientation");
+      vtkErrorMacro("ComputeGammaSlicePreview: " << errorMessage);
+      return errorMessage;
+    }
+  }
+
+  // Sample the slice with the finest spacing of the reference dose, covering the intersection of the slice plane
+  // and the reference dose. For the 3D search, the reference is sampled in a slab that covers the search radius
+  double* referenceSpacing = referenceDoseImage->GetSpacing();
+  double sampleSpacing = std::min(referenceSpacing[0], std::min(referenceSpacing[1], referenceSpacing[2]));
+  vtkSmartPointer<vtkMatrix4x4> referenceImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceDoseImage->GetImageToWorldMatrix(referenceImageToWorldMatrix);
+  int referenceExtent[6] = {0, -1, 0, -1, 0, -1};
+  referenceDoseImage->GetExtent(referenceExtent);
+  double sliceBounds[6] = {VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX};
+  for (int corner=0; corner<8; ++corner)
+  {
+    double cornerIjk[4] = { (double)referenceExtent[(corner & 1) ? 1 : 0], (double)referenceExtent[(corner & 2) ? 3 : 2],
+      (double)referenceExtent[(corner & 4) ? 5 : 4], 1.0 };
+    double cornerWorld[4] = {0.0, 0.0, 0.0, 1.0};
+    referenceImageToWorldMatrix->MultiplyPoint(cornerIjk, cornerWorld);
+    double cornerFromCenter[3] = { cornerWorld[0]-sliceCenter[0], cornerWorld[1]-sliceCenter[1], cornerWorld[2]-sliceCenter[2] };
+    for (int axis=0; axis<3; ++axis)
+    {
+      double coordinate = vtkMath::Dot(cornerFromCenter, sliceAxes[axis]);
+      sliceBounds[2*axis] = std::min(sliceBounds[2*axis], coordinate);
+      sliceBounds[2*axis+1] = std::max(sliceBounds[2*axis+1], coordinate);
+    }
+  }
+  if (sliceBounds[4] > 0.5 * sampleSpacing || sliceBounds[5] < -0.5 * sampleSpacing)
+  {
+    std::string errorMessage("Slice does not intersect the reference dose");
+    vtkErrorMacro("ComputeGammaSlicePreview: " << errorMessage);
+    return errorMessage;
+  }
+  int sliceMinimumIndex[2] = { (int)floor(sliceBounds[0] / sampleSpacing), (int)floor(sliceBounds[2] / sampleSpacing) };
+  int sliceMaximumIndex[2] = { (int)ceil(sliceBounds[1] / sampleSpacing), (int)ceil(sliceBounds[3] / sampleSpacing) };
+  int numberOfSearchLayers = (inPlaneSearch ? 0
+    : (int)ceil(parameterNode->GetDtaDistanceToleranceMm() * parameterNode->GetMaximumGamma() / sampleSpacing));
+
+  vtkSmartPointer<vtkMatrix4x4> slabImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int row=0; row<3; ++row)
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      slabImageToWorldMatrix->SetElement(row, axis, sliceAxes[axis][row] * sampleSpacing);
+    }
+    slabImageToWorldMatrix->SetElement(row, 3, sliceCenter[row]
+      + sliceMinimumIndex[0] * sampleSpacing * sliceAxes[0][row] + sliceMinimumIndex[1] * sampleSpacing * sliceAxes[1][row]);
+  }
+  vtkSmartPointer<vtkOrientedImageData> slabGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+  slabGeometry->SetGeometryFromImageToWorldMatrix(slabImageToWorldMatrix);
+  slabGeometry->SetExtent(0, sliceMaximumIndex[0]-sliceMinimumIndex[0], 0, sliceMaximumIndex[1]-sliceMinimumIndex[1],
+    -numberOfSearchLayers, numberOfSearchLayers);
+
+  vtkSmartPointer<vtkOrientedImageData> referenceSlabImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+    referenceDoseImage, slabGeometry, referenceSlabImage, parameterNode->GetUseLinearInterpolation()))
+  {
+    std::string errorMessage("Failed to resample reference dose to the slice");
+    vtkErrorMacro("ComputeGammaSlicePreview: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Compute gamma in the slice. The compare dose and the mask are resampled to the slab by the filter.
+  // Normalization uses the maximum of the whole reference dose, as in the 3D computation
+  double checkpointGammaStart = timer->GetUniversalTime();
+  vtkSmartPointer<vtkGammaDoseComparisonFilter> gammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+  gammaFilter->SetReferenceDoseImage(referenceSlabImage);
+  gammaFilter->SetCompareDoseImage(compareDoseImage);
+  gammaFilter->SetMaskImage(maskLabelmap);
+  this->SetGammaFilterParameters(parameterNode, gammaFilter);
+  if (parameterNode->GetUseMaximumDose())
+  {
+    gammaFilter->SetReferenceDoseGy(referenceDoseImage->GetScalarRange()[1]);
+  }
+  gammaFilter->SetAnalysisExtent(0, sliceMaximumIndex[0]-sliceMinimumIndex[0], 0, sliceMaximumIndex[1]-sliceMinimumIndex[1], 0, 0);
+
+  GammaProgressChannel progressChannel;
+  progressChannel.Logic = this;
+  progressChannel.ForwardProgress = true;
+  progressChannel.CancelRequestCount = this->GammaCancelRequestCount;
+  vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  progressCallback->SetCallback(GammaFilterProgressCallback);
+  progressCallback->SetClientData(&progressChannel);
+  gammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+
+  if (!gammaFilter->Update())
+  {
+    if (gammaFilter->GetAbortExecute())
+    {
+      return "Gamma computation cancelled";
+    }
+    std::string errorMessage("Slice gamma computation failed");
+    vtkErrorMacro("ComputeGammaSlicePreview: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Set single slice gamma image to the output volume with the slice geometry
+  outputSliceVolumeNode->SetIJKToRASMatrix(slabImageToWorldMatrix);
+  outputSliceVolumeNode->SetAndObserveImageData(gammaFilter->GetOutput());
+  this->SetupGammaVolumeDisplay(parameterNode, outputSliceVolumeNode);
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    std::cout << "Slice gamma preview computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
+              << "\tPreparing slice: " << checkpointGammaStart-checkpointStart << " s" << std::endl
+              << "\tGamma computation: " << checkpointEnd-checkpointGammaStart << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseComparisonModuleLogic::SetupGammaVolumeDisplay(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
   // Set default colormap to red
   if (gammaVolumeNode->GetVolumeDisplayNode() == NULL)
   {
@@ -312,21 +878,29 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     }
     else
     {
-      vtkWarningMacro("ComputeGammaDoseDifference: Loading gamma color table failed, stock color table is used!");
+      vtkWarningMacro("SetupGammaVolumeDisplay: Loading gamma color table failed, stock color table is used!");
       gammaScalarVolumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeRainbow");
     }
   }
   else
   {
-    vtkWarningMacro("ComputeGammaDoseDifference: Display node is not available for gamma volume node. The default color table will be used.");
+    vtkWarningMacro("SetupGammaVolumeDisplay: Display node is not available for gamma volume node. The default color table will be used.");
   }
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::SetupGammaVolumeNode(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
+  gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
+
+  this->SetupGammaVolumeDisplay(parameterNode, gammaVolumeNode);
 
   // Get common ancestor of the two input dose volumes in subject hierarchy
   vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
   if (!shNode)
   {
     std::string errorMessage("");
-    vtkErrorMacro("ComputeGammaDoseDifference: Failed to access subject hierarchy node" << errorMessage);
+    vtkErrorMacro("SetupGammaVolumeNode: Failed to access subject hierarchy node" << errorMessage);
     return errorMessage;
   }
   vtkIdType commonAncestorItemID = vtkSlicerSubjectHierarchyModuleLogic::AreNodesInSameBranch(
@@ -337,8 +911,16 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     commonAncestorItemID = shNode->GetSceneItemID();
   }
 
-  // Setup gamma volume subject hierarchy item
-  shNode->CreateItem(commonAncestorItemID, gammaVolumeNode);
+  // Setup gamma volume subject hierarchy item (it already exists if the computation is repeated)
+  vtkIdType gammaVolumeShItemID = shNode->GetItemByDataNode(gammaVolumeNode);
+  if (gammaVolumeShItemID == vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    shNode->CreateItem(commonAncestorItemID, gammaVolumeNode);
+  }
+  else
+  {
+    shNode->SetItemParent(gammaVolumeShItemID, commonAncestorItemID);
+  }
 
   // Add connection attribute to input dose volume nodes
   gammaVolumeNode->AddNodeReferenceID( vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_REFERENCE_DOSE_VOLUME_REFERENCE_ROLE.c_str(), 
@@ -356,12 +938,253 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     }
   }
 
-  parameterNode->ResultsValidOn();
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifferenceNative(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+
+  // Set up reference dose, masks and parameters
+  vtkSmartPointer<vtkGammaDoseComparisonFilter> gammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+  std::vector<std::string> regionSegmentIDs;
+  std::string errorMessage = this->SetupGammaFilterReference(parameterNode, gammaFilter, regionSegmentIDs);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  // Get compare dose in world coordinate frame
+  vtkSmartPointer<vtkOrientedImageData> compareDoseImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetCompareDoseVolumeNode(), compareDoseImage))
+  {
+    errorMessage = "Failed to get compare dose image";
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+  gammaFilter->SetCompareDoseImage(compareDoseImage);
+  gammaFilter->SetGenerateGammaImage(gammaVolumeNode != NULL);
+  // Multi-resolution evaluation only computes pass rates, so it is only used if no gamma volume is requested
+  gammaFilter->SetMultiResolution(gammaVolumeNode == NULL && parameterNode->GetMultiResolution());
+
+  // Compute gamma
+  double checkpointGammaStart = timer->GetUniversalTime();
+  GammaProgressChannel progressChannel;
+  progressChannel.Logic = this;
+  progressChannel.ForwardProgress = true;
+  progressChannel.CancelRequestCount = this->GammaCancelRequestCount;
+  vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  progressCallback->SetCallback(GammaFilterProgressCallback);
+  progressCallback->SetClientData(&progressChannel);
+  gammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+
+  if (!gammaFilter->Update())
+  {
+    if (gammaFilter->GetAbortExecute())
+    {
+      return "Gamma computation cancelled";
+    }
+    errorMessage = "Gamma computation failed";
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+
+  this->SetGammaFilterResults(parameterNode, gammaFilter, regionSegmentIDs, gammaVolumeNode);
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    std::cout << "Native gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
+              << "\tGetting input images: " << checkpointGammaStart-checkpointStart << " s" << std::endl
+              << "\tGamma computation: " << checkpointEnd-checkpointGammaStart << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::SetupGammaFilterReference(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkGammaDoseComparisonFilter* gammaFilter, std::vector<std::string>& regionSegmentIDs)
+{
+  regionSegmentIDs.clear();
+  if (!parameterNode || !gammaFilter)
+  {
+    std::string errorMessage("Invalid parameter set node or gamma filter");
+    vtkErrorMacro("SetupGammaFilterReference: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Get reference dose in world coordinate frame. The reference lattice defines the output lattice
+  vtkSmartPointer<vtkOrientedImageData> referenceDoseImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetReferenceDoseVolumeNode(), referenceDoseImage))
+  {
+    std::string errorMessage("Failed to get reference dose image");
+    vtkErrorMacro("SetupGammaFilterReference: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
+  vtkSmartPointer<vtkOrientedImageData> maskLabelmap;
+  if (maskSegmentationNode && parameterNode->GetMaskSegmentID())
+  {
+    maskLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    std::string errorMessage = this->GetSegmentLabelmap(maskSegmentationNode, parameterNode->GetMaskSegmentID(), maskLabelmap);
+    if (!errorMessage.empty())
+    {
+      return errorMessage;
+    }
+  }
+
+  // Pass rates are computed in the same run for each segment of the mask segmentation
+  gammaFilter->RemoveAllStatisticsRegionMasks();
+  if (maskSegmentationNode)
+  {
+    maskSegmentationNode->GetSegmentation()->GetSegmentIDs(regionSegmentIDs);
+    for (std::vector<std::string>::iterator segmentIdIt=regionSegmentIDs.begin(); segmentIdIt!=regionSegmentIDs.end(); ++segmentIdIt)
+    {
+      vtkSmartPointer<vtkOrientedImageData> regionLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      std::string errorMessage = this->GetSegmentLabelmap(maskSegmentationNode, segmentIdIt->c_str(), regionLabelmap);
+      if (!errorMessage.empty())
+      {
+        regionSegmentIDs.clear();
+        return errorMessage;
+      }
+      gammaFilter->AddStatisticsRegionMask(regionLabelmap);
+    }
+  }
+
+  gammaFilter->SetReferenceDoseImage(referenceDoseImage);
+  gammaFilter->SetMaskImage(maskLabelmap);
+  this->SetGammaFilterParameters(parameterNode, gammaFilter);
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseComparisonModuleLogic::SetGammaFilterParameters(vtkMRMLDoseComparisonNode* parameterNode, vtkGammaDoseComparisonFilter* gammaFilter)
+{
+  gammaFilter->SetDtaDistanceToleranceMm(parameterNode->GetDtaDistanceToleranceMm());
+  gammaFilter->SetDoseDifferenceTolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+  gammaFilter->SetUseLinearInterpolation(parameterNode->GetUseLinearInterpolation());
+  gammaFilter->SetLocalDoseDifference(parameterNode->GetLocalDoseDifference());
+  gammaFilter->SetReferenceDoseGy(parameterNode->GetUseMaximumDose() ? 0.0 : parameterNode->GetReferenceDoseGy());
+  gammaFilter->SetAnalysisThreshold(parameterNode->GetAnalysisThresholdPercent() / 100.0);
+  gammaFilter->SetMaximumGamma(parameterNode->GetMaximumGamma());
+  gammaFilter->SetDoseThresholdOnReferenceOnly(parameterNode->GetDoseThresholdOnReferenceOnly());
+  gammaFilter->SetInterpolationFactor(parameterNode->GetInterpolationFactor());
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseComparisonModuleLogic::SetGammaFilterResults(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkGammaDoseComparisonFilter* gammaFilter, const std::vector<std::string>& regionSegmentIDs, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
+  parameterNode->SetPassFractionPercent(gammaFilter->GetPassFraction() * 100.0);
+  parameterNode->SetMeanGamma(gammaFilter->GetMeanGamma());
+  for (int region=0; region<(int)regionSegmentIDs.size(); ++region)
+  {
+    parameterNode->SetSegmentPassFractionPercent(regionSegmentIDs[region].c_str(), gammaFilter->GetPassFractionInRegion(region) * 100.0);
+  }
+  std::vector<vtkIdType> gammaHistogram;
+  gammaFilter->GetGammaHistogram(gammaHistogram);
+  parameterNode->SetGammaHistogram(gammaHistogram);
+  parameterNode->SetReportString(gammaFilter->GetReportString().c_str());
+
+  // Set gamma image on the output volume node with the reference geometry
+  if (gammaVolumeNode && gammaFilter->GetOutput())
+  {
+    vtkSmartPointer<vtkMatrix4x4> referenceImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    gammaFilter->GetReferenceDoseImage()->GetImageToWorldMatrix(referenceImageToWorldMatrix);
+    gammaVolumeNode->SetIJKToRASMatrix(referenceImageToWorldMatrix);
+    gammaVolumeNode->SetAndObserveImageData(gammaFilter->GetOutput());
+  }
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifferencePlastimatch(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+
+  if (parameterNode->GetInterpolationFactor() > 1)
+  {
+    vtkWarningMacro("ComputeGammaDoseDifferencePlastimatch: Sub-voxel interpolation is only supported by the native gamma engine, it is ignored");
+  }
+
+  double checkpointConvertStart = timer->GetUniversalTime();
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
+  // The inputs are only read by the gamma computation, so the voxels of the volume nodes are used without copying
+  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode, true, true);
+  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode(), true, true);
+
+  Plm_image::Pointer maskVolume;
+  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
+  const char* maskSegmentID = parameterNode->GetMaskSegmentID();
+  if (maskSegmentationNode && maskSegmentID)
+  {
+    vtkSmartPointer<vtkOrientedImageData> maskSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    std::string errorMessage = this->GetSegmentLabelmap(maskSegmentationNode, maskSegmentID, maskSegmentLabelmap);
+    if (!errorMessage.empty())
+    {
+      return errorMessage;
+    }
+
+    // Convert mask to Plm image
+    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap, true);
+    if (!maskVolume)
+    {
+      std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
+      vtkErrorMacro("ComputeGammaDoseDifferencePlastimatch: " << errorMessage);
+      return errorMessage;
+    }
+  }
+
+  // Compute gamma dose volume
+  double checkpointGammaStart = timer->GetUniversalTime();
+  Gamma_dose_comparison gamma;
+  gamma.set_reference_image(referenceDose->itk_float());
+  gamma.set_compare_image(compareDose->itk_float());
+  if (maskSegmentationNode && maskSegmentID)
+  {
+    gamma.set_mask_image(maskVolume->itk_uchar());
+  }
+  gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
+  gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+  gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
+  gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
+  if (!parameterNode->GetUseMaximumDose())
+  {
+    gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
+  }
+  gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
+  gamma.set_gamma_max(parameterNode->GetMaximumGamma());
+  gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
+  GammaProgressChannel progressChannel;
+  progressChannel.Logic = this;
+  progressChannel.ForwardProgress = true;
+  PlastimatchGammaMutex.Lock();
+  PlastimatchGammaProgressChannel = &progressChannel;
+  gamma.set_progress_callback(&PlastimatchGammaProgressCallback);
+
+  gamma.run();
+
+  PlastimatchGammaProgressChannel = NULL;
+  PlastimatchGammaMutex.Unlock();
+
+  itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
+  parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
+  parameterNode->SetMeanGamma(-1.0); // Not provided by Plastimatch
+  parameterNode->SetReportString(gamma.get_report_string().c_str());
+
+  // Convert output to VTK. The gamma image is not used afterwards, so its buffer is handed over to the volume node
+  double checkpointVtkConvertStart = timer->GetUniversalTime();
+  PlmCommon::TransferItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
 
   if (this->LogSpeedMeasurements)
   {
     double checkpointEnd = timer->GetUniversalTime();
-    std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
+    std::cout << "Plastimatch gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
               << "\tApplying transforms: " << checkpointConvertStart-checkpointStart << " s" << std::endl
               << "\tConverting from VTK to ITK: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
               << "\tGamma computation: " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
@@ -371,6 +1194,55 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   return "";
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::GetSegmentLabelmap(
+  vtkMRMLSegmentationNode* maskSegmentationNode, const char* maskSegmentID, vtkOrientedImageData* maskLabelmap)
+{
+  if (!maskSegmentationNode || !maskSegmentID || !maskLabelmap)
+  {
+    std::string errorMessage("Invalid mask segmentation or segment ID");
+    vtkErrorMacro("GetSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Extract a labelmap for the dose comparison to use it as a mask
+  vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
+  vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
+  if (!maskSegment)
+  {
+    std::string errorMessage("Failed to get mask segment");
+    vtkErrorMacro("GetSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
+  vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
+  segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
+  segmentationCopy->CopyConversionParameters(maskSegmentation);
+  segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
+  if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+  {
+    std::string errorMessage("Failed to create binary labelmap representation for mask segment");
+    vtkErrorMacro("GetSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+  // Get segment binary labelmap
+  vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+
+  // Apply parent transformation nodes if necessary
+  if ( maskSegmentationNode->GetParentTransformNode()
+    && (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(maskSegmentationNode, maskSegmentLabelmap)) )
+  {
+    std::string errorMessage("Failed to apply parent transform on mask segment");
+    vtkErrorMacro("GetSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  maskLabelmap->ShallowCopy(maskSegmentLabelmap);
+  return "";
+}
+
 //---------------------------------------------------------------------------
 void vtkSlicerDoseComparisonModuleLogic::CreateDefaultGammaColorTable()
 {
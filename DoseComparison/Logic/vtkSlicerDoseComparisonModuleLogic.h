@@ -30,9 +30,19 @@
 // Slicer includes
 #include "vtkSlicerModuleLogic.h"
 
+// STD includes
+#include <string>
+#include <vector>
+
 #include "vtkSlicerDoseComparisonModuleLogicExport.h"
 
+class vtkCollection;
+class vtkGammaDoseComparisonFilter;
+class vtkMatrix4x4;
 class vtkMRMLDoseComparisonNode;
+class vtkMRMLScalarVolumeNode;
+class vtkMRMLSegmentationNode;
+class vtkOrientedImageData;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkSlicerDoseComparisonModuleLogic :
@@ -51,10 +61,37 @@ public:
   vtkTypeMacro(vtkSlicerDoseComparisonModuleLogic,vtkSlicerModuleLogic);
 
 public:
-  /// Compute gamma metric according to the selected input volumes and parameters (DoseComparison parameter set node content)
+  /// Compute gamma metric according to the selected input volumes and parameters (DoseComparison parameter set node content).
+  /// If statistics only mode is selected in the parameter node, then only the pass fractions and mean gamma are computed
+  /// (also per segment of the mask segmentation), and the gamma volume node is not needed
   /// \return Error message, empty string if no error
   std::string ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode);
 
+  /// Compute gamma metric for multiple compare doses against the same reference dose. Each parameter set node
+  /// specifies one compare dose and receives its results. The nodes must share the reference dose, the mask and the
+  /// gamma parameters. The reference dose, the masks and the normalization are prepared once, and the compare doses
+  /// are evaluated concurrently as long as the estimated memory need is within \sa BatchMemoryLimitMb.
+  /// Always uses the native gamma engine.
+  /// \param parameterNodes Collection of DoseComparison parameter set nodes
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaDoseDifferenceBatch(vtkCollection* parameterNodes);
+
+  /// Compute gamma only in a slice plane, for interactive preview of the gamma criteria. The slice is sampled with
+  /// the finest spacing of the reference dose within the reference dose bounds. The converted inputs are kept,
+  /// so repeated calls only resample the slice neighborhood. Starting a preview cancels the running computations.
+  /// \param sliceToRasMatrix Slice plane (e.g. SliceToRAS matrix of a slice node): axes in the columns and center in the fourth column
+  /// \param inPlaneSearch Search the compare dose only within the slice plane (2D gamma) if true, in 3D otherwise
+  /// \param outputSliceVolumeNode Single slice volume node receiving the gamma map, to be shown e.g. as foreground in slice views
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaSlicePreview(vtkMRMLDoseComparisonNode* parameterNode, vtkMatrix4x4* sliceToRasMatrix,
+    bool inPlaneSearch, vtkMRMLScalarVolumeNode* outputSliceVolumeNode);
+
+  /// Request cancelling the running gamma computations (they return a cancelled error message).
+  /// Can be called from progress event observers
+  void CancelGammaComputation();
+  /// Get number of cancel requests. Computations started with a different count are aborted
+  vtkGetMacro(GammaCancelRequestCount, unsigned long);
+
   /// Function called when gamma progress is updated by algorithm
   void GammaProgressUpdated(float progress);
 
@@ -66,6 +103,40 @@ protected:
   /// Loads default gamma color table from the supplied color table file
   void LoadDefaultGammaColorTable();
 
+  /// Compute gamma into the given volume node using the native multi-threaded engine (\sa vtkGammaDoseComparisonFilter)
+  /// \param gammaVolumeNode Output volume node. Only the statistics are computed if NULL
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaDoseDifferenceNative(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
+  /// Compute gamma into the given volume node using Plastimatch
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaDoseDifferencePlastimatch(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
+  /// Set reference dose, masks and parameters of the parameter node to a native gamma filter
+  /// \param regionSegmentIDs Output IDs of the segments added as statistics regions to the filter, in order
+  /// \return Error message, empty string if no error
+  std::string SetupGammaFilterReference(vtkMRMLDoseComparisonNode* parameterNode, vtkGammaDoseComparisonFilter* gammaFilter,
+    std::vector<std::string>& regionSegmentIDs);
+
+  /// Store results of an updated native gamma filter in the parameter node, and the gamma image in the volume node (if given)
+  void SetGammaFilterResults(vtkMRMLDoseComparisonNode* parameterNode, vtkGammaDoseComparisonFilter* gammaFilter,
+    const std::vector<std::string>& regionSegmentIDs, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
+  /// Set gamma parameters of the parameter node to a native gamma filter
+  void SetGammaFilterParameters(vtkMRMLDoseComparisonNode* parameterNode, vtkGammaDoseComparisonFilter* gammaFilter);
+
+  /// Set up display (gamma color table and window/level) of a gamma volume node
+  void SetupGammaVolumeDisplay(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
+  /// Set up display, subject hierarchy and references of a computed gamma volume node
+  /// \return Error message, empty string if no error
+  std::string SetupGammaVolumeNode(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
+  /// Get binary labelmap of a segment, in world coordinate frame
+  /// \param maskLabelmap Output labelmap
+  /// \return Error message, empty string if no error
+  std::string GetSegmentLabelmap(vtkMRMLSegmentationNode* maskSegmentationNode, const char* maskSegmentID, vtkOrientedImageData* maskLabelmap);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
@@ -77,6 +148,9 @@ public:
   vtkGetMacro(Progress, double);
   vtkSetMacro(Progress, double);
 
+  vtkGetMacro(BatchMemoryLimitMb, double);
+  vtkSetMacro(BatchMemoryLimitMb, double);
+
 protected:
   vtkSlicerDoseComparisonModuleLogic();
   virtual ~vtkSlicerDoseComparisonModuleLogic();
@@ -105,6 +179,17 @@ protected:
   /// Progress value (between 0 and 1).
   /// Note: Needed for python support
   double Progress;
+
+  /// Memory (in megabytes) that concurrently evaluated compare doses may use in batch gamma computation.
+  /// Compare doses are evaluated one by one if a single one exceeds it
+  double BatchMemoryLimitMb;
+
+  /// Number of cancel requests (\sa CancelGammaComputation)
+  unsigned long GammaCancelRequestCount;
+
+private:
+  class vtkInternal;
+  vtkInternal* Internal;
 };
 
 #endif
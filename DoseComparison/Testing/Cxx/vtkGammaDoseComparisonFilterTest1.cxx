@@ -0,0 +1,141 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DoseComparison includes
+#include "vtkGammaDoseComparisonFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+namespace
+{
+  const int IMAGE_SIZE = 20;
+
+  //-----------------------------------------------------------------------------
+  /// Create a cubic image with unit spacing, with one value for the voxels with I below the half of the image
+  /// and another value for the rest
+  vtkSmartPointer<vtkOrientedImageData> CreateHalfImage(int scalarType, double lowHalfValue, double highHalfValue)
+  {
+    vtkSmartPointer<vtkOrientedImageData> image = vtkSmartPointer<vtkOrientedImageData>::New();
+    image->SetExtent(0, IMAGE_SIZE-1, 0, IMAGE_SIZE-1, 0, IMAGE_SIZE-1);
+    image->AllocateScalars(scalarType, 1);
+    for (int k=0; k<IMAGE_SIZE; ++k)
+    {
+      for (int j=0; j<IMAGE_SIZE; ++j)
+      {
+        for (int i=0; i<IMAGE_SIZE; ++i)
+        {
+          image->SetScalarComponentFromDouble(i, j, k, 0, (i < IMAGE_SIZE/2 ? lowHalfValue : highHalfValue));
+        }
+      }
+    }
+    return image;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkGammaDoseComparisonFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  std::ostream& errorStream = std::cerr;
+
+  // Compare dose differs by 10% in the low half, so gamma exceeds one there except near the other half
+  vtkSmartPointer<vtkOrientedImageData> referenceDose = CreateHalfImage(VTK_FLOAT, 1.0, 1.0);
+  vtkSmartPointer<vtkOrientedImageData> compareDose = CreateHalfImage(VTK_FLOAT, 1.1, 1.0);
+  // Mask covers the high half, the statistics region covers the low half
+  vtkSmartPointer<vtkOrientedImageData> mask = CreateHalfImage(VTK_UNSIGNED_CHAR, 0.0, 1.0);
+  vtkSmartPointer<vtkOrientedImageData> region = CreateHalfImage(VTK_UNSIGNED_CHAR, 1.0, 0.0);
+  const vtkIdType numberOfVoxelsInHalf = IMAGE_SIZE * IMAGE_SIZE * IMAGE_SIZE / 2;
+
+  vtkSmartPointer<vtkGammaDoseComparisonFilter> gammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+  gammaFilter->SetReferenceDoseImage(referenceDose);
+  gammaFilter->SetCompareDoseImage(compareDose);
+  gammaFilter->AddStatisticsRegionMask(region);
+  if (!gammaFilter->Update())
+  {
+    errorStream << "ERROR: Gamma computation without mask failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkIdType regionAnalyzedVoxelsWithoutMask = gammaFilter->GetNumberOfAnalyzedVoxelsInRegion(0);
+  vtkIdType regionPassedVoxelsWithoutMask = gammaFilter->GetNumberOfPassedVoxelsInRegion(0);
+  if (regionAnalyzedVoxelsWithoutMask != numberOfVoxelsInHalf)
+  {
+    errorStream << "ERROR: Number of analyzed voxels in the region (" << regionAnalyzedVoxelsWithoutMask
+      << ") differs from the number of region voxels (" << numberOfVoxelsInHalf << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Region statistics are computed over the region itself, even if it is outside the mask
+  gammaFilter->SetMaskImage(mask);
+  if (!gammaFilter->Update())
+  {
+    errorStream << "ERROR: Gamma computation with mask failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (gammaFilter->GetNumberOfAnalyzedVoxels() != numberOfVoxelsInHalf)
+  {
+    errorStream << "ERROR: Number of analyzed voxels (" << gammaFilter->GetNumberOfAnalyzedVoxels()
+      << ") differs from the number of mask voxels (" << numberOfVoxelsInHalf << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( gammaFilter->GetNumberOfAnalyzedVoxelsInRegion(0) != regionAnalyzedVoxelsWithoutMask
+    || gammaFilter->GetNumberOfPassedVoxelsInRegion(0) != regionPassedVoxelsWithoutMask )
+  {
+    errorStream << "ERROR: Region statistics depend on the mask: " << gammaFilter->GetNumberOfPassedVoxelsInRegion(0)
+      << " of " << gammaFilter->GetNumberOfAnalyzedVoxelsInRegion(0) << " voxels passed with mask, "
+      << regionPassedVoxelsWithoutMask << " of " << regionAnalyzedVoxelsWithoutMask << " without" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Voxels outside the mask are not in the gamma image, and the histogram covers the analyzed voxels
+  vtkImageData* gammaImage = gammaFilter->GetOutput();
+  if (!gammaImage)
+  {
+    errorStream << "ERROR: No gamma image" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int i=0; i<IMAGE_SIZE/2; ++i)
+  {
+    if (gammaImage->GetScalarComponentAsDouble(i, IMAGE_SIZE/2, IMAGE_SIZE/2, 0) != 0.0)
+    {
+      errorStream << "ERROR: Non-zero gamma outside the mask at I=" << i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::vector<vtkIdType> gammaHistogram;
+  gammaFilter->GetGammaHistogram(gammaHistogram);
+  vtkIdType numberOfVoxelsInHistogram = 0;
+  for (std::vector<vtkIdType>::iterator binIt=gammaHistogram.begin(); binIt!=gammaHistogram.end(); ++binIt)
+  {
+    numberOfVoxelsInHistogram += (*binIt);
+  }
+  if ( (int)gammaHistogram.size() != gammaFilter->GetNumberOfGammaHistogramBins()
+    || numberOfVoxelsInHistogram != gammaFilter->GetNumberOfAnalyzedVoxels() )
+  {
+    errorStream << "ERROR: Gamma histogram (" << gammaHistogram.size() << " bins, " << numberOfVoxelsInHistogram
+      << " voxels) does not match the analyzed voxels (" << gammaFilter->GetNumberOfAnalyzedVoxels() << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
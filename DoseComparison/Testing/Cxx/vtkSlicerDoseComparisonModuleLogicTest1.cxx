@@ -25,6 +25,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "PlmCommon.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -36,6 +37,7 @@
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkPointData.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -147,6 +149,9 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
   // Disable symmetric dose threshold (it is the new default)
   paramNode->SetDoseThresholdOnReferenceOnly(true);
 
+  // The baseline has been computed by Plastimatch
+  paramNode->UseNativeGammaEngineOff();
+
   // Create and set up logic
   vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic> doseComparisonLogic = vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic>::New();
   doseComparisonLogic->SetMRMLScene(mrmlScene);
@@ -182,5 +187,214 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Compute gamma with the native engine with the same parameters and compare it to the Plastimatch output
+  double plastimatchPassFractionPercent = paramNode->GetPassFractionPercent();
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> nativeGammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  nativeGammaVolumeNode->SetName("OutputDoseNative");
+  mrmlScene->AddNode(nativeGammaVolumeNode);
+  paramNode->SetAndObserveGammaVolumeNode(nativeGammaVolumeNode);
+  paramNode->UseNativeGammaEngineOn();
+
+  std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty() || !paramNode->GetResultsValid())
+  {
+    errorStream << "ERROR: Native gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkImageData* nativeGammaImage = nativeGammaVolumeNode->GetImageData();
+  vtkImageData* plastimatchGammaImage = outputGammaVolumeNode->GetImageData();
+  int nativeDimensions[3] = {0, 0, 0};
+  int plastimatchDimensions[3] = {0, 0, 0};
+  nativeGammaImage->GetDimensions(nativeDimensions);
+  plastimatchGammaImage->GetDimensions(plastimatchDimensions);
+  if ( nativeDimensions[0] != plastimatchDimensions[0] || nativeDimensions[1] != plastimatchDimensions[1]
+    || nativeDimensions[2] != plastimatchDimensions[2] )
+  {
+    errorStream << "ERROR: Native gamma volume dimensions (" << nativeDimensions[0] << ", " << nativeDimensions[1] << ", " << nativeDimensions[2]
+      << ") differ from Plastimatch gamma volume dimensions (" << plastimatchDimensions[0] << ", " << plastimatchDimensions[1] << ", "
+      << plastimatchDimensions[2] << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Small differences are allowed due to the different resampling of the compare dose and float precision
+  const double passFractionTolerancePercent = 0.5;
+  const double meanGammaDifferenceTolerance = 0.01;
+  double passFractionDifferencePercent = fabs(paramNode->GetPassFractionPercent() - plastimatchPassFractionPercent);
+  if (passFractionDifferencePercent > passFractionTolerancePercent)
+  {
+    errorStream << "ERROR: Native gamma pass fraction (" << paramNode->GetPassFractionPercent()
+      << "%) differs from Plastimatch pass fraction (" << plastimatchPassFractionPercent << "%)" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkDataArray* nativeGammaScalars = nativeGammaImage->GetPointData()->GetScalars();
+  vtkDataArray* plastimatchGammaScalars = plastimatchGammaImage->GetPointData()->GetScalars();
+  double sumGammaDifference = 0.0;
+  vtkIdType numberOfVoxels = nativeGammaScalars->GetNumberOfTuples();
+  for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+  {
+    sumGammaDifference += fabs(nativeGammaScalars->GetTuple1(voxelIndex) - plastimatchGammaScalars->GetTuple1(voxelIndex));
+  }
+  double meanGammaDifference = (numberOfVoxels > 0 ? sumGammaDifference / numberOfVoxels : 0.0);
+  if (meanGammaDifference > meanGammaDifferenceTolerance)
+  {
+    errorStream << "ERROR: Mean difference between native and Plastimatch gamma (" << meanGammaDifference
+      << ") exceeds tolerance (" << meanGammaDifferenceTolerance << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Statistics computed without gamma volume must be identical to those of the full computation
+  double nativePassFractionPercent = paramNode->GetPassFractionPercent();
+  double nativeMeanGamma = paramNode->GetMeanGamma();
+  paramNode->StatisticsOnlyOn();
+  errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty() || !paramNode->GetResultsValid())
+  {
+    errorStream << "ERROR: Gamma statistics computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( paramNode->GetPassFractionPercent() != nativePassFractionPercent
+    || paramNode->GetMeanGamma() != nativeMeanGamma )
+  {
+    errorStream << "ERROR: Statistics only gamma results (pass fraction " << paramNode->GetPassFractionPercent()
+      << "%, mean gamma " << paramNode->GetMeanGamma() << ") differ from full computation (pass fraction "
+      << nativePassFractionPercent << "%, mean gamma " << nativeMeanGamma << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Multi-resolution evaluation only searches the voxels not classified by the bounds, but the pass fraction is identical
+  paramNode->MultiResolutionOn();
+  errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty() || !paramNode->GetResultsValid())
+  {
+    errorStream << "ERROR: Multi-resolution gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (paramNode->GetPassFractionPercent() != nativePassFractionPercent)
+  {
+    errorStream << "ERROR: Multi-resolution gamma pass fraction (" << paramNode->GetPassFractionPercent()
+      << "%) differs from full computation (" << nativePassFractionPercent << "%)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  paramNode->MultiResolutionOff();
+  paramNode->StatisticsOnlyOff();
+
+  // Batch computation sharing the reference must give the same results as the individual computations.
+  // The second compare dose is the reference itself, so all voxels pass
+  vtkSmartPointer<vtkMRMLDoseComparisonNode> identityParamNode = vtkSmartPointer<vtkMRMLDoseComparisonNode>::New();
+  mrmlScene->AddNode(identityParamNode);
+  identityParamNode->Copy(paramNode);
+  identityParamNode->SetAndObserveReferenceDoseVolumeNode(day1DoseScalarVolumeNode);
+  identityParamNode->SetAndObserveCompareDoseVolumeNode(day1DoseScalarVolumeNode);
+  identityParamNode->StatisticsOnlyOn();
+  vtkSmartPointer<vtkCollection> batchParamNodes = vtkSmartPointer<vtkCollection>::New();
+  batchParamNodes->AddItem(paramNode);
+  batchParamNodes->AddItem(identityParamNode);
+  errorMessage = doseComparisonLogic->ComputeGammaDoseDifferenceBatch(batchParamNodes);
+  if (!errorMessage.empty() || !paramNode->GetResultsValid() || !identityParamNode->GetResultsValid())
+  {
+    errorStream << "ERROR: Batch gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( paramNode->GetPassFractionPercent() != nativePassFractionPercent
+    || paramNode->GetMeanGamma() != nativeMeanGamma )
+  {
+    errorStream << "ERROR: Batch gamma results (pass fraction " << paramNode->GetPassFractionPercent()
+      << "%, mean gamma " << paramNode->GetMeanGamma() << ") differ from individual computation (pass fraction "
+      << nativePassFractionPercent << "%, mean gamma " << nativeMeanGamma << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (identityParamNode->GetPassFractionPercent() != 100.0 || identityParamNode->GetMeanGamma() != 0.0)
+  {
+    errorStream << "ERROR: Batch gamma of the reference against itself (pass fraction " << identityParamNode->GetPassFractionPercent()
+      << "%, mean gamma " << identityParamNode->GetMeanGamma() << ") is not perfect" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Slice preview through the center of the reference dose compared to itself is a single slice of zero gamma
+  double referenceBounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  day1DoseScalarVolumeNode->GetRASBounds(referenceBounds);
+  vtkNew<vtkMatrix4x4> sliceToRasMatrix;
+  for (int axis=0; axis<3; ++axis)
+  {
+    sliceToRasMatrix->SetElement(axis, 3, (referenceBounds[2*axis] + referenceBounds[2*axis+1]) / 2.0);
+  }
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> slicePreviewVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  mrmlScene->AddNode(slicePreviewVolumeNode);
+  unsigned long cancelRequestCount = doseComparisonLogic->GetGammaCancelRequestCount();
+  errorMessage = doseComparisonLogic->ComputeGammaSlicePreview(identityParamNode, sliceToRasMatrix.GetPointer(), false, slicePreviewVolumeNode);
+  if (!errorMessage.empty() || !slicePreviewVolumeNode->GetImageData())
+  {
+    errorStream << "ERROR: Slice gamma preview failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (doseComparisonLogic->GetGammaCancelRequestCount() != cancelRequestCount + 1)
+  {
+    errorStream << "ERROR: Slice gamma preview did not cancel the running computations" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int slicePreviewDimensions[3] = {0, 0, 0};
+  slicePreviewVolumeNode->GetImageData()->GetDimensions(slicePreviewDimensions);
+  if (slicePreviewDimensions[2] != 1 || slicePreviewVolumeNode->GetImageData()->GetScalarRange()[1] != 0.0)
+  {
+    errorStream << "ERROR: Slice gamma preview of the reference against itself is not a single slice of zero gamma (dimensions "
+      << slicePreviewDimensions[0] << "x" << slicePreviewDimensions[1] << "x" << slicePreviewDimensions[2]
+      << ", maximum gamma " << slicePreviewVolumeNode->GetImageData()->GetScalarRange()[1] << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Sub-voxel search only adds candidate positions, so gamma cannot increase and the pass fraction cannot decrease
+  paramNode->SetInterpolationFactor(3);
+  errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty() || !paramNode->GetResultsValid())
+  {
+    errorStream << "ERROR: Gamma computation with sub-voxel search failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (paramNode->GetPassFractionPercent() < nativePassFractionPercent)
+  {
+    errorStream << "ERROR: Pass fraction with sub-voxel search (" << paramNode->GetPassFractionPercent()
+      << "%) is lower than without it (" << nativePassFractionPercent << "%)" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Interpolation factor is limited, as the sub-voxel search grows with its cube
+  paramNode->SetInterpolationFactor(1000);
+  if (paramNode->GetInterpolationFactor() != 10)
+  {
+    errorStream << "ERROR: Interpolation factor is not clamped to 10: " << paramNode->GetInterpolationFactor() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Conversion to Plm image copies the voxels of the volume node, unless sharing is requested by a read-only caller
+  vtkSmartPointer<vtkImageData> smallImage = vtkSmartPointer<vtkImageData>::New();
+  smallImage->SetDimensions(3, 3, 3);
+  smallImage->AllocateScalars(VTK_FLOAT, 1);
+  smallImage->GetPointData()->GetScalars()->FillComponent(0, 1.0);
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> smallVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  mrmlScene->AddNode(smallVolumeNode);
+  smallVolumeNode->SetAndObserveImageData(smallImage);
+  Plm_image::Pointer copiedPlmImage = PlmCommon::ConvertVolumeNodeToPlmImage(smallVolumeNode);
+  Plm_image::Pointer sharedPlmImage = PlmCommon::ConvertVolumeNodeToPlmImage(smallVolumeNode, true, true);
+  void* volumeVoxels = smallImage->GetScalarPointer();
+  if (copiedPlmImage->itk_float()->GetBufferPointer() == volumeVoxels)
+  {
+    errorStream << "ERROR: Plm image conversion uses the voxels of the volume node by default" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (sharedPlmImage->itk_float()->GetBufferPointer() != volumeVoxels)
+  {
+    errorStream << "ERROR: Plm image conversion with shared voxels copied the voxels of the volume node" << std::endl;
+    return EXIT_FAILURE;
+  }
+  copiedPlmImage->itk_float()->GetBufferPointer()[0] = 2.0f;
+  if (smallImage->GetScalarComponentAsDouble(0, 0, 0, 0) != 1.0)
+  {
+    errorStream << "ERROR: Modifying the copied Plm image changed the volume node" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,453 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DoseVolumeHistogram includes
+#include "vtkSlicerPlanQualityIndexLogic.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSegmentation.h"
+#include "vtkSegment.h"
+#include "vtkSegmentationConverter.h"
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+
+// VTK includes
+#include <vtkImageCast.h>
+#include <vtkImageConstantPad.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Voxel counts and target doses accumulated by one thread
+  struct PlanQualityAccumulator
+  {
+    PlanQualityAccumulator()
+      : PrescriptionIsodoseVoxels(0)
+      , HalfPrescriptionIsodoseVoxels(0)
+    {
+    }
+
+    void Reset(int numberOfTargets)
+    {
+      this->PrescriptionIsodoseVoxels = 0;
+      this->HalfPrescriptionIsodoseVoxels = 0;
+      this->TargetVoxels.assign(numberOfTargets, 0);
+      this->TargetInPrescriptionIsodoseVoxels.assign(numberOfTargets, 0);
+      this->TargetDoses.assign(numberOfTargets, std::vector<double>());
+    }
+
+    void Add(PlanQualityAccumulator& other)
+    {
+      this->PrescriptionIsodoseVoxels += other.PrescriptionIsodoseVoxels;
+      this->HalfPrescriptionIsodoseVoxels += other.HalfPrescriptionIsodoseVoxels;
+      for (size_t targetIndex=0; targetIndex<this->TargetVoxels.size(); ++targetIndex)
+      {
+        this->TargetVoxels[targetIndex] += other.TargetVoxels[targetIndex];
+        this->TargetInPrescriptionIsodoseVoxels[targetIndex] += other.TargetInPrescriptionIsodoseVoxels[targetIndex];
+        this->TargetDoses[targetIndex].insert(this->TargetDoses[targetIndex].end(),
+          other.TargetDoses[targetIndex].begin(), other.TargetDoses[targetIndex].end());
+      }
+    }
+
+    vtkIdType PrescriptionIsodoseVoxels;
+    vtkIdType HalfPrescriptionIsodoseVoxels;
+    std::vector<vtkIdType> TargetVoxels;
+    std::vector<vtkIdType> TargetInPrescriptionIsodoseVoxels;
+    std::vector< std::vector<double> > TargetDoses;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Visit the dose voxels slice by slice, and accumulate the isodose volumes and the target statistics
+  template <class T>
+  class PlanQualityFunctor
+  {
+  public:
+    PlanQualityFunctor(const T* dose, vtkIdType sliceSize, const std::vector<unsigned char*>& targetMasks, double prescriptionDose)
+      : Dose(dose)
+      , SliceSize(sliceSize)
+      , TargetMasks(targetMasks)
+      , PrescriptionDose(prescriptionDose)
+    {
+      this->Total.Reset((int)targetMasks.size());
+    }
+
+    void Initialize()
+    {
+      this->Accumulator.Local().Reset((int)this->TargetMasks.size());
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      PlanQualityAccumulator& accumulator = this->Accumulator.Local();
+      double halfPrescriptionDose = 0.5 * this->PrescriptionDose;
+      int numberOfTargets = (int)this->TargetMasks.size();
+      for (vtkIdType voxelIndex=beginSlice*this->SliceSize; voxelIndex<endSlice*this->SliceSize; ++voxelIndex)
+      {
+        double dose = (double)this->Dose[voxelIndex];
+        bool inPrescriptionIsodose = (dose >= this->PrescriptionDose);
+        if (inPrescriptionIsodose)
+        {
+          ++accumulator.PrescriptionIsodoseVoxels;
+        }
+        if (dose >= halfPrescriptionDose)
+        {
+          ++accumulator.HalfPrescriptionIsodoseVoxels;
+        }
+        for (int targetIndex=0; targetIndex<numberOfTargets; ++targetIndex)
+        {
+          if (!this->TargetMasks[targetIndex][voxelIndex])
+          {
+            continue;
+          }
+          ++accumulator.TargetVoxels[targetIndex];
+          if (inPrescriptionIsodose)
+          {
+            ++accumulator.TargetInPrescriptionIsodoseVoxels[targetIndex];
+          }
+          accumulator.TargetDoses[targetIndex].push_back(dose);
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      for (vtkSMPThreadLocal<PlanQualityAccumulator>::iterator accumulatorIt=this->Accumulator.begin(); accumulatorIt!=this->Accumulator.end(); ++accumulatorIt)
+      {
+        this->Total.Add(*accumulatorIt);
+      }
+    }
+
+    PlanQualityAccumulator& GetTotal() { return this->Total; }
+
+  private:
+    const T* Dose;
+    vtkIdType SliceSize;
+    const std::vector<unsigned char*>& TargetMasks;
+    double PrescriptionDose;
+    vtkSMPThreadLocal<PlanQualityAccumulator> Accumulator;
+    PlanQualityAccumulator Total;
+  };
+
+  //----------------------------------------------------------------------------
+  template <class T>
+  void AccumulatePlanQuality(const T* dose, const int dimensions[3], const std::vector<unsigned char*>& targetMasks,
+    double prescriptionDose, PlanQualityAccumulator& total)
+  {
+    vtkIdType sliceSize = (vtkIdType)dimensions[0] * dimensions[1];
+    PlanQualityFunctor<T> functor(dose, sliceSize, targetMasks, prescriptionDose);
+    vtkSMPTools::For(0, dimensions[2], functor);
+    total = functor.GetTotal();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get the minimum dose of the hottest given percentage of the voxels. The order of the doses is changed
+  double GetDoseOfHottestPercentage(std::vector<double>& doses, double percentage)
+  {
+    if (doses.empty())
+    {
+      return 0.0;
+    }
+    size_t index = (size_t)((1.0 - percentage / 100.0) * doses.size());
+    index = std::min(index, doses.size() - 1);
+    std::nth_element(doses.begin(), doses.begin() + index, doses.end());
+    return doses[index];
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerPlanQualityIndexLogic);
+
+//----------------------------------------------------------------------------
+vtkSlicerPlanQualityIndexLogic::vtkSlicerPlanQualityIndexLogic()
+{
+  this->PrescriptionDose = 0.0;
+  this->PrescriptionIsodoseVolumeCc = 0.0;
+  this->HalfPrescriptionIsodoseVolumeCc = 0.0;
+  this->GradientIndex = 0.0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerPlanQualityIndexLogic::~vtkSlicerPlanQualityIndexLogic()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPlanQualityIndexLogic::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "PrescriptionDose: " << this->PrescriptionDose << "\n";
+  os << indent << "NumberOfTargetSegmentIDs: " << this->TargetSegmentIDs.size() << "\n";
+  os << indent << "PrescriptionIsodoseVolumeCc: " << this->PrescriptionIsodoseVolumeCc << "\n";
+  os << indent << "HalfPrescriptionIsodoseVolumeCc: " << this->HalfPrescriptionIsodoseVolumeCc << "\n";
+  os << indent << "GradientIndex: " << this->GradientIndex << "\n";
+  for (std::vector<TargetIndices>::iterator targetIt=this->Targets.begin(); targetIt!=this->Targets.end(); ++targetIt)
+  {
+    os << indent << "Target " << targetIt->SegmentID << ": TV=" << targetIt->TargetVolumeCc
+      << " TV_PIV=" << targetIt->TargetVolumeInPrescriptionIsodoseCc << " CI(Paddick)=" << targetIt->PaddickConformityIndex
+      << " HI=" << targetIt->HomogeneityIndex << "\n";
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPlanQualityIndexLogic::SetDoseVolumeNode(vtkMRMLScalarVolumeNode* doseVolumeNode)
+{
+  if (this->DoseVolumeNode == doseVolumeNode)
+  {
+    return;
+  }
+  this->DoseVolumeNode = doseVolumeNode;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPlanQualityIndexLogic::SetSegmentationNode(vtkMRMLSegmentationNode* segmentationNode)
+{
+  if (this->SegmentationNode == segmentationNode)
+  {
+    return;
+  }
+  this->SegmentationNode = segmentationNode;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPlanQualityIndexLogic::AddTargetSegmentID(std::string segmentID)
+{
+  this->TargetSegmentIDs.push_back(segmentID);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPlanQualityIndexLogic::RemoveAllTargetSegmentIDs()
+{
+  this->TargetSegmentIDs.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPlanQualityIndexLogic::GetTargetIndices(int targetIndex, TargetIndices& indices)
+{
+  if (targetIndex < 0 || targetIndex >= (int)this->Targets.size())
+  {
+    vtkErrorMacro("GetTargetIndices: Invalid target index " << targetIndex);
+    return false;
+  }
+  indices = this->Targets[targetIndex];
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerPlanQualityIndexLogic::ComputePlanQualityIndices()
+{
+  this->Targets.clear();
+  this->PrescriptionIsodoseVolumeCc = 0.0;
+  this->HalfPrescriptionIsodoseVolumeCc = 0.0;
+  this->GradientIndex = 0.0;
+
+  if (!this->DoseVolumeNode || !this->DoseVolumeNode->GetImageData() || !this->SegmentationNode)
+  {
+    std::string errorMessage("Both segmentation node and dose volume node need to be set");
+    vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+    return errorMessage;
+  }
+  if (this->PrescriptionDose <= 0.0)
+  {
+    std::string errorMessage("Prescription dose needs to be positive");
+    vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Create oriented image data from dose volume
+  vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(this->DoseVolumeNode) );
+  if (!doseImageData.GetPointer() || !doseImageData->GetPointData()->GetScalars() || doseImageData->GetNumberOfScalarComponents() != 1)
+  {
+    std::string errorMessage("Failed to get image data from dose volume");
+    vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+    return errorMessage;
+  }
+
+  // If target list is empty then all segments are targets
+  vtkSegmentation* segmentation = this->SegmentationNode->GetSegmentation();
+  std::vector<std::string> segmentIDs = this->TargetSegmentIDs;
+  if (segmentIDs.empty())
+  {
+    segmentation->GetSegmentIDs(segmentIDs);
+  }
+
+  // Duplicate target segments to get binary labelmaps in the dose geometry without oversampling,
+  // so that each dose voxel is either inside or outside of a target
+  vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
+  segmentationCopy->SetMasterRepresentationName(segmentation->GetMasterRepresentationName());
+  segmentationCopy->CopyConversionParameters(segmentation);
+  for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+  {
+    if (!segmentationCopy->CopySegmentFromSegmentation(segmentation, (*segmentIt)))
+    {
+      std::string errorMessage("Failed to get target segment " + (*segmentIt));
+      vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+      return errorMessage;
+    }
+  }
+  segmentationCopy->SetConversionParameter( vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
+    vtkSegmentationConverter::SerializeImageGeometry(doseImageData) );
+  segmentationCopy->SetConversionParameter( vtkClosedSurfaceToBinaryLabelmapConversionRule::GetOversamplingFactorParameterName(), "1" );
+
+  const char* representationName = vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName();
+  bool resamplingRequired = false;
+  if (!segmentationCopy->CreateRepresentation(representationName, true))
+  {
+    if (!segmentationCopy->ContainsRepresentation(representationName))
+    {
+      std::string errorMessage("Unable to acquire binary labelmap from segmentation");
+      vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+      return errorMessage;
+    }
+    // If conversion failed, then resample binary labelmaps in the segments
+    resamplingRequired = true;
+  }
+
+  // Get target masks covering the whole dose volume
+  int doseExtent[6] = {0,-1,0,-1,0,-1};
+  doseImageData->GetExtent(doseExtent);
+  std::vector< vtkSmartPointer<vtkImageData> > targetMaskImages;
+  std::vector<unsigned char*> targetMasks;
+  for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+  {
+    vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast(
+      segmentationCopy->GetSegment(*segmentIt)->GetRepresentation(representationName) );
+    if (!segmentLabelmap)
+    {
+      std::string errorMessage("Failed to get labelmap for segment " + (*segmentIt));
+      vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+      return errorMessage;
+    }
+
+    // Apply parent transformation nodes if necessary, and resample to the dose geometry
+    bool segmentResamplingRequired = resamplingRequired;
+    if (this->SegmentationNode->GetParentTransformNode())
+    {
+      double backgroundValue[4] = {0.0, 0.0, 0.0, 0.0};
+      if (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(this->SegmentationNode, segmentLabelmap, false, backgroundValue))
+      {
+        std::string errorMessage("Failed to apply parent transformation to segment " + (*segmentIt));
+        vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+        return errorMessage;
+      }
+      segmentResamplingRequired = true;
+    }
+    if ( segmentResamplingRequired
+      && !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(segmentLabelmap, doseImageData, segmentLabelmap) )
+    {
+      std::string errorMessage("Failed to resample binary labelmap of segment " + (*segmentIt));
+      vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+      return errorMessage;
+    }
+
+    // Make sure the labelmap has the extent of the dose volume and one byte per voxel
+    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+    padder->SetInputData(segmentLabelmap);
+    padder->SetConstant(0);
+    padder->SetOutputWholeExtent(doseExtent);
+    vtkSmartPointer<vtkImageCast> caster = vtkSmartPointer<vtkImageCast>::New();
+    caster->SetInputConnection(padder->GetOutputPort());
+    caster->SetOutputScalarTypeToUnsignedChar();
+    caster->ClampOverflowOn();
+    caster->Update();
+
+    vtkSmartPointer<vtkImageData> targetMaskImage = caster->GetOutput();
+    targetMaskImages.push_back(targetMaskImage);
+    targetMasks.push_back(static_cast<unsigned char*>(targetMaskImage->GetScalarPointer()));
+  }
+
+  // Accumulate isodose volumes and target statistics in one pass over the dose
+  int doseDimensions[3] = {0, 0, 0};
+  doseImageData->GetDimensions(doseDimensions);
+  PlanQualityAccumulator total;
+  switch (doseImageData->GetScalarType())
+  {
+    vtkTemplateMacro(AccumulatePlanQuality<VTK_TT>(static_cast<VTK_TT*>(doseImageData->GetScalarPointer()),
+      doseDimensions, targetMasks, this->PrescriptionDose, total));
+  default:
+    {
+    std::string errorMessage("Unsupported dose scalar type");
+    vtkErrorMacro("ComputePlanQualityIndices: " << errorMessage);
+    return errorMessage;
+    }
+  }
+
+  // Derive indices
+  double doseSpacing[3] = {0.0, 0.0, 0.0};
+  doseImageData->GetSpacing(doseSpacing);
+  double voxelVolumeCc = doseSpacing[0] * doseSpacing[1] * doseSpacing[2] / 1000.0;
+  this->PrescriptionIsodoseVolumeCc = total.PrescriptionIsodoseVoxels * voxelVolumeCc;
+  this->HalfPrescriptionIsodoseVolumeCc = total.HalfPrescriptionIsodoseVoxels * voxelVolumeCc;
+  this->GradientIndex = (total.PrescriptionIsodoseVoxels > 0 ?
+    (double)total.HalfPrescriptionIsodoseVoxels / (double)total.PrescriptionIsodoseVoxels : 0.0);
+
+  for (int targetIndex=0; targetIndex<(int)segmentIDs.size(); ++targetIndex)
+  {
+    TargetIndices indices;
+    indices.SegmentID = segmentIDs[targetIndex];
+    vtkIdType targetVoxels = total.TargetVoxels[targetIndex];
+    vtkIdType targetInPrescriptionIsodoseVoxels = total.TargetInPrescriptionIsodoseVoxels[targetIndex];
+    indices.TargetVolumeCc = targetVoxels * voxelVolumeCc;
+    indices.TargetVolumeInPrescriptionIsodoseCc = targetInPrescriptionIsodoseVoxels * voxelVolumeCc;
+
+    std::vector<double>& targetDoses = total.TargetDoses[targetIndex];
+    indices.D2 = GetDoseOfHottestPercentage(targetDoses, 2.0);
+    indices.D50 = GetDoseOfHottestPercentage(targetDoses, 50.0);
+    indices.D98 = GetDoseOfHottestPercentage(targetDoses, 98.0);
+
+    if (targetVoxels > 0)
+    {
+      indices.RtogConformityIndex = (double)total.PrescriptionIsodoseVoxels / (double)targetVoxels;
+      indices.Coverage = (double)targetInPrescriptionIsodoseVoxels / (double)targetVoxels;
+    }
+    if (total.PrescriptionIsodoseVoxels > 0)
+    {
+      indices.Selectivity = (double)targetInPrescriptionIsodoseVoxels / (double)total.PrescriptionIsodoseVoxels;
+    }
+    indices.PaddickConformityIndex = indices.Coverage * indices.Selectivity;
+    if (indices.D50 > 0.0)
+    {
+      indices.HomogeneityIndex = (indices.D2 - indices.D98) / indices.D50;
+    }
+    this->Targets.push_back(indices);
+  }
+
+  this->Modified();
+  return "";
+}
@@ -0,0 +1,141 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSlicerPlanQualityIndexLogic_h
+#define __vtkSlicerPlanQualityIndexLogic_h
+
+#include <vtkSlicerDoseVolumeHistogramModuleLogicExport.h>
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+class vtkMRMLScalarVolumeNode;
+class vtkMRMLSegmentationNode;
+
+/// \ingroup SlicerRt_QtModules_DoseVolumeHistogram
+/// \brief Compute conformity, gradient and homogeneity indices of a plan for multiple targets in one pass over the dose
+///
+/// The target segments are rasterized on the dose grid, then the dose voxels are visited once (multi-threaded).
+/// For every voxel the prescription isodose volume (PIV), the half prescription isodose volume (V50%), and for each
+/// target the target volume (TV), the target volume within the prescription isodose (TV_PIV) and the dose values
+/// are accumulated. The indices of all targets are derived from these:
+///   - Paddick conformity index: TV_PIV^2 / (TV * PIV)
+///   - RTOG conformity index: PIV / TV
+///   - Coverage: TV_PIV / TV, selectivity: TV_PIV / PIV
+///   - Paddick gradient index: V50% / PIV
+///   - ICRU 83 homogeneity index: (D2 - D98) / D50
+/// PIV and V50% are computed over the whole dose volume, so with multiple targets the conformity indices of a target
+/// also include the prescription isodose volume around the other targets.
+class VTK_SLICER_DOSEVOLUMEHISTOGRAM_LOGIC_EXPORT vtkSlicerPlanQualityIndexLogic : public vtkObject
+{
+public:
+  /// Plan quality indices of one target
+  struct TargetIndices
+  {
+    TargetIndices()
+      : TargetVolumeCc(0.0)
+      , TargetVolumeInPrescriptionIsodoseCc(0.0)
+      , D2(0.0)
+      , D50(0.0)
+      , D98(0.0)
+      , PaddickConformityIndex(0.0)
+      , RtogConformityIndex(0.0)
+      , Coverage(0.0)
+      , Selectivity(0.0)
+      , HomogeneityIndex(0.0)
+    {
+    }
+
+    std::string SegmentID;
+    double TargetVolumeCc;
+    double TargetVolumeInPrescriptionIsodoseCc;
+    /// Minimum dose of the hottest 2%, 50% and 98% of the target volume
+    double D2;
+    double D50;
+    double D98;
+    double PaddickConformityIndex;
+    double RtogConformityIndex;
+    double Coverage;
+    double Selectivity;
+    double HomogeneityIndex;
+  };
+
+public:
+  static vtkSlicerPlanQualityIndexLogic *New();
+  vtkTypeMacro(vtkSlicerPlanQualityIndexLogic, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set dose volume
+  void SetDoseVolumeNode(vtkMRMLScalarVolumeNode* doseVolumeNode);
+  /// Set segmentation containing the targets
+  void SetSegmentationNode(vtkMRMLSegmentationNode* segmentationNode);
+
+  /// Add target segment. If no target is added then all segments are targets
+  void AddTargetSegmentID(std::string segmentID);
+  /// Remove all target segments
+  void RemoveAllTargetSegmentIDs();
+
+  /// Prescription dose, in the unit of the dose volume
+  vtkGetMacro(PrescriptionDose, double);
+  vtkSetMacro(PrescriptionDose, double);
+
+  /// Compute the plan quality indices of all targets
+  /// \return Error message, empty string on success
+  std::string ComputePlanQualityIndices();
+
+  /// Get prescription isodose volume (output)
+  vtkGetMacro(PrescriptionIsodoseVolumeCc, double);
+  /// Get half prescription isodose volume (output)
+  vtkGetMacro(HalfPrescriptionIsodoseVolumeCc, double);
+  /// Get Paddick gradient index (output)
+  vtkGetMacro(GradientIndex, double);
+
+  /// Get number of targets the indices were computed for (output)
+  int GetNumberOfTargets() { return (int)this->Targets.size(); };
+  /// Get indices of a target (output)
+  /// \return Success flag
+  bool GetTargetIndices(int targetIndex, TargetIndices& indices);
+
+protected:
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> DoseVolumeNode;
+  vtkSmartPointer<vtkMRMLSegmentationNode> SegmentationNode;
+  std::vector<std::string> TargetSegmentIDs;
+  double PrescriptionDose;
+
+  double PrescriptionIsodoseVolumeCc;
+  double HalfPrescriptionIsodoseVolumeCc;
+  double GradientIndex;
+  std::vector<TargetIndices> Targets;
+
+protected:
+  vtkSlicerPlanQualityIndexLogic();
+  virtual ~vtkSlicerPlanQualityIndexLogic();
+
+private:
+  vtkSlicerPlanQualityIndexLogic(const vtkSlicerPlanQualityIndexLogic&); // Not implemented
+  void operator=(const vtkSlicerPlanQualityIndexLogic&);                 // Not implemented
+};
+
+#endif
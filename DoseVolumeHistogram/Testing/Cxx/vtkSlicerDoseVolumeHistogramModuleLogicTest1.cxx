@@ -22,6 +22,7 @@
 #include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
 #include "vtkSlicerDoseVolumeHistogramComparisonLogic.h"
 #include "vtkMRMLDoseVolumeHistogramNode.h"
+#include "vtkSlicerPlanQualityIndexLogic.h"
 
 // SlicerRt includes
 #include "vtkSlicerRtCommon.h"
@@ -51,6 +52,7 @@
 #include <vtkImageAccumulate.h>
 #include <vtkLookupTable.h>
 #include <vtkNew.h>
+#include <vtkPointData.h>
 #include <vtkTable.h>
 #include <vtkTimerLog.h>
 
@@ -559,6 +561,51 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
     }
   }
 
+  // Plan quality indices of all segments as targets, with half of the maximum dose prescribed
+  vtkNew<vtkSlicerPlanQualityIndexLogic> planQualityLogic;
+  planQualityLogic->SetDoseVolumeNode(doseScalarVolumeNode);
+  planQualityLogic->SetSegmentationNode(segmentationNode);
+  planQualityLogic->SetPrescriptionDose(0.5 * maxDose);
+  std::string planQualityErrorMessage = planQualityLogic->ComputePlanQualityIndices();
+  if (!planQualityErrorMessage.empty() || planQualityLogic->GetNumberOfTargets() != segmentationNode->GetSegmentation()->GetNumberOfSegments())
+  {
+    std::cerr << "Failed to compute plan quality indices: " << planQualityErrorMessage << std::endl;
+    returnWithSuccess = false;
+  }
+
+  // Prescription isodose volume must match the number of dose voxels reaching the prescription
+  vtkDataArray* doseScalars = doseScalarVolumeNode->GetImageData()->GetPointData()->GetScalars();
+  vtkIdType prescriptionIsodoseVoxels = 0;
+  for (vtkIdType voxelIndex=0; voxelIndex<doseScalars->GetNumberOfTuples(); ++voxelIndex)
+  {
+    if (doseScalars->GetTuple1(voxelIndex) >= planQualityLogic->GetPrescriptionDose())
+    {
+      ++prescriptionIsodoseVoxels;
+    }
+  }
+  double doseSpacing[3] = {0.0, 0.0, 0.0};
+  doseScalarVolumeNode->GetSpacing(doseSpacing);
+  double expectedPrescriptionIsodoseVolumeCc = prescriptionIsodoseVoxels * doseSpacing[0] * doseSpacing[1] * doseSpacing[2] / 1000.0;
+  if ( fabs(planQualityLogic->GetPrescriptionIsodoseVolumeCc() - expectedPrescriptionIsodoseVolumeCc) > 1e-6
+    || planQualityLogic->GetHalfPrescriptionIsodoseVolumeCc() < planQualityLogic->GetPrescriptionIsodoseVolumeCc() )
+  {
+    std::cerr << "Invalid prescription isodose volumes: PIV=" << planQualityLogic->GetPrescriptionIsodoseVolumeCc()
+      << " (expected " << expectedPrescriptionIsodoseVolumeCc << "), V50%=" << planQualityLogic->GetHalfPrescriptionIsodoseVolumeCc() << std::endl;
+    returnWithSuccess = false;
+  }
+  for (int targetIndex=0; targetIndex<planQualityLogic->GetNumberOfTargets(); ++targetIndex)
+  {
+    vtkSlicerPlanQualityIndexLogic::TargetIndices indices;
+    planQualityLogic->GetTargetIndices(targetIndex, indices);
+    if ( indices.TargetVolumeInPrescriptionIsodoseCc > indices.TargetVolumeCc
+      || indices.PaddickConformityIndex < 0.0 || indices.PaddickConformityIndex > 1.0
+      || indices.D98 > indices.D50 || indices.D50 > indices.D2 )
+    {
+      std::cerr << "Inconsistent plan quality indices for target " << indices.SegmentID << std::endl;
+      returnWithSuccess = false;
+    }
+  }
+
   if (!returnWithSuccess)
   {
     return EXIT_FAILURE;
@@ -0,0 +1,568 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkIsodoseContourFilter.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkImageData.h>
+#include <vtkMarchingCubesTriangleCases.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkIsodoseContourFilter);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Offsets of the cube vertices in the order used by the marching cubes case table
+  const int CUBE_VERTEX_OFFSETS[8][3] = { {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1} };
+
+  /// Cube edges of the marching cubes case table as (vertex with the lower coordinates, axis of the edge)
+  const int CUBE_EDGES[12][2] = { {0,0}, {1,1}, {3,0}, {0,1}, {4,0}, {5,1}, {7,0}, {4,1}, {0,2}, {1,2}, {3,2}, {2,2} };
+
+  //----------------------------------------------------------------------------
+  /// Geometry of the input image and of the blocks
+  struct ContourGeometry
+  {
+    int Dimensions[3];
+    /// Index increment along each axis
+    vtkIdType Increments[3];
+    double Origin[3];
+    double Spacing[3];
+    int Extent[6];
+    int BlockSize;
+    int NumberOfBlocks[3];
+
+    vtkIdType GetBlockIndex(int bi, int bj, int bk) const
+    {
+      return bi + this->NumberOfBlocks[0] * ((vtkIdType)bj + (vtkIdType)this->NumberOfBlocks[1] * bk);
+    }
+
+    /// Get the cell range of a block along an axis
+    void GetBlockCellRange(int axis, int blockIndex, int& begin, int& end) const
+    {
+      begin = blockIndex * this->BlockSize;
+      end = std::min(begin + this->BlockSize, this->Dimensions[axis] - 1);
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  /// Part of the isosurface of one level that is generated in one slice of cells.
+  /// Edges are identified by the key 3 * (index of the voxel at the lower end of the edge) + axis
+  struct SliceContour
+  {
+    /// Keys of the edges crossed by the isosurface in ascending order, one per point
+    std::vector<vtkIdType> EdgeKeys;
+    /// Point coordinates (three values per point)
+    std::vector<float> Points;
+    /// Triangles as triplets of indices into EdgeKeys
+    std::vector<vtkIdType> Triangles;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute value range of the blocks. Slices of blocks are processed in parallel
+  template<class T> class BlockRangeFunctor
+  {
+  public:
+    BlockRangeFunctor(const T* scalars, const ContourGeometry& geometry, std::vector<double>& minima, std::vector<double>& maxima)
+      : Scalars(scalars)
+      , Geometry(geometry)
+      , Minima(minima)
+      , Maxima(maxima)
+    {
+    }
+
+    void operator()(vtkIdType beginBlockSlice, vtkIdType endBlockSlice) const
+    {
+      const ContourGeometry& geometry = this->Geometry;
+      for (int bk=(int)beginBlockSlice; bk<(int)endBlockSlice; ++bk)
+      {
+        int kBegin = 0, kEnd = 0;
+        geometry.GetBlockCellRange(2, bk, kBegin, kEnd);
+        for (int bj=0; bj<geometry.NumberOfBlocks[1]; ++bj)
+        {
+          int jBegin = 0, jEnd = 0;
+          geometry.GetBlockCellRange(1, bj, jBegin, jEnd);
+          for (int bi=0; bi<geometry.NumberOfBlocks[0]; ++bi)
+          {
+            int iBegin = 0, iEnd = 0;
+            geometry.GetBlockCellRange(0, bi, iBegin, iEnd);
+
+            // The cells of the block use the voxels up to the end index inclusive
+            double minimum = VTK_DOUBLE_MAX;
+            double maximum = VTK_DOUBLE_MIN;
+            for (int k=kBegin; k<=kEnd; ++k)
+            {
+              for (int j=jBegin; j<=jEnd; ++j)
+              {
+                const T* scalarPtr = this->Scalars + iBegin + j * geometry.Increments[1] + k * geometry.Increments[2];
+                for (int i=iBegin; i<=iEnd; ++i, ++scalarPtr)
+                {
+                  double value = (double)(*scalarPtr);
+                  minimum = std::min(minimum, value);
+                  maximum = std::max(maximum, value);
+                }
+              }
+            }
+            vtkIdType blockIndex = geometry.GetBlockIndex(bi, bj, bk);
+            this->Minima[blockIndex] = minimum;
+            this->Maxima[blockIndex] = maximum;
+          }
+        }
+      }
+    }
+
+  private:
+    const T* Scalars;
+    const ContourGeometry& Geometry;
+    std::vector<double>& Minima;
+    std::vector<double>& Maxima;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Generate the triangles of all levels in slices of cells. Slices are processed in parallel,
+  /// each slice writes only its own contours
+  template<class T> class ContourSliceFunctor
+  {
+  public:
+    ContourSliceFunctor(const T* scalars, const ContourGeometry& geometry, const std::vector<double>& levels,
+      const std::vector<double>& blockMinima, const std::vector<double>& blockMaxima, std::vector< std::vector<SliceContour> >& sliceContours)
+      : Scalars(scalars)
+      , Geometry(geometry)
+      , Levels(levels)
+      , BlockMinima(blockMinima)
+      , BlockMaxima(blockMaxima)
+      , SliceContours(sliceContours)
+    {
+      for (int vertex=0; vertex<8; ++vertex)
+      {
+        this->VertexIndexOffsets[vertex] = CUBE_VERTEX_OFFSETS[vertex][0] * geometry.Increments[0]
+          + CUBE_VERTEX_OFFSETS[vertex][1] * geometry.Increments[1] + CUBE_VERTEX_OFFSETS[vertex][2] * geometry.Increments[2];
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice) const
+    {
+      const ContourGeometry& geometry = this->Geometry;
+      vtkMarchingCubesTriangleCases* triangleCases = vtkMarchingCubesTriangleCases::GetCases();
+      std::vector<int> activeLevelIndices;
+      for (int k=(int)beginSlice; k<(int)endSlice; ++k)
+      {
+        std::vector<SliceContour>& contours = this->SliceContours[k];
+        int bk = k / geometry.BlockSize;
+        for (int bj=0; bj<geometry.NumberOfBlocks[1]; ++bj)
+        {
+          int jBegin = 0, jEnd = 0;
+          geometry.GetBlockCellRange(1, bj, jBegin, jEnd);
+          for (int bi=0; bi<geometry.NumberOfBlocks[0]; ++bi)
+          {
+            // A level crosses a cell only if some of its voxels are below and some are at or above the level
+            vtkIdType blockIndex = geometry.GetBlockIndex(bi, bj, bk);
+            activeLevelIndices.clear();
+            for (int levelIndex=0; levelIndex<(int)this->Levels.size(); ++levelIndex)
+            {
+              if (this->BlockMinima[blockIndex] < this->Levels[levelIndex] && this->Levels[levelIndex] <= this->BlockMaxima[blockIndex])
+              {
+                activeLevelIndices.push_back(levelIndex);
+              }
+            }
+            if (activeLevelIndices.empty())
+            {
+              continue;
+            }
+
+            int iBegin = 0, iEnd = 0;
+            geometry.GetBlockCellRange(0, bi, iBegin, iEnd);
+            for (int j=jBegin; j<jEnd; ++j)
+            {
+              for (int i=iBegin; i<iEnd; ++i)
+              {
+                vtkIdType cellIndex = i + j * geometry.Increments[1] + k * geometry.Increments[2];
+                double values[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+                for (int vertex=0; vertex<8; ++vertex)
+                {
+                  values[vertex] = (double)this->Scalars[cellIndex + this->VertexIndexOffsets[vertex]];
+                }
+
+                for (std::vector<int>::iterator levelIt=activeLevelIndices.begin(); levelIt!=activeLevelIndices.end(); ++levelIt)
+                {
+                  double level = this->Levels[*levelIt];
+                  int caseIndex = 0;
+                  for (int vertex=0; vertex<8; ++vertex)
+                  {
+                    if (values[vertex] >= level)
+                    {
+                      caseIndex |= (1 << vertex);
+                    }
+                  }
+                  if (caseIndex == 0 || caseIndex == 255)
+                  {
+                    continue;
+                  }
+
+                  // Store triangles as edge keys, which are replaced by point indices when the slice is complete
+                  std::vector<vtkIdType>& triangles = contours[*levelIt].Triangles;
+                  for (EDGE_LIST* edge = triangleCases[caseIndex].edges; edge[0] > -1; ++edge)
+                  {
+                    const int* cubeEdge = CUBE_EDGES[*edge];
+                    triangles.push_back((cellIndex + this->VertexIndexOffsets[cubeEdge[0]]) * 3 + cubeEdge[1]);
+                  }
+                }
+              }
+            }
+          }
+        }
+
+        for (int levelIndex=0; levelIndex<(int)this->Levels.size(); ++levelIndex)
+        {
+          this->CreateSlicePoints(contours[levelIndex], this->Levels[levelIndex]);
+        }
+      }
+    }
+
+  private:
+    /// Create one point per crossed edge of a slice and convert the triangles to point indices
+    void CreateSlicePoints(SliceContour& contour, double level) const
+    {
+      if (contour.Triangles.empty())
+      {
+        return;
+      }
+      contour.EdgeKeys = contour.Triangles;
+      std::sort(contour.EdgeKeys.begin(), contour.EdgeKeys.end());
+      contour.EdgeKeys.erase(std::unique(contour.EdgeKeys.begin(), contour.EdgeKeys.end()), contour.EdgeKeys.end());
+
+      const ContourGeometry& geometry = this->Geometry;
+      contour.Points.resize(contour.EdgeKeys.size() * 3);
+      for (size_t pointIndex=0; pointIndex<contour.EdgeKeys.size(); ++pointIndex)
+      {
+        vtkIdType voxelIndex = contour.EdgeKeys[pointIndex] / 3;
+        int axis = (int)(contour.EdgeKeys[pointIndex] % 3);
+        double value0 = (double)this->Scalars[voxelIndex];
+        double value1 = (double)this->Scalars[voxelIndex + geometry.Increments[axis]];
+        double t = (level - value0) / (value1 - value0);
+
+        int voxelIjk[3] = { (int)(voxelIndex % geometry.Dimensions[0]),
+          (int)((voxelIndex / geometry.Increments[1]) % geometry.Dimensions[1]), (int)(voxelIndex / geometry.Increments[2]) };
+        for (int coordinate=0; coordinate<3; ++coordinate)
+        {
+          double index = geometry.Extent[2*coordinate] + voxelIjk[coordinate] + (coordinate == axis ? t : 0.0);
+          contour.Points[3*pointIndex + coordinate] = (float)(geometry.Origin[coordinate] + geometry.Spacing[coordinate] * index);
+        }
+      }
+
+      for (std::vector<vtkIdType>::iterator triangleIt=contour.Triangles.begin(); triangleIt!=contour.Triangles.end(); ++triangleIt)
+      {
+        (*triangleIt) = std::lower_bound(contour.EdgeKeys.begin(), contour.EdgeKeys.end(), *triangleIt) - contour.EdgeKeys.begin();
+      }
+    }
+
+  private:
+    const T* Scalars;
+    const ContourGeometry& Geometry;
+    const std::vector<double>& Levels;
+    const std::vector<double>& BlockMinima;
+    const std::vector<double>& BlockMaxima;
+    std::vector< std::vector<SliceContour> >& SliceContours;
+    vtkIdType VertexIndexOffsets[8];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Assemble the output of each level from its slice contours. The points on the plane between two
+  /// slices are generated by both slices, they are merged here. Levels are processed in parallel
+  class MergeSliceContoursFunctor
+  {
+  public:
+    MergeSliceContoursFunctor(const ContourGeometry& geometry, const std::vector< std::vector<SliceContour> >& sliceContours,
+      std::vector< vtkSmartPointer<vtkPolyData> >& outputs)
+      : Geometry(geometry)
+      , SliceContours(sliceContours)
+      , Outputs(outputs)
+    {
+    }
+
+    void operator()(vtkIdType beginLevel, vtkIdType endLevel) const
+    {
+      for (vtkIdType levelIndex=beginLevel; levelIndex<endLevel; ++levelIndex)
+      {
+        this->Outputs[levelIndex] = this->MergeLevel((int)levelIndex);
+      }
+    }
+
+  private:
+    vtkSmartPointer<vtkPolyData> MergeLevel(int levelIndex) const
+    {
+      std::vector<float> points;
+      std::vector<vtkIdType> triangles;
+      std::vector<vtkIdType> sliceToOutputPointIds;
+      // Edges on the top plane of the previous slice and the current slice, with the output point IDs
+      std::vector<vtkIdType> previousTopKeys;
+      std::vector<vtkIdType> previousTopPointIds;
+      std::vector<vtkIdType> currentTopKeys;
+      std::vector<vtkIdType> currentTopPointIds;
+      vtkIdType numberOfPoints = 0;
+
+      for (size_t k=0; k<this->SliceContours.size(); ++k)
+      {
+        const SliceContour& contour = this->SliceContours[k][levelIndex];
+        vtkIdType topPlaneFirstKey = ((vtkIdType)k + 1) * this->Geometry.Increments[2] * 3;
+        sliceToOutputPointIds.resize(contour.EdgeKeys.size());
+        currentTopKeys.clear();
+        currentTopPointIds.clear();
+        size_t previousTopIndex = 0;
+
+        // Edge keys are sorted, so the matching edges of the previous slice are found in one pass
+        for (size_t slicePointIndex=0; slicePointIndex<contour.EdgeKeys.size(); ++slicePointIndex)
+        {
+          vtkIdType key = contour.EdgeKeys[slicePointIndex];
+          vtkIdType pointId = -1;
+          if (key < topPlaneFirstKey && key % 3 != 2)
+          {
+            while (previousTopIndex < previousTopKeys.size() && previousTopKeys[previousTopIndex] < key)
+            {
+              ++previousTopIndex;
+            }
+            if (previousTopIndex < previousTopKeys.size() && previousTopKeys[previousTopIndex] == key)
+            {
+              pointId = previousTopPointIds[previousTopIndex];
+            }
+          }
+          if (pointId < 0)
+          {
+            pointId = numberOfPoints++;
+            points.insert(points.end(), contour.Points.begin() + 3*slicePointIndex, contour.Points.begin() + 3*slicePointIndex + 3);
+          }
+          sliceToOutputPointIds[slicePointIndex] = pointId;
+          if (key >= topPlaneFirstKey)
+          {
+            currentTopKeys.push_back(key);
+            currentTopPointIds.push_back(pointId);
+          }
+        }
+
+        for (std::vector<vtkIdType>::const_iterator triangleIt=contour.Triangles.begin(); triangleIt!=contour.Triangles.end(); ++triangleIt)
+        {
+          triangles.push_back(sliceToOutputPointIds[*triangleIt]);
+        }
+        previousTopKeys.swap(currentTopKeys);
+        previousTopPointIds.swap(currentTopPointIds);
+      }
+
+      vtkSmartPointer<vtkPoints> outputPoints = vtkSmartPointer<vtkPoints>::New();
+      outputPoints->SetDataTypeToFloat();
+      outputPoints->SetNumberOfPoints(numberOfPoints);
+      for (vtkIdType pointId=0; pointId<numberOfPoints; ++pointId)
+      {
+        outputPoints->SetPoint(pointId, &(points[3*pointId]));
+      }
+      vtkSmartPointer<vtkCellArray> outputPolys = vtkSmartPointer<vtkCellArray>::New();
+      vtkIdType numberOfTriangles = (vtkIdType)triangles.size() / 3;
+      outputPolys->Allocate(outputPolys->EstimateSize(numberOfTriangles, 3));
+      for (vtkIdType triangleIndex=0; triangleIndex<numberOfTriangles; ++triangleIndex)
+      {
+        outputPolys->InsertNextCell(3, &(triangles[3*triangleIndex]));
+      }
+
+      vtkSmartPointer<vtkPolyData> output = vtkSmartPointer<vtkPolyData>::New();
+      output->SetPoints(outputPoints);
+      output->SetPolys(outputPolys);
+      return output;
+    }
+
+  private:
+    const ContourGeometry& Geometry;
+    const std::vector< std::vector<SliceContour> >& SliceContours;
+    std::vector< vtkSmartPointer<vtkPolyData> >& Outputs;
+  };
+
+  //----------------------------------------------------------------------------
+  template<class T> void ComputeBlockRanges(const T* scalars, const ContourGeometry& geometry,
+    std::vector<double>& blockMinima, std::vector<double>& blockMaxima)
+  {
+    BlockRangeFunctor<T> functor(scalars, geometry, blockMinima, blockMaxima);
+    vtkSMPTools::For(0, geometry.NumberOfBlocks[2], functor);
+  }
+
+  //----------------------------------------------------------------------------
+  template<class T> void ContourSlices(const T* scalars, const ContourGeometry& geometry, const std::vector<double>& levels,
+    const std::vector<double>& blockMinima, const std::vector<double>& blockMaxima, std::vector< std::vector<SliceContour> >& sliceContours)
+  {
+    ContourSliceFunctor<T> functor(scalars, geometry, levels, blockMinima, blockMaxima, sliceContours);
+    vtkSMPTools::For(0, (vtkIdType)sliceContours.size(), 1, functor);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkIsodoseContourFilter::vtkIsodoseContourFilter()
+{
+  this->BlockSize = 8;
+  this->NumberOfBlocks = 0;
+  this->NumberOfSkippedBlocks = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkIsodoseContourFilter::~vtkIsodoseContourFilter()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkIsodoseContourFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Levels:";
+  for (std::vector<double>::iterator levelIt=this->Levels.begin(); levelIt!=this->Levels.end(); ++levelIt)
+  {
+    os << " " << (*levelIt);
+  }
+  os << "\n";
+  os << indent << "BlockSize: " << this->BlockSize << "\n";
+  os << indent << "NumberOfBlocks: " << this->NumberOfBlocks << "\n";
+  os << indent << "NumberOfSkippedBlocks: " << this->NumberOfSkippedBlocks << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkIsodoseContourFilter::SetInputImage(vtkImageData* inputImage)
+{
+  this->InputImage = inputImage;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkIsodoseContourFilter::AddLevel(double level)
+{
+  this->Levels.push_back(level);
+  this->Modified();
+  return (int)this->Levels.size() - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkIsodoseContourFilter::RemoveAllLevels()
+{
+  this->Levels.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkIsodoseContourFilter::GetLevel(int levelIndex)
+{
+  if (levelIndex < 0 || levelIndex >= (int)this->Levels.size())
+  {
+    vtkErrorMacro("GetLevel: Invalid level index " << levelIndex);
+    return 0.0;
+  }
+  return this->Levels[levelIndex];
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkIsodoseContourFilter::GetOutput(int levelIndex)
+{
+  if (levelIndex < 0 || levelIndex >= (int)this->Outputs.size())
+  {
+    return NULL;
+  }
+  return this->Outputs[levelIndex];
+}
+
+//----------------------------------------------------------------------------
+bool vtkIsodoseContourFilter::Update()
+{
+  this->Outputs.clear();
+  this->NumberOfBlocks = 0;
+  this->NumberOfSkippedBlocks = 0;
+
+  if (!this->InputImage || !this->InputImage->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Invalid input image");
+    return false;
+  }
+  if (this->InputImage->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("Update: Input image needs to have a single scalar component");
+    return false;
+  }
+
+  int numberOfLevels = (int)this->Levels.size();
+  ContourGeometry geometry;
+  this->InputImage->GetDimensions(geometry.Dimensions);
+  this->InputImage->GetOrigin(geometry.Origin);
+  this->InputImage->GetSpacing(geometry.Spacing);
+  this->InputImage->GetExtent(geometry.Extent);
+  geometry.Increments[0] = 1;
+  geometry.Increments[1] = geometry.Dimensions[0];
+  geometry.Increments[2] = (vtkIdType)geometry.Dimensions[0] * geometry.Dimensions[1];
+  geometry.BlockSize = this->BlockSize;
+  int numberOfSlices = std::max(geometry.Dimensions[2] - 1, 0);
+  for (int axis=0; axis<3; ++axis)
+  {
+    int numberOfCells = std::max(geometry.Dimensions[axis] - 1, 0);
+    geometry.NumberOfBlocks[axis] = (numberOfCells + this->BlockSize - 1) / this->BlockSize;
+  }
+
+  // Value range of the blocks
+  this->NumberOfBlocks = (vtkIdType)geometry.NumberOfBlocks[0] * geometry.NumberOfBlocks[1] * geometry.NumberOfBlocks[2];
+  std::vector<double> blockMinima(this->NumberOfBlocks, 0.0);
+  std::vector<double> blockMaxima(this->NumberOfBlocks, 0.0);
+  void* scalars = this->InputImage->GetScalarPointer();
+  switch (this->InputImage->GetScalarType())
+  {
+    vtkTemplateMacro(ComputeBlockRanges<VTK_TT>(static_cast<VTK_TT*>(scalars), geometry, blockMinima, blockMaxima));
+  default:
+    vtkErrorMacro("Update: Unsupported scalar type " << this->InputImage->GetScalarTypeAsString());
+    return false;
+  }
+  for (vtkIdType blockIndex=0; blockIndex<this->NumberOfBlocks; ++blockIndex)
+  {
+    bool skipped = true;
+    for (int levelIndex=0; levelIndex<numberOfLevels; ++levelIndex)
+    {
+      if (blockMinima[blockIndex] < this->Levels[levelIndex] && this->Levels[levelIndex] <= blockMaxima[blockIndex])
+      {
+        skipped = false;
+        break;
+      }
+    }
+    if (skipped)
+    {
+      ++this->NumberOfSkippedBlocks;
+    }
+  }
+
+  // Contour all levels in slices of cells, then merge the slices
+  std::vector< std::vector<SliceContour> > sliceContours(numberOfSlices, std::vector<SliceContour>(numberOfLevels));
+  switch (this->InputImage->GetScalarType())
+  {
+    vtkTemplateMacro(ContourSlices<VTK_TT>(static_cast<VTK_TT*>(scalars), geometry, this->Levels, blockMinima, blockMaxima, sliceContours));
+  }
+
+  this->Outputs.resize(numberOfLevels);
+  MergeSliceContoursFunctor mergeFunctor(geometry, sliceContours, this->Outputs);
+  vtkSMPTools::For(0, numberOfLevels, 1, mergeFunctor);
+
+  return true;
+}
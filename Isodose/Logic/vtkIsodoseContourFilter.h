@@ -0,0 +1,108 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkIsodoseContourFilter - Generate isosurfaces of multiple levels in a single sweep
+// .SECTION Description
+
+#ifndef __vtkIsodoseContourFilter_h
+#define __vtkIsodoseContourFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerIsodoseModuleLogicExport.h"
+
+class vtkImageData;
+class vtkPolyData;
+
+/// \ingroup SlicerRt_QtModules_Isodose
+/// \brief Multi-threaded marching cubes of multiple iso-levels in one pass over the image
+///
+/// The cells of the image are visited once, and the triangles of all levels crossing a cell are generated
+/// from the same eight voxel values. The image is divided into blocks of cells, and the value range of each
+/// block is computed before the sweep, so that blocks whose range contains none of the levels are skipped.
+/// Slices of cells are processed in parallel, then the points shared by adjacent slices are merged.
+///
+/// The triangles follow the case table and interpolation of vtkImageMarchingCubes, so each output contains the same
+/// points and triangles as vtkImageMarchingCubes with the same level. The order of points and triangles may differ,
+/// but it does not depend on the number of threads.
+class VTK_SLICER_ISODOSE_LOGIC_EXPORT vtkIsodoseContourFilter : public vtkObject
+{
+public:
+  static vtkIsodoseContourFilter *New();
+  vtkTypeMacro(vtkIsodoseContourFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set input image. It needs to have a single scalar component
+  void SetInputImage(vtkImageData* inputImage);
+  /// Get input image
+  vtkImageData* GetInputImage() { return this->InputImage; };
+
+  /// Add iso-level
+  /// \return Index of the level, which is the index of its output
+  int AddLevel(double level);
+  /// Remove all iso-levels
+  void RemoveAllLevels();
+  /// Get number of iso-levels
+  int GetNumberOfLevels() { return (int)this->Levels.size(); };
+  /// Get iso-level of the given index
+  double GetLevel(int levelIndex);
+
+  /// Generate the isosurfaces of all levels
+  /// \return Success flag
+  bool Update();
+
+  /// Get isosurface of a level (output). The points are in the physical space of the input image.
+  /// NULL if the index is invalid or the filter has not been updated
+  vtkPolyData* GetOutput(int levelIndex);
+
+  /// Get number of blocks the image was divided to (output)
+  vtkGetMacro(NumberOfBlocks, vtkIdType);
+  /// Get number of blocks skipped because none of the levels is within their value range (output)
+  vtkGetMacro(NumberOfSkippedBlocks, vtkIdType);
+
+  /// Size of the blocks along each axis, in cells, for which the value range is computed
+  vtkGetMacro(BlockSize, int);
+  vtkSetClampMacro(BlockSize, int, 2, 64);
+
+protected:
+  vtkSmartPointer<vtkImageData> InputImage;
+  std::vector<double> Levels;
+  std::vector< vtkSmartPointer<vtkPolyData> > Outputs;
+
+  int BlockSize;
+
+  vtkIdType NumberOfBlocks;
+  vtkIdType NumberOfSkippedBlocks;
+
+protected:
+  vtkIsodoseContourFilter();
+  ~vtkIsodoseContourFilter();
+
+private:
+  vtkIsodoseContourFilter(const vtkIsodoseContourFilter&); // Not implemented
+  void operator=(const vtkIsodoseContourFilter&);          // Not implemented
+};
+
+#endif
@@ -49,6 +49,7 @@ vtkMRMLIsodoseNode::vtkMRMLIsodoseNode()
   this->ShowIsodoseSurfaces = true;
   this->ShowScalarBar = false;
   this->ShowDoseVolumesOnly = true;
+  this->ShowSliceIsodoseLines = false;
 
   this->HideFromEditors = false;
 }
@@ -69,6 +70,7 @@ void vtkMRMLIsodoseNode::WriteXML(ostream& of, int nIndent)
   vtkMRMLWriteXMLBooleanMacro(ShowIsodoseSurfaces, ShowIsodoseSurfaces);
   vtkMRMLWriteXMLBooleanMacro(ShowScalarBar, ShowScalarBar);
   vtkMRMLWriteXMLBooleanMacro(ShowDoseVolumesOnly, ShowDoseVolumesOnly);
+  vtkMRMLWriteXMLBooleanMacro(ShowSliceIsodoseLines, ShowSliceIsodoseLines);
   vtkMRMLWriteXMLEndMacro(); 
 }
 
@@ -83,6 +85,7 @@ void vtkMRMLIsodoseNode::ReadXMLAttributes(const char** atts)
   vtkMRMLReadXMLBooleanMacro(ShowIsodoseSurfaces, ShowIsodoseSurfaces);
   vtkMRMLReadXMLBooleanMacro(ShowScalarBar, ShowScalarBar);
   vtkMRMLReadXMLBooleanMacro(ShowDoseVolumesOnly, ShowDoseVolumesOnly);
+  vtkMRMLReadXMLBooleanMacro(ShowSliceIsodoseLines, ShowSliceIsodoseLines);
   vtkMRMLReadXMLEndMacro();
 
   this->EndModify(disabledModify);
@@ -102,6 +105,7 @@ void vtkMRMLIsodoseNode::Copy(vtkMRMLNode *anode)
   vtkMRMLCopyBooleanMacro(ShowIsodoseSurfaces);
   vtkMRMLCopyBooleanMacro(ShowScalarBar);
   vtkMRMLCopyBooleanMacro(ShowDoseVolumesOnly);
+  vtkMRMLCopyBooleanMacro(ShowSliceIsodoseLines);
   vtkMRMLCopyEndMacro();
 
   this->EndModify(disabledModify);
@@ -117,6 +121,7 @@ void vtkMRMLIsodoseNode::PrintSelf(ostream& os, vtkIndent indent)
   vtkMRMLPrintBooleanMacro(ShowIsodoseSurfaces);
   vtkMRMLPrintBooleanMacro(ShowScalarBar);
   vtkMRMLPrintBooleanMacro(ShowDoseVolumesOnly);
+  vtkMRMLPrintBooleanMacro(ShowSliceIsodoseLines);
   vtkMRMLPrintEndMacro();
 }
 
@@ -89,6 +89,11 @@ public:
   vtkSetMacro(ShowDoseVolumesOnly, bool);
   vtkBooleanMacro(ShowDoseVolumesOnly, bool);
 
+  /// Get/Set show isodose lines in slice views checkbox state
+  vtkGetMacro(ShowSliceIsodoseLines, bool);
+  vtkSetMacro(ShowSliceIsodoseLines, bool);
+  vtkBooleanMacro(ShowSliceIsodoseLines, bool);
+
 protected:
   vtkMRMLIsodoseNode();
   ~vtkMRMLIsodoseNode();
@@ -107,6 +112,9 @@ protected:
 
   /// State of Show dose volumes only checkbox
   bool ShowDoseVolumesOnly;
+
+  /// State of Show isodose lines in slice views checkbox
+  bool ShowSliceIsodoseLines;
 };
 
 #endif
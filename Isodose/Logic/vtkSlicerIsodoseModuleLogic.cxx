@@ -22,6 +22,7 @@
 // Isodose includes
 #include "vtkSlicerIsodoseModuleLogic.h"
 #include "vtkMRMLIsodoseNode.h"
+#include "vtkIsodoseContourFilter.h"
 
 // Subject Hierarchy includes
 #include "vtkMRMLSubjectHierarchyConstants.h"
@@ -31,12 +32,20 @@
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+
 // MRML includes
 #include <vtkMRMLColorTableNode.h>
 #include <vtkMRMLModelDisplayNode.h>
 #include <vtkMRMLModelNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLSliceNode.h>
 #include <vtkMRMLTransformNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
 
@@ -45,22 +54,38 @@
 
 // VTK includes
 #include <vtkColorTransferFunction.h>
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
 #include <vtkDecimatePro.h>
+#include <vtkFlyingEdges2D.h>
 #include <vtkGeneralTransform.h>
 #include <vtkImageChangeInformation.h>
 #include <vtkImageData.h>
-#include <vtkImageMarchingCubes.h>
 #include <vtkImageReslice.h>
+#include <vtkImageShrink3D.h>
+#include <vtkIntArray.h>
 #include <vtkLookupTable.h>
+#include <vtkMatrix4x4.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
 #include <vtkPolyDataNormals.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
+#include <vtkTransform.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkTriangleFilter.h>
 #include <vtkWindowedSincPolyDataFilter.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+
 //----------------------------------------------------------------------------
 const char* DEFAULT_ISODOSE_COLOR_TABLE_FILE_NAME = "Isodose_ColorTable.ctbl";
 const char* DEFAULT_ISODOSE_COLOR_TABLE_NODE_NAME = "Isodose_ColorTable_Default";
@@ -68,6 +93,455 @@ const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX =
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_PARAMETER_SET_BASE_NAME_PREFIX = "IsodoseParameterSet_";
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX = "_IsodoseSurfaces";
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_COLOR_TABLE_NODE_NAME_POSTFIX = "_IsodoseColorTable";
+const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_SEGMENTATION_NODE_NAME_POSTFIX = "_IsodoseSegmentation";
+const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_LEVEL_ATTRIBUTE_NAME = "Isodose.Level";
+const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_SLICE_LINES_MODEL_NODE_NAME_PREFIX = "IsodoseLines_";
+const char* vtkSlicerIsodoseModuleLogic::ISODOSE_LEVEL_INDEX_ARRAY_NAME = "IsodoseLevelIndex";
+
+//----------------------------------------------------------------------------
+/// Number of slice positions for which the isodose lines are kept for each slice view
+const unsigned int SLICE_ISODOSE_LINES_CACHE_SIZE = 64;
+
+namespace
+{
+  //---------------------------------------------------------------------------
+  /// Surface generation of one isodose level (\sa CreateIsodoseSurfaces)
+  struct IsodoseSurfaceJob
+  {
+    /// Isosurface of the level in IJK space
+    vtkSmartPointer<vtkPolyData> IsoPolyData;
+    /// Generated surface in RAS space. NULL if the level does not produce any points
+    vtkSmartPointer<vtkPolyData> IsodoseSurface;
+  };
+
+  //---------------------------------------------------------------------------
+  /// Run the isodose surface processing pipelines of the levels in parallel. Each job uses its own filters
+  /// and input, and no MRML node is accessed, so the surfaces are the same as when run one by one.
+  /// Coarse surfaces (\sa vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces) skip decimation and smoothing
+  class IsodoseSurfaceFunctor
+  {
+  public:
+    IsodoseSurfaceFunctor(std::vector<IsodoseSurfaceJob>& jobs, vtkMatrix4x4* ijkToRasMatrix, bool coarse=false)
+      : Jobs(jobs)
+      , IJKToRASMatrix(ijkToRasMatrix)
+      , Coarse(coarse)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      for (vtkIdType jobIndex=begin; jobIndex<end; ++jobIndex)
+      {
+        this->Jobs[jobIndex].IsodoseSurface = this->CreateIsodoseSurface(this->Jobs[jobIndex]);
+      }
+    }
+
+  private:
+    vtkSmartPointer<vtkPolyData> CreateIsodoseSurface(const IsodoseSurfaceJob& job) const
+    {
+      if (!job.IsoPolyData || job.IsoPolyData->GetNumberOfPoints() < 1)
+      {
+        return NULL;
+      }
+
+      vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+      normals->ComputePointNormalsOn();
+      normals->SetFeatureAngle(60);
+      if (this->Coarse)
+      {
+        normals->SetInputData(job.IsoPolyData);
+        normals->Update();
+        return this->TransformToRAS(normals->GetOutput());
+      }
+
+      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+      triangleFilter->SetInputData(job.IsoPolyData);
+      triangleFilter->Update();
+
+      vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+      decimate->SetInputData(triangleFilter->GetOutput());
+      decimate->SetTargetReduction(0.6);
+      decimate->SetFeatureAngle(60);
+      decimate->SplittingOff();
+      decimate->PreserveTopologyOn();
+      decimate->SetMaximumError(1);
+      decimate->Update();
+
+      vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+      smootherSinc->SetPassBand(0.1);
+      smootherSinc->SetInputData(decimate->GetOutput() );
+      smootherSinc->SetNumberOfIterations(2);
+      smootherSinc->FeatureEdgeSmoothingOff();
+      smootherSinc->BoundarySmoothingOff();
+      smootherSinc->Update();
+
+      normals->SetInputData(smootherSinc->GetOutput());
+      normals->Update();
+      return this->TransformToRAS(normals->GetOutput());
+    }
+
+    vtkSmartPointer<vtkPolyData> TransformToRAS(vtkPolyData* ijkPolyData) const
+    {
+      vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
+      inputIJKToRASTransform->Identity();
+      inputIJKToRASTransform->SetMatrix(this->IJKToRASMatrix);
+
+      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+      transformPolyData->SetInputData(ijkPolyData);
+      transformPolyData->SetTransform(inputIJKToRASTransform);
+      transformPolyData->Update();
+
+      return transformPolyData->GetOutput();
+    }
+
+  private:
+    std::vector<IsodoseSurfaceJob>& Jobs;
+    /// IJK to RAS matrix of the dose volume. Only read by the jobs
+    vtkMatrix4x4* IJKToRASMatrix;
+    /// Flag indicating whether coarse preview surfaces are generated
+    bool Coarse;
+  };
+
+  //---------------------------------------------------------------------------
+  /// Threshold the dose at all levels in one pass. For each voxel the number of levels not above the dose is found
+  /// in the ascending level list, and the labelmaps of those levels are set
+  template <class T>
+  class IsodoseThresholdFunctor
+  {
+  public:
+    IsodoseThresholdFunctor(const T* dose, const std::vector<double>& sortedLevels, std::vector<unsigned char*>& labelmaps)
+      : Dose(dose)
+      , SortedLevels(sortedLevels)
+      , Labelmaps(labelmaps)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      size_t numberOfLevels = this->SortedLevels.size();
+      for (vtkIdType voxelIndex=begin; voxelIndex<end; ++voxelIndex)
+      {
+        double dose = (double)this->Dose[voxelIndex];
+        size_t numberOfLevelsInside = std::upper_bound(this->SortedLevels.begin(), this->SortedLevels.end(), dose) - this->SortedLevels.begin();
+        for (size_t levelIndex=0; levelIndex<numberOfLevels; ++levelIndex)
+        {
+          this->Labelmaps[levelIndex][voxelIndex] = (levelIndex < numberOfLevelsInside ? 1 : 0);
+        }
+      }
+    }
+
+  private:
+    const T* Dose;
+    const std::vector<double>& SortedLevels;
+    std::vector<unsigned char*>& Labelmaps;
+  };
+
+  //---------------------------------------------------------------------------
+  template <class T>
+  void ThresholdDose(const T* dose, vtkIdType numberOfVoxels, const std::vector<double>& sortedLevels, std::vector<unsigned char*>& labelmaps)
+  {
+    IsodoseThresholdFunctor<T> functor(dose, sortedLevels, labelmaps);
+    vtkSMPTools::For(0, numberOfVoxels, functor);
+  }
+
+  //---------------------------------------------------------------------------
+  /// Create isodose lines of all levels in a slice plane. The dose is resampled on the plane with the smallest voxel
+  /// spacing and all levels are contoured in one pass. The lines are extruded along the slice normal to thin ribbons
+  /// centered on the plane, as the slice views display the intersection of models with the slice plane.
+  /// \param reslicedDose Dose image in IJK space (unit spacing, zero origin)
+  /// \param ijkToRasMatrix IJK to RAS matrix of the dose volume
+  /// \param sliceToRasMatrix Slice to RAS matrix of the slice node
+  /// \return Ribbons in RAS with cell data containing the index of the level of each cell
+  vtkSmartPointer<vtkPolyData> CreateSliceIsodoseLines(vtkImageData* reslicedDose, vtkMatrix4x4* ijkToRasMatrix,
+    vtkMatrix4x4* sliceToRasMatrix, const std::vector<double>& levels)
+  {
+    vtkSmartPointer<vtkPolyData> ribbons = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> ribbonPoints = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> ribbonPolys = vtkSmartPointer<vtkCellArray>::New();
+    vtkSmartPointer<vtkIntArray> levelIndexArray = vtkSmartPointer<vtkIntArray>::New();
+    levelIndexArray->SetName(vtkSlicerIsodoseModuleLogic::ISODOSE_LEVEL_INDEX_ARRAY_NAME);
+    ribbons->SetPoints(ribbonPoints);
+    ribbons->SetPolys(ribbonPolys);
+    ribbons->GetCellData()->SetScalars(levelIndexArray);
+    if (levels.empty())
+    {
+      return ribbons;
+    }
+
+    // Slice to IJK transform
+    vtkSmartPointer<vtkMatrix4x4> rasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Invert(ijkToRasMatrix, rasToIjkMatrix);
+    vtkSmartPointer<vtkMatrix4x4> sliceToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Multiply4x4(rasToIjkMatrix, sliceToRasMatrix, sliceToIjkMatrix);
+    vtkSmartPointer<vtkMatrix4x4> ijkToSliceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Invert(sliceToIjkMatrix, ijkToSliceMatrix);
+
+    // Bounding box of the dose in slice coordinates
+    int extent[6] = {0, -1, 0, -1, 0, -1};
+    reslicedDose->GetExtent(extent);
+    double sliceBounds[6] = {VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN};
+    for (int corner=0; corner<8; ++corner)
+    {
+      double ijkCorner[4] = { (double)extent[corner & 1], (double)extent[2 + ((corner >> 1) & 1)], (double)extent[4 + ((corner >> 2) & 1)], 1.0 };
+      double sliceCorner[4] = {0.0, 0.0, 0.0, 1.0};
+      ijkToSliceMatrix->MultiplyPoint(ijkCorner, sliceCorner);
+      for (int axis=0; axis<3; ++axis)
+      {
+        sliceBounds[2*axis] = std::min(sliceBounds[2*axis], sliceCorner[axis]);
+        sliceBounds[2*axis+1] = std::max(sliceBounds[2*axis+1], sliceCorner[axis]);
+      }
+    }
+    if (sliceBounds[4] > 0.0 || sliceBounds[5] < 0.0)
+    {
+      // The slice does not intersect the dose
+      return ribbons;
+    }
+
+    // Sample the plane with the smallest voxel spacing of the dose
+    double samplingSpacing = VTK_DOUBLE_MAX;
+    for (int column=0; column<3; ++column)
+    {
+      double columnNorm = sqrt( ijkToRasMatrix->GetElement(0,column) * ijkToRasMatrix->GetElement(0,column)
+        + ijkToRasMatrix->GetElement(1,column) * ijkToRasMatrix->GetElement(1,column)
+        + ijkToRasMatrix->GetElement(2,column) * ijkToRasMatrix->GetElement(2,column) );
+      if (columnNorm > 0.0)
+      {
+        samplingSpacing = std::min(samplingSpacing, columnNorm);
+      }
+    }
+    if (samplingSpacing == VTK_DOUBLE_MAX)
+    {
+      return ribbons;
+    }
+
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData(reslicedDose);
+    reslice->SetResliceAxes(sliceToIjkMatrix);
+    reslice->SetOutputDimensionality(2);
+    reslice->SetOutputOrigin(0, 0, 0);
+    reslice->SetOutputSpacing(samplingSpacing, samplingSpacing, 1.0);
+    reslice->SetOutputExtent( (int)floor(sliceBounds[0] / samplingSpacing), (int)ceil(sliceBounds[1] / samplingSpacing),
+      (int)floor(sliceBounds[2] / samplingSpacing), (int)ceil(sliceBounds[3] / samplingSpacing), 0, 0 );
+    reslice->SetInterpolationModeToLinear();
+    reslice->SetBackgroundLevel(0.0);
+
+    // Contour all levels at once
+    vtkSmartPointer<vtkFlyingEdges2D> contour = vtkSmartPointer<vtkFlyingEdges2D>::New();
+    contour->SetInputConnection(reslice->GetOutputPort());
+    contour->SetNumberOfContours((int)levels.size());
+    for (int levelIndex=0; levelIndex<(int)levels.size(); ++levelIndex)
+    {
+      contour->SetValue(levelIndex, levels[levelIndex]);
+    }
+    contour->ComputeScalarsOn();
+    contour->Update();
+
+    vtkPolyData* lines = contour->GetOutput();
+    vtkDataArray* lineScalars = lines->GetPointData()->GetScalars();
+    if (!lineScalars || lines->GetNumberOfLines() == 0)
+    {
+      return ribbons;
+    }
+
+    // Extrude the lines to ribbons. Each line point becomes a pair of ribbon points
+    double halfWidth = 0.5 * samplingSpacing;
+    vtkIdType numberOfLinePoints = lines->GetNumberOfPoints();
+    ribbonPoints->SetNumberOfPoints(2 * numberOfLinePoints);
+    for (vtkIdType pointId=0; pointId<numberOfLinePoints; ++pointId)
+    {
+      double linePoint[3] = {0.0, 0.0, 0.0};
+      lines->GetPoint(pointId, linePoint);
+      for (int side=0; side<2; ++side)
+      {
+        double slicePoint[4] = { linePoint[0], linePoint[1], (side ? halfWidth : -halfWidth), 1.0 };
+        double rasPoint[4] = {0.0, 0.0, 0.0, 1.0};
+        sliceToRasMatrix->MultiplyPoint(slicePoint, rasPoint);
+        ribbonPoints->SetPoint(2 * pointId + side, rasPoint);
+      }
+    }
+
+    vtkCellArray* lineCells = lines->GetLines();
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    for (lineCells->InitTraversal(); lineCells->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      if (numberOfCellPoints < 2)
+      {
+        continue;
+      }
+      // Level of the line is the closest level to its contour value
+      double lineValue = lineScalars->GetTuple1(cellPointIds[0]);
+      int lineLevelIndex = 0;
+      for (int levelIndex=1; levelIndex<(int)levels.size(); ++levelIndex)
+      {
+        if (fabs(levels[levelIndex] - lineValue) < fabs(levels[lineLevelIndex] - lineValue))
+        {
+          lineLevelIndex = levelIndex;
+        }
+      }
+      for (vtkIdType segmentIndex=0; segmentIndex<numberOfCellPoints-1; ++segmentIndex)
+      {
+        vtkIdType quad[4] = { 2 * cellPointIds[segmentIndex], 2 * cellPointIds[segmentIndex+1],
+          2 * cellPointIds[segmentIndex+1] + 1, 2 * cellPointIds[segmentIndex] + 1 };
+        ribbonPolys->InsertNextCell(4, quad);
+        levelIndexArray->InsertNextValue(lineLevelIndex);
+      }
+    }
+
+    return ribbons;
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerIsodoseModuleLogic::vtkInternal
+{
+public:
+  vtkInternal()
+    : DoseContentMTime(0)
+  {
+    std::fill(this->DoseIJKToRASMatrix, this->DoseIJKToRASMatrix + 16, 0.0);
+  }
+
+  /// Get dose volume resliced to a unit spacing IJK lattice with its parent transform applied.
+  /// Reslicing is only done if the dose volume (its image data or parent transform) has changed since
+  /// the last call, in which case the cached isodose surfaces are discarded
+  vtkImageData* GetReslicedDose(vtkMRMLScalarVolumeNode* doseVolumeNode);
+
+  /// Discard resliced dose, isodose surfaces (including pending refinements) and slice isodose lines
+  void Reset();
+
+  /// Get modification time of the contents of a volume node (image data and parent transform).
+  /// The node itself is not included, as it is also modified by changes irrelevant to the isodose (e.g. name)
+  static vtkMTimeType GetVolumeNodeContentMTime(vtkMRMLScalarVolumeNode* volumeNode);
+
+  /// Determine whether the cached data was generated from the current state of a dose volume
+  bool IsCacheValid(vtkMRMLScalarVolumeNode* doseVolumeNode, vtkMatrix4x4* ijkToRasMatrix);
+
+public:
+  /// Dose volume the cached data was generated from, with its state
+  std::string DoseNodeID;
+  vtkMTimeType DoseContentMTime;
+  std::string DoseTransformNodeID;
+  double DoseIJKToRASMatrix[16];
+  vtkSmartPointer<vtkImageData> ReslicedDose;
+
+  /// Isodose surfaces (in RAS) generated from the resliced dose by level. NULL if the level has no surface.
+  /// The surface processing parameters are fixed, so the level identifies the surface
+  std::map<double, vtkSmartPointer<vtkPolyData> > LevelSurfaces;
+
+  /// Coarse isodose surfaces (in RAS) generated from the downsampled dose, shown until replaced by the surface
+  /// of the same level in LevelSurfaces
+  std::map<double, vtkSmartPointer<vtkPolyData> > CoarseLevelSurfaces;
+  /// Levels with a coarse surface for which the full quality surface has not been generated yet, in order
+  std::deque<double> PendingRefinementLevels;
+
+  /// Isodose lines of a slice position
+  struct SliceLines
+  {
+    double SliceToRASMatrix[16];
+    vtkSmartPointer<vtkPolyData> Lines;
+  };
+
+  /// Isodose lines generated from the resliced dose for each slice node ID, most recently used first
+  std::map<std::string, std::deque<SliceLines> > SliceLinesCache;
+  /// Levels the cached isodose lines were generated for
+  std::vector<double> SliceLinesLevels;
+  /// Slice isodose line model node IDs for each slice node ID
+  std::map<std::string, std::string> SliceLinesModelNodeIDs;
+};
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkSlicerIsodoseModuleLogic::vtkInternal::GetReslicedDose(vtkMRMLScalarVolumeNode* doseVolumeNode)
+{
+  vtkSmartPointer<vtkMatrix4x4> inputIJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetIJKToRASMatrix(inputIJK2RASMatrix);
+  if (this->IsCacheValid(doseVolumeNode, inputIJK2RASMatrix))
+  {
+    return this->ReslicedDose;
+  }
+  this->Reset();
+
+  // Reslice dose volume
+  vtkSmartPointer<vtkMatrix4x4> inputRAS2IJKMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetRASToIJKMatrix(inputRAS2IJKMatrix); 
+
+  vtkSmartPointer<vtkTransform> outputIJK2IJKResliceTransform = vtkSmartPointer<vtkTransform>::New(); 
+  outputIJK2IJKResliceTransform->Identity();
+  outputIJK2IJKResliceTransform->PostMultiply();
+  outputIJK2IJKResliceTransform->SetMatrix(inputIJK2RASMatrix);
+
+  vtkSmartPointer<vtkMRMLTransformNode> inputVolumeNodeTransformNode = doseVolumeNode->GetParentTransformNode();
+  vtkSmartPointer<vtkMatrix4x4> inputRAS2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (inputVolumeNodeTransformNode!=NULL)
+  {
+    inputVolumeNodeTransformNode->GetMatrixTransformToWorld(inputRAS2RASMatrix);  
+    outputIJK2IJKResliceTransform->Concatenate(inputRAS2RASMatrix);
+  }
+  
+  outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
+  outputIJK2IJKResliceTransform->Inverse();
+
+  int dimensions[3] = {0, 0, 0};
+  doseVolumeNode->GetImageData()->GetDimensions(dimensions);
+  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+  reslice->SetInputData(doseVolumeNode->GetImageData());
+  reslice->SetOutputOrigin(0, 0, 0);
+  reslice->SetOutputSpacing(1, 1, 1);
+  reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
+  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
+  reslice->Update();
+
+  this->ReslicedDose = reslice->GetOutput();
+  this->DoseNodeID = (doseVolumeNode->GetID() ? doseVolumeNode->GetID() : "");
+  this->DoseContentMTime = vtkInternal::GetVolumeNodeContentMTime(doseVolumeNode);
+  this->DoseTransformNodeID = (inputVolumeNodeTransformNode ? inputVolumeNodeTransformNode->GetID() : "");
+  std::copy(&(inputIJK2RASMatrix->Element[0][0]), &(inputIJK2RASMatrix->Element[0][0]) + 16, this->DoseIJKToRASMatrix);
+  return this->ReslicedDose;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerIsodoseModuleLogic::vtkInternal::IsCacheValid(vtkMRMLScalarVolumeNode* doseVolumeNode, vtkMatrix4x4* ijkToRasMatrix)
+{
+  if (!this->ReslicedDose || !doseVolumeNode->GetID() || this->DoseNodeID != doseVolumeNode->GetID())
+  {
+    return false;
+  }
+  vtkMRMLTransformNode* transformNode = doseVolumeNode->GetParentTransformNode();
+  if ( this->DoseContentMTime != vtkInternal::GetVolumeNodeContentMTime(doseVolumeNode)
+    || this->DoseTransformNodeID != (transformNode ? transformNode->GetID() : "") )
+  {
+    return false;
+  }
+  return std::equal(&(ijkToRasMatrix->Element[0][0]), &(ijkToRasMatrix->Element[0][0]) + 16, this->DoseIJKToRASMatrix);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::vtkInternal::Reset()
+{
+  this->DoseNodeID.clear();
+  this->DoseContentMTime = 0;
+  this->DoseTransformNodeID.clear();
+  this->ReslicedDose = NULL;
+  this->LevelSurfaces.clear();
+  this->CoarseLevelSurfaces.clear();
+  this->PendingRefinementLevels.clear();
+  this->SliceLinesCache.clear();
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkSlicerIsodoseModuleLogic::vtkInternal::GetVolumeNodeContentMTime(vtkMRMLScalarVolumeNode* volumeNode)
+{
+  vtkMTimeType contentMTime = 0;
+  if (volumeNode->GetImageData())
+  {
+    contentMTime = volumeNode->GetImageData()->GetMTime();
+  }
+  if (volumeNode->GetParentTransformNode())
+  {
+    contentMTime = std::max(contentMTime, volumeNode->GetParentTransformNode()->GetMTime());
+  }
+  return contentMTime;
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
@@ -75,17 +549,23 @@ vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::vtkSlicerIsodoseModuleLogic()
 {
+  this->CoarseSurfaceShrinkFactor = 4;
+
+  this->Internal = new vtkInternal;
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::~vtkSlicerIsodoseModuleLogic()
 {
+  delete this->Internal;
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerIsodoseModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "CoarseSurfaceShrinkFactor: " << this->CoarseSurfaceShrinkFactor << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -148,6 +628,9 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneEndClose()
     return;
   }
 
+  this->Internal->Reset();
+  this->Internal->SliceLinesModelNodeIDs.clear();
+
   this->Modified();
 }
 
@@ -181,6 +664,12 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
     return;
   }
 
+  // Discard cached data of removed dose volume
+  if (node->GetID() && this->Internal->DoseNodeID == node->GetID())
+  {
+    this->Internal->Reset();
+  }
+
   // if the scene is still updating, jump out
   if (this->GetMRMLScene()->IsBatchProcessing())
   {
@@ -485,7 +974,7 @@ void vtkSlicerIsodoseModuleLogic::SetNumberOfIsodoseLevels(vtkMRMLIsodoseNode* p
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode)
+void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode, bool progressive/*=false*/)
 {
   vtkMRMLScene* scene = this->GetMRMLScene();
   if (!scene || !parameterNode)
@@ -514,148 +1003,342 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   if (!doseShItemID)
   {
     vtkErrorMacro("CreateIsodoseSurfaces: Failed to get subject hierarchy item for dose volume '" << doseVolumeNode->GetName() << "'");
+    scene->EndState(vtkMRMLScene::BatchProcessState);
     return;
   }
 
-  // Check existing isodose set and remove if exists
-  vtkIdType isodoseFolderItemID = this->GetIsodoseFolderItemID(doseVolumeNode);
-  if (isodoseFolderItemID)
-  {
-    shNode->RemoveItem(isodoseFolderItemID, true, true);
-  }
-
-  // Setup isodose subject hierarchy folder
-  std::string isodoseFolderName = std::string(doseVolumeNode->GetName()) + vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX;
-  isodoseFolderItemID = shNode->CreateFolderItem(doseShItemID, isodoseFolderName);
-
   // Get color table
   vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
   if (!colorTableNode)
   {
     vtkErrorMacro("CreateIsodoseSurfaces: Failed to get isodose color table node for dose volume " << doseVolumeNode->GetName());
+    scene->EndState(vtkMRMLScene::BatchProcessState);
     return;
   }
 
+  // Use existing isodose subject hierarchy folder or create it if missing
+  vtkIdType isodoseFolderItemID = this->GetIsodoseFolderItemID(doseVolumeNode);
+  if (!isodoseFolderItemID)
+  {
+    std::string isodoseFolderName = std::string(doseVolumeNode->GetName()) + vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX;
+    isodoseFolderItemID = shNode->CreateFolderItem(doseShItemID, isodoseFolderName);
+  }
+
   // Progress
-  int progressStepCount = colorTableNode->GetNumberOfColors() + 1 /* reslice step */;
+  int progressStepCount = 3 /* reslice, surface generation, model update */;
   int currentProgressStep = 0;
 
-  // Reslice dose volume
+  // Get resliced dose volume. Surfaces cached for a previous state of the dose are discarded if it needs to be resliced
+  vtkImageData* reslicedDoseVolumeImage = this->Internal->GetReslicedDose(doseVolumeNode);
   vtkSmartPointer<vtkMatrix4x4> inputIJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   doseVolumeNode->GetIJKToRASMatrix(inputIJK2RASMatrix);
-  vtkSmartPointer<vtkMatrix4x4> inputRAS2IJKMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  doseVolumeNode->GetRASToIJKMatrix(inputRAS2IJKMatrix); 
 
-  vtkSmartPointer<vtkTransform> outputIJK2IJKResliceTransform = vtkSmartPointer<vtkTransform>::New(); 
-  outputIJK2IJKResliceTransform->Identity();
-  outputIJK2IJKResliceTransform->PostMultiply();
-  outputIJK2IJKResliceTransform->SetMatrix(inputIJK2RASMatrix);
+  // Report progress
+  ++currentProgressStep;
+  double progress = (double)(currentProgressStep) / (double)progressStepCount;
+  this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
 
-  vtkSmartPointer<vtkMRMLTransformNode> inputVolumeNodeTransformNode = doseVolumeNode->GetParentTransformNode();
-  vtkSmartPointer<vtkMatrix4x4> inputRAS2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  if (inputVolumeNodeTransformNode!=NULL)
+  // Discard surfaces of removed levels and collect the levels without cached surface.
+  // Surfaces still waiting for refinement are generated again in the requested mode
+  this->Internal->CoarseLevelSurfaces.clear();
+  this->Internal->PendingRefinementLevels.clear();
+  int numberOfLevels = colorTableNode->GetNumberOfColors();
+  std::vector<double> levels(numberOfLevels, 0.0);
+  for (int i = 0; i < numberOfLevels; i++)
   {
-    inputVolumeNodeTransformNode->GetMatrixTransformToWorld(inputRAS2RASMatrix);  
-    outputIJK2IJKResliceTransform->Concatenate(inputRAS2RASMatrix);
+    levels[i] = vtkVariant(colorTableNode->GetColorName(i)).ToDouble();
+  }
+  std::map<double, vtkSmartPointer<vtkPolyData> >& levelSurfaces = this->Internal->LevelSurfaces;
+  for (std::map<double, vtkSmartPointer<vtkPolyData> >::iterator surfaceIt=levelSurfaces.begin(); surfaceIt!=levelSurfaces.end(); )
+  {
+    if (std::find(levels.begin(), levels.end(), surfaceIt->first) == levels.end())
+    {
+      levelSurfaces.erase(surfaceIt++);
+    }
+    else
+    {
+      ++surfaceIt;
+    }
+  }
+  std::vector<double> levelsToCompute;
+  for (std::vector<double>::iterator levelIt=levels.begin(); levelIt!=levels.end(); ++levelIt)
+  {
+    if ( levelSurfaces.find(*levelIt) == levelSurfaces.end()
+      && std::find(levelsToCompute.begin(), levelsToCompute.end(), *levelIt) == levelsToCompute.end() )
+    {
+      levelsToCompute.push_back(*levelIt);
+    }
   }
-  
-  outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
-  outputIJK2IJKResliceTransform->Inverse();
 
-  int dimensions[3] = {0, 0, 0};
-  doseVolumeNode->GetImageData()->GetDimensions(dimensions);
-  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
-  reslice->SetInputData(doseVolumeNode->GetImageData());
-  reslice->SetOutputOrigin(0, 0, 0);
-  reslice->SetOutputSpacing(1, 1, 1);
-  reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
-  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
-  reslice->Update();
-  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+  if (!levelsToCompute.empty())
+  {
+    // In progressive mode the surfaces are first generated from the downsampled dose, and the full
+    // quality surfaces are generated later by RefineNextIsodoseSurface
+    vtkSmartPointer<vtkImageData> contourInputImage = reslicedDoseVolumeImage;
+    if (progressive)
+    {
+      vtkSmartPointer<vtkImageShrink3D> shrink = vtkSmartPointer<vtkImageShrink3D>::New();
+      shrink->SetInputData(reslicedDoseVolumeImage);
+      shrink->SetShrinkFactors(this->CoarseSurfaceShrinkFactor, this->CoarseSurfaceShrinkFactor, this->CoarseSurfaceShrinkFactor);
+      shrink->AveragingOn();
+      shrink->Update();
+      contourInputImage = shrink->GetOutput();
+    }
+
+    // Contour the new isodose levels in one pass over the dose
+    vtkSmartPointer<vtkIsodoseContourFilter> contourFilter = vtkSmartPointer<vtkIsodoseContourFilter>::New();
+    contourFilter->SetInputImage(contourInputImage);
+    for (std::vector<double>::iterator levelIt=levelsToCompute.begin(); levelIt!=levelsToCompute.end(); ++levelIt)
+    {
+      contourFilter->AddLevel(*levelIt);
+    }
+    if (!contourFilter->Update())
+    {
+      vtkErrorMacro("CreateIsodoseSurfaces: Failed to contour dose volume " << doseVolumeNode->GetName());
+      scene->EndState(vtkMRMLScene::BatchProcessState);
+      return;
+    }
+
+    // Process the surfaces of the new levels concurrently
+    int numberOfLevelsToCompute = (int)levelsToCompute.size();
+    std::vector<IsodoseSurfaceJob> jobs(numberOfLevelsToCompute);
+    for (int i = 0; i < numberOfLevelsToCompute; i++)
+    {
+      jobs[i].IsoPolyData = contourFilter->GetOutput(i);
+    }
+    IsodoseSurfaceFunctor functor(jobs, inputIJK2RASMatrix, progressive);
+    vtkSMPTools::For(0, numberOfLevelsToCompute, 1, functor);
+
+    for (int i = 0; i < numberOfLevelsToCompute; i++)
+    {
+      if (progressive)
+      {
+        this->Internal->CoarseLevelSurfaces[levelsToCompute[i]] = jobs[i].IsodoseSurface;
+        this->Internal->PendingRefinementLevels.push_back(levelsToCompute[i]);
+      }
+      else
+      {
+        levelSurfaces[levelsToCompute[i]] = jobs[i].IsodoseSurface;
+      }
+    }
+  }
 
   // Report progress
   ++currentProgressStep;
-  double progress = (double)(currentProgressStep) / (double)progressStepCount;
+  progress = (double)(currentProgressStep) / (double)progressStepCount;
+  this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+
+  this->UpdateIsodoseModelNodes(parameterNode, isodoseFolderItemID);
+
+  // Report progress
+  ++currentProgressStep;
+  progress = (double)(currentProgressStep) / (double)progressStepCount;
   this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
 
-  // Create isodose surfaces
-  for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
+  // Update dose color table based on isodose
+  this->UpdateDoseColorTableFromIsodose(parameterNode);
+
+  scene->EndState(vtkMRMLScene::BatchProcessState);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerIsodoseModuleLogic::RefineNextIsodoseSurface(vtkMRMLIsodoseNode* parameterNode)
+{
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  if (!scene || !parameterNode)
   {
-    double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    const char* strIsoLevel = colorTableNode->GetColorName(i);
-    double isoLevel = vtkVariant(strIsoLevel).ToDouble();
-    colorTableNode->GetColor(i, val);
+    vtkErrorMacro("RefineNextIsodoseSurface: Invalid scene or parameter set node");
+    return false;
+  }
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData() || !colorTableNode)
+  {
+    vtkErrorMacro("RefineNextIsodoseSurface: Invalid dose volume or isodose color table");
+    this->CancelIsodoseSurfaceRefinement();
+    return false;
+  }
+
+  // Refinement is only possible for the dose state the coarse surfaces were generated from
+  vtkSmartPointer<vtkMatrix4x4> inputIJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetIJKToRASMatrix(inputIJK2RASMatrix);
+  if (!this->Internal->IsCacheValid(doseVolumeNode, inputIJK2RASMatrix))
+  {
+    this->CancelIsodoseSurfaceRefinement();
+    return false;
+  }
+  vtkIdType isodoseFolderItemID = this->GetIsodoseFolderItemID(doseVolumeNode);
+  if (!isodoseFolderItemID)
+  {
+    this->CancelIsodoseSurfaceRefinement();
+    return false;
+  }
+
+  // Get next pending level that is still used
+  int numberOfLevels = colorTableNode->GetNumberOfColors();
+  std::vector<double> levels(numberOfLevels, 0.0);
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    levels[i] = vtkVariant(colorTableNode->GetColorName(i)).ToDouble();
+  }
+  std::deque<double>& pendingLevels = this->Internal->PendingRefinementLevels;
+  while (!pendingLevels.empty() && std::find(levels.begin(), levels.end(), pendingLevels.front()) == levels.end())
+  {
+    this->Internal->CoarseLevelSurfaces.erase(pendingLevels.front());
+    pendingLevels.pop_front();
+  }
+  if (pendingLevels.empty())
+  {
+    return false;
+  }
+  double level = pendingLevels.front();
+  pendingLevels.pop_front();
+
+  // Generate full quality surface of the level
+  vtkSmartPointer<vtkIsodoseContourFilter> contourFilter = vtkSmartPointer<vtkIsodoseContourFilter>::New();
+  contourFilter->SetInputImage(this->Internal->ReslicedDose);
+  contourFilter->AddLevel(level);
+  if (!contourFilter->Update())
+  {
+    vtkErrorMacro("RefineNextIsodoseSurface: Failed to contour dose volume " << doseVolumeNode->GetName());
+    this->CancelIsodoseSurfaceRefinement();
+    return false;
+  }
+  std::vector<IsodoseSurfaceJob> jobs(1);
+  jobs[0].IsoPolyData = contourFilter->GetOutput(0);
+  IsodoseSurfaceFunctor functor(jobs, inputIJK2RASMatrix);
+  functor(0, 1);
+
+  this->Internal->LevelSurfaces[level] = jobs[0].IsodoseSurface;
+  this->Internal->CoarseLevelSurfaces.erase(level);
 
-    vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
-    marchingCubes->SetInputData(reslicedDoseVolumeImage);
-    marchingCubes->SetNumberOfContours(1); 
-    marchingCubes->SetValue(0, isoLevel);
-    marchingCubes->ComputeScalarsOff();
-    marchingCubes->ComputeGradientsOff();
-    marchingCubes->ComputeNormalsOff();
-    marchingCubes->Update();
+  // Swap the refined surface into the model node of the level
+  this->UpdateIsodoseModelNodes(parameterNode, isodoseFolderItemID);
 
-    vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
-    if (isoPolyData->GetNumberOfPoints() >= 1)
+  return !pendingLevels.empty();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::CancelIsodoseSurfaceRefinement()
+{
+  // Coarse surfaces remain displayed, and are replaced when the isodose surfaces are generated again
+  this->Internal->PendingRefinementLevels.clear();
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerIsodoseModuleLogic::GetNumberOfPendingIsodoseSurfaceRefinements()
+{
+  return (int)this->Internal->PendingRefinementLevels.size();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::UpdateIsodoseModelNodes(vtkMRMLIsodoseNode* parameterNode, vtkIdType isodoseFolderItemID)
+{
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(scene);
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!shNode || !doseVolumeNode || !colorTableNode)
+  {
+    vtkErrorMacro("UpdateIsodoseModelNodes: Invalid subject hierarchy, dose volume, or isodose color table");
+    return;
+  }
+
+  // Collect existing isodose model nodes, so that they can be reused for unchanged levels
+  std::vector<vtkMRMLModelNode*> existingModelNodes;
+  std::vector<vtkIdType> isodoseChildItemIDs;
+  shNode->GetItemChildren(isodoseFolderItemID, isodoseChildItemIDs, false);
+  for (std::vector<vtkIdType>::iterator childIt=isodoseChildItemIDs.begin(); childIt!=isodoseChildItemIDs.end(); ++childIt)
+  {
+    vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast(shNode->GetItemDataNode(*childIt));
+    if (modelNode)
     {
-      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
-      triangleFilter->SetInputData(marchingCubes->GetOutput());
-      triangleFilter->Update();
+      existingModelNodes.push_back(modelNode);
+    }
+  }
 
-      vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
-      decimate->SetInputData(triangleFilter->GetOutput());
-      decimate->SetTargetReduction(0.6);
-      decimate->SetFeatureAngle(60);
-      decimate->SplittingOff();
-      decimate->PreserveTopologyOn();
-      decimate->SetMaximumError(1);
-      decimate->Update();
+  // Get dose unit name
+  vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+  std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
+    doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
 
-      vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
-      smootherSinc->SetPassBand(0.1);
-      smootherSinc->SetInputData(decimate->GetOutput() );
-      smootherSinc->SetNumberOfIterations(2);
-      smootherSinc->FeatureEdgeSmoothingOff();
-      smootherSinc->BoundarySmoothingOff();
-      smootherSinc->Update();
+  // Create or update isodose model nodes in level order
+  int numberOfLevels = colorTableNode->GetNumberOfColors();
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    // Use the full quality surface of the level if available, otherwise its coarse surface
+    double level = vtkVariant(colorTableNode->GetColorName(i)).ToDouble();
+    vtkPolyData* isodoseSurface = NULL;
+    std::map<double, vtkSmartPointer<vtkPolyData> >::iterator surfaceIt = this->Internal->LevelSurfaces.find(level);
+    if (surfaceIt != this->Internal->LevelSurfaces.end())
+    {
+      isodoseSurface = surfaceIt->second;
+    }
+    else if ((surfaceIt = this->Internal->CoarseLevelSurfaces.find(level)) != this->Internal->CoarseLevelSurfaces.end())
+    {
+      isodoseSurface = surfaceIt->second;
+    }
+    if (!isodoseSurface)
+    {
+      continue;
+    }
 
-      vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-      normals->SetInputData(smootherSinc->GetOutput());
-      normals->ComputePointNormalsOn();
-      normals->SetFeatureAngle(60);
-      normals->Update();
+    double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    const char* strIsoLevel = colorTableNode->GetColorName(i);
+    colorTableNode->GetColor(i, val);
 
-      vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
-      inputIJKToRASTransform->Identity();
-      inputIJKToRASTransform->SetMatrix(inputIJK2RASMatrix);
+    // Find model node of the same level
+    vtkMRMLModelNode* isodoseModelNode = NULL;
+    for (std::vector<vtkMRMLModelNode*>::iterator modelIt=existingModelNodes.begin(); modelIt!=existingModelNodes.end(); ++modelIt)
+    {
+      const char* levelAttribute = (*modelIt)->GetAttribute(vtkSlicerIsodoseModuleLogic::ISODOSE_LEVEL_ATTRIBUTE_NAME.c_str());
+      if ( levelAttribute && vtkVariant(levelAttribute).ToDouble() == level
+        && vtkMRMLModelDisplayNode::SafeDownCast((*modelIt)->GetDisplayNode()) )
+      {
+        isodoseModelNode = (*modelIt);
+        existingModelNodes.erase(modelIt);
+        break;
+      }
+    }
 
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetInputData(normals->GetOutput());
-      transformPolyData->SetTransform(inputIJKToRASTransform);
-      transformPolyData->Update();
-  
-      vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
-      displayNode = vtkMRMLModelDisplayNode::SafeDownCast(scene->AddNode(displayNode));
+    vtkMRMLModelDisplayNode* displayNode = NULL;
+    if (isodoseModelNode)
+    {
+      displayNode = vtkMRMLModelDisplayNode::SafeDownCast(isodoseModelNode->GetDisplayNode());
+    }
+    else
+    {
+      vtkSmartPointer<vtkMRMLModelDisplayNode> newDisplayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
+      displayNode = vtkMRMLModelDisplayNode::SafeDownCast(scene->AddNode(newDisplayNode));
       displayNode->SliceIntersectionVisibilityOn();  
       displayNode->VisibilityOn(); 
-      displayNode->SetColor(val[0], val[1], val[2]);
-      displayNode->SetOpacity(val[3]);
-    
+
       // Disable backface culling to make the back side of the model visible as well
       displayNode->SetBackfaceCulling(0);
+    }
+    displayNode->SetColor(val[0], val[1], val[2]);
+    displayNode->SetOpacity(val[3]);
 
-      // Get dose unit name
-      std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
-        doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
-
-      vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
-      std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
+    std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
+    if (isodoseModelNode)
+    {
+      isodoseModelNode->SetName(isodoseModelNodeName.c_str());
+      if (isodoseModelNode->GetPolyData() != isodoseSurface)
+      {
+        isodoseModelNode->SetAndObservePolyData(isodoseSurface);
+      }
+    }
+    else
+    {
+      vtkSmartPointer<vtkMRMLModelNode> newModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
+      isodoseModelNode = newModelNode;
       isodoseModelNode->SetName(isodoseModelNodeName.c_str());
       isodoseModelNode->SetSelectable(1);
       isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1"); // The attribute above distinguishes isodoses from regular models
+      isodoseModelNode->SetAttribute(vtkSlicerIsodoseModuleLogic::ISODOSE_LEVEL_ATTRIBUTE_NAME.c_str(), strIsoLevel);
       scene->AddNode(isodoseModelNode);
       isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
-      isodoseModelNode->SetAndObservePolyData(transformPolyData->GetOutput());
+      isodoseModelNode->SetAndObservePolyData(isodoseSurface);
       shNode->RequestOwnerPluginSearch(isodoseModelNode); //TODO: Why is this needed?
 
       // Put the new node in the isodose folder
@@ -665,17 +1348,293 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
         shNode->SetItemParent(isodoseModelItemID, isodoseFolderItemID);
       }
     }
-
-    // Report progress
-    ++currentProgressStep;
-    progress = (double)(currentProgressStep) / (double)progressStepCount;
-    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
   } // For all isodose levels
 
-  // Update dose color table based on isodose
-  this->UpdateDoseColorTableFromIsodose(parameterNode);
+  // Remove model nodes of the levels that were removed or have no surface any more
+  for (std::vector<vtkMRMLModelNode*>::iterator modelIt=existingModelNodes.begin(); modelIt!=existingModelNodes.end(); ++modelIt)
+  {
+    if ((*modelIt)->GetDisplayNode())
+    {
+      scene->RemoveNode((*modelIt)->GetDisplayNode());
+    }
+    vtkIdType isodoseModelItemID = shNode->GetItemByDataNode(*modelIt);
+    if (isodoseModelItemID)
+    {
+      shNode->RemoveItem(isodoseModelItemID);
+    }
+    else
+    {
+      scene->RemoveNode(*modelIt);
+    }
+  }
+}
 
-  scene->EndState(vtkMRMLScene::BatchProcessState);
+//---------------------------------------------------------------------------
+vtkMRMLSegmentationNode* vtkSlicerIsodoseModuleLogic::CreateIsodoseSegmentation(vtkMRMLIsodoseNode* parameterNode)
+{
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  if (!scene || !parameterNode)
+  {
+    vtkErrorMacro("CreateIsodoseSegmentation: Invalid scene or parameter set node");
+    return NULL;
+  }
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(scene);
+  if (!shNode)
+  {
+    vtkErrorMacro("CreateIsodoseSegmentation: Failed to access subject hierarchy node");
+    return NULL;
+  }
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  vtkImageData* doseImageData = (doseVolumeNode ? doseVolumeNode->GetImageData() : NULL);
+  if (!doseImageData || !doseImageData->GetPointData()->GetScalars() || doseImageData->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("CreateIsodoseSegmentation: Invalid dose volume");
+    return NULL;
+  }
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!colorTableNode)
+  {
+    vtkErrorMacro("CreateIsodoseSegmentation: Failed to get isodose color table node for dose volume " << doseVolumeNode->GetName());
+    return NULL;
+  }
+
+  // Create a labelmap in the dose geometry for each level
+  int numberOfLevels = colorTableNode->GetNumberOfColors();
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
+  std::vector<double> levels(numberOfLevels, 0.0);
+  std::vector< vtkSmartPointer<vtkOrientedImageData> > levelLabelmaps(numberOfLevels);
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    levels[i] = vtkVariant(colorTableNode->GetColorName(i)).ToDouble();
+    levelLabelmaps[i] = vtkSmartPointer<vtkOrientedImageData>::New();
+    levelLabelmaps[i]->SetExtent(doseImageData->GetExtent());
+    levelLabelmaps[i]->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    levelLabelmaps[i]->SetGeometryFromImageToWorldMatrix(doseIjkToRasMatrix);
+  }
+
+  // Threshold all levels in one pass. The levels are passed in ascending order
+  std::vector< std::pair<double, int> > levelOrder(numberOfLevels);
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    levelOrder[i] = std::make_pair(levels[i], i);
+  }
+  std::sort(levelOrder.begin(), levelOrder.end());
+  std::vector<double> sortedLevels(numberOfLevels, 0.0);
+  std::vector<unsigned char*> sortedLabelmapPointers(numberOfLevels, (unsigned char*)NULL);
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    sortedLevels[i] = levelOrder[i].first;
+    sortedLabelmapPointers[i] = static_cast<unsigned char*>(levelLabelmaps[levelOrder[i].second]->GetScalarPointer());
+  }
+  vtkIdType numberOfVoxels = doseImageData->GetNumberOfPoints();
+  switch (doseImageData->GetScalarType())
+  {
+    vtkTemplateMacro(ThresholdDose<VTK_TT>(static_cast<VTK_TT*>(doseImageData->GetScalarPointer()),
+      numberOfVoxels, sortedLevels, sortedLabelmapPointers));
+  default:
+    vtkErrorMacro("CreateIsodoseSegmentation: Unsupported dose scalar type " << doseImageData->GetScalarTypeAsString());
+    return NULL;
+  }
+
+  // Use existing isodose segmentation of the dose volume or create it if missing
+  std::string segmentationNodeName = std::string(doseVolumeNode->GetName()) + vtkSlicerIsodoseModuleLogic::ISODOSE_SEGMENTATION_NODE_NAME_POSTFIX;
+  vtkMRMLSegmentationNode* segmentationNode = vtkMRMLSegmentationNode::SafeDownCast(scene->GetFirstNodeByName(segmentationNodeName.c_str()));
+  if (!segmentationNode)
+  {
+    vtkSmartPointer<vtkMRMLSegmentationNode> newSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+    newSegmentationNode->SetName(segmentationNodeName.c_str());
+    scene->AddNode(newSegmentationNode);
+    segmentationNode = newSegmentationNode;
+    segmentationNode->CreateDefaultDisplayNodes();
+    shNode->RequestOwnerPluginSearch(segmentationNode);
+
+    // Put the segmentation next to the dose volume
+    vtkIdType segmentationItemID = shNode->GetItemByDataNode(segmentationNode);
+    vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+    if (segmentationItemID && doseShItemID) // There is no automatic SH creation in automatic tests
+    {
+      shNode->SetItemParent(segmentationItemID, shNode->GetItemParent(doseShItemID));
+    }
+  }
+  // Labelmaps are in the dose geometry, so the dose transform applies to the segmentation as well
+  segmentationNode->SetAndObserveTransformNodeID(doseVolumeNode->GetTransformNodeID());
+
+  // Replace segments with the labelmaps of the current levels. Only the master representation is created,
+  // so closed surfaces are only generated on demand
+  vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+  int wasModifying = segmentationNode->StartModify();
+  std::vector<std::string> segmentIDs;
+  segmentation->GetSegmentIDs(segmentIDs);
+  for (std::vector<std::string>::iterator segmentIt=segmentIDs.begin(); segmentIt!=segmentIDs.end(); ++segmentIt)
+  {
+    segmentation->RemoveSegment(*segmentIt);
+  }
+  segmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+
+  std::string doseUnitName = shNode->GetAttributeFromItemAncestor(shNode->GetItemByDataNode(doseVolumeNode),
+    vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    double val[4] = {0.0, 0.0, 0.0, 0.0};
+    colorTableNode->GetColor(i, val);
+    std::string segmentName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + colorTableNode->GetColorName(i) + doseUnitName;
+
+    vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+    segment->SetName(segmentName.c_str());
+    segment->SetColor(val[0], val[1], val[2]);
+    segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), levelLabelmaps[i]);
+    segmentation->AddSegment(segment);
+  }
+  segmentationNode->EndModify(wasModifying);
+
+  return segmentationNode;
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLModelNode* vtkSlicerIsodoseModuleLogic::UpdateSliceIsodoseLines(vtkMRMLIsodoseNode* parameterNode, vtkMRMLSliceNode* sliceNode)
+{
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  if (!scene || !parameterNode || !sliceNode || !sliceNode->GetID())
+  {
+    vtkErrorMacro("UpdateSliceIsodoseLines: Invalid scene, parameter set node, or slice node");
+    return NULL;
+  }
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData())
+  {
+    vtkErrorMacro("UpdateSliceIsodoseLines: Invalid dose volume");
+    return NULL;
+  }
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!colorTableNode)
+  {
+    vtkErrorMacro("UpdateSliceIsodoseLines: Failed to get isodose color table node for dose volume " << doseVolumeNode->GetName());
+    return NULL;
+  }
+
+  // Discard cached lines if the dose or the levels changed
+  vtkImageData* reslicedDoseVolumeImage = this->Internal->GetReslicedDose(doseVolumeNode);
+  int numberOfLevels = colorTableNode->GetNumberOfColors();
+  std::vector<double> levels(numberOfLevels, 0.0);
+  for (int i = 0; i < numberOfLevels; i++)
+  {
+    levels[i] = vtkVariant(colorTableNode->GetColorName(i)).ToDouble();
+  }
+  if (levels != this->Internal->SliceLinesLevels)
+  {
+    this->Internal->SliceLinesCache.clear();
+    this->Internal->SliceLinesLevels = levels;
+  }
+
+  // Get lines of the slice position from the cache or create them
+  vtkMatrix4x4* sliceToRasMatrix = sliceNode->GetSliceToRAS();
+  std::deque<vtkInternal::SliceLines>& sliceLinesCache = this->Internal->SliceLinesCache[sliceNode->GetID()];
+  vtkSmartPointer<vtkPolyData> sliceLines;
+  for (std::deque<vtkInternal::SliceLines>::iterator linesIt=sliceLinesCache.begin(); linesIt!=sliceLinesCache.end(); ++linesIt)
+  {
+    if (std::equal(&(sliceToRasMatrix->Element[0][0]), &(sliceToRasMatrix->Element[0][0]) + 16, linesIt->SliceToRASMatrix))
+    {
+      // Move to the front as most recently used
+      vtkInternal::SliceLines cachedLines = (*linesIt);
+      sliceLinesCache.erase(linesIt);
+      sliceLinesCache.push_front(cachedLines);
+      sliceLines = cachedLines.Lines;
+      break;
+    }
+  }
+  if (!sliceLines)
+  {
+    vtkSmartPointer<vtkMatrix4x4> inputIJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    doseVolumeNode->GetIJKToRASMatrix(inputIJK2RASMatrix);
+    sliceLines = CreateSliceIsodoseLines(reslicedDoseVolumeImage, inputIJK2RASMatrix, sliceToRasMatrix, levels);
+
+    vtkInternal::SliceLines newLines;
+    std::copy(&(sliceToRasMatrix->Element[0][0]), &(sliceToRasMatrix->Element[0][0]) + 16, newLines.SliceToRASMatrix);
+    newLines.Lines = sliceLines;
+    sliceLinesCache.push_front(newLines);
+    if (sliceLinesCache.size() > SLICE_ISODOSE_LINES_CACHE_SIZE)
+    {
+      sliceLinesCache.pop_back();
+    }
+  }
+
+  // Get model node of the slice view or create it. It is only displayed in its slice view
+  vtkMRMLModelNode* linesModelNode = vtkMRMLModelNode::SafeDownCast(
+    scene->GetNodeByID(this->Internal->SliceLinesModelNodeIDs[sliceNode->GetID()]) );
+  vtkMRMLModelDisplayNode* displayNode = NULL;
+  if (linesModelNode)
+  {
+    displayNode = vtkMRMLModelDisplayNode::SafeDownCast(linesModelNode->GetDisplayNode());
+  }
+  if (linesModelNode && !displayNode)
+  {
+    scene->RemoveNode(linesModelNode);
+    linesModelNode = NULL;
+  }
+  if (!linesModelNode)
+  {
+    vtkSmartPointer<vtkMRMLModelDisplayNode> newDisplayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
+    newDisplayNode->SetHideFromEditors(1);
+    newDisplayNode->SetSaveWithScene(false);
+    displayNode = vtkMRMLModelDisplayNode::SafeDownCast(scene->AddNode(newDisplayNode));
+    displayNode->AddViewNodeID(sliceNode->GetID());
+    displayNode->VisibilityOn();
+    displayNode->SliceIntersectionVisibilityOn();
+    displayNode->SetSliceIntersectionThickness(2);
+
+    vtkSmartPointer<vtkMRMLModelNode> newModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
+    std::string linesModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_SLICE_LINES_MODEL_NODE_NAME_PREFIX
+      + (sliceNode->GetLayoutName() ? sliceNode->GetLayoutName() : sliceNode->GetID());
+    newModelNode->SetName(linesModelNodeName.c_str());
+    newModelNode->SetHideFromEditors(1);
+    newModelNode->SetSelectable(0);
+    newModelNode->SetSaveWithScene(false);
+    linesModelNode = vtkMRMLModelNode::SafeDownCast(scene->AddNode(newModelNode));
+    linesModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
+    this->Internal->SliceLinesModelNodeIDs[sliceNode->GetID()] = linesModelNode->GetID();
+  }
+
+  // Color the lines by the isodose color table
+  int wasModifying = displayNode->StartModify();
+  displayNode->SetAndObserveColorNodeID(colorTableNode->GetID());
+  displayNode->SetActiveScalarName(vtkSlicerIsodoseModuleLogic::ISODOSE_LEVEL_INDEX_ARRAY_NAME);
+  displayNode->SetScalarRangeFlag(vtkMRMLDisplayNode::UseManualScalarRange);
+  displayNode->SetScalarRange(0, std::max(numberOfLevels - 1, 1));
+  displayNode->ScalarVisibilityOn();
+  displayNode->SetOpacity(1.0);
+  displayNode->EndModify(wasModifying);
+
+  if (linesModelNode->GetPolyData() != sliceLines)
+  {
+    linesModelNode->SetAndObservePolyData(sliceLines);
+  }
+  return linesModelNode;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::RemoveSliceIsodoseLines()
+{
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  if (scene)
+  {
+    for (std::map<std::string, std::string>::iterator modelIt=this->Internal->SliceLinesModelNodeIDs.begin();
+      modelIt!=this->Internal->SliceLinesModelNodeIDs.end(); ++modelIt)
+    {
+      vtkMRMLModelNode* linesModelNode = vtkMRMLModelNode::SafeDownCast(scene->GetNodeByID(modelIt->second));
+      if (!linesModelNode)
+      {
+        continue;
+      }
+      if (linesModelNode->GetDisplayNode())
+      {
+        scene->RemoveNode(linesModelNode->GetDisplayNode());
+      }
+      scene->RemoveNode(linesModelNode);
+    }
+  }
+  this->Internal->SliceLinesModelNodeIDs.clear();
+  this->Internal->SliceLinesCache.clear();
 }
 
 //---------------------------------------------------------------------------
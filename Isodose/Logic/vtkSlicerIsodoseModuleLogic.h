@@ -37,7 +37,10 @@
 class vtkMRMLColorTableNode;
 class vtkMRMLIsodoseNode;
 class vtkMRMLModelHierarchyNode;
+class vtkMRMLModelNode;
 class vtkMRMLScalarVolumeNode;
+class vtkMRMLSegmentationNode;
+class vtkMRMLSliceNode;
 
 /// \ingroup SlicerRt_QtModules_Isodose
 class VTK_SLICER_ISODOSE_LOGIC_EXPORT vtkSlicerIsodoseModuleLogic : public vtkSlicerModuleLogic
@@ -48,6 +51,12 @@ public:
   static const std::string ISODOSE_PARAMETER_SET_BASE_NAME_PREFIX;
   static const std::string ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX;
   static const std::string ISODOSE_COLOR_TABLE_NODE_NAME_POSTFIX;
+  static const std::string ISODOSE_SEGMENTATION_NODE_NAME_POSTFIX;
+  /// Attribute of the isodose model nodes storing the dose level of the surface
+  static const std::string ISODOSE_LEVEL_ATTRIBUTE_NAME;
+  static const std::string ISODOSE_SLICE_LINES_MODEL_NODE_NAME_PREFIX;
+  /// Name of the cell data array of the slice isodose lines containing the index of the isodose level
+  static const char* ISODOSE_LEVEL_INDEX_ARRAY_NAME;
 
 public:
   static vtkSlicerIsodoseModuleLogic *New();
@@ -57,8 +66,43 @@ public:
   /// Set number of isodose levels
   void SetNumberOfIsodoseLevels(vtkMRMLIsodoseNode* parameterNode, int newNumberOfColors);
 
-  /// Accumulates dose volumes with the given IDs and corresponding weights
-  void CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode);
+  /// Create or update isodose surfaces of the dose volume for the levels in the isodose color table.
+  /// The resliced dose and the surface of each level are cached, so if the dose volume is unchanged then
+  /// only the surfaces of new or changed levels are generated, and model nodes of removed levels are deleted
+  /// \param progressive If true, then the new levels get coarse surfaces generated from the dose downsampled by
+  ///   \sa CoarseSurfaceShrinkFactor, which are replaced one by one by calling \sa RefineNextIsodoseSurface
+  void CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode, bool progressive=false);
+
+  /// Generate the full quality surface of the next level that has a coarse surface (\sa CreateIsodoseSurfaces),
+  /// and set it to the existing model node of the level
+  /// \return True if there are more levels to refine
+  bool RefineNextIsodoseSurface(vtkMRMLIsodoseNode* parameterNode);
+
+  /// Stop refining the coarse isodose surfaces. The coarse surfaces are kept until the next surface generation
+  void CancelIsodoseSurfaceRefinement();
+
+  /// Get number of levels whose coarse surface has not been refined yet
+  int GetNumberOfPendingIsodoseSurfaceRefinements();
+
+  /// Downsampling factor of the dose along each axis for the coarse isodose surfaces. Default is 4
+  vtkGetMacro(CoarseSurfaceShrinkFactor, int);
+  vtkSetClampMacro(CoarseSurfaceShrinkFactor, int, 2, 16);
+
+  /// Create or update isodose lines of all levels in a slice view, without generating isodose surfaces.
+  /// The dose is resampled on the slice plane and contoured in 2D. The lines are cached for the recent slice
+  /// positions of each slice view, so they are only computed again if the dose or the levels change.
+  /// \return Model node of the lines, which is only displayed in the given slice view. NULL on failure
+  vtkMRMLModelNode* UpdateSliceIsodoseLines(vtkMRMLIsodoseNode* parameterNode, vtkMRMLSliceNode* sliceNode);
+
+  /// Remove isodose line models of all slice views (\sa UpdateSliceIsodoseLines)
+  void RemoveSliceIsodoseLines();
+
+  /// Create or update a segmentation with one binary labelmap segment for each isodose level, containing the
+  /// voxels where the dose is at least the level. All levels are thresholded in one pass over the dose grid,
+  /// so no isodose surface is needed. The labelmaps have the geometry of the dose volume, and closed surfaces
+  /// are only created when requested by the user.
+  /// \return Segmentation node of the dose volume. NULL on failure
+  vtkMRMLSegmentationNode* CreateIsodoseSegmentation(vtkMRMLIsodoseNode* parameterNode);
 
   /// Get isodose folder for a dose volume
   /// \param node Dose volume node or isodose parameter node referencing the dose volume
@@ -84,6 +128,10 @@ protected:
   /// \return The loaded color table node if loading succeeded, NULL otherwise
   vtkMRMLColorTableNode* LoadDefaultIsodoseColorTable();
 
+  /// Create, update, or remove the model nodes in the isodose folder according to the cached surfaces of the
+  /// levels in the isodose color table. Model nodes of existing levels are reused
+  void UpdateIsodoseModelNodes(vtkMRMLIsodoseNode* parameterNode, vtkIdType isodoseFolderItemID);
+
 protected:
   virtual void SetMRMLSceneInternal(vtkMRMLScene* newScene) VTK_OVERRIDE;
 
@@ -98,9 +146,17 @@ protected:
   vtkSlicerIsodoseModuleLogic();
   virtual ~vtkSlicerIsodoseModuleLogic();
 
+protected:
+  /// Downsampling factor of the dose for the coarse isodose surfaces
+  int CoarseSurfaceShrinkFactor;
+
 private:
   vtkSlicerIsodoseModuleLogic(const vtkSlicerIsodoseModuleLogic&); // Not implemented
   void operator=(const vtkSlicerIsodoseModuleLogic&);               // Not implemented
+
+private:
+  class vtkInternal;
+  vtkInternal* Internal;
 };
 
 #endif
@@ -19,9 +19,17 @@
 
 ==============================================================================*/
 
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+
 // Isodose includes
 #include "vtkSlicerIsodoseModuleLogic.h"
 #include "vtkMRMLIsodoseNode.h"
+#include "vtkIsodoseContourFilter.h"
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
@@ -31,16 +39,21 @@
 #include <vtkMRMLModelNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLSliceNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 
 // VTK includes
 #include <vtkCollection.h>
 #include <vtkDoubleArray.h>
 #include <vtkImageData.h>
+#include <vtkImageMarchingCubes.h>
 #include <vtkMassProperties.h>
+#include <vtkMatrix4x4.h>
 #include <vtkNew.h>
+#include <vtkPointData.h>
 #include <vtkPolyData.h>
 #include <vtkPolyDataReader.h>
+#include <vtkSmartPointer.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -234,5 +247,205 @@ int vtkSlicerIsodoseModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // The model node and the surface of the unchanged level are kept when levels are added
+  double singleLevelVolume = propertiesCurrent->GetVolume();
+  vtkMRMLModelNode* singleLevelModelNode = modelNode;
+  vtkSmartPointer<vtkPolyData> singleLevelPolyData = modelNode->GetPolyData();
+  isodoseLogic->SetNumberOfIsodoseLevels(paramNode, 3);
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+
+  isodoseFolderitemID = isodoseLogic->GetIsodoseFolderItemID(paramNode);
+  isodoseChildItemIDs.clear();
+  shNode->GetItemChildren(isodoseFolderitemID, isodoseChildItemIDs, false);
+  if (isodoseChildItemIDs.size() == 0)
+  {
+    std::cerr << "No items in isodose folder after multi-level isodose generation" << std::endl;
+    return EXIT_FAILURE;
+  }
+  modelNode = vtkMRMLModelNode::SafeDownCast(shNode->GetItemDataNode(isodoseChildItemIDs[0]));
+  if (modelNode != singleLevelModelNode || modelNode->GetPolyData() != singleLevelPolyData)
+  {
+    std::cerr << "Isodose model node of unchanged level was not reused" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Surfaces generated together with other levels must be identical to the one generated alone.
+  // Modifying the dose forces generating all levels again
+  doseScalarVolumeNode->GetImageData()->Modified();
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  isodoseChildItemIDs.clear();
+  shNode->GetItemChildren(isodoseFolderitemID, isodoseChildItemIDs, false);
+  if (isodoseChildItemIDs.size() == 0)
+  {
+    std::cerr << "No items in isodose folder after multi-level isodose regeneration" << std::endl;
+    return EXIT_FAILURE;
+  }
+  modelNode = vtkMRMLModelNode::SafeDownCast(shNode->GetItemDataNode(isodoseChildItemIDs[0]));
+  if (!modelNode || modelNode->GetPolyData() == singleLevelPolyData)
+  {
+    std::cerr << "Isodose surface was not regenerated after the dose was modified" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkNew<vtkMassProperties> propertiesMultiLevel;
+  propertiesMultiLevel->SetInputData(modelNode->GetPolyData());
+  propertiesMultiLevel->Update();
+  if (fabs(propertiesMultiLevel->GetVolume() - singleLevelVolume) > 1e-6)
+  {
+    std::cerr << "Isodose surface differs when generated with multiple levels" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Model nodes of removed levels are deleted
+  isodoseLogic->SetNumberOfIsodoseLevels(paramNode, 1);
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  isodoseChildItemIDs.clear();
+  shNode->GetItemChildren(isodoseFolderitemID, isodoseChildItemIDs, false);
+  if (isodoseChildItemIDs.size() != 1 || shNode->GetItemDataNode(isodoseChildItemIDs[0]) != singleLevelModelNode)
+  {
+    std::cerr << "Isodose models of removed levels were not deleted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  isodoseLogic->SetNumberOfIsodoseLevels(paramNode, 3);
+
+  // Progressive generation shows coarse surfaces in the existing model nodes, then refines them in place
+  doseScalarVolumeNode->GetImageData()->Modified();
+  isodoseLogic->CreateIsodoseSurfaces(paramNode, true);
+  isodoseChildItemIDs.clear();
+  shNode->GetItemChildren(isodoseFolderitemID, isodoseChildItemIDs, false);
+  std::vector<vtkMRMLNode*> coarseModelNodes;
+  for (std::vector<vtkIdType>::iterator childIt=isodoseChildItemIDs.begin(); childIt!=isodoseChildItemIDs.end(); ++childIt)
+  {
+    coarseModelNodes.push_back(shNode->GetItemDataNode(*childIt));
+  }
+  if ( coarseModelNodes.empty() || coarseModelNodes[0] != singleLevelModelNode
+    || isodoseLogic->GetNumberOfPendingIsodoseSurfaceRefinements() == 0 )
+  {
+    std::cerr << "Coarse isodose surfaces were not created in the existing model nodes" << std::endl;
+    return EXIT_FAILURE;
+  }
+  while (isodoseLogic->RefineNextIsodoseSurface(paramNode))
+  {
+  }
+  isodoseChildItemIDs.clear();
+  shNode->GetItemChildren(isodoseFolderitemID, isodoseChildItemIDs, false);
+  std::vector<vtkMRMLNode*> refinedModelNodes;
+  for (std::vector<vtkIdType>::iterator childIt=isodoseChildItemIDs.begin(); childIt!=isodoseChildItemIDs.end(); ++childIt)
+  {
+    refinedModelNodes.push_back(shNode->GetItemDataNode(*childIt));
+  }
+  if (refinedModelNodes != coarseModelNodes || isodoseLogic->GetNumberOfPendingIsodoseSurfaceRefinements() != 0)
+  {
+    std::cerr << "Refined isodose surfaces were not set to the existing model nodes" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkNew<vtkMassProperties> propertiesRefined;
+  propertiesRefined->SetInputData(singleLevelModelNode->GetPolyData());
+  propertiesRefined->Update();
+  if (fabs(propertiesRefined->GetVolume() - singleLevelVolume) > 1e-6)
+  {
+    std::cerr << "Refined isodose surface differs from the one generated directly" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Single-sweep contouring of all levels must produce the same points and triangles as marching cubes
+  vtkNew<vtkIsodoseContourFilter> contourFilter;
+  contourFilter->SetInputImage(doseScalarVolumeNode->GetImageData());
+  for (int levelIndex=0; levelIndex<isodoseColorNode->GetNumberOfColors(); ++levelIndex)
+  {
+    contourFilter->AddLevel(vtkVariant(isodoseColorNode->GetColorName(levelIndex)).ToDouble());
+  }
+  if (!contourFilter->Update())
+  {
+    std::cerr << "Failed to contour dose volume" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int levelIndex=0; levelIndex<contourFilter->GetNumberOfLevels(); ++levelIndex)
+  {
+    vtkNew<vtkImageMarchingCubes> marchingCubes;
+    marchingCubes->SetInputData(doseScalarVolumeNode->GetImageData());
+    marchingCubes->SetValue(0, contourFilter->GetLevel(levelIndex));
+    marchingCubes->ComputeScalarsOff();
+    marchingCubes->ComputeGradientsOff();
+    marchingCubes->ComputeNormalsOff();
+    marchingCubes->Update();
+
+    vtkPolyData* contourPolyData = contourFilter->GetOutput(levelIndex);
+    if ( !contourPolyData || contourPolyData->GetNumberOfPoints() != marchingCubes->GetOutput()->GetNumberOfPoints()
+      || contourPolyData->GetNumberOfPolys() != marchingCubes->GetOutput()->GetNumberOfPolys() )
+    {
+      std::cerr << "Isosurface of level " << contourFilter->GetLevel(levelIndex) << " differs from marching cubes result" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Isodose segments contain the voxels where the dose is at least the level
+  vtkMRMLSegmentationNode* isodoseSegmentationNode = isodoseLogic->CreateIsodoseSegmentation(paramNode);
+  if (!isodoseSegmentationNode || isodoseSegmentationNode->GetSegmentation()->GetNumberOfSegments() != isodoseColorNode->GetNumberOfColors())
+  {
+    std::cerr << "Failed to create isodose segmentation" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> isodoseSegmentIDs;
+  isodoseSegmentationNode->GetSegmentation()->GetSegmentIDs(isodoseSegmentIDs);
+  vtkDataArray* doseScalars = doseScalarVolumeNode->GetImageData()->GetPointData()->GetScalars();
+  for (int levelIndex=0; levelIndex<isodoseColorNode->GetNumberOfColors(); ++levelIndex)
+  {
+    double level = vtkVariant(isodoseColorNode->GetColorName(levelIndex)).ToDouble();
+    vtkSegment* isodoseSegment = isodoseSegmentationNode->GetSegmentation()->GetSegment(isodoseSegmentIDs[levelIndex]);
+    vtkOrientedImageData* isodoseLabelmap = vtkOrientedImageData::SafeDownCast(
+      isodoseSegment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+    if ( !isodoseLabelmap || isodoseSegment->GetRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName())
+      || isodoseLabelmap->GetNumberOfPoints() != doseScalars->GetNumberOfTuples() )
+    {
+      std::cerr << "Invalid isodose segment representations for level " << level << std::endl;
+      return EXIT_FAILURE;
+    }
+    vtkDataArray* labelmapScalars = isodoseLabelmap->GetPointData()->GetScalars();
+    for (vtkIdType voxelIndex=0; voxelIndex<doseScalars->GetNumberOfTuples(); ++voxelIndex)
+    {
+      if ((labelmapScalars->GetTuple1(voxelIndex) != 0) != (doseScalars->GetTuple1(voxelIndex) >= level))
+      {
+        std::cerr << "Isodose segment of level " << level << " differs from thresholded dose at voxel " << voxelIndex << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // Isodose lines in a slice view through the center of the dose, computed without surfaces
+  int doseExtent[6] = {0, -1, 0, -1, 0, -1};
+  doseScalarVolumeNode->GetImageData()->GetExtent(doseExtent);
+  double doseCenterIjk[4] = { 0.5 * (doseExtent[0] + doseExtent[1]), 0.5 * (doseExtent[2] + doseExtent[3]), 0.5 * (doseExtent[4] + doseExtent[5]), 1.0 };
+  double doseCenterRas[4] = {0.0, 0.0, 0.0, 1.0};
+  vtkNew<vtkMatrix4x4> doseIjkToRasMatrix;
+  doseScalarVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix.GetPointer());
+  doseIjkToRasMatrix->MultiplyPoint(doseCenterIjk, doseCenterRas);
+
+  vtkNew<vtkMRMLSliceNode> sliceNode;
+  sliceNode->SetLayoutName("Red");
+  mrmlScene->AddNode(sliceNode.GetPointer());
+  sliceNode->SetOrientationToAxial();
+  sliceNode->JumpSliceByCentering(doseCenterRas[0], doseCenterRas[1], doseCenterRas[2]);
+
+  vtkMRMLModelNode* sliceLinesModelNode = isodoseLogic->UpdateSliceIsodoseLines(paramNode, sliceNode.GetPointer());
+  if (!sliceLinesModelNode || !sliceLinesModelNode->GetPolyData() || sliceLinesModelNode->GetPolyData()->GetNumberOfPolys() == 0)
+  {
+    std::cerr << "Failed to create isodose lines in slice view" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkPolyData* sliceLinesPolyData = sliceLinesModelNode->GetPolyData();
+  if ( isodoseLogic->UpdateSliceIsodoseLines(paramNode, sliceNode.GetPointer()) != sliceLinesModelNode
+    || sliceLinesModelNode->GetPolyData() != sliceLinesPolyData )
+  {
+    std::cerr << "Isodose lines of unchanged slice position were not reused" << std::endl;
+    return EXIT_FAILURE;
+  }
+  isodoseLogic->RemoveSliceIsodoseLines();
+  if (mrmlScene->IsNodePresent(sliceLinesModelNode))
+  {
+    std::cerr << "Slice isodose line model was not removed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
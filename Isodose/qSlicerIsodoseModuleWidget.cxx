@@ -22,6 +22,7 @@
 // Qt includes
 #include <QCheckBox>
 #include <QDebug>
+#include <QTimer>
 
 // SlicerQt includes
 #include "qSlicerIsodoseModuleWidget.h"
@@ -50,6 +51,7 @@
 #include <vtkMRMLModelHierarchyNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLSliceNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 
 // VTK includes
@@ -310,6 +312,7 @@ void qSlicerIsodoseModuleWidget::updateWidgetFromMRML()
 
     d->checkBox_Isoline->setChecked(paramNode->GetShowIsodoseLines());
     d->checkBox_Isosurface->setChecked(paramNode->GetShowIsodoseSurfaces());
+    d->checkBox_SliceIsoline->setChecked(paramNode->GetShowSliceIsodoseLines());
   }
 }
 
@@ -337,10 +340,13 @@ void qSlicerIsodoseModuleWidget::setup()
   connect( d->checkBox_ShowDoseVolumesOnly, SIGNAL( stateChanged(int) ), this, SLOT( showDoseVolumesOnlyCheckboxChanged(int) ) );
   connect( d->checkBox_Isoline, SIGNAL(toggled(bool)), this, SLOT( setIsolineVisibility(bool) ) );
   connect( d->checkBox_Isosurface, SIGNAL(toggled(bool)), this, SLOT( setIsosurfaceVisibility(bool) ) );
+  connect( d->checkBox_SliceIsoline, SIGNAL(toggled(bool)), this, SLOT( setSliceIsolineVisibility(bool) ) );
   connect( d->checkBox_ScalarBar, SIGNAL(toggled(bool)), this, SLOT( setScalarBarVisibility(bool) ) );
   connect( d->checkBox_ScalarBar2D, SIGNAL(toggled(bool)), this, SLOT( setScalarBar2DVisibility(bool) ) );
 
   connect( d->pushButton_Apply, SIGNAL(clicked()), this, SLOT(applyClicked()) );
+  connect( d->pushButton_CancelRefinement, SIGNAL(clicked()), this, SLOT(cancelRefinementClicked()) );
+  connect( d->pushButton_CreateSegmentation, SIGNAL(clicked()), this, SLOT(createSegmentationClicked()) );
 
   d->pushButton_Apply->setMinimumSize(d->pushButton_Apply->sizeHint().width() + 8, d->pushButton_Apply->sizeHint().height() + 4);
 
@@ -632,6 +638,83 @@ void qSlicerIsodoseModuleWidget::setIsosurfaceVisibility(bool visible)
   }
 }
 
+//------------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::setSliceIsolineVisibility(bool visible)
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  if (!this->mrmlScene())
+  {
+    qCritical() << Q_FUNC_INFO << ": Invalid scene";
+    return;
+  }
+
+  vtkMRMLIsodoseNode* paramNode = vtkMRMLIsodoseNode::SafeDownCast(d->MRMLNodeComboBox_ParameterSet->currentNode());
+  if (!paramNode)
+  {
+    return;
+  }
+
+  paramNode->DisableModifiedEventOn();
+  paramNode->SetShowSliceIsodoseLines(visible);
+  paramNode->DisableModifiedEventOff();
+
+  // Follow slice position changes only while the slice isodose lines are shown
+  std::vector<vtkMRMLNode*> sliceNodes;
+  this->mrmlScene()->GetNodesByClass("vtkMRMLSliceNode", sliceNodes);
+  for (std::vector<vtkMRMLNode*>::iterator sliceNodeIt=sliceNodes.begin(); sliceNodeIt!=sliceNodes.end(); ++sliceNodeIt)
+  {
+    qvtkDisconnect( (*sliceNodeIt), vtkCommand::ModifiedEvent, this, SLOT( onSliceNodeModified(vtkObject*) ) );
+    if (visible)
+    {
+      qvtkConnect( (*sliceNodeIt), vtkCommand::ModifiedEvent, this, SLOT( onSliceNodeModified(vtkObject*) ) );
+    }
+  }
+
+  if (visible)
+  {
+    this->updateSliceIsodoseLines();
+  }
+  else
+  {
+    d->logic()->RemoveSliceIsodoseLines();
+  }
+}
+
+//------------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::onSliceNodeModified(vtkObject* caller)
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  vtkMRMLSliceNode* sliceNode = vtkMRMLSliceNode::SafeDownCast(caller);
+  vtkMRMLIsodoseNode* paramNode = vtkMRMLIsodoseNode::SafeDownCast(d->MRMLNodeComboBox_ParameterSet->currentNode());
+  if (!sliceNode || !paramNode || !paramNode->GetShowSliceIsodoseLines() || !paramNode->GetDoseVolumeNode())
+  {
+    return;
+  }
+
+  d->logic()->UpdateSliceIsodoseLines(paramNode, sliceNode);
+}
+
+//------------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::updateSliceIsodoseLines()
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  vtkMRMLIsodoseNode* paramNode = vtkMRMLIsodoseNode::SafeDownCast(d->MRMLNodeComboBox_ParameterSet->currentNode());
+  if (!this->mrmlScene() || !paramNode || !paramNode->GetShowSliceIsodoseLines() || !paramNode->GetDoseVolumeNode())
+  {
+    return;
+  }
+
+  std::vector<vtkMRMLNode*> sliceNodes;
+  this->mrmlScene()->GetNodesByClass("vtkMRMLSliceNode", sliceNodes);
+  for (std::vector<vtkMRMLNode*>::iterator sliceNodeIt=sliceNodes.begin(); sliceNodeIt!=sliceNodes.end(); ++sliceNodeIt)
+  {
+    d->logic()->UpdateSliceIsodoseLines(paramNode, vtkMRMLSliceNode::SafeDownCast(*sliceNodeIt));
+  }
+}
+
 //------------------------------------------------------------------------------
 void qSlicerIsodoseModuleWidget::setScalarBarVisibility(bool visible)
 {
@@ -732,7 +815,78 @@ void qSlicerIsodoseModuleWidget::applyClicked()
   QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
 
   // Compute the isodose surface for the selected dose volume
-  d->logic()->CreateIsodoseSurfaces(paramNode);
+  bool progressive = d->checkBox_Progressive->isChecked();
+  d->logic()->CreateIsodoseSurfaces(paramNode, progressive);
+
+  // Update slice isodose lines to the new levels
+  this->updateSliceIsodoseLines();
+
+  QApplication::restoreOverrideCursor();
+
+  // Replace coarse surfaces by full quality ones while the application stays responsive
+  if (progressive && d->logic()->GetNumberOfPendingIsodoseSurfaceRefinements() > 0)
+  {
+    d->pushButton_CancelRefinement->setEnabled(true);
+    QTimer::singleShot(0, this, SLOT(refineIsodoseSurfaces()));
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::refineIsodoseSurfaces()
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  vtkMRMLIsodoseNode* paramNode = vtkMRMLIsodoseNode::SafeDownCast(d->MRMLNodeComboBox_ParameterSet->currentNode());
+  if (!this->mrmlScene() || !paramNode || d->logic()->GetNumberOfPendingIsodoseSurfaceRefinements() == 0)
+  {
+    d->pushButton_CancelRefinement->setEnabled(false);
+    return;
+  }
+
+  // One level is refined at a time, so that events (such as cancel) are processed in between
+  if (d->logic()->RefineNextIsodoseSurface(paramNode))
+  {
+    QTimer::singleShot(0, this, SLOT(refineIsodoseSurfaces()));
+  }
+  else
+  {
+    d->pushButton_CancelRefinement->setEnabled(false);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::cancelRefinementClicked()
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  d->logic()->CancelIsodoseSurfaceRefinement();
+  d->pushButton_CancelRefinement->setEnabled(false);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::createSegmentationClicked()
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  if (!this->mrmlScene())
+  {
+    qCritical() << Q_FUNC_INFO << ": Invalid scene";
+    return;
+  }
+
+  vtkMRMLIsodoseNode* paramNode = vtkMRMLIsodoseNode::SafeDownCast(d->MRMLNodeComboBox_ParameterSet->currentNode());
+  if (!paramNode)
+  {
+    return;
+  }
+
+  QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
+
+  // Threshold the dose at the isodose levels into segments
+  if (!d->logic()->CreateIsodoseSegmentation(paramNode))
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to create isodose segmentation";
+  }
 
   QApplication::restoreOverrideCursor();
 }
@@ -748,6 +902,7 @@ void qSlicerIsodoseModuleWidget::updateButtonsState()
                    && paramNode->GetColorTableNode()
                    && paramNode->GetColorTableNode()->GetNumberOfColors() > 0;
   d->pushButton_Apply->setEnabled(applyEnabled);
+  d->pushButton_CreateSegmentation->setEnabled(applyEnabled);
 }
 
 //-----------------------------------------------------------
@@ -29,6 +29,7 @@
 
 class qSlicerIsodoseModuleWidgetPrivate;
 class vtkMRMLNode;
+class vtkObject;
 class QTableWidgetItem;
 
 /// \ingroup SlicerRt_QtModules_Isodose
@@ -82,6 +83,12 @@ protected slots:
   /// Slot for changing isosurface visibility
   void setIsosurfaceVisibility(bool);
 
+  /// Slot for changing visibility of the isodose lines computed directly in the slice views
+  void setSliceIsolineVisibility(bool);
+
+  /// Slot handling change of a slice node (e.g. slice position) to update its isodose lines
+  void onSliceNodeModified(vtkObject*);
+
   /// Slot for changing 3D scalar bar visibility
   void setScalarBarVisibility(bool);
 
@@ -91,6 +98,15 @@ protected slots:
   /// Slot handling clicking the Apply button
   void applyClicked();
 
+  /// Refine the next coarse isodose surface, and schedule the following one if any
+  void refineIsodoseSurfaces();
+
+  /// Slot handling clicking the Cancel refinement button
+  void cancelRefinementClicked();
+
+  /// Slot handling clicking the Create segmentation button
+  void createSegmentationClicked();
+
   /// Slot called on change in logic
   void onLogicModified();
 
@@ -104,6 +120,9 @@ protected:
   /// Updates button states
   void updateButtonsState();
 
+  /// Update isodose lines in all slice views if enabled
+  void updateSliceIsodoseLines();
+
 protected:
   QScopedPointer<qSlicerIsodoseModuleWidgetPrivate> d_ptr;
   
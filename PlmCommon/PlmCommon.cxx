@@ -24,28 +24,75 @@
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLModelNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
+#include <vtkGeneralTransform.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
 
 // Segmentations includes
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 
 //----------------------------------------------------------------------------
 // Utility functions
+//----------------------------------------------------------------------------
+/// Get the image of a volume node as oriented image data. The voxels are not copied unless the
+/// parent transform requires resampling (in which case new scalars are created)
+static bool
+get_oriented_image_data (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform, vtkOrientedImageData* outImageData)
+{
+  if (!inVolumeNode || !inVolumeNode->GetImageData())
+  {
+    return false;
+  }
+
+  outImageData->vtkImageData::ShallowCopy(inVolumeNode->GetImageData());
+
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  inVolumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  outImageData->SetGeometryFromImageToWorldMatrix(ijkToRasMatrix);
+
+  vtkMRMLTransformNode* parentTransformNode = inVolumeNode->GetParentTransformNode();
+  if (applyWorldTransform && parentTransformNode)
+  {
+    vtkSmartPointer<vtkGeneralTransform> inVolumeToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+    parentTransformNode->GetTransformToWorld(inVolumeToWorldTransform);
+    vtkOrientedImageDataResample::TransformOrientedImage(outImageData, inVolumeToWorldTransform);
+  }
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 template<class T> 
 static typename itk::Image<T,3>::Pointer
-convert_to_itk (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform)
+convert_to_itk (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform, bool shareVoxels)
 {
-  typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
-  if (!vtkSlicerRtCommon::ConvertVolumeNodeToItkImage<T>(inVolumeNode, image, applyWorldTransform, true))
+  if (!shareVoxels)
+  {
+    typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
+    if (!vtkSlicerRtCommon::ConvertVolumeNodeToItkImage<T>(inVolumeNode, image, applyWorldTransform, true))
+    {
+      vtkGenericWarningMacro("PlmCommon::convert_to_itk(vtkMRMLScalarVolumeNode): Failed to convert volume node to PlmImage!");
+    }
+    return image;
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> orientedImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  typename itk::Image<T,3>::Pointer image;
+  if (get_oriented_image_data(inVolumeNode, applyWorldTransform, orientedImageData))
+  {
+    image = PlmCommon::WrapVtkOrientedImageDataAsItkImage<T>(orientedImageData, true);
+  }
+  if (image.IsNull())
   {
     vtkGenericWarningMacro("PlmCommon::convert_to_itk(vtkMRMLScalarVolumeNode): Failed to convert volume node to PlmImage!");
+    image = itk::Image<T,3>::New ();
   }
   return image;
 }
@@ -53,12 +100,23 @@ convert_to_itk (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform)
 //----------------------------------------------------------------------------
 template<class T> 
 static typename itk::Image<T,3>::Pointer
-convert_to_itk (vtkOrientedImageData* inImageData)
+convert_to_itk (vtkOrientedImageData* inImageData, bool shareVoxels)
 {
-  typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
-  if (!vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(inImageData, image, true))
+  if (!shareVoxels)
+  {
+    typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
+    if (!vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(inImageData, image, true))
+    {
+      vtkGenericWarningMacro("PlmCommon::convert_to_itk(vtkOrientedImageData): Failed to convert oriented image data to PlmImage!");
+    }
+    return image;
+  }
+
+  typename itk::Image<T,3>::Pointer image = PlmCommon::WrapVtkOrientedImageDataAsItkImage<T>(inImageData, true);
+  if (image.IsNull())
   {
     vtkGenericWarningMacro("PlmCommon::convert_to_itk(vtkOrientedImageData): Failed to convert oriented image data to PlmImage!");
+    image = itk::Image<T,3>::New ();
   }
   return image;
 }
@@ -66,7 +124,7 @@ convert_to_itk (vtkOrientedImageData* inImageData)
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/)
+PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/, bool shareVoxels/* = false*/)
 {
   Plm_image::Pointer image = Plm_image::New ();
 
@@ -82,49 +140,49 @@ PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bo
   switch (vtk_type) {
   case VTK_CHAR:
   case VTK_SIGNED_CHAR:
-    image->set_itk (convert_to_itk<char> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<char> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
   case VTK_UNSIGNED_CHAR:
-    image->set_itk (convert_to_itk<unsigned char> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned char> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
   case VTK_SHORT:
-    image->set_itk (convert_to_itk<short> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<short> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
   case VTK_UNSIGNED_SHORT:
-    image->set_itk (convert_to_itk<unsigned short> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned short> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
 #if (CMAKE_SIZEOF_UINT == 4)
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<int> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<int> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned int> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned int> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
 #else
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<long> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<long> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned long> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned long> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
 #endif
   
   case VTK_FLOAT:
-    image->set_itk (convert_to_itk<float> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<float> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
   
   case VTK_DOUBLE:
-    image->set_itk (convert_to_itk<double> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<double> (inVolumeNode, applyWorldTransform, shareVoxels));
     break;
 
   default:
@@ -137,15 +195,15 @@ PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bo
 
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform/* = true*/)
+PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform/* = true*/, bool shareVoxels/* = false*/)
 {
   return PlmCommon::ConvertVolumeNodeToPlmImage(
-    vtkMRMLScalarVolumeNode::SafeDownCast(inNode), applyWorldTransform);
+    vtkMRMLScalarVolumeNode::SafeDownCast(inNode), applyWorldTransform, shareVoxels);
 }
 
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData)
+PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData, bool shareVoxels/* = false*/)
 {
   Plm_image::Pointer image = Plm_image::New ();
 
@@ -160,49 +218,49 @@ PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageDa
   switch (vtk_type) {
   case VTK_CHAR:
   case VTK_SIGNED_CHAR:
-    image->set_itk (convert_to_itk<char> (inImageData));
+    image->set_itk (convert_to_itk<char> (inImageData, shareVoxels));
     break;
   
   case VTK_UNSIGNED_CHAR:
-    image->set_itk (convert_to_itk<unsigned char> (inImageData));
+    image->set_itk (convert_to_itk<unsigned char> (inImageData, shareVoxels));
     break;
   
   case VTK_SHORT:
-    image->set_itk (convert_to_itk<short> (inImageData));
+    image->set_itk (convert_to_itk<short> (inImageData, shareVoxels));
     break;
   
   case VTK_UNSIGNED_SHORT:
-    image->set_itk (convert_to_itk<unsigned short> (inImageData));
+    image->set_itk (convert_to_itk<unsigned short> (inImageData, shareVoxels));
     break;
   
 #if (CMAKE_SIZEOF_UINT == 4)
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<int> (inImageData));
+    image->set_itk (convert_to_itk<int> (inImageData, shareVoxels));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned int> (inImageData));
+    image->set_itk (convert_to_itk<unsigned int> (inImageData, shareVoxels));
     break;
 #else
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<long> (inImageData));
+    image->set_itk (convert_to_itk<long> (inImageData, shareVoxels));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned long> (inImageData));
+    image->set_itk (convert_to_itk<unsigned long> (inImageData, shareVoxels));
     break;
 #endif
   
   case VTK_FLOAT:
-    image->set_itk (convert_to_itk<float> (inImageData));
+    image->set_itk (convert_to_itk<float> (inImageData, shareVoxels));
     break;
   
   case VTK_DOUBLE:
-    image->set_itk (convert_to_itk<double> (inImageData));
+    image->set_itk (convert_to_itk<double> (inImageData, shareVoxels));
     break;
 
   default:
@@ -33,6 +33,7 @@
 
 #include "vtkPlmCommonWin32Header.h"
 
+class vtkImageData;
 class vtkMRMLNode;
 class vtkMRMLScalarVolumeNode;
 
@@ -48,15 +49,45 @@ public:
   /// Convert MRML volume node to Plm image using typed scalar volume node
   /// \param inVolumeNode Scalar volume node to convert
   /// \param applyWorldTransform Flag determining if parent transform is applied to volume node when converting to Plm image. True by default
-  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true);
+  /// \param shareVoxels Flag determining if the Plm image uses the voxel buffer of the volume node instead of a copy
+  ///   (\sa WrapVtkOrientedImageDataAsItkImage). Only for callers that do not modify the Plm image. False by default
+  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true, bool shareVoxels = false);
 
   /// Convert MRML volume node to Plm image using generic MRML node type
   /// \param inNode Node to convert (must be scalar volume node type)
   /// \param applyWorldTransform Flag determining if parent transform is applied to volume node when converting to Plm image. True by default
-  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform = true);
+  /// \param shareVoxels Flag determining if the Plm image uses the voxel buffer of the volume node. False by default
+  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform = true, bool shareVoxels = false);
 
   /// Convert VTK oriented image data to Plm image
-  static Plm_image::Pointer ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData);
+  /// \param shareVoxels Flag determining if the Plm image uses the voxel buffer of the image data instead of a copy.
+  ///   Only for callers that do not modify the Plm image. False by default
+  static Plm_image::Pointer ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData, bool shareVoxels = false);
+
+  /// Wrap the scalars of VTK oriented image data as an ITK image without copying. Origin, spacing and
+  /// direction are set from the image geometry. The ITK image keeps a reference to the scalar array, so it
+  /// remains valid even if the image data is deleted or its scalars are replaced. The voxels are shared,
+  /// so changes made through the ITK image are visible in the VTK image.
+  /// \param inImageData Input oriented image data with single component scalars of size of T
+  /// \param applyRasToLpsConversion Apply RAS (Slicer) to LPS (ITK, DICOM) coordinate frame conversion. True by default
+  /// \return ITK image, NULL on failure
+  template<typename T> static typename itk::Image<T, 3>::Pointer WrapVtkOrientedImageDataAsItkImage(vtkOrientedImageData* inImageData, bool applyRasToLpsConversion=true);
+
+  /// Set the voxels of an ITK image to VTK image data. The image geometry is not considered.
+  /// If nothing else refers to the pixel buffer of the ITK image, then its ownership is transferred to the
+  /// VTK image without copying, and the ITK image is emptied. Otherwise the voxels are copied.
+  /// \param vtkType Data scalar type (i.e VTK_FLOAT)
+  /// \return Success
+  template<typename T> static bool TransferItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType);
+
+  /// Set ITK image to MRML volume node, transferring ownership of the pixel buffer if possible (\sa TransferItkImageToVtkImageData).
+  /// Image geometry is transferred.
+  /// \param vtkType Data scalar type (i.e VTK_FLOAT)
+  /// \param applyLpsToRasConversion Apply LPS (ITK, DICOM) to RAS (Slicer) coordinate frame conversion. True by default
+  /// \return Success
+  template<typename T> static bool TransferItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion=true);
 };
 
+#include "PlmCommon.txx"
+
 #endif
@@ -0,0 +1,236 @@
+/*==========================================================================
+
+  Copyright (c) Massachusetts General Hospital, Boston, MA, USA. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Gregory C. Sharp, Massachusetts General Hospital
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Natural Sciences and Engineering Research Council
+  of Canada.
+
+==========================================================================*/
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// ITK includes
+#include <itkImportImageContainer.h>
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtCommon.h"
+
+//----------------------------------------------------------------------------
+/// ITK pixel container using the buffer of a VTK data array. The container keeps a reference
+/// to the array, so the buffer remains valid as long as the container is used by an ITK image
+template<typename TElementIdentifier, typename TElement>
+class PlmCommonVtkDataArrayImageContainer : public itk::ImportImageContainer<TElementIdentifier, TElement>
+{
+public:
+  typedef PlmCommonVtkDataArrayImageContainer Self;
+  typedef itk::ImportImageContainer<TElementIdentifier, TElement> Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  itkNewMacro(Self);
+  itkTypeMacro(PlmCommonVtkDataArrayImageContainer, ImportImageContainer);
+
+  /// Use the buffer of a data array. The memory is not managed by the container
+  void SetDataArray(vtkDataArray* dataArray)
+  {
+    this->DataArray = dataArray;
+    this->SetImportPointer(static_cast<TElement*>(dataArray->GetVoidPointer(0)),
+      (TElementIdentifier)dataArray->GetNumberOfValues(), false);
+  }
+
+protected:
+  PlmCommonVtkDataArrayImageContainer() { }
+  virtual ~PlmCommonVtkDataArrayImageContainer() { }
+
+private:
+  PlmCommonVtkDataArrayImageContainer(const Self&); // Not implemented
+  void operator=(const Self&); // Not implemented
+
+  vtkSmartPointer<vtkDataArray> DataArray;
+};
+
+//----------------------------------------------------------------------------
+template<typename T> typename itk::Image<T, 3>::Pointer PlmCommon::WrapVtkOrientedImageDataAsItkImage(vtkOrientedImageData* inImageData, bool applyRasToLpsConversion/*=true*/)
+{
+  typedef itk::Image<T, 3> ImageType;
+  if (!inImageData || !inImageData->GetPointData()->GetScalars())
+  {
+    vtkGenericWarningMacro("PlmCommon::WrapVtkOrientedImageDataAsItkImage: Invalid input image data!");
+    return NULL;
+  }
+  vtkDataArray* scalars = inImageData->GetPointData()->GetScalars();
+  if (scalars->GetNumberOfComponents() != 1 || scalars->GetDataTypeSize() != (int)sizeof(T))
+  {
+    vtkErrorWithObjectMacro(inImageData, "WrapVtkOrientedImageDataAsItkImage: Requested type has a different scalar size than input type, or input has multiple components!");
+    return NULL;
+  }
+
+  typename ImageType::Pointer outItkImage = ImageType::New();
+
+  // Geometry: the columns of the image to world matrix are the axis directions scaled by the spacing
+  vtkSmartPointer<vtkMatrix4x4> inImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  inImageData->GetImageToWorldMatrix(inImageToWorldMatrix);
+  if (applyRasToLpsConversion)
+  {
+    for (int col=0; col<4; ++col)
+    {
+      inImageToWorldMatrix->SetElement(0, col, -inImageToWorldMatrix->GetElement(0, col));
+      inImageToWorldMatrix->SetElement(1, col, -inImageToWorldMatrix->GetElement(1, col));
+    }
+  }
+  typename ImageType::SpacingType outputSpacing;
+  typename ImageType::PointType outputOrigin;
+  typename ImageType::DirectionType outputDirectionMatrix;
+  for (unsigned int col=0; col<3; ++col)
+  {
+    double len = 0.0;
+    for (unsigned int row=0; row<3; ++row)
+    {
+      len += inImageToWorldMatrix->GetElement(row, col) * inImageToWorldMatrix->GetElement(row, col);
+    }
+    len = sqrt(len);
+    outputSpacing[col] = (len > 0.0 ? len : 1.0);
+    for (unsigned int row=0; row<3; ++row)
+    {
+      outputDirectionMatrix[row][col] = (len > 0.0 ? inImageToWorldMatrix->GetElement(row, col) / len : (row == col ? 1.0 : 0.0));
+    }
+    outputOrigin[col] = inImageToWorldMatrix->GetElement(col, 3);
+  }
+  outItkImage->SetSpacing(outputSpacing);
+  outItkImage->SetOrigin(outputOrigin);
+  outItkImage->SetDirection(outputDirectionMatrix);
+
+  // Regions
+  int inputExtent[6] = {0, -1, 0, -1, 0, -1};
+  inImageData->GetExtent(inputExtent);
+  typename ImageType::SizeType inputSize;
+  typename ImageType::IndexType start;
+  for (unsigned int axis=0; axis<3; ++axis)
+  {
+    inputSize[axis] = inputExtent[2*axis+1] - inputExtent[2*axis] + 1;
+    start[axis] = inputExtent[2*axis];
+  }
+  typename ImageType::RegionType region;
+  region.SetSize(inputSize);
+  region.SetIndex(start);
+  outItkImage->SetRegions(region);
+
+  // Use the VTK scalar buffer (VTK and ITK both store the first index fastest)
+  typedef PlmCommonVtkDataArrayImageContainer<typename ImageType::PixelContainer::ElementIdentifier, T> ContainerType;
+  typename ContainerType::Pointer container = ContainerType::New();
+  container->SetDataArray(scalars);
+  outItkImage->SetPixelContainer(container);
+
+  return outItkImage;
+}
+
+//----------------------------------------------------------------------------
+template<typename T> bool PlmCommon::TransferItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType)
+{
+  if (outVtkImageData == NULL)
+  {
+    vtkGenericWarningMacro("PlmCommon::TransferItkImageToVtkImageData: Output VTK image data is NULL!");
+    return false;
+  }
+  if (inItkImage.IsNull())
+  {
+    vtkErrorWithObjectMacro(outVtkImageData, "TransferItkImageToVtkImageData: Input ITK image is invalid!");
+    return false;
+  }
+
+  vtkSmartPointer<vtkDataArray> scalars = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(vtkType));
+  if (!scalars || scalars->GetDataTypeSize() != (int)sizeof(T))
+  {
+    vtkErrorWithObjectMacro(outVtkImageData, "TransferItkImageToVtkImageData: Requested VTK type has a different scalar size than input type!");
+    return false;
+  }
+
+  // The buffer can only be taken over if nothing else refers to it, the ITK image would free it,
+  // and it contains exactly the voxels of the image
+  typename itk::Image<T, 3>::RegionType region = inItkImage->GetBufferedRegion();
+  typename itk::Image<T, 3>::PixelContainer* container = inItkImage->GetPixelContainer();
+  if ( !container || container->GetReferenceCount() != 1 || !container->GetContainerManageMemory()
+    || region != inItkImage->GetLargestPossibleRegion() || container->Size() != region.GetNumberOfPixels() )
+  {
+    return vtkSlicerRtCommon::ConvertItkImageToVtkImageData<T>(inItkImage, outVtkImageData, vtkType);
+  }
+
+  typename itk::Image<T, 3>::SizeType imageSize = region.GetSize();
+  int extent[6] = {0, (int)imageSize[0]-1, 0, (int)imageSize[1]-1, 0, (int)imageSize[2]-1};
+
+  // ITK allocates the buffer with new[], so the array deletes it with delete[]
+  scalars->SetNumberOfComponents(1);
+  scalars->SetVoidArray(container->GetBufferPointer(), (vtkIdType)container->Size(), 0, vtkAbstractArray::VTK_DATA_ARRAY_DELETE);
+  container->ContainerManageMemoryOff();
+
+  // Detach the buffer from the ITK image so that it cannot be accessed after the array deleted it
+  inItkImage->Initialize();
+
+  outVtkImageData->SetExtent(extent);
+  outVtkImageData->GetPointData()->SetScalars(scalars);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+template<typename T> bool PlmCommon::TransferItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion/*=true*/)
+{
+  if (outVolumeNode == NULL)
+  {
+    vtkGenericWarningMacro("PlmCommon::TransferItkImageToVolumeNode: Failed to transfer itk image to volume node - output MRML volume node is NULL!");
+    return false;
+  }
+  if (inItkImage.IsNull())
+  {
+    vtkErrorWithObjectMacro(outVolumeNode, "TransferItkImageToVolumeNode: Failed to transfer itk image to volume node - input image is NULL!");
+    return false;
+  }
+
+  // Get geometry before the buffer is transferred, as the ITK image is emptied then
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  typename itk::Image<T, 3>::PointType itkOrigin = inItkImage->GetOrigin();
+  typename itk::Image<T, 3>::SpacingType itkSpacing = inItkImage->GetSpacing();
+  typename itk::Image<T, 3>::DirectionType itkDirections = inItkImage->GetDirection();
+  for (unsigned int row=0; row<3; ++row)
+  {
+    // LPS (ITK) to RAS (Slicer) conversion negates the first two world axes
+    double sign = (applyLpsToRasConversion && row < 2 ? -1.0 : 1.0);
+    for (unsigned int col=0; col<3; ++col)
+    {
+      ijkToRasMatrix->SetElement(row, col, sign * itkDirections[row][col] * itkSpacing[col]);
+    }
+    ijkToRasMatrix->SetElement(row, 3, sign * itkOrigin[row]);
+  }
+
+  vtkSmartPointer<vtkImageData> outImageData = vtkSmartPointer<vtkImageData>::New();
+  if (!PlmCommon::TransferItkImageToVtkImageData<T>(inItkImage, outImageData, vtkType))
+  {
+    vtkErrorWithObjectMacro(outVolumeNode, "TransferItkImageToVolumeNode: Failed to transfer ITK image to VTK image data");
+    return false;
+  }
+
+  outVolumeNode->SetIJKToRASMatrix(ijkToRasMatrix);
+  outVolumeNode->SetAndObserveImageData(outImageData);
+  return true;
+}